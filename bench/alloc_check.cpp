@@ -0,0 +1,85 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     alloc_check.cpp
+*   Brief:    heap allocations of the steady-state host result path(decode, NMS, arena,
+*             ObjResult export), must be 0 per frame. use: ./Alloc_check [frames]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/yolov7.hpp"
+#include "inc/detection.h"
+#include "inc/box_decode.h"
+#include <export/export.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <vector>
+
+#define BENCH_COUNT_ALLOC
+#include "bench/bench_common.h"
+
+int main(int arv, char** arg)
+{
+    const int frames = arv > 1 ? atoi(arg[1]) : 200;
+    const siran::ModelDesc desc = siran::DefaultModelDesc();
+    Yolov7 yolov7(desc);
+    siran::DecodeParams params;
+    params.rows = yolov7.RowInfo().size();
+    params.class_num = desc.num_classes;
+    params.input_w = desc.input_w;
+    params.input_h = desc.input_h;
+    params.conf_thresh = desc.conf_thresh;
+    params.nms_thresh = desc.nms_thresh;
+    siran::CpuBoxDecoder decoder(params, yolov7.RowInfo());
+    siran::DetectionArena arena;
+    std::vector<siran::DecodeBox> boxes;
+    boxes.reserve(siran::kMaxDecodeBoxes);
+    ObjResult obj_result;
+
+    /// @brief Empty, sparse, crowded(>100 kept) and truncated(>512 candidates) frames.
+    const int hits[] = {0, 20, 400, 3000};
+    const int kinds = sizeof(hits) / sizeof(hits[0]);
+    std::mt19937 rng(5);
+    /// @brief Small confident boxes, few of them suppressed, so crowded frames keep > 100.
+    SynthOutputConfig shape = DefaultSynthOutputConfig();
+    shape.box_range = 0.3f;
+    shape.obj_min = 0.6f;
+    shape.cls_min = 0.9f;
+    std::vector<std::vector<float> > outputs(kinds);
+    for (int k = 0; k < kinds; ++k)
+    {
+        MakeOutput(params.rows, desc.num_classes, hits[k], rng, outputs[k], shape);
+    }
+
+    /// @brief Warm up, buffers grow to the largest frame once.
+    for (int k = 0; k < kinds; ++k)
+    {
+        yolov7.YoloProcess(outputs[k].data(), desc.conf_thresh, 1.5f, &arena);
+        ToObjResult(arena.View(), &obj_result);
+        decoder.Decode(outputs[k].data(), boxes);
+    }
+
+    int fail = 0;
+    printf("%8s %8s %10s %10s %14s\n", "hits", "kept", "truncated", "obj_num", "allocs/frame");
+    for (int k = 0; k < kinds; ++k)
+    {
+        const long before = g_alloc_num.load();
+        for (int i = 0; i < frames; ++i)
+        {
+            yolov7.YoloProcess(outputs[k].data(), desc.conf_thresh, 1.5f, &arena);
+            ToObjResult(arena.View(), &obj_result);
+            decoder.Decode(outputs[k].data(), boxes);
+        }
+        const double allocs = (g_alloc_num.load() - before) * 1.0 / frames;
+        const siran::DetectionSpan view = arena.View();
+        printf("%8d %8d %10s %10d %14.2f\n", hits[k], view.Count(), view.Truncated() ? "yes" : "no",
+               view.Empty() ? 0 : obj_result.obj_num, allocs);
+        if (allocs != 0. || view.Truncated() != decoder.Truncated())
+        {
+            fail = 1;
+        }
+    }
+    printf("%s\n", fail ? "FAILED" : "OK, no heap allocation in steady state");
+    return fail;
+}
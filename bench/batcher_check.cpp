@@ -0,0 +1,282 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     batcher_check.cpp
+*   Brief:    micro-batcher checks on SimBatchBackend, no GPU needed: full batches form at once,
+*             a partial batch is flushed at the deadline and padded to the profile batch, a full
+*             queue rejects, Stop runs what is queued and the backend counters agree with the
+*             batcher stats under concurrent producers. use: ./Batcher_check
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/batcher.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+/// @brief SimBatchBackend with every batch recorded, Hold() blocks batches until Release().
+class RecordingBackend : public siran::IBatchBackend
+{
+public:
+    RecordingBackend(const std::vector<int> &batch_sizes, const int &fixed_us = 100):
+        sim_(batch_sizes, fixed_us, 10),
+        hold_(false),
+        entered_(0)
+    {
+    }
+
+    std::vector<int> BatchSizes() const
+    {
+        return sim_.BatchSizes();
+    }
+
+    int RunBatch(const std::vector<void*> &payloads, const int &profile_batch, std::vector<int> &status)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            Record record = {(int)payloads.size(), profile_batch, Clock::now()};
+            records_.push_back(record);
+            entered_++;
+            cond_.notify_all();
+            cond_.wait(lock, [this] { return !hold_; });
+        }
+        return sim_.RunBatch(payloads, profile_batch, status);
+    }
+
+    void Hold()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hold_ = true;
+    }
+
+    void Release()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        hold_ = false;
+        cond_.notify_all();
+    }
+
+    /// @brief Wait until n batches entered RunBatch.
+    void WaitEntered(const int &n)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this, n] { return entered_ >= n; });
+    }
+
+    typedef struct Record_
+    {
+        int frames;
+        int profile_batch;
+        Clock::time_point start;
+    }Record;
+
+    std::vector<Record> Records()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return records_;
+    }
+
+    siran::SimBatchBackend sim_;
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool hold_;
+    int entered_;
+    std::vector<Record> records_;
+};
+
+static siran::BatcherConfig Config(const int &max_batch, const int &max_wait_us, const int &queue_capacity = 256)
+{
+    siran::BatcherConfig config = siran::DefaultBatcherConfig();
+    config.max_batch = max_batch;
+    config.max_wait_us = max_wait_us;
+    config.queue_capacity = queue_capacity;
+    return config;
+}
+
+static bool AllStatus(std::vector<std::future<int> > &futures, const int &status)
+{
+    bool ok = true;
+    for(size_t i=0;i<futures.size();++i)
+    {
+        ok = futures[i].get() == status && ok;
+    }
+    return ok;
+}
+
+
+static void CheckProfileBatch()
+{
+    RecordingBackend backend({8, 0, 2, 2, 1, -4});
+    siran::MicroBatcher batcher(&backend, Config(4, 1000));
+    Check(1 == batcher.ProfileBatch(1) && 2 == batcher.ProfileBatch(2) && 8 == batcher.ProfileBatch(3) &&
+          8 == batcher.ProfileBatch(8) && 8 == batcher.ProfileBatch(9), "profile batch: smallest backend size holding n");
+}
+
+
+static void CheckFullBatch()
+{
+    RecordingBackend backend({1, 2, 4, 8});
+    /// @brief A deadline far away, only the size trigger can run the batch early.
+    siran::MicroBatcher batcher(&backend, Config(8, 2000000));
+    batcher.Start();
+    const Clock::time_point submit = Clock::now();
+    std::vector<std::future<int> > futures;
+    for(int i=0;i<8;++i)
+    {
+        futures.push_back(batcher.Submit(nullptr));
+    }
+    const bool ok = AllStatus(futures, 0);
+    const std::vector<RecordingBackend::Record> records = backend.Records();
+    Check(ok && 1 == records.size() && 8 == records[0].frames && 8 == records[0].profile_batch,
+          "full batch: 8 frames run as one batch of 8");
+    Check(!records.empty() && records[0].start - submit < std::chrono::milliseconds(500),
+          "full batch: runs without waiting for the deadline");
+    batcher.Stop();
+    const siran::BatcherStats stats = batcher.GetStats();
+    Check(8 == stats.frames && 1 == stats.batches && 1 == stats.profile_hits[3] && 1 == backend.sim_.Batches(),
+          "full batch: stats and backend counters agree");
+}
+
+
+static void CheckDeadline()
+{
+    RecordingBackend backend({1, 2, 4, 8});
+    const int max_wait_us = 20000;
+    siran::MicroBatcher batcher(&backend, Config(8, max_wait_us));
+    batcher.Start();
+    const Clock::time_point submit = Clock::now();
+    std::vector<std::future<int> > futures;
+    for(int i=0;i<3;++i)
+    {
+        futures.push_back(batcher.Submit(nullptr));
+    }
+    const bool ok = AllStatus(futures, 0);
+    const std::vector<RecordingBackend::Record> records = backend.Records();
+    Check(ok && 1 == records.size() && 3 == records[0].frames && 4 == records[0].profile_batch,
+          "deadline: 3 frames flushed as one batch padded to 4");
+    const double waited_us = records.empty() ? 0. : std::chrono::duration<double, std::micro>(records[0].start - submit).count();
+    printf("deadline %d us, partial batch started after %.0f us\n", max_wait_us, waited_us);
+    Check(waited_us >= max_wait_us && waited_us < max_wait_us + 500000, "deadline: partial batch waits for the deadline, not longer");
+
+    /// @brief 10 frames with a target of 8: one full batch at once, the rest at their deadline.
+    futures.clear();
+    for(int i=0;i<10;++i)
+    {
+        futures.push_back(batcher.Submit(nullptr));
+    }
+    const bool ok_split = AllStatus(futures, 0);
+    const std::vector<RecordingBackend::Record> split = backend.Records();
+    Check(ok_split && 3 == split.size() && 8 == split[1].frames && 2 == split[2].frames && 2 == split[2].profile_batch,
+          "deadline: frames beyond the target batch run in the next batch");
+    batcher.Stop();
+    const siran::BatcherStats stats = batcher.GetStats();
+    Check(13 == stats.frames && 3 == stats.batches && 3 == backend.sim_.Batches(), "deadline: stats and backend counters agree");
+}
+
+
+static void CheckQueueFullAndStop()
+{
+    RecordingBackend backend({1});
+    siran::MicroBatcher batcher(&backend, Config(1, 1000, 4));
+    Check(-1 == batcher.Submit(nullptr).get(), "stopped: submit returns -1");
+    batcher.Start();
+    backend.Hold();
+    std::vector<std::future<int> > futures;
+    futures.push_back(batcher.Submit(nullptr));
+    backend.WaitEntered(1);
+    for(int i=0;i<4;++i)
+    {
+        futures.push_back(batcher.Submit(nullptr));
+    }
+    std::future<int> rejected = batcher.Submit(nullptr);
+    Check(-2 == rejected.get() && 4 == batcher.QueueDepth(), "queue full: submit beyond the capacity returns -2");
+
+    /// @brief Stop while the backend is blocked, the queued frames still run.
+    std::thread stopper([&batcher]() { batcher.Stop(); });
+    backend.Release();
+    stopper.join();
+    Check(AllStatus(futures, 0) && 0 == batcher.QueueDepth() && 5 == backend.sim_.Batches(), "stop: queued frames run before stop returns");
+    Check(-1 == batcher.Submit(nullptr).get(), "stop: later submits return -1");
+    const siran::BatcherStats stats = batcher.GetStats();
+    Check(5 == stats.frames && 1 == stats.rejected, "queue full: rejected counted");
+}
+
+
+static void CheckProducers()
+{
+    RecordingBackend backend({1, 2, 4, 8}, 200);
+    siran::MicroBatcher batcher(&backend, Config(8, 2000));
+    batcher.Start();
+    const int producers = 4;
+    const int frames = 200;
+    std::vector<std::thread> threads;
+    std::vector<int> failed(producers, 0);
+    for(int p=0;p<producers;++p)
+    {
+        threads.emplace_back([&batcher, &failed, p, frames]() {
+            for(int i=0;i<frames;++i)
+            {
+                failed[p] += batcher.Submit(nullptr).get() == 0 ? 0 : 1;
+            }
+        });
+    }
+    /// @brief Counters are read while the dispatcher runs batches.
+    int64_t last_batches = 0;
+    bool monotonic = true;
+    while(batcher.GetStats().frames < producers * frames)
+    {
+        const int64_t batches = backend.sim_.Batches();
+        monotonic = monotonic && batches >= last_batches;
+        last_batches = batches;
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    for(size_t i=0;i<threads.size();++i)
+    {
+        threads[i].join();
+    }
+    batcher.Stop();
+    const siran::BatcherStats stats = batcher.GetStats();
+    const std::vector<RecordingBackend::Record> records = backend.Records();
+    int64_t busy_us = 0;
+    int recorded_frames = 0;
+    bool within = true;
+    for(size_t i=0;i<records.size();++i)
+    {
+        busy_us += 200 + 10 * records[i].profile_batch;
+        recorded_frames += records[i].frames;
+        within = within && records[i].frames <= 8 && records[i].frames <= records[i].profile_batch;
+    }
+    printf("%d producers x %d frames: %lld batches, %.2f frames/batch\n", producers, frames,
+           (long long)stats.batches, stats.frames * 1.0 / std::max<int64_t>(stats.batches, 1));
+    Check(0 == failed[0] + failed[1] + failed[2] + failed[3] && producers * frames == recorded_frames,
+          "producers: every frame runs once");
+    Check(within && monotonic, "producers: batches within max_batch and the profile batch");
+    Check(stats.batches == backend.sim_.Batches() && (int64_t)records.size() == stats.batches && busy_us == backend.sim_.BusyUs(),
+          "producers: backend counters agree with the batcher stats");
+}
+
+
+int main()
+{
+    CheckProfileBatch();
+    CheckFullBatch();
+    CheckDeadline();
+    CheckQueueFullAndStop();
+    CheckProducers();
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
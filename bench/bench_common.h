@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     bench_common.h
+*   Brief:    shared bench fixtures: synthetic network output and, with BENCH_COUNT_ALLOC defined
+*             before the include, a global operator new that counts heap allocations(define it in
+*             one translation unit of the executable only).
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_BENCH_COMMON_H_
+#define YOLOV7TRT_BENCH_COMMON_H_
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <random>
+#include <vector>
+
+/// @brief Shape of the hit rows of MakeOutput, feature values before the decode.
+typedef struct SynthOutputConfig_
+{
+    /// @brief w/h features are box_min + box_range * u, larger boxes give NMS more work.
+    float box_min;
+    float box_range;
+    /// @brief Objectness of a hit in [obj_min, 1), its class score in [cls_min, 1).
+    float obj_min;
+    float cls_min;
+}SynthOutputConfig;
+
+inline SynthOutputConfig DefaultSynthOutputConfig()
+{
+    SynthOutputConfig config;
+    config.box_min = 0.05f;
+    config.box_range = 0.5f;
+    config.obj_min = 0.4f;
+    config.cls_min = 0.5f;
+    return config;
+}
+
+/// @brief Network output with hits rows over the thresholds, the rest low noise(< 0.1) below them.
+inline void MakeOutput(const int &rows, const int &class_num, const int &hits, std::mt19937 &rng, std::vector<float> &out,
+                       const SynthOutputConfig &config = DefaultSynthOutputConfig())
+{
+    const int row_len = class_num + 5;
+    std::uniform_real_distribution<float> uni(0.f, 1.f);
+    out.resize((size_t)rows * row_len);
+    for (size_t i = 0; i < out.size(); ++i)
+    {
+        out[i] = 0.1f * uni(rng);
+    }
+    for (int k = 0; k < hits; ++k)
+    {
+        float *feat = &out[(size_t)(rng() % rows) * row_len];
+        feat[0] = uni(rng);
+        feat[1] = uni(rng);
+        feat[2] = config.box_min + config.box_range * uni(rng);
+        feat[3] = config.box_min + config.box_range * uni(rng);
+        feat[4] = config.obj_min + (1.f - config.obj_min) * uni(rng);
+        feat[5 + rng() % class_num] = config.cls_min + (1.f - config.cls_min) * uni(rng);
+    }
+}
+
+#ifdef BENCH_COUNT_ALLOC
+/// @brief Heap allocations through operator new since the start of the process.
+static std::atomic<long> g_alloc_num(0);
+
+void* operator new(size_t size)
+{
+    g_alloc_num++;
+    void *p = malloc(size ? size : 1);
+    if (nullptr == p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+#endif
+
+#endif
@@ -0,0 +1,202 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     calib_check.cpp
+*   Brief:    INT8 calibration host side checks, no GPU needed: batch stream content and
+*             bounded prefetch, calibration cache i/o, calibration ids and label matching.
+*             use: ./Calib_check [images] [batch size]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/calibrator.h"
+#include "inc/det_eval.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <set>
+#include <thread>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+/// @brief Wraps a source, counts frames read so the prefetch depth can be observed.
+class CountingSource : public siran::IFrameSource
+{
+public:
+    explicit CountingSource(siran::IFrameSource *source):
+        source_(source),
+        reads_(0)
+    {
+    }
+
+    int Read(cv::Mat &frame)
+    {
+        const int iret = source_->Read(frame);
+        if(iret == 0)
+        {
+            reads_++;
+        }
+        return iret;
+    }
+
+    siran::IFrameSource *source_;
+    std::atomic<int> reads_;
+};
+
+static void CheckStream(const int &images, const int &batch_size)
+{
+    siran::CalibrationConfig config = siran::DefaultCalibrationConfig();
+    config.batch_size = batch_size;
+    config.input_w = 320;
+    config.input_h = 320;
+    config.max_batches = 0;
+    config.prefetch = 2;
+    config.thread_num = 2;
+
+    /// @brief Reference batches from the same frames through LetterboxRef.
+    siran::SyntheticSource ref_source(640, 480, 0., images);
+    std::vector<float> reference;
+    cv::Mat frame;
+    siran::LetterboxTable table;
+    siran::BuildLetterboxTable(640, 480, config.input_w, config.input_h, table);
+    const size_t image_floats = (size_t)3 * config.input_w * config.input_h;
+    while(ref_source.Read(frame) == 0)
+    {
+        reference.resize(reference.size() + image_floats);
+        siran::LetterboxRef(frame.data, frame.step, table, reference.data() + reference.size() - image_floats,
+                            config.input_w, config.input_h);
+    }
+
+    siran::SyntheticSource synthetic(640, 480, 0., images);
+    CountingSource source(&synthetic);
+    siran::CalibrationBatchStream stream(&source, config);
+    stream.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    /// @brief prefetch batches queued plus the one the loader holds when it blocks.
+    Check(source.reads_.load() <= (config.prefetch + 1) * batch_size, "loader stops prefetch batches ahead");
+
+    std::vector<float> batch;
+    int batches = 0;
+    bool sizes_ok = true;
+    double max_diff = 0.;
+    std::set<const float*> buffers;
+    while(stream.Next(batch))
+    {
+        sizes_ok = sizes_ok && batch.size() == stream.BatchFloats();
+        for(size_t i=0;i<batch.size();++i)
+        {
+            max_diff = std::max(max_diff, (double)fabs(batch[i] - reference[batches * batch.size() + i]));
+        }
+        buffers.insert(batch.data());
+        batches++;
+    }
+    Check(sizes_ok, "batches are batch_size x 3 x h x w");
+    Check(batches == images / batch_size && stream.Batches() == batches, "every full batch delivered");
+    Check(stream.Dropped() == images % batch_size, "short last batch dropped");
+    Check(max_diff == 0., "batches match the inference letterbox");
+    /// @brief prefetch queued, one filling and one held by the caller.
+    Check((int)buffers.size() <= config.prefetch + 2, "batch buffers recycled");
+    printf("     %d batches of %d, %lld dropped, %zu batch buffers\n", batches, batch_size, (long long)stream.Dropped(), buffers.size());
+
+    siran::SyntheticSource limited_source(640, 480, 0., images);
+    config.max_batches = 2;
+    siran::CalibrationBatchStream limited(&limited_source, config);
+    batches = 0;
+    while(limited.Next(batch))
+    {
+        batches++;
+    }
+    Check(batches == std::min(2, images / batch_size), "max_batches caps the stream");
+
+    siran::SyntheticSource endless(640, 480, 0., -1);
+    siran::CalibrationBatchStream stopped(&endless, config);
+    stopped.Next(batch);
+    /// @brief Endless source: the loader fills prefetch batches and then blocks on the full ring.
+    int64_t filled = -1;
+    for(int i=0;i<200 && filled != stopped.Batches();++i)
+    {
+        filled = stopped.Batches();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    const auto stop_start = std::chrono::steady_clock::now();
+    stopped.Stop();
+    const double stop_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stop_start).count();
+    const int64_t stopped_batches = stopped.Batches();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    char what[96];
+    snprintf(what, sizeof(what), "stop while the loader is blocked returns in %.1f ms", stop_ms);
+    Check(stop_ms < 1000., what);
+    Check(stopped.Batches() == stopped_batches, "loader does not advance after stop");
+}
+
+static void CheckCache()
+{
+    char path_template[] = "/tmp/calib_check_XXXXXX";
+    const int fd = mkstemp(path_template);
+    close(fd);
+    const std::string path = path_template;
+    const std::string entropy = "TRT-8401-EntropyCalibration2\nimages: 3c010a14\noutput: 3e4f1a2b\n";
+    std::string data;
+    Check(siran::WriteCalibrationCache(path, entropy) == 0, "cache written");
+    Check(siran::ReadCalibrationCache(path, siran::CALIB_ENTROPY, data) == 0 && data == entropy, "cache read back");
+    Check(siran::ReadCalibrationCache(path, siran::CALIB_MINMAX, data) == -2, "cache of another algorithm rejected");
+    Check(siran::ReadCalibrationCache(path + ".missing", siran::CALIB_ENTROPY, data) == -1, "missing cache");
+    siran::WriteCalibrationCache(path, "garbage");
+    Check(siran::ReadCalibrationCache(path, siran::CALIB_ENTROPY, data) == -2, "not a TRT cache rejected");
+    unlink(path.c_str());
+
+    siran::CalibrationConfig config = siran::DefaultCalibrationConfig();
+    std::vector<std::string> images = {"a.jpg", "b.jpg"};
+    const std::string id = siran::CalibrationId(images, siran::CALIB_ENTROPY, config);
+    Check(id == siran::CalibrationId(images, siran::CALIB_ENTROPY, config), "calibration id stable");
+    Check(id != siran::CalibrationId(images, siran::CALIB_MINMAX, config), "calibration id per algorithm");
+    images.push_back("c.jpg");
+    Check(id != siran::CalibrationId(images, siran::CALIB_ENTROPY, config), "calibration id per image set");
+}
+
+static void CheckEval()
+{
+    Check(siran::YoloLabelPath("/data/coco/images/val/0001.jpg") == "/data/coco/labels/val/0001.txt", "label path of an images dir");
+    Check(siran::YoloLabelPath("data/x.v2.png") == "data/x.v2.txt", "label path next to the image");
+
+    char path_template[] = "/tmp/calib_check_label_XXXXXX";
+    const int fd = mkstemp(path_template);
+    close(fd);
+    {
+        std::ofstream file(path_template);
+        file << "0 0.25 0.25 0.2 0.2\n1 0.75 0.75 0.2 0.2\n\n";
+    }
+    std::vector<siran::Detection> truths;
+    Check(siran::LoadYoloLabels(path_template, 100, 200, truths) == 0 && truths.size() == 2, "labels loaded");
+    Check(fabs(truths[0].left - 15.f) < 1e-4f && fabs(truths[0].bottom - 70.f) < 1e-4f, "labels scaled to pixels");
+    unlink(path_template);
+
+    std::vector<siran::Detection> preds = truths;
+    preds[0].prob = 0.9f;
+    preds[1].class_id = 0;     // wrong class
+    preds.push_back(truths[0]);
+    preds.back().prob = 0.5f;  // duplicate
+    siran::MatchStats stats = siran::EmptyMatchStats();
+    siran::MatchDetections(preds.data(), preds.size(), truths.data(), truths.size(), 0.5f, stats);
+    Check(stats.tp == 1 && stats.fp == 2 && stats.fn == 1, "class aware greedy matching");
+    Check(fabs(siran::Precision(stats) - 1. / 3) < 1e-9 && fabs(siran::Recall(stats) - 0.5) < 1e-9 && siran::MeanIou(stats) == 1., "precision, recall and iou");
+}
+
+int main(int arv, char** arg)
+{
+    const int images = arv > 1 ? atoi(arg[1]) : 37;
+    const int batch_size = arv > 2 ? atoi(arg[2]) : 4;
+    CheckStream(images, batch_size);
+    CheckCache();
+    CheckEval();
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     decode_bench.cpp
+*   Brief:    box decoders vs Yolov7::YoloProcess, result match, time and D2H bytes per frame,
+*             a decoder that differs from YoloProcess returns non-zero. use: ./Decode_bench [loops] [candidate rows]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/yolov7.hpp"
+#include "inc/box_decode.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cuda_runtime_api.h>
+
+#include "bench/bench_common.h"
+
+static bool SameBoxes(const std::vector<object_t> &ref, const std::vector<siran::DecodeBox> &boxes, const int &input_w, const int &input_h)
+{
+    if (ref.size() != boxes.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < ref.size(); ++i)
+    {
+        if (ref[i].left != boxes[i].left * input_w || ref[i].right != boxes[i].right * input_w ||
+            ref[i].low != boxes[i].low * input_h || ref[i].high != boxes[i].high * input_h ||
+            ref[i].id != boxes[i].id || ref[i].prob != boxes[i].prob)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int arv, char** arg)
+{
+    const int loops = arv > 1 ? atoi(arg[1]) : 50;
+    const int hits = arv > 2 ? atoi(arg[2]) : 300;
+    const siran::ModelDesc desc = siran::DefaultModelDesc();
+    Yolov7 yolov7(desc);
+    const std::vector<row_info_t> &row_info = yolov7.RowInfo();
+    const int rows = row_info.size();
+
+    siran::DecodeParams params;
+    params.rows = rows;
+    params.class_num = desc.num_classes;
+    params.input_w = desc.input_w;
+    params.input_h = desc.input_h;
+    params.conf_thresh = desc.conf_thresh;
+    params.nms_thresh = desc.nms_thresh;
+    siran::CpuBoxDecoder cpu_decoder(params, row_info);
+
+    std::mt19937 rng(11);
+    std::vector<float> output;
+    /// @brief Large boxes, so NMS has work to do.
+    SynthOutputConfig shape = DefaultSynthOutputConfig();
+    shape.box_min = 0.2f;
+    MakeOutput(rows, desc.num_classes, hits, rng, output, shape);
+    const size_t output_bytes = output.size() * sizeof(float);
+
+    std::vector<object_t> ref;
+    std::vector<siran::DecodeBox> boxes;
+    auto time_start = std::chrono::steady_clock::now();
+    for (int i=0;i<loops;++i)
+    {
+        yolov7.YoloProcess(output.data(), desc.conf_thresh, &ref);
+    }
+    const double ref_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count() / loops;
+
+    time_start = std::chrono::steady_clock::now();
+    for (int i=0;i<loops;++i)
+    {
+        cpu_decoder.Decode(output.data(), boxes);
+    }
+    const double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count() / loops;
+
+    printf("rows %d, objectness hits %d, kept %d\n", rows, hits, (int)ref.size());
+    printf("%-22s %10s %12s %8s\n", "decoder", "ms/frame", "D2H bytes", "match");
+    printf("%-22s %10.3f %12zu %8s\n", "YoloProcess", ref_ms, output_bytes, "-");
+    int mismatch = SameBoxes(ref, boxes, desc.input_w, desc.input_h) ? 0 : 1;
+    printf("%-22s %10.3f %12zu %8s\n", "CpuBoxDecoder", cpu_ms, output_bytes, 0 == mismatch ? "yes" : "NO");
+
+    int device_num = 0;
+    if (cudaGetDeviceCount(&device_num) != cudaSuccess || device_num <= 0)
+    {
+        printf("no cuda device, device decoder skipped\n");
+        return mismatch == 0 ? 0 : 1;
+    }
+    float *gpu_out = nullptr;
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+    cudaMalloc((void**)&gpu_out, output_bytes);
+    cudaMemcpy(gpu_out, output.data(), output_bytes, cudaMemcpyHostToDevice);
+    const bool device_nms[2] = {true, false};
+    for (int k=0;k<2;++k)
+    {
+        siran::DeviceBoxDecoder device_decoder(params, row_info, device_nms[k]);
+        device_decoder.Decode(gpu_out, boxes, stream);
+        time_start = std::chrono::steady_clock::now();
+        for (int i=0;i<loops;++i)
+        {
+            device_decoder.Decode(gpu_out, boxes, stream);
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count() / loops;
+        const bool match = SameBoxes(ref, boxes, desc.input_w, desc.input_h);
+        mismatch += match ? 0 : 1;
+        printf("%-22s %10.3f %12zu %8s\n", device_nms[k] ? "DeviceBoxDecoder" : "DeviceBoxDecoder+host", ms,
+               sizeof(siran::DecodeOutput), match ? "yes" : "NO");
+    }
+    cudaFree(gpu_out);
+    cudaStreamDestroy(stream);
+    return mismatch == 0 ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     device_group_bench.cpp
+*   Brief:    device group dispatch test over simulated devices(MockInferBackend), uneven
+*             per-device cost, least outstanding vs round robin, no GPU needed.
+*             use: ./Device_group_bench [requests] [callers] [device costs us, e.g. 2000,2000,3000,6000]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/device_group.h"
+#include "inc/histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static const int kInstancesPerDevice = 2;
+
+/// @brief Run requests from callers threads, each a synchronous Run, return 0 when every request
+///        completed and no simulated context was entered twice at once.
+static int RunPolicy(const char *name, const int &policy, const std::vector<int> &costs, const int &requests, const int &callers)
+{
+    std::vector<std::unique_ptr<siran::MockInferBackend> > backends;
+    siran::DeviceGroup group(policy, 64);
+    for(size_t d=0;d<costs.size();++d)
+    {
+        backends.emplace_back(new siran::MockInferBackend(kInstancesPerDevice, costs[d]));
+        group.AddDevice(d, backends.back().get());
+    }
+    if(group.Start() != 0)
+    {
+        printf("start failed\n");
+        return -1;
+    }
+
+    std::atomic<int> next(0);
+    std::atomic<int> failed(0);
+    std::mutex latency_mutex;
+    siran::Histogram latency_us(siran::Histogram::ExponentialBounds(100., 1.1, 1e8));
+    const auto time_start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for(int c=0;c<callers;++c)
+    {
+        threads.emplace_back([&]() {
+            while(next++ < requests)
+            {
+                siran::InferTask task;
+                task.payload = nullptr;
+                task.status = 0;
+                const auto begin = std::chrono::steady_clock::now();
+                if(group.Run(&task) != 0)
+                {
+                    failed++;
+                }
+                const double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+                std::lock_guard<std::mutex> lock(latency_mutex);
+                latency_us.Add(us);
+            }
+        });
+    }
+    for(size_t i=0;i<threads.size();++i)
+    {
+        threads[i].join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+    group.Stop();
+
+    printf("%-18s %.0f req/s  latency p50 %.0fus p99 %.0fus  share:", name, requests / seconds,
+           latency_us.Percentile(0.5), latency_us.Percentile(0.99));
+    int64_t total = 0, overlaps = 0;
+    const std::vector<siran::DeviceLoad> loads = group.GetLoads();
+    for(size_t d=0;d<loads.size();++d)
+    {
+        printf(" gpu%d(%dus) %lld", loads[d].device_id, costs[d], (long long)loads[d].completed);
+        total += loads[d].completed;
+        overlaps += backends[d]->Overlaps();
+    }
+    printf("\n");
+    if(failed > 0 || total != requests || overlaps != 0)
+    {
+        printf("%s: failed %d, completed %lld of %d, overlaps %lld\n", name, failed.load(), (long long)total, requests, (long long)overlaps);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int arv, char** arg)
+{
+    const int requests = arv > 1 ? atoi(arg[1]) : 2000;
+    const int callers = arv > 2 ? atoi(arg[2]) : 16;
+    std::vector<int> costs;
+    const char *cost_list = arv > 3 ? arg[3] : "2000,2000,3000,6000";
+    for(const char *p=cost_list;*p;)
+    {
+        costs.push_back(atoi(p));
+        p = strchr(p, ',');
+        if(nullptr == p)
+        {
+            break;
+        }
+        p++;
+    }
+
+    printf("%d cuda device(s) on this host", siran::CudaDeviceCount());
+    const std::vector<siran::CudaDeviceInfo> &devices = siran::CudaDevices();
+    for(size_t i=0;i<devices.size();++i)
+    {
+        printf(", gpu%d %s numa %d", devices[i].id, devices[i].name.c_str(), devices[i].numa_node);
+    }
+    printf("\n%zu simulated devices x %d contexts, %d requests from %d callers\n", costs.size(), kInstancesPerDevice, requests, callers);
+
+    int iret = RunPolicy("least outstanding", siran::DISPATCH_LEAST_OUTSTANDING, costs, requests, callers);
+    iret |= RunPolicy("round robin", siran::DISPATCH_ROUND_ROBIN, costs, requests, callers);
+    return iret == 0 ? 0 : 1;
+}
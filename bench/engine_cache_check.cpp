@@ -0,0 +1,200 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     engine_cache_check.cpp
+*   Brief:    engine cache lookup, keying, timing cache reuse and eviction over a fake builder,
+*             no GPU needed. With an onnx file it builds a real engine through the cache.
+*             use: ./Engine_cache_check [model.onnx [fp32|fp16|int8] [max batch] [device id]]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/engine_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+
+/// @brief Writes a small plan naming what it was built from, timing cache grows one line per build.
+class FakeEngineBuilder : public siran::IEngineBuilder
+{
+public:
+    explicit FakeEngineBuilder(const int &sm_major = 8):
+        sm_major_(sm_major),
+        builds_(0),
+        fail_(false)
+    {
+    }
+
+    siran::EnginePlatform Platform() const
+    {
+        siran::EnginePlatform platform;
+        platform.gpu_name = sm_major_ == 8 ? "Fake RTX 3080 Ti" : "Fake RTX 2070";
+        platform.sm_major = sm_major_;
+        platform.sm_minor = sm_major_ == 8 ? 6 : 5;
+        platform.trt_version = 8401;
+        return platform;
+    }
+
+    int Build(const siran::EngineBuildConfig &config, std::string &timing_cache, const std::string &engine_file)
+    {
+        last_timing_in_ = timing_cache;
+        if(fail_)
+        {
+            return -3;
+        }
+        builds_++;
+        std::ofstream file(engine_file, std::ios::binary);
+        file << "ptrt fake engine of " << config.onnx_file << " " << siran::EnginePrecisionName(config.precision) << "\n";
+        timing_cache += "tactics " + std::to_string(builds_) + "\n";
+        return 0;
+    }
+
+    int sm_major_;
+    int builds_;
+    bool fail_;
+    std::string last_timing_in_;
+};
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+static bool Exists(const std::string &path)
+{
+    return access(path.c_str(), F_OK) == 0;
+}
+
+static void WriteText(const std::string &path, const std::string &text)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file << text;
+}
+
+static int RunFakeChecks()
+{
+    char dir_template[] = "/tmp/engine_cache_check_XXXXXX";
+    const std::string dir = mkdtemp(dir_template);
+    const std::string onnx = dir + "/yolov7.onnx";
+    WriteText(onnx, "onnx model v1");
+    WriteText(dir + "/yolov7.cfg", "num_classes: 4\n");
+
+    siran::EngineCacheConfig cache_config = siran::DefaultEngineCacheConfig();
+    cache_config.cache_dir = dir + "/cache";
+    cache_config.max_entries = 3;
+    FakeEngineBuilder builder;
+    siran::EngineBuildConfig build = siran::DefaultEngineBuildConfig();
+    build.onnx_file = onnx;
+
+    std::string fp16_file, again_file;
+    {
+        siran::EngineCache cache(&builder, cache_config);
+        Check(cache.GetEngine(build, fp16_file) == 0 && builder.builds_ == 1, "miss builds the engine");
+        Check(Exists(fp16_file) && fp16_file.find("yolov7_sm86_trt8401_fp16_") != std::string::npos, "engine named by model, sm, trt and precision");
+        Check(Exists(fp16_file.substr(0, fp16_file.size() - 4) + ".cfg"), "model descriptor copied next to the engine");
+        Check(cache.GetEngine(build, again_file) == 0 && again_file == fp16_file && builder.builds_ == 1, "second call hits");
+        Check(builder.last_timing_in_.empty(), "first build starts without timing cache");
+    }
+    {
+        siran::EngineCache cache(&builder, cache_config);
+        Check(cache.GetEngine(build, again_file) == 0 && builder.builds_ == 1 && cache.GetStats().hits == 1, "new cache instance hits on disk");
+
+        siran::EngineBuildConfig fp32 = build;
+        fp32.precision = siran::PRECISION_FP32;
+        std::string fp32_file;
+        Check(cache.GetEngine(fp32, fp32_file) == 0 && fp32_file != fp16_file && builder.builds_ == 2, "precision is part of the key");
+        Check(builder.last_timing_in_ == "tactics 1\n", "timing cache of the first build reused");
+
+        siran::EngineBuildConfig batch = build;
+        batch.profiles.push_back(siran::BatchProfile("images", 3, 640, 640, 4, 8));
+        std::string batch_file;
+        Check(cache.GetEngine(batch, batch_file) == 0 && batch_file != fp16_file && builder.builds_ == 3, "profiles are part of the key");
+        Check(cache.Key(batch).find("profile=images:1x3x640x640/4x3x640x640/8x3x640x640") != std::string::npos, "profile text in the key");
+
+        siran::EngineBuildConfig int8_a = build, int8_b = build;
+        int8_a.precision = int8_b.precision = siran::PRECISION_INT8;
+        int8_a.calibration_id = "coco_val_500";
+        int8_b.calibration_id = "site_a_1000";
+        Check(cache.EnginePath(int8_a) != cache.EnginePath(int8_b), "int8 calibration set is part of the key");
+
+        /// @brief 3 engines, limit 3; touch fp16 so fp32 becomes the oldest, the 4th build evicts it.
+        usleep(10000);
+        Check(cache.GetEngine(build, again_file) == 0, "hit refreshes last use");
+        Check(cache.GetEngine(int8_a, again_file) == 0 && builder.builds_ == 4, "int8 engine built");
+        Check(!Exists(fp32_file) && Exists(fp16_file) && Exists(batch_file) && cache.GetStats().evictions == 1, "least recently used engine evicted");
+        Check(cache.Entries().size() == 3, "cache trimmed to max_entries");
+    }
+    {
+        FakeEngineBuilder turing(7);
+        siran::EngineCache cache(&turing, cache_config);
+        std::string turing_file;
+        Check(cache.GetEngine(build, turing_file) == 0 && turing_file != fp16_file && turing.builds_ == 1, "gpu architecture is part of the key");
+        Check(turing.last_timing_in_.empty(), "timing cache is per platform");
+    }
+    {
+        siran::EngineCache cache(&builder, cache_config);
+        const int builds = builder.builds_;
+        WriteText(onnx, "onnx model v2");
+        std::string v2_file;
+        Check(cache.GetEngine(build, v2_file) == 0 && v2_file != fp16_file && builder.builds_ == builds + 1, "changed model content rebuilds");
+
+        WriteText(v2_file.substr(0, v2_file.size() - 4) + ".key", "model=0\n");
+        Check(cache.GetEngine(build, again_file) == 0 && again_file == v2_file && builder.builds_ == builds + 2, "mismatching key rebuilds");
+
+        WriteText(cache_config.cache_dir + "/hand_built.trt", "ptrt");
+        cache.Trim();
+        Check(Exists(cache_config.cache_dir + "/hand_built.trt"), "files without a key are never evicted");
+
+        siran::EngineBuildConfig missing = build;
+        missing.onnx_file = dir + "/missing.onnx";
+        Check(cache.GetEngine(missing, again_file) == -1, "missing onnx is an error");
+
+        builder.fail_ = true;
+        siran::EngineBuildConfig fp32 = build;
+        fp32.precision = siran::PRECISION_FP32;
+        Check(cache.GetEngine(fp32, again_file) == -3 && !Exists(cache.EnginePath(fp32)) && cache.GetStats().build_failures == 1, "failed build leaves no entry");
+        builder.fail_ = false;
+    }
+    const std::string cmd = "rm -rf " + dir;
+    if(system(cmd.c_str()) != 0)
+    {
+        printf("warning: %s failed\n", cmd.c_str());
+    }
+    return g_failed;
+}
+
+int main(int arv, char** arg)
+{
+    if(arv < 2)
+    {
+        const int failed = RunFakeChecks();
+        printf(failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", failed);
+        return failed == 0 ? 0 : 1;
+    }
+
+    /// @brief Real build through the cache, the second lookup should hit.
+    const std::string precision_name = arv > 2 ? arg[2] : "fp16";
+    const int precision = precision_name == "fp32" ? siran::PRECISION_FP32 :
+                          (precision_name == "int8" ? siran::PRECISION_INT8 : siran::PRECISION_FP16);
+    const int max_batch = arv > 3 ? atoi(arg[3]) : 1;
+    const int device_id = arv > 4 ? atoi(arg[4]) : 0;
+    for(int i=0;i<2;++i)
+    {
+        std::string engine_file;
+        const auto time_start = std::chrono::steady_clock::now();
+        const int iret = siran::GetCachedEngine(arg[1], device_id, engine_file, precision, max_batch);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+        printf("%s: code %d, %s, %.1fms\n", i == 0 ? "first" : "second", iret, engine_file.c_str(), ms);
+        if(iret != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
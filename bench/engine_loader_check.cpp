@@ -0,0 +1,148 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     engine_loader_check.cpp
+*   Brief:    engine loader checks on a fake runtime, no GPU needed: a plan is handed to deserialize
+*             without a copy from memory and mmap sources, and open, header and deserialize
+*             failures return their codes and close the source. use: ./Engine_loader_check
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/engine_loader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+/// @brief Fake IRuntime::deserializeCudaEngine, keeps what it was given, fails on request.
+class FakeRuntime
+{
+public:
+    explicit FakeRuntime(const bool &fail = false):
+        fail_(fail),
+        calls_(0),
+        data_(nullptr),
+        size_(0)
+    {
+    }
+
+    std::function<bool(const void*, size_t)> Hook()
+    {
+        return [this](const void *data, size_t size) {
+            calls_++;
+            data_ = data;
+            size_ = size;
+            plan_.assign((const char*)data, size);
+            return !fail_;
+        };
+    }
+
+    bool fail_;
+    int calls_;
+    const void *data_;
+    size_t size_;
+    std::string plan_;
+};
+
+static std::string FakePlan(const char *magic, const size_t &size)
+{
+    std::string plan(size, '\0');
+    memcpy(&plan[0], magic, 4);
+    for(size_t i=4;i<size;++i)
+    {
+        plan[i] = (char)(i * 131);
+    }
+    return plan;
+}
+
+
+static void CheckMemorySource()
+{
+    const std::string plan = FakePlan("ftrt", 4096);
+    siran::MemoryFileSource source(plan);
+    FakeRuntime runtime;
+    siran::EngineLoadReport report;
+    memset(&report, 0, sizeof(report));
+    const int iret = siran::LoadEngineFile(source, "embedded.trt", runtime.Hook(), &report);
+    Check(0 == iret && 1 == runtime.calls_ && runtime.plan_ == plan, "memory source: plan deserialized as is");
+    Check(report.file_size == plan.size() && report.total_ms >= report.deserialize_ms, "memory source: report filled");
+    Check(nullptr == source.Data() && 0 == source.Size(), "memory source: closed after load");
+
+    siran::MemoryFileSource unknown(FakePlan("abcd", 4096));
+    FakeRuntime loose;
+    Check(0 == siran::LoadEngineFile(unknown, "unknown.trt", loose.Hook()) && 1 == loose.calls_,
+          "unknown magic: warning only, still deserialized");
+    Check(-2 == siran::CheckEngineHeader(FakePlan("abcd", 4096).data(), 4096, true) &&
+          0 == siran::CheckEngineHeader(FakePlan("ptrt", 4096).data(), 4096, true), "strict header check");
+}
+
+
+static void CheckMmapSource()
+{
+    char path[] = "/tmp/engine_loader_check_XXXXXX";
+    const int fd = mkstemp(path);
+    const std::string plan = FakePlan("ptrt", 1 << 20);
+    const bool written = fd >= 0 && write(fd, plan.data(), plan.size()) == (ssize_t)plan.size();
+    if(fd >= 0)
+    {
+        close(fd);
+    }
+    Check(written, "mmap source: fake plan written");
+
+    siran::MmapFileSource source;
+    const void *mapping = nullptr;
+    FakeRuntime runtime;
+    std::function<bool(const void*, size_t)> hook = runtime.Hook();
+    const int iret = siran::LoadEngineFile(source, path, [&](const void *data, size_t size) {
+        mapping = data;
+        return hook(data, size);
+    });
+    Check(0 == iret && runtime.plan_ == plan, "mmap source: plan deserialized as is");
+    Check(nullptr != mapping && nullptr == source.Data() && 0 == source.Size(),
+          "mmap source: mapping handed over, unmapped after load");
+    unlink(path);
+
+    FakeRuntime missing;
+    Check(-1 == siran::LoadEngineFile(source, path, missing.Hook()) && 0 == missing.calls_,
+          "missing file: -1, runtime not called");
+}
+
+
+static void CheckErrors()
+{
+    siran::MemoryFileSource truncated(FakePlan("ftrt", siran::kMinEngineSize - 1));
+    FakeRuntime runtime;
+    Check(-2 == siran::LoadEngineFile(truncated, "truncated.trt", runtime.Hook()) && 0 == runtime.calls_ &&
+          nullptr == truncated.Data(), "truncated file: -2, runtime not called, source closed");
+
+    siran::MemoryFileSource empty("");
+    Check(-2 == siran::LoadEngineFile(empty, "empty.trt", runtime.Hook()) && 0 == runtime.calls_,
+          "empty file: -2");
+
+    siran::MemoryFileSource source(FakePlan("ftrt", 4096));
+    FakeRuntime failing(true);
+    siran::EngineLoadReport report;
+    memset(&report, 0, sizeof(report));
+    Check(-3 == siran::LoadEngineFile(source, "bad.trt", failing.Hook(), &report) && 1 == failing.calls_ &&
+          nullptr == source.Data(), "deserialize failure: -3, source closed");
+    Check(4096 == report.file_size, "deserialize failure: report still filled");
+}
+
+
+int main()
+{
+    CheckMemorySource();
+    CheckMmapSource();
+    CheckErrors();
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,391 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     gate_check.cpp
+*   Brief:    motion gate checks, no GPU needed: gate decisions on still, moving and resized
+*             frames, then one clip through the stream pipeline with and without the gate, a
+*             colour blob detector stands in for the engine so region crops are detected like
+*             whole frames. Reports skipped and region frames, detector calls and pixels, and
+*             recall/precision of the gated results against the ungated ones.
+*             use: ./Gate_check [clip path or -] [generated frames] [min recall]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/motion_gate.h"
+#include "inc/stream.h"
+#include "inc/trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+/// @brief Generated corridor, a still textured background with sensor noise, two parked boxes
+///        and people-sized boxes walking through now and then. Idle stretches are gated away.
+class CorridorSource : public siran::IFrameSource
+{
+public:
+    CorridorSource(const int &width, const int &height, const int64_t &frame_num):
+        width_(width),
+        height_(height),
+        frame_num_(frame_num),
+        index_(0),
+        noise_(12345u)
+    {
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> level(90, 140);
+        background_ = cv::Mat(height_, width_, CV_8UC3, cv::Scalar(0, 0, 0));
+        for(int y=0;y<height_;y+=4)
+        {
+            for(int x=0;x<width_;x+=4)
+            {
+                const int v = level(rng);
+                cv::rectangle(background_, cv::Rect(x, y, 4, 4), cv::Scalar(v, v, v), -1);
+            }
+        }
+        cv::rectangle(background_, cv::Rect(width_ / 10, height_ / 12, width_ / 8, height_ / 6), cv::Scalar(40, 40, 200), -1);
+        cv::rectangle(background_, cv::Rect(width_ * 7 / 10, height_ / 12, width_ / 6, height_ / 7), cv::Scalar(200, 60, 40), -1);
+    }
+
+    int Read(cv::Mat &frame)
+    {
+        if(index_ >= frame_num_)
+        {
+            return -1;
+        }
+        cv::Mat image = background_.clone();
+        /// @brief +-6 gray levels of noise, below the gate pixel_thresh.
+        for(int y=0;y<height_;++y)
+        {
+            uint8_t *row = image.data + (size_t)y * image.step;
+            for(int x=0;x<width_*3;++x)
+            {
+                noise_ ^= noise_ << 13;
+                noise_ ^= noise_ >> 17;
+                noise_ ^= noise_ << 5;
+                row[x] = (uint8_t)std::min(255, std::max(0, (int)row[x] + (int)(noise_ % 13) - 6));
+            }
+        }
+        /// @brief Walkers on the lower half, one left to right, one right to left.
+        const int64_t t = index_ % 600;
+        if(t >= 60 && t < 60 + (width_ + 100) / 6)
+        {
+            const int x = (int)((t - 60) * 6) - 100;
+            cv::rectangle(image, cv::Rect(x, height_ / 2, 100, 220), cv::Scalar(30, 200, 220), -1);
+        }
+        if(t >= 330 && t < 330 + (width_ + 80) / 5)
+        {
+            const int x = width_ - (int)((t - 330) * 5);
+            cv::rectangle(image, cv::Rect(x, height_ / 2 + 120, 80, 180), cv::Scalar(220, 40, 200), -1);
+        }
+        index_++;
+        frame = image;
+        return 0;
+    }
+
+private:
+    int width_;
+    int height_;
+    int64_t frame_num_;
+    int64_t index_;
+    uint32_t noise_;
+    cv::Mat background_;
+};
+
+/// @brief Stand-in detector, 4-connected blobs of saturated 8x8 cells(the cell center pixel
+///        decides), one class. Counts calls, pixels and time like an engine would cost them.
+class BlobDetector : public siran::IStreamDetector
+{
+public:
+    BlobDetector():
+        calls_(0),
+        pixels_(0),
+        time_ns_(0),
+        arena_(256)
+    {
+    }
+
+    int Detect(const cv::Mat &view, siran::DetectionSpan *detections)
+    {
+        const uint64_t start = siran::NowNs();
+        const int cell = 8;
+        const int cells_x = view.cols / cell;
+        const int cells_y = view.rows / cell;
+        marks_.assign((size_t)cells_x * cells_y, 0);
+        for(int cy=0;cy<cells_y;++cy)
+        {
+            const uint8_t *row = view.data + (size_t)(cy * cell + cell / 2) * view.step;
+            for(int cx=0;cx<cells_x;++cx)
+            {
+                const uint8_t *p = row + (cx * cell + cell / 2) * 3;
+                const int hi = std::max(p[0], std::max(p[1], p[2]));
+                const int lo = std::min(p[0], std::min(p[1], p[2]));
+                marks_[(size_t)cy * cells_x + cx] = hi - lo > 80 ? 1 : 0;
+            }
+        }
+        arena_.Reset();
+        for(int start_cell=0;start_cell<cells_x*cells_y;++start_cell)
+        {
+            if(marks_[start_cell] != 1)
+            {
+                continue;
+            }
+            int x_min = cells_x, y_min = cells_y, x_max = -1, y_max = -1, count = 0;
+            stack_.assign(1, start_cell);
+            marks_[start_cell] = 2;
+            while(!stack_.empty())
+            {
+                const int index = stack_.back();
+                stack_.pop_back();
+                const int cx = index % cells_x;
+                const int cy = index / cells_x;
+                x_min = std::min(x_min, cx);
+                x_max = std::max(x_max, cx);
+                y_min = std::min(y_min, cy);
+                y_max = std::max(y_max, cy);
+                count++;
+                const int next[4] = {cx > 0 ? index - 1 : -1, cx < cells_x - 1 ? index + 1 : -1,
+                                     cy > 0 ? index - cells_x : -1, cy < cells_y - 1 ? index + cells_x : -1};
+                for(int k=0;k<4;++k)
+                {
+                    if(next[k] >= 0 && 1 == marks_[next[k]])
+                    {
+                        marks_[next[k]] = 2;
+                        stack_.push_back(next[k]);
+                    }
+                }
+            }
+            if(count < 4)
+            {
+                continue;
+            }
+            siran::Detection det;
+            det.left = (float)(x_min * cell);
+            det.top = (float)(y_min * cell);
+            det.right = (float)((x_max + 1) * cell);
+            det.bottom = (float)((y_max + 1) * cell);
+            det.class_id = 0;
+            det.prob = 0.9f;
+            arena_.Push(det);
+        }
+        *detections = arena_.View();
+        calls_++;
+        pixels_ += (int64_t)view.cols * view.rows;
+        time_ns_ += siran::NowNs() - start;
+        return detections->Empty() ? -999 : 0;
+    }
+
+    int64_t calls_;
+    int64_t pixels_;
+    uint64_t time_ns_;
+
+private:
+    siran::DetectionArena arena_;
+    std::vector<uint8_t> marks_;
+    std::vector<int> stack_;
+};
+
+static float IoU(const siran::Detection &a, const siran::Detection &b)
+{
+    const float w = std::min(a.right, b.right) - std::max(a.left, b.left);
+    const float h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+    if(w <= 0.f || h <= 0.f)
+    {
+        return 0.f;
+    }
+    const float inter = w * h;
+    return inter / ((a.right - a.left) * (a.bottom - a.top) + (b.right - b.left) * (b.bottom - b.top) - inter);
+}
+
+/// @brief Boxes of a that have a same class box of b with IoU >= 0.5, greedy one to one.
+static int Matched(const std::vector<siran::Detection> &a, const std::vector<siran::Detection> &b)
+{
+    std::vector<uint8_t> used(b.size(), 0);
+    int matched = 0;
+    for(size_t i=0;i<a.size();++i)
+    {
+        for(size_t j=0;j<b.size();++j)
+        {
+            if(!used[j] && a[i].class_id == b[j].class_id && IoU(a[i], b[j]) >= 0.5f)
+            {
+                used[j] = 1;
+                matched++;
+                break;
+            }
+        }
+    }
+    return matched;
+}
+
+
+static void CheckDecisions()
+{
+    siran::MotionGateConfig config = siran::DefaultMotionGateConfig();
+    config.enable = true;
+    config.keyframe_interval = 10;
+    config.max_rois = 1;
+    siran::MotionGate gate(config);
+    siran::GateDecision decision;
+    cv::Mat still(720, 1280, CV_8UC3, cv::Scalar(100, 100, 100));
+
+    gate.Update(still, decision);
+    Check(siran::GATE_FULL == decision.action && !decision.keyframe, "first frame runs whole");
+    bool skipped = true;
+    for(int i=1;i<10;++i)
+    {
+        gate.Update(still, decision);
+        skipped = skipped && siran::GATE_SKIP == decision.action;
+    }
+    gate.Update(still, decision);
+    Check(skipped && siran::GATE_FULL == decision.action && decision.keyframe, "still frames skipped, keyframe every 10th");
+
+    cv::Mat moved = still.clone();
+    cv::rectangle(moved, cv::Rect(600, 300, 60, 120), cv::Scalar(30, 200, 220), -1);
+    gate.Update(moved, decision);
+    bool inside = 1 == decision.rois.size();
+    for(size_t i=0;i<decision.rois.size();++i)
+    {
+        const cv::Rect &r = decision.rois[i];
+        inside = inside && r.x <= 600 && r.y <= 300 && r.x + r.width >= 660 && r.y + r.height >= 420 &&
+                 r.width >= config.roi_min_w && r.height >= config.roi_min_h && r.x >= 0 && r.y >= 0 &&
+                 r.x + r.width <= 1280 && r.y + r.height <= 720;
+    }
+    Check(siran::GATE_ROI == decision.action && inside, "moving box gives one region around it, network input size");
+    gate.Update(moved, decision);
+    Check(siran::GATE_SKIP == decision.action, "the region frame became the reference");
+
+    cv::Mat apart = moved.clone();
+    cv::rectangle(apart, cv::Rect(20, 20, 60, 60), cv::Scalar(220, 40, 200), -1);
+    cv::rectangle(apart, cv::Rect(1200, 640, 60, 60), cv::Scalar(220, 40, 200), -1);
+    gate.Update(apart, decision);
+    Check(siran::GATE_FULL == decision.action && !decision.keyframe, "regions beyond max_rois run whole");
+
+    gate.Update(apart, decision);
+    gate.Invalidate();
+    gate.Update(apart, decision);
+    Check(siran::GATE_FULL == decision.action, "invalidated gate runs whole");
+
+    cv::Mat small(480, 640, CV_8UC3, cv::Scalar(100, 100, 100));
+    gate.Update(small, decision);
+    Check(siran::GATE_FULL == decision.action, "new frame size runs whole");
+    gate.Update(small, decision);
+    Check(siran::GATE_SKIP == decision.action, "still frame of the new size skipped");
+
+    const siran::GateStats stats = gate.GetStats();
+    Check(stats.frames == stats.full + stats.roi + stats.skipped && stats.keyframes == 1 && stats.roi == 1,
+          "gate counters add up");
+}
+
+
+typedef struct ClipRun_
+{
+    std::vector<std::vector<siran::Detection> > frames;
+    std::vector<uint8_t> seen;
+    siran::StreamStats stats;
+    int64_t calls;
+    int64_t pixels;
+    uint64_t time_ns;
+}ClipRun;
+
+static int RunClip(const std::string &clip, const int64_t &frame_num, const bool &gated, ClipRun &run)
+{
+    CorridorSource corridor(1280, 720, frame_num);
+    siran::VideoFileSource file(clip, -1.);
+    siran::IFrameSource *source = &corridor;
+    if(!clip.empty())
+    {
+        if(!file.IsOpened())
+        {
+            return -1;
+        }
+        source = &file;
+    }
+    BlobDetector detector;
+    siran::StreamConfig config = siran::DefaultStreamConfig();
+    config.gate.enable = gated;
+    siran::StreamPipeline stream(&detector, source, config);
+    run.frames.clear();
+    run.seen.clear();
+    stream.Start([&run](const siran::StreamResult &result) {
+        if(result.seq >= (int64_t)run.frames.size())
+        {
+            run.frames.resize(result.seq + 1);
+            run.seen.resize(result.seq + 1, 0);
+        }
+        run.frames[result.seq] = result.detections;
+        run.seen[result.seq] = 1;
+    });
+    stream.Wait();
+    run.stats = stream.GetStats();
+    run.calls = detector.calls_;
+    run.pixels = detector.pixels_;
+    run.time_ns = detector.time_ns_;
+    return 0;
+}
+
+
+static void CheckClip(const std::string &clip, const int64_t &frame_num, const double &min_recall)
+{
+    ClipRun full, gated;
+    if(RunClip(clip, frame_num, false, full) != 0 || RunClip(clip, frame_num, true, gated) != 0)
+    {
+        Check(false, "clip opened");
+        return;
+    }
+    /// @brief Frames dropped at the ring by either run are left out of the comparison.
+    int64_t compared = 0, reference = 0, detected = 0, recalled = 0, precise = 0;
+    for(size_t s=0;s<std::min(full.frames.size(), gated.frames.size());++s)
+    {
+        if(!full.seen[s] || !gated.seen[s])
+        {
+            continue;
+        }
+        compared++;
+        reference += full.frames[s].size();
+        detected += gated.frames[s].size();
+        recalled += Matched(full.frames[s], gated.frames[s]);
+        precise += Matched(gated.frames[s], full.frames[s]);
+    }
+    const double recall = reference > 0 ? (double)recalled / reference : 1.;
+    const double precision = detected > 0 ? (double)precise / detected : 1.;
+    const siran::StreamStats &stats = gated.stats;
+    printf("%s: %lld frames compared, gated %lld delivered, skipped %lld, regions %lld, keyframes %lld\n",
+           clip.empty() ? "generated corridor" : clip.c_str(), (long long)compared, (long long)stats.delivered,
+           (long long)stats.gate_skipped, (long long)stats.gate_roi, (long long)stats.gate_keyframes);
+    printf("detector calls %lld -> %lld, pixels %.1fM -> %.1fM, time %.1fms -> %.1fms\n",
+           (long long)full.calls, (long long)gated.calls, full.pixels * 1e-6, gated.pixels * 1e-6,
+           full.time_ns * 1e-6, gated.time_ns * 1e-6);
+    printf("gated against ungated boxes: recall %.3f, precision %.3f(%lld reference boxes)\n",
+           recall, precision, (long long)reference);
+    Check(compared > 0, "frames compared");
+    Check(recall >= min_recall && precision >= min_recall, "gated detections match ungated ones");
+    Check(full.stats.inferred == full.stats.delivered && gated.stats.inferred == gated.stats.delivered - stats.gate_skipped,
+          "inferred counts frames the detector ran on");
+    if(clip.empty())
+    {
+        Check(stats.gate_skipped > 0 && stats.gate_roi > 0 && stats.gate_keyframes > 0, "corridor skipped, region and keyframe frames");
+        Check(gated.pixels < full.pixels / 2, "gated detector pixels under half");
+    }
+}
+
+
+int main(int arv, char** arg)
+{
+    const std::string clip = arv > 1 && strcmp(arg[1], "-") != 0 ? arg[1] : "";
+    const int64_t frame_num = arv > 2 ? atoll(arg[2]) : 1200;
+    const double min_recall = arv > 3 ? atof(arg[3]) : 0.95;
+    CheckDecisions();
+    CheckClip(clip, frame_num, min_recall);
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     host_decode_bench.cpp
+*   Brief:    host decoder vs the original nested loop decode, 80/4/12 classes, returns 1 on a
+*             mismatch. use: ./Host_decode_bench [loops] [tensor file]
+*             the tensor file is a raw float dump of one 80-class frame output.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/host_decode.h"
+#include "inc/yolov7_simd.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "bench/bench_common.h"
+
+/// @brief The level/anchor/h/w loop YoloProcess used before the decode tables, the reference result.
+static int LegacyDecode(const float *fea_out, const siran::ModelDesc &desc, const float &g_thresh, siran::DecodeBox *boxes, const int &max_num)
+{
+    const int class_num = desc.num_classes;
+    int feat = 0;
+    int object_num = 0;
+    for (size_t stride_i = 0; stride_i < desc.strides.size(); stride_i++)
+    {
+        const int feat_w = desc.input_w / desc.strides[stride_i];
+        const int feat_h = desc.input_h / desc.strides[stride_i];
+        for (int ac_i = 0; ac_i < desc.num_anchors; ac_i++)
+        {
+            const float *anchor = &desc.anchors[(stride_i * desc.num_anchors + ac_i) * 2];
+            for (int h_i = 0; h_i < feat_h; h_i++)
+            {
+                for (int w_i = 0; w_i < feat_w; w_i++)
+                {
+                    float obj_conf = fea_out[4 + feat];
+                    if (obj_conf > g_thresh)
+                    {
+                        int max_class_index = 0;
+                        float max_class_conf = 0.f;
+                        for (int class_i = 0; class_i < class_num; ++class_i)
+                        {
+                            if (fea_out[5 + class_i + feat] > max_class_conf)
+                            {
+                                max_class_conf = fea_out[5 + class_i + feat];
+                                max_class_index = class_i;
+                            }
+                        }
+                        float conf = max_class_conf * obj_conf;
+                        if (conf > g_thresh && object_num < max_num)
+                        {
+                            float cx = (fea_out[0 + feat] * 2.f - 0.5f + (float)w_i) / feat_w;
+                            float cy = (fea_out[1 + feat] * 2.f - 0.5f + (float)h_i) / feat_h;
+                            float w  = pow(fea_out[2 + feat] * 2.f, 2) * anchor[0] / desc.input_w;
+                            float h  = pow(fea_out[3 + feat] * 2.f, 2) * anchor[1] / desc.input_h;
+                            siran::DecodeBox &box = boxes[object_num];
+                            box.left  = std::max(0.f, std::min(1.f, cx - w / 2));
+                            box.right = std::max(0.f, std::min(1.f, cx + w / 2));
+                            box.low   = std::max(0.f, std::min(1.f, cy - h / 2));
+                            box.high  = std::max(0.f, std::min(1.f, cy + h / 2));
+                            box.prob  = conf;
+                            box.id = max_class_index;
+                            ++object_num;
+                        }
+                    }
+                    feat += class_num + 5;
+                }
+            }
+        }
+    }
+    return object_num;
+}
+
+static bool LoadTensor(const char *path, const size_t &num, std::vector<float> &out)
+{
+    FILE *fp = fopen(path, "rb");
+    if (nullptr == fp)
+    {
+        return false;
+    }
+    out.resize(num);
+    const size_t n = fread(out.data(), sizeof(float), num, fp);
+    fclose(fp);
+    return n == num;
+}
+
+static bool SameBoxes(const siran::DecodeBox *a, const siran::DecodeBox *b, const int &n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        if (a[i].left != b[i].left || a[i].right != b[i].right || a[i].low != b[i].low || a[i].high != b[i].high ||
+            a[i].id != b[i].id || a[i].prob != b[i].prob)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Fn>
+static double TimeMs(const int &loops, Fn fn)
+{
+    fn();
+    auto time_start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loops; ++i)
+    {
+        fn();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count() / loops;
+}
+
+int main(int arv, char** arg)
+{
+    const int loops = arv > 1 ? atoi(arg[1]) : 100;
+    const char *tensor_file = arv > 2 ? arg[2] : nullptr;
+    const int class_nums[] = {80, 4, 12};
+    const int hit_nums[] = {50, 500, 5000};
+    const int max_num = siran::kMaxDecodeBoxes;
+    const int isa = DetectDecodeIsa();
+    std::vector<siran::DecodeBox> ref(max_num), boxes(max_num);
+    std::mt19937 rng(3);
+
+    printf("%7s %6s %6s %12s %12s %9s %6s\n", "classes", "hits", "cands", "nested ms", "decoder ms", "vs nested", "match");
+    int mismatch = 0;
+    for (size_t c=0;c<sizeof(class_nums)/sizeof(class_nums[0]);++c)
+    {
+        siran::ModelDesc desc = siran::DefaultModelDesc();
+        desc.num_classes = class_nums[c];
+        siran::IHostDecoder *decoder = siran::CreateHostDecoder(desc);
+        decoder->SetIsa(isa);
+        const int rows = siran::BuildDecodeBlocks(desc).back().row_end;
+        for (size_t h=0;h<sizeof(hit_nums)/sizeof(hit_nums[0]);++h)
+        {
+            std::vector<float> output;
+            const bool from_file = tensor_file && 80 == desc.num_classes && 0 == h;
+            if (!from_file || !LoadTensor(tensor_file, (size_t)rows * (desc.num_classes + 5), output))
+            {
+                MakeOutput(rows, desc.num_classes, hit_nums[h], rng, output);
+            }
+            const float thresh = desc.conf_thresh;
+            bool truncated = false;
+            int ref_num = 0, num = 0;
+            const double ref_ms = TimeMs(loops, [&]() { ref_num = LegacyDecode(output.data(), desc, thresh, ref.data(), max_num); });
+            const double ms = TimeMs(loops, [&]() { num = decoder->Decode(output.data(), thresh, boxes.data(), max_num, truncated); });
+            const bool match = num == ref_num && SameBoxes(ref.data(), boxes.data(), ref_num);
+            mismatch += match ? 0 : 1;
+            printf("%7d %6s %6d %12.4f %12.4f %8.1fx %6s\n", desc.num_classes,
+                   from_file ? "file" : std::to_string(hit_nums[h]).c_str(), ref_num, ref_ms, ms,
+                   ref_ms / ms, match ? "yes" : "NO");
+        }
+        delete decoder;
+    }
+    if (mismatch > 0)
+    {
+        printf("MISMATCH: %d case(s) differ from the nested loop decode\n", mismatch);
+        return 1;
+    }
+    return 0;
+}
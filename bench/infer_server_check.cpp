@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     infer_server_check.cpp
+*   Brief:    inference server checks on MockInferBackend, no GPU needed: a full queue rejects
+*             with -2 and is counted, max_queue_depth follows the queue, Stop finishes what is
+*             queued, and concurrent Run callers all complete with every instance used by one
+*             thread at a time. use: ./InferServer_check [threads] [runs per thread]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/infer_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+static siran::InferTask MakeTask(std::atomic<int> *done_num)
+{
+    siran::InferTask task;
+    task.payload = nullptr;
+    task.status = -100;
+    task.done = [done_num](siran::InferTask *) { (*done_num)++; };
+    return task;
+}
+
+
+/// @brief One slow instance and a queue of 2: the worker holds the first task, two more fill the queue.
+static void CheckBackpressure()
+{
+    siran::MockInferBackend backend(1, 300000);
+    siran::InferServer server(&backend, 2);
+    std::atomic<int> done_num(0);
+    std::vector<siran::InferTask> tasks(5, MakeTask(&done_num));
+    Check(-1 == server.Submit(&tasks[0]), "submit before Start: -1");
+    Check(0 == server.Start(), "server started");
+
+    int iret = server.Submit(&tasks[0]);
+    /// @brief Wait for the worker to take the first task off the queue.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while(server.QueueDepth() > 0 && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    iret |= server.Submit(&tasks[1]);
+    iret |= server.Submit(&tasks[2]);
+    Check(0 == iret && 2 == server.QueueDepth(), "three tasks accepted, two waiting");
+    Check(-2 == server.Submit(&tasks[3]), "full queue: Submit returns -2");
+    Check(-2 == server.SubmitWait(&tasks[4], 10), "full queue: SubmitWait times out with -2");
+
+    siran::ServerStats stats = server.GetStats();
+    Check(3 == stats.submitted && 2 == stats.rejected && 2 == stats.max_queue_depth,
+          "submitted 3, rejected 2, max queue depth 2");
+
+    server.Stop();
+    stats = server.GetStats();
+    Check(3 == stats.completed && 3 == done_num.load() && 0 == stats.queue_depth, "Stop finishes the queued tasks");
+    Check(0 == tasks[0].status && 0 == tasks[1].status && 0 == tasks[2].status && -100 == tasks[3].status,
+          "accepted tasks ran, the rejected one did not");
+    Check(-1 == server.Submit(&tasks[3]), "submit after Stop: -1");
+}
+
+
+static void CheckConcurrentRun(const int &thread_num, const int &run_num)
+{
+    const int instance_num = 4;
+    siran::MockInferBackend backend(instance_num, 200);
+    siran::InferServer server(&backend, 8);
+    Check(0 == server.Start(), "server started");
+
+    std::atomic<int> done_num(0);
+    std::atomic<int> ok_num(0);
+    std::vector<std::thread> callers;
+    for(int t=0;t<thread_num;++t)
+    {
+        callers.emplace_back([&]() {
+            siran::InferTask task = MakeTask(&done_num);
+            for(int i=0;i<run_num;++i)
+            {
+                ok_num += 0 == server.Run(&task) ? 1 : 0;
+            }
+        });
+    }
+    for(size_t i=0;i<callers.size();++i)
+    {
+        callers[i].join();
+    }
+    const siran::ServerStats stats = server.GetStats();
+    server.Stop();
+
+    const int64_t total = (int64_t)thread_num * run_num;
+    const std::vector<int64_t> runs = backend.InstanceRuns();
+    const int64_t backend_runs = std::accumulate(runs.begin(), runs.end(), (int64_t)0);
+    printf("%d callers x %d runs: completed %lld, max queue depth %d, max concurrent instances %d\n", thread_num,
+           run_num, (long long)stats.completed, stats.max_queue_depth, backend.MaxConcurrent());
+    Check(total == ok_num.load() && total == done_num.load(), "every Run returned 0 and called its done");
+    Check(total == stats.submitted && total == stats.completed && 0 == stats.rejected && backend_runs == total,
+          "server and backend counters agree");
+    Check(stats.max_queue_depth <= 8 && backend.MaxConcurrent() <= instance_num, "queue and instances stay in bounds");
+    Check(0 == backend.Overlaps(), "an instance is used by one worker at a time");
+}
+
+
+int main(int arv, char** arg)
+{
+    const int thread_num = arv > 1 ? atoi(arg[1]) : 16;
+    const int run_num = arv > 2 ? atoi(arg[2]) : 200;
+    CheckBackpressure();
+    CheckConcurrentRun(thread_num, run_num);
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     ingest_bench.cpp
+*   Brief:    batch ingest throughput, no GPU or engine needed. Directory listing on 1 vs N
+*             threads, then sequential imread + detect against the decode pool with and
+*             without reduced JPEG decode, detect is a fixed cost stand-in.
+*             use: ./Ingest_bench folder [decode threads] [prefetch] [infer ms]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/ingest.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <thread>
+
+/// @brief Stand-in detector, sleeps infer_ms per image and reports one box at the center.
+class SleepDetector : public siran::IStreamDetector
+{
+public:
+    explicit SleepDetector(const double &infer_ms):
+        infer_ms_(infer_ms),
+        arena_(4)
+    {
+    }
+
+    int Detect(const cv::Mat &view, siran::DetectionSpan *detections)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(infer_ms_ * 1000)));
+        arena_.Reset();
+        siran::Detection det;
+        det.left = view.cols * 0.25f;
+        det.top = view.rows * 0.25f;
+        det.right = view.cols * 0.75f;
+        det.bottom = view.rows * 0.75f;
+        det.class_id = 0;
+        det.prob = 0.9f;
+        arena_.Push(det);
+        *detections = arena_.View();
+        return 0;
+    }
+
+private:
+    double infer_ms_;
+    siran::DetectionArena arena_;
+};
+
+/// @brief Counts results and checks every file arrives once with boxes in file pixels.
+class CheckSink : public siran::IResultSink
+{
+public:
+    CheckSink():
+        boxes_ok_(true)
+    {
+    }
+
+    int Write(const siran::IngestItem &item, const int &status, const siran::DetectionSpan &detections)
+    {
+        indices_.insert(item.index);
+        if(0 == status && detections.Count() == 1)
+        {
+            /// @brief The stand-in box spans the middle half of the image it was given.
+            const siran::Detection &det = detections[0];
+            boxes_ok_ = boxes_ok_ && fabs(det.right - det.left - item.src_w * 0.5f) <= item.reduce &&
+                        fabs(det.bottom - det.top - item.src_h * 0.5f) <= item.reduce;
+        }
+        return 0;
+    }
+
+    int Flush()
+    {
+        return 0;
+    }
+
+    std::set<int64_t> indices_;
+    bool boxes_ok_;
+};
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int RunPool(const char *name, const std::vector<std::string> &files, const siran::IngestConfig &config,
+                    const double &infer_ms)
+{
+    SleepDetector detector(infer_ms);
+    std::vector<siran::IStreamDetector*> detectors(1, &detector);
+    CheckSink sink;
+    siran::ImageIngest ingest(files, config);
+    const auto time_start = std::chrono::steady_clock::now();
+    siran::RunIngest(ingest, detectors, &sink);
+    const double ms = ElapsedMs(time_start);
+    const siran::IngestStats stats = ingest.GetStats();
+    printf("%-22s %9.1fms %8.1f img/s  decode %7.2fms/img  wait %8.1fms  %lld reduced  %lld failed  %s\n", name, ms,
+           files.size() * 1000. / ms, stats.decode_ms / std::max<int64_t>(1, stats.files), stats.wait_ms,
+           (long long)stats.reduced, (long long)stats.failed,
+           sink.indices_.size() == files.size() && sink.boxes_ok_ ? "ok" : "MISMATCH");
+    return sink.indices_.size() == files.size() && sink.boxes_ok_ ? 0 : 1;
+}
+
+int main(int arv, char** arg)
+{
+    if(arv < 2)
+    {
+        printf("use: ./Ingest_bench folder [decode threads] [prefetch] [infer ms]\n");
+        return -1;
+    }
+    siran::IngestConfig config = siran::DefaultIngestConfig();
+    config.decode_threads = arv > 2 ? atoi(arg[2]) : config.decode_threads;
+    config.prefetch = arv > 3 ? atoi(arg[3]) : config.prefetch;
+    const double infer_ms = arv > 4 ? atof(arg[4]) : 5.;
+
+    std::vector<std::string> files, single;
+    auto time_start = std::chrono::steady_clock::now();
+    siran::ListFiles(arg[1], config.extensions, 1, single);
+    const double single_ms = ElapsedMs(time_start);
+    time_start = std::chrono::steady_clock::now();
+    if(siran::ListFiles(arg[1], config.extensions, config.list_threads, files) != 0)
+    {
+        printf("%s is not a readable folder\n", arg[1]);
+        return -1;
+    }
+    const double list_ms = ElapsedMs(time_start);
+    printf("%zu images, list 1 thread %.1fms, %d threads %.1fms, %s\n", files.size(), single_ms, config.list_threads,
+           list_ms, files == single ? "same sorted list" : "LISTS DIFFER");
+    int mismatch = files == single ? 0 : 1;
+    if(files.empty())
+    {
+        return mismatch;
+    }
+
+    /// @brief Old Test_app loop, full size imread then detect on one thread.
+    SleepDetector detector(infer_ms);
+    time_start = std::chrono::steady_clock::now();
+    double decode_ms = 0.;
+    for(size_t i=0;i<files.size();++i)
+    {
+        const auto decode_start = std::chrono::steady_clock::now();
+        cv::Mat image = cv::imread(files[i], cv::IMREAD_COLOR);
+        decode_ms += ElapsedMs(decode_start);
+        siran::DetectionSpan detections;
+        if(!image.empty())
+        {
+            detector.Detect(image, &detections);
+        }
+    }
+    const double sequential_ms = ElapsedMs(time_start);
+    printf("%-22s %9.1fms %8.1f img/s  decode %7.2fms/img\n", "sequential imread", sequential_ms,
+           files.size() * 1000. / sequential_ms, decode_ms / files.size());
+
+    siran::IngestConfig full = config;
+    full.target_w = 0;
+    mismatch += RunPool("pool full size", files, full, infer_ms);
+    mismatch += RunPool("pool reduced decode", files, config, infer_ms);
+    config.keep_order = false;
+    mismatch += RunPool("pool reduced unordered", files, config, infer_ms);
+    return mismatch > 0 ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     int8_compare.cpp
+*   Brief:    INT8 vs FP16 on a labeled set. Builds both engines through the engine cache, INT8
+*             calibrated on calib_dir(calibration cache reused), then precision/recall against
+*             yolo txt labels, INT8/FP16 agreement and latency of each engine.
+*             use: ./Int8_compare model.onnx calib_dir eval_dir [entropy|minmax] [calib batches] [device id]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/calibrator.h"
+#include "inc/det_eval.h"
+#include "inc/engine_cache.h"
+#include "inc/model_desc.h"
+#include "inc/utils.h"
+#include "inc/yolov7_trt.h"
+#include <NvInfer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+/// @brief Image files of a directory tree, sorted so calibration ids are stable.
+static std::vector<std::string> ImageFiles(const std::string &dir)
+{
+    std::vector<std::string> files, images;
+    GetFilePath(dir.c_str(), files);
+    for(size_t i=0;i<files.size();++i)
+    {
+        std::string ext = files[i].substr(files[i].find_last_of('.') + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if(ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp")
+        {
+            images.push_back(files[i]);
+        }
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+}
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int arv, char** arg)
+{
+    if(arv < 4)
+    {
+        printf("use: ./Int8_compare model.onnx calib_dir eval_dir [entropy|minmax] [calib batches] [device id]\n");
+        return -1;
+    }
+    const std::string onnx_file = arg[1];
+    const int algorithm = arv > 4 && std::string(arg[4]) == "minmax" ? siran::CALIB_MINMAX : siran::CALIB_ENTROPY;
+    const int device_id = arv > 6 ? atoi(arg[6]) : 0;
+
+    siran::ModelDesc desc;
+    if(siran::LoadModelDesc(siran::ModelDescPath(onnx_file), desc) != 0)
+    {
+        desc = siran::DefaultModelDesc();
+    }
+    siran::CalibrationConfig calib_config = siran::DefaultCalibrationConfig();
+    calib_config.input_w = desc.input_w;
+    calib_config.input_h = desc.input_h;
+    calib_config.max_batches = arv > 5 ? atoi(arg[5]) : calib_config.max_batches;
+    const std::vector<std::string> calib_images = ImageFiles(arg[2]);
+    const std::vector<std::string> eval_images = ImageFiles(arg[3]);
+    printf("%zu calibration images, %zu evaluation images, %s calibration\n", calib_images.size(), eval_images.size(),
+           siran::CalibrationAlgorithmName(algorithm));
+
+    /// @brief Engines and the calibration cache live in the engine cache next to the model.
+    siran::TrtEngineBuilder builder(device_id);
+    siran::EngineCacheConfig cache_config = siran::DefaultEngineCacheConfig();
+    const size_t slash = onnx_file.find_last_of('/');
+    cache_config.cache_dir = (slash == std::string::npos ? std::string(".") : onnx_file.substr(0, slash)) + "/engine_cache";
+    siran::EngineCache cache(&builder, cache_config);
+
+    siran::EngineBuildConfig fp16_build = siran::DefaultEngineBuildConfig();
+    fp16_build.onnx_file = onnx_file;
+    siran::EngineBuildConfig int8_build = fp16_build;
+    int8_build.precision = siran::PRECISION_INT8;
+    int8_build.calibration_id = siran::CalibrationId(calib_images, algorithm, calib_config);
+
+    siran::ImageListSource calib_source(calib_images, 0., false);
+    siran::CalibrationBatchStream calib_stream(&calib_source, calib_config);
+    const std::string calib_cache = cache_config.cache_dir + "/" + int8_build.calibration_id + ".calib";
+    nvinfer1::IInt8Calibrator *calibrator = siran::CreateInt8Calibrator(&calib_stream, calib_cache, algorithm);
+    int8_build.calibrator = calibrator;
+
+    std::string fp16_file, int8_file;
+    int iret = cache.GetEngine(fp16_build, fp16_file);
+    if(iret == 0)
+    {
+        iret = cache.GetEngine(int8_build, int8_file);
+    }
+    calib_stream.Stop();
+    delete calibrator;
+    if(iret != 0)
+    {
+        printf("engine build failed, code %d\n", iret);
+        return 1;
+    }
+
+    siran::Yolov7Trt fp16_trt(fp16_file, device_id);
+    siran::Yolov7Trt int8_trt(int8_file, device_id);
+    if(fp16_trt.InitStatus() != 0 || int8_trt.InitStatus() != 0)
+    {
+        printf("engine not ready, fp16 code %d, int8 code %d\n", fp16_trt.InitStatus(), int8_trt.InitStatus());
+        return 1;
+    }
+    siran::MatchStats fp16_stats = siran::EmptyMatchStats();
+    siran::MatchStats int8_stats = siran::EmptyMatchStats();
+    siran::MatchStats agreement = siran::EmptyMatchStats();
+    double fp16_ms = 0., int8_ms = 0.;
+    int frames = 0, labeled = 0;
+    std::vector<siran::Detection> truths;
+    for(size_t i=0;i<eval_images.size();++i)
+    {
+        cv::Mat image = cv::imread(eval_images[i], cv::IMREAD_COLOR);
+        if(image.empty())
+        {
+            continue;
+        }
+        siran::DetectionSpan fp16_dets, int8_dets;
+        auto time_start = std::chrono::steady_clock::now();
+        fp16_trt.Yolov7Detect(image, &fp16_dets);
+        fp16_ms += ElapsedMs(time_start);
+        time_start = std::chrono::steady_clock::now();
+        int8_trt.Yolov7Detect(image, &int8_dets);
+        int8_ms += ElapsedMs(time_start);
+        frames++;
+
+        /// @brief INT8 against FP16 as reference, how much quantization changes the output.
+        siran::MatchDetections(int8_dets.Data(), int8_dets.Count(), fp16_dets.Data(), fp16_dets.Count(), 0.5f, agreement);
+        if(siran::LoadYoloLabels(siran::YoloLabelPath(eval_images[i]), image.cols, image.rows, truths) != 0)
+        {
+            continue;
+        }
+        labeled++;
+        siran::MatchDetections(fp16_dets.Data(), fp16_dets.Count(), truths.data(), truths.size(), 0.5f, fp16_stats);
+        siran::MatchDetections(int8_dets.Data(), int8_dets.Count(), truths.data(), truths.size(), 0.5f, int8_stats);
+    }
+    if(0 == frames)
+    {
+        printf("no readable evaluation image\n");
+        return 1;
+    }
+
+    printf("%d frames, %d labeled, IoU 0.5\n", frames, labeled);
+    printf("fp16  precision %.4f  recall %.4f  mean IoU %.3f  %.2fms/frame\n",
+           siran::Precision(fp16_stats), siran::Recall(fp16_stats), siran::MeanIou(fp16_stats), fp16_ms / frames);
+    printf("int8  precision %.4f  recall %.4f  mean IoU %.3f  %.2fms/frame\n",
+           siran::Precision(int8_stats), siran::Recall(int8_stats), siran::MeanIou(int8_stats), int8_ms / frames);
+    printf("int8 vs fp16: %lld matched, %lld extra, %lld missing, mean IoU %.3f\n", (long long)agreement.tp,
+           (long long)agreement.fp, (long long)agreement.fn, siran::MeanIou(agreement));
+    return 0;
+}
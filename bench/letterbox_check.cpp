@@ -0,0 +1,81 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     letterbox_check.cpp
+*   Brief:    letterbox checks against the cv::resize reference StaticResize: the coefficient
+*             tables(LetterboxRef, shared with the cuda kernel) and CpuLetterbox must be bit-exact,
+*             including exact 2x downscales, where cv::resize takes its INTER_AREA path, odd sizes
+*             and upscales. use: ./Letterbox_check [thread_num]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/preprocess.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+static int CountMismatch(const std::vector<float> &a, const std::vector<float> &b)
+{
+    int mismatch = 0;
+    for(size_t i=0;i<a.size();++i)
+    {
+        mismatch += a[i] == b[i] ? 0 : 1;
+    }
+    return mismatch;
+}
+
+
+int main(int arv, char** arg)
+{
+    const int thread_num = arv > 1 ? atoi(arg[1]) : 0;
+    const int dst_w = 640;
+    const int dst_h = 640;
+    /// @brief 2x: 1280x720 and 1280x1280, 4x: 2560x1440, odd, identity and upscales.
+    const int sizes[10][2] = {{1280, 720}, {1280, 1280}, {1920, 1080}, {3840, 2160}, {2560, 1440},
+                              {1281, 719}, {641, 363}, {640, 480}, {800, 600}, {320, 240}};
+
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> pixel(0, 255);
+    siran::CpuLetterbox letterbox(dst_w, dst_h, thread_num);
+    std::vector<float> ref(3 * dst_w * dst_h);
+    std::vector<float> table_out(ref.size());
+    std::vector<float> cpu_out(ref.size());
+    for(int i=0;i<10;++i)
+    {
+        const int src_w = sizes[i][0];
+        const int src_h = sizes[i][1];
+        /// @brief Padded row step, as a cropped or aligned cv::Mat has.
+        const size_t step = src_w * 3 + 64;
+        std::vector<uint8_t> src(step * src_h);
+        for(size_t j=0;j<src.size();++j)
+        {
+            src[j] = (uint8_t)pixel(rng);
+        }
+        siran::LetterboxTable table;
+        siran::BuildLetterboxTable(src_w, src_h, dst_w, dst_h, table);
+        int iret = siran::StaticResize(src.data(), step, src_w, src_h, ref.data(), dst_w, dst_h);
+        iret |= siran::LetterboxRef(src.data(), step, table, table_out.data(), dst_w, dst_h);
+        iret |= letterbox.Run(src.data(), step, src_w, src_h, cpu_out.data());
+
+        char what[96];
+        const int table_mismatch = CountMismatch(ref, table_out);
+        snprintf(what, sizeof(what), "%dx%d -> %dx%d tables bit-exact with cv::resize(%d mismatches)",
+                 src_w, src_h, table.unpad_w, table.unpad_h, table_mismatch);
+        Check(0 == iret && 0 == table_mismatch, what);
+        const int cpu_mismatch = CountMismatch(table_out, cpu_out);
+        snprintf(what, sizeof(what), "%dx%d CpuLetterbox bit-exact with LetterboxRef(%d mismatches)",
+                 src_w, src_h, cpu_mismatch);
+        Check(0 == cpu_mismatch, what);
+    }
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
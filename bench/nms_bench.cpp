@@ -0,0 +1,131 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     nms_bench.cpp
+*   Brief:    NMS engine vs all-pairs NMS, 100 ~ 20k candidates, a kept set that differs from
+*             the all-pairs reference returns non-zero. use: ./Nms_bench [loops]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/yolov7.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+/// @brief The sort and all-pairs sweep Yolov7::NMS used before NmsEngine, the reference result.
+static void NmsAllPairs(const object_t *objects, const int &object_num, const float &thresh, int *valid_)
+{
+    std::vector<int> idx(object_num);
+    std::iota(idx.begin(), idx.end(), 0);
+    std::stable_sort(idx.begin(), idx.end(), [objects](int i1, int i2) { return objects[i1].prob > objects[i2].prob; });
+    for (int i_sort = 0; i_sort < object_num; ++i_sort)
+    {
+        int i = idx[i_sort];
+        if (!valid_[i])
+        {
+            continue;
+        }
+        const object_t &obj1 = objects[i];
+        float a1 = (obj1.right - obj1.left) * (obj1.high - obj1.low);
+        for (int j_sort = i_sort + 1; j_sort < object_num; ++j_sort)
+        {
+            int j = idx[j_sort];
+            if (!valid_[j] || objects[j].id != obj1.id)
+            {
+                continue;
+            }
+            const object_t &obj2 = objects[j];
+            float a2 = (obj2.right - obj2.left) * (obj2.high - obj2.low);
+            float left = std::max(obj1.left, obj2.left);
+            float low = std::max(obj1.low, obj2.low);
+            float right = std::min(obj1.right, obj2.right);
+            float high = std::min(obj1.high, obj2.high);
+            float sa = std::max(0.f, right - left) * std::max(0.f, high - low);
+            if (sa / (a1 + a2 - sa) > thresh)
+            {
+                valid_[j] = 0;
+            }
+        }
+    }
+}
+
+/// @brief Crowded scene, boxes jittered around a few hundred objects, normalized coordinates.
+static void MakeCandidates(const int &num, const int &class_num, std::mt19937 &rng, std::vector<object_t> &objects)
+{
+    std::uniform_real_distribution<float> uni(0.f, 1.f);
+    std::normal_distribution<float> jitter(0.f, 0.01f);
+    const int centers = std::max(1, num / 20);
+    std::vector<float> cx(centers), cy(centers), w(centers), h(centers);
+    std::vector<int> cls(centers);
+    for (int i = 0; i < centers; ++i)
+    {
+        cx[i] = uni(rng);
+        cy[i] = uni(rng);
+        w[i] = 0.01f + 0.1f * uni(rng);
+        h[i] = 0.02f + 0.2f * uni(rng);
+        cls[i] = rng() % class_num;
+    }
+    objects.resize(num);
+    for (int i = 0; i < num; ++i)
+    {
+        const int c = rng() % centers;
+        const float x = cx[c] + jitter(rng);
+        const float y = cy[c] + jitter(rng);
+        const float bw = w[c] * (1.f + 5.f * jitter(rng));
+        const float bh = h[c] * (1.f + 5.f * jitter(rng));
+        object_t &obj = objects[i];
+        obj.left  = std::max(0.f, std::min(1.f, x - bw / 2));
+        obj.right = std::max(0.f, std::min(1.f, x + bw / 2));
+        obj.low   = std::max(0.f, std::min(1.f, y - bh / 2));
+        obj.high  = std::max(0.f, std::min(1.f, y + bh / 2));
+        obj.prob  = 0.25f + 0.75f * uni(rng);
+        obj.id    = cls[c];
+    }
+}
+
+int main(int arv, char** arg)
+{
+    const int loops = arv > 1 ? atoi(arg[1]) : 20;
+    const int counts[] = {100, 500, 1000, 2000, 5000, 10000, 20000};
+    const float thresh = siran::DefaultModelDesc().nms_thresh;
+    std::mt19937 rng(7);
+    siran::NmsEngine engine;
+    int mismatch = 0;
+
+    printf("%8s %14s %14s %8s %8s\n", "boxes", "all-pairs ms", "engine ms", "speedup", "match");
+    for (size_t c=0;c<sizeof(counts)/sizeof(counts[0]);++c)
+    {
+        const int num = counts[c];
+        std::vector<object_t> objects;
+        MakeCandidates(num, 4, rng, objects);
+        std::vector<int> ref(num), valid(num);
+
+        const int ref_loops = num > 5000 ? 1 : loops;
+        auto time_start = std::chrono::steady_clock::now();
+        for (int i=0;i<ref_loops;++i)
+        {
+            std::fill(ref.begin(), ref.end(), 1);
+            NmsAllPairs(objects.data(), num, thresh, ref.data());
+        }
+        const double ref_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count() / ref_loops;
+
+        time_start = std::chrono::steady_clock::now();
+        for (int i=0;i<loops;++i)
+        {
+            std::fill(valid.begin(), valid.end(), 1);
+            engine.Run(objects.data(), num, thresh, valid.data());
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count() / loops;
+
+        const bool match = (ref == valid);
+        mismatch += match ? 0 : 1;
+        printf("%8d %14.3f %14.3f %7.1fx %8s\n", num, ref_ms, ms, ref_ms / ms, match ? "yes" : "NO");
+    }
+    if(mismatch > 0)
+    {
+        printf("%d size(s) differ from the all-pairs reference\n", mismatch);
+    }
+    return mismatch == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     pipeline_check.cpp
+*   Brief:    stage pipeline scheduler checks on SimStageExecutor, no GPU needed: every frame
+*             runs every stage once and in order, a slot is not reused before its frame left
+*             the last stage, stages of different frames overlap and the makespan is bound by
+*             the slowest stage instead of the sum of stages. use: ./Pipeline_check [frames]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+/// @brief SimStageExecutor with the launch order and slots recorded, fail_frame fails its stage 1.
+class RecordingExecutor : public siran::IStageExecutor
+{
+public:
+    RecordingExecutor(const std::vector<double> &stage_cost, const int64_t &fail_frame = -1):
+        sim_(stage_cost),
+        fail_frame_(fail_frame)
+    {
+    }
+
+    int Launch(const int &stage, const int &slot, const int64_t &frame_id)
+    {
+        Record record = {frame_id, stage, slot};
+        launches_.push_back(record);
+        const int iret = sim_.Launch(stage, slot, frame_id);
+        return frame_id == fail_frame_ && 1 == stage ? -1 : iret;
+    }
+
+    typedef struct Record_
+    {
+        int64_t frame_id;
+        int stage;
+        int slot;
+    }Record;
+
+    siran::SimStageExecutor sim_;
+    std::vector<Record> launches_;
+
+private:
+    int64_t fail_frame_;
+};
+
+
+static void CheckOrder(const int &frames)
+{
+    const std::vector<double> cost = {2.0, 5.0, 1.0, 3.0};
+    RecordingExecutor executor(cost);
+    siran::PipelineScheduler scheduler(&executor, siran::STAGE_NUM);
+    int iret = 0;
+    for(int f=0;f<frames;++f)
+    {
+        iret |= scheduler.Push(f);
+        if(scheduler.InFlight() > siran::STAGE_NUM)
+        {
+            iret = -100;
+        }
+    }
+    iret |= scheduler.Flush();
+    Check(0 == iret && 0 == scheduler.InFlight(), "push and flush succeed, at most STAGE_NUM frames in flight");
+
+    /// @brief Launch order: stages of a frame in order, each once, slot reuse after the last stage.
+    std::vector<int> next_stage(frames, 0);
+    std::vector<int64_t> slot_owner(siran::STAGE_NUM, -1);
+    bool ordered = true;
+    bool slot_safe = true;
+    for(size_t i=0;i<executor.launches_.size();++i)
+    {
+        const RecordingExecutor::Record &r = executor.launches_[i];
+        ordered = ordered && r.stage == next_stage[r.frame_id] && r.slot == (int)(r.frame_id % siran::STAGE_NUM);
+        next_stage[r.frame_id]++;
+        if(0 == r.stage)
+        {
+            slot_safe = slot_safe && (slot_owner[r.slot] < 0 || next_stage[slot_owner[r.slot]] == siran::STAGE_NUM);
+            slot_owner[r.slot] = r.frame_id;
+        }
+    }
+    bool complete = true;
+    for(int f=0;f<frames;++f)
+    {
+        complete = complete && siran::STAGE_NUM == next_stage[f];
+    }
+    Check(ordered && complete, "every frame runs every stage once, in stage order");
+    Check(slot_safe, "a slot is reused only after its frame left the last stage");
+
+    /// @brief Timeline: a stage waits for the frame's previous stage, a resource runs one job at a time.
+    const std::vector<siran::StageSpan> &timeline = executor.sim_.Timeline();
+    std::vector<std::vector<double> > ends(frames, std::vector<double>(siran::STAGE_NUM, 0.0));
+    std::vector<double> resource_free(siran::STAGE_NUM, 0.0);
+    bool causal = true;
+    bool serial = true;
+    bool overlap = false;
+    for(size_t i=0;i<timeline.size();++i)
+    {
+        const siran::StageSpan &span = timeline[i];
+        causal = causal && (0 == span.stage || span.start >= ends[span.frame_id][span.stage - 1]);
+        serial = serial && span.start >= resource_free[span.stage];
+        resource_free[span.stage] = span.end;
+        ends[span.frame_id][span.stage] = span.end;
+        for(size_t j=0;j<i && !overlap;++j)
+        {
+            const siran::StageSpan &other = timeline[j];
+            overlap = other.frame_id != span.frame_id && other.stage != span.stage &&
+                      other.start < span.end && span.start < other.end;
+        }
+    }
+    Check(causal && serial, "stages wait for their frame and their resource");
+    Check(overlap, "stages of different frames overlap");
+
+    const double serial_time = frames * std::accumulate(cost.begin(), cost.end(), 0.0);
+    const double bound = std::accumulate(cost.begin(), cost.end(), 0.0) + (frames - 1) * *std::max_element(cost.begin(), cost.end());
+    printf("%d frames: serial %.1f, pipelined %.1f, slowest stage bound %.1f\n", frames, serial_time,
+           executor.sim_.Makespan(), bound);
+    Check(executor.sim_.Makespan() <= bound + 1e-9, "makespan bound by the slowest stage");
+}
+
+
+static void CheckFailure()
+{
+    RecordingExecutor executor(std::vector<double>(siran::STAGE_NUM, 1.0), 2);
+    siran::PipelineScheduler scheduler(&executor, siran::STAGE_NUM);
+    int iret = 0;
+    for(int f=0;f<6;++f)
+    {
+        const int ret = scheduler.Push(f);
+        iret = iret != 0 ? iret : ret;
+    }
+    const int flushed = scheduler.Flush();
+    Check(-1 == iret && 0 == flushed && 0 == scheduler.InFlight() && executor.launches_.size() == 6 * siran::STAGE_NUM,
+          "a failed launch is returned once and the frames still drain");
+}
+
+
+int main(int arv, char** arg)
+{
+    const int frames = arv > 1 ? atoi(arg[1]) : 100;
+    CheckOrder(frames);
+    CheckFailure();
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     pool_check.cpp
+*   Brief:    buffer pool checks on a host allocator, no GPU needed: size buckets, reuse across
+*             varying request sizes, the cached memory cap and release of everything on
+*             destruction. use: ./Pool_check [frames]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/buffer_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <vector>
+
+static int g_failed = 0;
+static int64_t g_live = 0;
+static int64_t g_live_bytes = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+/// @brief Host allocator, a size header in front of every buffer keeps the live byte count.
+static void* HostAlloc(const size_t &bytes, const int &kind)
+{
+    size_t *ptr = (size_t*)malloc(bytes + sizeof(size_t));
+    if(nullptr == ptr)
+    {
+        return nullptr;
+    }
+    ptr[0] = bytes;
+    g_live++;
+    g_live_bytes += bytes;
+    return ptr + 1;
+}
+
+static void HostFree(void *ptr, const int &kind)
+{
+    size_t *base = (size_t*)ptr - 1;
+    g_live--;
+    g_live_bytes -= base[0];
+    free(base);
+}
+
+
+static void CheckBuckets()
+{
+    bool bounded = true;
+    bool monotonic = true;
+    size_t last = 0;
+    for(size_t bytes=1;bytes<(1u << 24);bytes=bytes*9/8+1)
+    {
+        const size_t bucket = siran::BufferPoolBucket(bytes);
+        bounded = bounded && bucket >= bytes && (bytes <= 256 || bucket * 4 <= bytes * 5);
+        monotonic = monotonic && bucket >= last;
+        last = bucket;
+    }
+    Check(bounded, "bucket covers the request, at most 25% over it");
+    Check(monotonic && siran::BufferPoolBucket(1 << 20) == (1u << 20), "buckets monotonic, powers of two exact");
+}
+
+
+/// @brief Letterbox staging of camera frames of varying sizes, as Yolov7Trt::AcquireMat does.
+static void CheckVaryingSizes(const int &frames)
+{
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> width(1200, 1920);
+    std::uniform_int_distribution<int> height(700, 1080);
+    const size_t cap = (size_t)64 << 20;
+    {
+        siran::BufferPool pool(HostAlloc, HostFree, cap);
+        int64_t max_cached = 0;
+        for(int f=0;f<frames;++f)
+        {
+            void *input = pool.Acquire((size_t)width(rng) * height(rng) * 3, siran::MEM_DEVICE);
+            void *output = pool.Acquire(25200 * 85 * sizeof(float), siran::MEM_PINNED);
+            pool.Release(input);
+            pool.Release(output);
+            max_cached = std::max(max_cached, pool.GetStats().bytes_cached);
+        }
+        const siran::PoolStats stats = pool.GetStats();
+        printf("%d frames: %lld allocations, %lld hits, %lld misses, %.1fMB cached\n", frames,
+               (long long)stats.allocations, (long long)stats.hits, (long long)stats.misses, stats.bytes_cached / 1048576.0);
+        Check(stats.allocations <= 8, "varying frame sizes share a few buckets");
+        Check(max_cached <= (int64_t)cap && g_live_bytes <= (int64_t)cap, "cached memory stays under the cap");
+    }
+    Check(0 == g_live && 0 == g_live_bytes, "destruction frees every buffer");
+}
+
+
+static void CheckCap()
+{
+    const size_t cap = (size_t)4 << 20;
+    {
+        siran::BufferPool pool(HostAlloc, HostFree, cap);
+        std::vector<void*> buffers;
+        for(int i=0;i<8;++i)
+        {
+            buffers.push_back(pool.Acquire((size_t)1 << 20, siran::MEM_DEVICE));
+        }
+        void *large = pool.Acquire((size_t)8 << 20, siran::MEM_DEVICE);
+        for(size_t i=0;i<buffers.size();++i)
+        {
+            pool.Release(buffers[i]);
+        }
+        const siran::PoolStats before = pool.GetStats();
+        pool.Release(large);
+        const siran::PoolStats after = pool.GetStats();
+        Check(before.bytes_cached == (int64_t)cap && before.frees == 4, "releases beyond the cap are freed");
+        Check(after.bytes_cached == (int64_t)cap && after.frees == 5, "a buffer larger than the cap is freed first");
+        Check(before.bytes_in_use == (8 << 20) && 0 == after.bytes_in_use, "in use counters follow acquire/release");
+        pool.Trim();
+        Check(0 == pool.GetStats().bytes_cached && 0 == g_live, "trim frees the cache");
+    }
+    Check(0 == g_live, "destruction frees every buffer");
+}
+
+
+int main(int arv, char** arg)
+{
+    const int frames = arv > 1 ? atoi(arg[1]) : 2000;
+    CheckBuckets();
+    CheckVaryingSizes(frames);
+    CheckCap();
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
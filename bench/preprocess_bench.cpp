@@ -0,0 +1,61 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     preprocess_bench.cpp
+*   Brief:    cpu preprocessing throughput, the output is compared with LetterboxRef and the
+*             cv::resize reference StaticResize first and a mismatch returns non-zero.
+*             use: ./Preprocess_bench [thread_num] [loops]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/preprocess.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+int main(int arv, char** arg)
+{
+    const int thread_num = arv > 1 ? atoi(arg[1]) : 0;
+    const int loops = arv > 2 ? atoi(arg[2]) : 200;
+    const int sizes[3][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    const char *names[3] = {"720p", "1080p", "4K"};
+
+    siran::CpuLetterbox letterbox(640, 640, thread_num);
+    std::vector<float> dst(3 * 640 * 640);
+    std::vector<float> ref(dst.size());
+    std::vector<float> cv_ref(dst.size());
+    int mismatch_sizes = 0;
+    for(int i=0;i<3;++i)
+    {
+        const int src_w = sizes[i][0];
+        const int src_h = sizes[i][1];
+        std::vector<uint8_t> src(src_w * src_h * 3);
+        for(size_t j=0;j<src.size();++j)
+        {
+            src[j] = (uint8_t)((j * 2654435761u) >> 24);
+        }
+        /// @brief Warm up, builds the coefficient table, and checks the output.
+        letterbox.Run(src.data(), src_w * 3, src_w, src_h, dst.data());
+        siran::LetterboxTable table;
+        siran::BuildLetterboxTable(src_w, src_h, 640, 640, table);
+        siran::LetterboxRef(src.data(), src_w * 3, table, ref.data(), 640, 640);
+        siran::StaticResize(src.data(), src_w * 3, src_w, src_h, cv_ref.data(), 640, 640);
+        if(dst != ref || ref != cv_ref)
+        {
+            printf("%-6s %4dx%-4d  MISMATCH against LetterboxRef/StaticResize\n", names[i], src_w, src_h);
+            mismatch_sizes++;
+            continue;
+        }
+
+        auto time_start = std::chrono::steady_clock::now();
+        for(int j=0;j<loops;++j)
+        {
+            letterbox.Run(src.data(), src_w * 3, src_w, src_h, dst.data());
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count();
+        printf("%-6s %4dx%-4d  %8.3f ms/frame  %8.1f fps\n", names[i], src_w, src_h,
+               sec * 1000. / loops, loops / sec);
+    }
+    return mismatch_sizes == 0 ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     replay_bench.cpp
+*   Brief:    offline replay of recorded output tensors through the host postprocess(decode,
+*             NMS, ObjResult export), no GPU or engine needed.
+*             replay:    ./Replay_bench dump_file [model cfg] [loops] [trace json]
+*             synthetic: ./Replay_bench --synth dump_file [frames] [model cfg]
+*             dumps come from Yolov7Trt::StartCapture or --synth.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/yolov7.hpp"
+#include "inc/detection.h"
+#include "inc/histogram.h"
+#include "inc/tensor_dump.h"
+#include "inc/trace.h"
+#include <export/export.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#define BENCH_COUNT_ALLOC
+#include "bench/bench_common.h"
+
+static siran::ModelDesc LoadDesc(const char *cfg)
+{
+    siran::ModelDesc desc = siran::DefaultModelDesc();
+    if (cfg && siran::LoadModelDesc(cfg, desc) != 0)
+    {
+        printf("%s load failed, use default model descriptor\n", cfg);
+        desc = siran::DefaultModelDesc();
+    }
+    return desc;
+}
+
+/**
+ * @brief WriteSynthetic -- Frames of a street-like scene, 0 ~ 60 objects, each seen by a few
+ *        neighbouring rows, plus low background noise.
+ */
+static int WriteSynthetic(const char *path, const int &frames, const siran::ModelDesc &desc)
+{
+    Yolov7 yolov7(desc);
+    const int rows = yolov7.RowInfo().size();
+    const int row_len = desc.num_classes + 5;
+    siran::TensorDumpWriter writer;
+    if (writer.Open(path, rows, row_len) != 0)
+    {
+        printf("%s open failed\n", path);
+        return -1;
+    }
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<float> uni(0.f, 1.f);
+    std::vector<float> out((size_t)rows * row_len);
+    for (int f = 0; f < frames; ++f)
+    {
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            out[i] = 0.05f * uni(rng);
+        }
+        const int objects = rng() % 61;
+        for (int k = 0; k < objects; ++k)
+        {
+            const int row = rng() % rows;
+            const int cls = rng() % desc.num_classes;
+            const float x = uni(rng), y = uni(rng), w = 0.2f + 0.4f * uni(rng), h = 0.2f + 0.4f * uni(rng);
+            for (int d = 0; d < 4 && row + d < rows; ++d)
+            {
+                float *feat = &out[(size_t)(row + d) * row_len];
+                feat[0] = x;
+                feat[1] = y;
+                feat[2] = w;
+                feat[3] = h;
+                feat[4] = 0.5f + 0.5f * uni(rng);
+                feat[5 + cls] = 0.6f + 0.4f * uni(rng);
+            }
+        }
+        writer.Write(out.data(), 1920, 1080);
+    }
+    printf("wrote %lld frames of %d x %d to %s\n", (long long)writer.Frames(), rows, row_len, path);
+    return 0;
+}
+
+int main(int arv, char** arg)
+{
+    if (arv < 2)
+    {
+        printf("use: ./Replay_bench dump_file [model cfg] [loops] [trace json]\n");
+        printf("     ./Replay_bench --synth dump_file [frames] [model cfg]\n");
+        return -1;
+    }
+    if (0 == strcmp(arg[1], "--synth"))
+    {
+        if (arv < 3)
+        {
+            return -1;
+        }
+        return WriteSynthetic(arg[2], arv > 3 ? atoi(arg[3]) : 200, LoadDesc(arv > 4 ? arg[4] : nullptr));
+    }
+
+    const siran::ModelDesc desc = LoadDesc(arv > 2 ? arg[2] : nullptr);
+    const int loops = arv > 3 ? atoi(arg[3]) : 5;
+    /// @brief With a trace file the decode/NMS spans are recorded, compare ns/frame with a run
+    ///        without it for the tracing overhead.
+    const char *trace_file = arv > 4 ? arg[4] : nullptr;
+    if (trace_file)
+    {
+        siran::TraceEnable(true, true);
+    }
+    siran::TensorDumpReader reader;
+    if (reader.Open(arg[1]) != 0 || reader.Frames() <= 0)
+    {
+        printf("%s is not a tensor dump\n", arg[1]);
+        return -1;
+    }
+    Yolov7 yolov7(desc);
+    if (reader.RowLen() != desc.num_classes + 5 || reader.Rows() != (int)yolov7.RowInfo().size())
+    {
+        printf("dump is %d x %d, model descriptor expects %d x %d\n", reader.Rows(), reader.RowLen(),
+               (int)yolov7.RowInfo().size(), desc.num_classes + 5);
+        return -1;
+    }
+    const int64_t frames = reader.Frames();
+    siran::DetectionArena arena;
+    ObjResult obj_result;
+
+    /// @brief One pass to warm caches and grow the NMS buffers, not measured.
+    for (int64_t i = 0; i < frames; ++i)
+    {
+        int src_w = 0, src_h = 0;
+        const float *output = reader.Frame(i, &src_w, &src_h);
+        const float scale = std::max(src_w * 1.f / desc.input_w, src_h * 1.f / desc.input_h);
+        yolov7.YoloProcess(output, desc.conf_thresh, scale, &arena);
+        siran::ToObjResult(arena.View(), &obj_result);
+    }
+
+    siran::TraceReset();
+    siran::Histogram latency_ns(siran::Histogram::ExponentialBounds(1000., 1.1, 1e9));
+    int64_t candidates = 0, kept = 0, exported = 0, truncated = 0;
+    const long alloc_before = g_alloc_num.load();
+    for (int l = 0; l < loops; ++l)
+    {
+        for (int64_t i = 0; i < frames; ++i)
+        {
+            int src_w = 0, src_h = 0;
+            const float *output = reader.Frame(i, &src_w, &src_h);
+            const auto time_start = std::chrono::steady_clock::now();
+            const float scale = std::max(src_w * 1.f / desc.input_w, src_h * 1.f / desc.input_h);
+            yolov7.YoloProcess(output, desc.conf_thresh, scale, &arena);
+            siran::ToObjResult(arena.View(), &obj_result);
+            latency_ns.Add(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - time_start).count());
+            candidates += yolov7.object_num;
+            kept += arena.Count();
+            exported += arena.Count() > 0 ? obj_result.obj_num : 0;
+            truncated += arena.Truncated() ? 1 : 0;
+        }
+    }
+    const long allocs = g_alloc_num.load() - alloc_before;
+    const double runs = (double)frames * loops;
+
+    printf("frames %lld x %d loops, %d x %d, %d classes\n", (long long)frames, loops, reader.Rows(), reader.RowLen(), desc.num_classes);
+    printf("ns/frame      mean %.0f  p50 %.0f  p99 %.0f  max %.0f\n", latency_ns.Mean(), latency_ns.Percentile(0.5),
+           latency_ns.Percentile(0.99), latency_ns.Max());
+    printf("candidates/frame %.1f  kept/frame %.1f  exported/frame %.1f  truncated frames %lld\n",
+           candidates / runs, kept / runs, exported / runs, (long long)truncated);
+    printf("allocations/frame %.3f\n", allocs / runs);
+    if (trace_file)
+    {
+        const std::vector<siran::StageLatency> latencies = siran::TraceLatencies();
+        for (size_t i = 0; i < latencies.size(); ++i)
+        {
+            const siran::StageLatency &l = latencies[i];
+            printf("%-10s n %lld  mean %.0f  p50 %.0f  p99 %.0f  p999 %.0f  max %.0f ns\n", siran::TraceStageName(l.stage),
+                   (long long)l.count, l.mean_ns, l.p50_ns, l.p99_ns, l.p999_ns, l.max_ns);
+        }
+        if (siran::TraceExportChrome(trace_file) != 0)
+        {
+            printf("%s open failed\n", trace_file);
+        }
+    }
+    /// @brief Non-zero exit for regression scripts when the hot path starts allocating.
+    return allocs > 0 ? 2 : 0;
+}
@@ -0,0 +1,278 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     result_writer_bench.cpp
+*   Brief:    bulk result output cost on the inference thread, no GPU or engine needed. Text lines
+*             with fprintf against ResultWriter binary records and JSON lines(caller latency,
+*             bytes per frame, write calls, rotation, binary read back), then synchronous
+*             draw + JPEG encode against AsyncRenderer.
+*             use: ./Result_writer_bench [frames] [boxes per frame] [output dir] [render frames]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/histogram.h"
+#include "inc/result_render.h"
+#include "inc/result_writer.h"
+#include "inc/trace.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/// @brief Deterministic boxes of frame i, the same on write and read back.
+static void MakeDetections(const int64_t &frame, const int &count, std::vector<siran::Detection> &dets)
+{
+    dets.resize(count);
+    for(int k=0;k<count;++k)
+    {
+        siran::Detection &det = dets[k];
+        det.left = (float)((frame * 7 + k * 13) % 1800);
+        det.top = (float)((frame * 3 + k * 29) % 1000);
+        det.right = det.left + 20.f + k;
+        det.bottom = det.top + 40.f + k;
+        det.class_id = (int)((frame + k) % 80);
+        det.prob = 0.25f + 0.5f * ((frame + k) % 100) / 100.f;
+    }
+}
+
+/// @brief Result files of a prefix, sorted by index.
+static std::vector<std::string> PrefixFiles(const std::string &dir, const std::string &base, const std::string &ext)
+{
+    std::vector<std::string> files;
+    DIR *handle = opendir(dir.c_str());
+    if(nullptr == handle)
+    {
+        return files;
+    }
+    struct dirent *entry = nullptr;
+    while((entry = readdir(handle)) != nullptr)
+    {
+        const std::string name = entry->d_name;
+        if(name.compare(0, base.size() + 1, base + "_") == 0 && name.size() > ext.size() &&
+           name.compare(name.size() - ext.size(), ext.size(), ext) == 0)
+        {
+            files.push_back(dir + "/" + name);
+        }
+    }
+    closedir(handle);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+static void RemoveFiles(const std::vector<std::string> &files)
+{
+    for(size_t i=0;i<files.size();++i)
+    {
+        unlink(files[i].c_str());
+    }
+}
+
+static void PrintLatency(const char *name, const int64_t &frames, const double &total_ms, const siran::Histogram &hist,
+                         const uint64_t &bytes, const char *extra)
+{
+    printf("%-14s caller mean %7.0fns p99 %7.0fns max %9.0fns  total %8.1fms  %6.1f B/frame  %s\n", name,
+           hist.Mean(), hist.Percentile(0.99), hist.Max(), total_ms, (double)bytes / frames, extra);
+}
+
+static int RunText(const std::string &dir, const int64_t &frames, const int &boxes)
+{
+    const std::string path = dir + "/bench_text.txt";
+    FILE *fp = fopen(path.c_str(), "w");
+    if(nullptr == fp)
+    {
+        printf("cannot open %s\n", path.c_str());
+        return 1;
+    }
+    siran::Histogram hist(siran::Histogram::ExponentialBounds(50., 1.2, 1e9));
+    std::vector<siran::Detection> dets;
+    const uint64_t time_start = siran::NowNs();
+    for(int64_t i=0;i<frames;++i)
+    {
+        MakeDetections(i, boxes, dets);
+        const uint64_t t0 = siran::NowNs();
+        for(int k=0;k<boxes;++k)
+        {
+            fprintf(fp, "frame_%lld %d %.4f %.1f %.1f %.1f %.1f\n", (long long)i, dets[k].class_id, dets[k].prob,
+                    dets[k].left, dets[k].top, dets[k].right, dets[k].bottom);
+        }
+        hist.Add((double)(siran::NowNs() - t0));
+    }
+    fclose(fp);
+    const double total_ms = (siran::NowNs() - time_start) * 1e-6;
+    struct stat buf;
+    const uint64_t bytes = stat(path.c_str(), &buf) == 0 ? buf.st_size : 0;
+    PrintLatency("fprintf text", frames, total_ms, hist, bytes, "");
+    unlink(path.c_str());
+    return 0;
+}
+
+static int RunWriter(const std::string &dir, const int64_t &frames, const int &boxes, const int &format)
+{
+    const std::string base = siran::RESULT_JSONL == format ? "bench_jsonl" : "bench_bin";
+    const std::string ext = siran::RESULT_JSONL == format ? ".jsonl" : ".bin";
+    RemoveFiles(PrefixFiles(dir, base, ext));
+
+    siran::ResultWriterConfig config = siran::DefaultResultWriterConfig();
+    config.path_prefix = dir + "/" + base;
+    config.format = format;
+    config.max_file_bytes = 8 << 20;
+    siran::ResultWriter writer(config);
+    if(writer.Open() != 0)
+    {
+        printf("cannot open %s\n", config.path_prefix.c_str());
+        return 1;
+    }
+    siran::Histogram hist(siran::Histogram::ExponentialBounds(50., 1.2, 1e9));
+    std::vector<siran::Detection> dets;
+    char name[32];
+    const uint64_t time_start = siran::NowNs();
+    for(int64_t i=0;i<frames;++i)
+    {
+        MakeDetections(i, boxes, dets);
+        snprintf(name, sizeof(name), "frame_%lld", (long long)i);
+        siran::ResultMeta meta;
+        meta.frame_id = i;
+        meta.timestamp_ns = 1000 + i;
+        meta.width = 1920;
+        meta.height = 1080;
+        meta.status = 0;
+        meta.name = name;
+        const uint64_t t0 = siran::NowNs();
+        writer.Write(meta, siran::DetectionSpan(dets.data(), boxes, false));
+        hist.Add((double)(siran::NowNs() - t0));
+    }
+    writer.Close();
+    const double total_ms = (siran::NowNs() - time_start) * 1e-6;
+    const siran::ResultWriterStats stats = writer.GetStats();
+
+    /// @brief Binary files read back record by record across the rotation.
+    std::string verdict = "";
+    int mismatch = 0;
+    const std::vector<std::string> files = PrefixFiles(dir, base, ext);
+    if(siran::RESULT_BINARY == format)
+    {
+        int64_t next = 0;
+        bool same = true;
+        siran::ResultRecord record;
+        for(size_t f=0;f<files.size() && same;++f)
+        {
+            siran::ResultReader reader;
+            same = reader.Open(files[f]) == 0;
+            int iret = 0;
+            while(same && (iret = reader.Next(record)) == 0)
+            {
+                MakeDetections(next, boxes, dets);
+                snprintf(name, sizeof(name), "frame_%lld", (long long)next);
+                same = record.frame_id == next && record.timestamp_ns == (uint64_t)(1000 + next) && record.name == name &&
+                       record.width == 1920 && record.detections.size() == dets.size();
+                for(size_t k=0;same && k<dets.size();++k)
+                {
+                    same = 0 == memcmp(&record.detections[k], &dets[k], sizeof(siran::Detection));
+                }
+                next++;
+            }
+            same = same && 1 == iret;
+        }
+        verdict = same && next == frames ? "read back ok" : "READ BACK MISMATCH";
+        mismatch = same && next == frames ? 0 : 1;
+    }
+    char extra[160];
+    snprintf(extra, sizeof(extra), "%lld writes, %zu files, %.1fms blocked  %s", (long long)stats.write_calls,
+             files.size(), stats.blocked_ms, verdict.c_str());
+    PrintLatency(siran::RESULT_JSONL == format ? "writer jsonl" : "writer binary", frames, total_ms, hist, stats.bytes, extra);
+    RemoveFiles(files);
+    return mismatch;
+}
+
+static int CheckRetention(const std::string &dir)
+{
+    const std::string base = "bench_keep";
+    RemoveFiles(PrefixFiles(dir, base, ".bin"));
+    siran::ResultWriterConfig config = siran::DefaultResultWriterConfig();
+    config.path_prefix = dir + "/" + base;
+    config.buffer_bytes = 4096;
+    config.max_file_bytes = 8192;
+    config.max_files = 3;
+    siran::ResultWriter writer(config);
+    writer.Open();
+    std::vector<siran::Detection> dets;
+    MakeDetections(0, 20, dets);
+    siran::ResultMeta meta = {0, 0, 640, 480, 0, nullptr};
+    for(int i=0;i<2000;++i)
+    {
+        meta.frame_id = i;
+        writer.Write(meta, siran::DetectionSpan(dets.data(), dets.size(), false));
+        if(i % 100 == 99)
+        {
+            writer.Flush();
+        }
+    }
+    writer.Close();
+    const std::vector<std::string> files = PrefixFiles(dir, base, ".bin");
+    const siran::ResultWriterStats stats = writer.GetStats();
+    printf("%-14s %lld files written, %zu kept(max 3)  %s\n", "retention", (long long)stats.files, files.size(),
+           files.size() == 3 && stats.files > 3 ? "ok" : "MISMATCH");
+    RemoveFiles(files);
+    return files.size() == 3 && stats.files > 3 ? 0 : 1;
+}
+
+static int RunRender(const std::string &dir, const int &frames, const int &boxes)
+{
+    cv::Mat frame(1080, 1920, CV_8UC3, cv::Scalar(90, 120, 150));
+    std::vector<siran::Detection> dets;
+    siran::RenderConfig config = siran::DefaultRenderConfig();
+    config.save_dir = dir + "/bench_render";
+
+    /// @brief What verbos cost per frame before, clone + draw + encode on the caller.
+    siran::Histogram sync_hist(siran::Histogram::ExponentialBounds(1e3, 1.2, 1e10));
+    for(int i=0;i<frames;++i)
+    {
+        MakeDetections(i, boxes, dets);
+        const uint64_t t0 = siran::NowNs();
+        cv::Mat image = frame.clone();
+        siran::DrawDetections(image, dets.data(), boxes);
+        cv::imwrite(config.save_dir + "_sync.jpg", image);
+        sync_hist.Add((double)(siran::NowNs() - t0));
+    }
+    unlink((config.save_dir + "_sync.jpg").c_str());
+
+    siran::AsyncRenderer renderer(config);
+    siran::Histogram async_hist(siran::Histogram::ExponentialBounds(1e3, 1.2, 1e10));
+    for(int i=0;i<frames;++i)
+    {
+        MakeDetections(i, boxes, dets);
+        const uint64_t t0 = siran::NowNs();
+        /// @brief The renderer draws into the submitted frame, each submit hands over its own copy.
+        renderer.Submit(frame.clone(), "render", siran::DetectionSpan(dets.data(), boxes, false));
+        async_hist.Add((double)(siran::NowNs() - t0));
+    }
+    renderer.Wait();
+    const siran::RenderStats stats = renderer.GetStats();
+    printf("%-14s caller p50 %8.3fms p99 %8.3fms\n", "render sync", sync_hist.Percentile(0.5) * 1e-6, sync_hist.Percentile(0.99) * 1e-6);
+    printf("%-14s caller p50 %8.3fms p99 %8.3fms  %lld rendered, %lld dropped, %.3fms/render on the worker\n", "render async",
+           async_hist.Percentile(0.5) * 1e-6, async_hist.Percentile(0.99) * 1e-6, (long long)stats.rendered,
+           (long long)stats.dropped, stats.render_ms / std::max<int64_t>(1, stats.rendered + stats.failed));
+    unlink((config.save_dir + "/render.jpg").c_str());
+    rmdir(config.save_dir.c_str());
+    return stats.failed > 0 ? 1 : 0;
+}
+
+int main(int arv, char** arg)
+{
+    const int64_t frames = arv > 1 ? atoll(arg[1]) : 200000;
+    const int boxes = arv > 2 ? atoi(arg[2]) : 12;
+    const std::string dir = arv > 3 ? arg[3] : "/tmp";
+    const int render_frames = arv > 4 ? atoi(arg[4]) : 200;
+    printf("%lld frames, %d boxes per frame, output in %s\n", (long long)frames, boxes, dir.c_str());
+    int failed = RunText(dir, frames, boxes);
+    failed += RunWriter(dir, frames, boxes, siran::RESULT_BINARY);
+    failed += RunWriter(dir, frames, boxes, siran::RESULT_JSONL);
+    failed += CheckRetention(dir);
+    failed += RunRender(dir, render_frames, boxes);
+    return failed > 0 ? 1 : 0;
+}
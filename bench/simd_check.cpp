@@ -0,0 +1,162 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     simd_check.cpp
+*   Brief:    decode kernel checks, every DecodeIsa the running cpu supports against the scalar
+*             loops: objectness filter survivors and class argmax value/index must be identical,
+*             including ties, thresh-equal, negative, all-zero and NaN rows. use: ./Simd_check [loops]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/yolov7_simd.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+static const char* IsaName(const int &isa)
+{
+    switch(isa)
+    {
+    case DECODE_SSE4: return "sse4.1";
+    case DECODE_AVX2: return "avx2";
+    case DECODE_NEON: return "neon";
+    default: return "scalar";
+    }
+}
+
+/// @brief x86 paths are ordered, avx2 cpus also run sse4.1; NEON is the only arm path.
+static bool IsaSupported(const int &isa, const int &best)
+{
+    if(DECODE_SCALAR == isa)
+    {
+        return true;
+    }
+    if(DECODE_NEON == isa || DECODE_NEON == best)
+    {
+        return isa == best;
+    }
+    return isa <= best;
+}
+
+/// @brief Output rows with a few hand made cases mixed in, values quantized so ties happen.
+static void MakeRows(const int &rows, const int &row_len, const float &thresh, std::mt19937 &rng, std::vector<float> &out)
+{
+    std::uniform_real_distribution<float> uni(0.f, 1.f);
+    std::uniform_int_distribution<int> level(0, 15);
+    out.resize((size_t)rows * row_len);
+    for(int r=0;r<rows;++r)
+    {
+        float *row = out.data() + (size_t)r * row_len;
+        for(int i=0;i<row_len;++i)
+        {
+            row[i] = level(rng) / 15.f;
+        }
+        switch(r % 7)
+        {
+        case 0:
+            row[4] = thresh;                      // equal is not greater
+            break;
+        case 1:
+            for(int i=5;i<row_len;++i)
+            {
+                row[i] = 0.f;                     // no class above 0, index 0
+            }
+            break;
+        case 2:
+            for(int i=5;i<row_len;++i)
+            {
+                row[i] = -uni(rng);               // negative scores clamp to 0 like the scalar loop
+            }
+            break;
+        case 3:
+            row[row_len - 1] = row[5] = 1.f;      // first of two maxima wins
+            break;
+        case 4:
+            row[4] = std::numeric_limits<float>::quiet_NaN();
+            row[row_len - 1] = std::numeric_limits<float>::quiet_NaN();
+            row[5 + (r / 7) % (row_len - 5)] = std::numeric_limits<float>::quiet_NaN();
+            break;                                // NaN scores are skipped like the scalar loop
+        default:
+            row[4] = uni(rng);
+            break;
+        }
+    }
+}
+
+static int CheckIsa(const int &isa, const int &loops)
+{
+    std::mt19937 rng(2022 + isa);
+    const int row_lens[5] = {6, 7, 13, 85, 90};
+    const int row_nums[6] = {0, 1, 15, 17, 333, 25200};
+    const float threshs[3] = {0.f, 0.25f, 8.f / 15.f};
+    std::vector<float> out;
+    std::vector<int> idx_ref, idx;
+    int mismatch = 0;
+    for(int loop=0;loop<loops;++loop)
+    {
+        for(int l=0;l<5;++l)
+        {
+            for(int n=0;n<6;++n)
+            {
+                const int row_len = row_lens[l];
+                const int rows = row_nums[n];
+                const float thresh = threshs[loop % 3];
+                MakeRows(rows, row_len, thresh, rng, out);
+                idx_ref.assign(rows + 1, -1);
+                idx.assign(rows + 1, -1);
+                const int n_ref = FilterObjScalar(out.data(), rows, row_len, thresh, idx_ref.data());
+                const int n_isa = FilterObj(isa, out.data(), rows, row_len, thresh, idx.data());
+                if(n_ref != n_isa || idx_ref != idx)
+                {
+                    mismatch++;
+                    continue;
+                }
+                for(int r=0;r<rows;++r)
+                {
+                    const float *cls = out.data() + (size_t)r * row_len + 5;
+                    int index_ref = -1, index = -1;
+                    const float conf_ref = ArgmaxScalar(cls, row_len - 5, index_ref);
+                    const float conf = Argmax(isa, cls, row_len - 5, index);
+                    mismatch += conf_ref == conf && index_ref == index ? 0 : 1;
+                }
+            }
+        }
+    }
+    return mismatch;
+}
+
+int main(int arv, char** arg)
+{
+    const int loops = arv > 1 ? atoi(arg[1]) : 6;
+    const int best = DetectDecodeIsa();
+    printf("cpu decode path: %s\n", IsaName(best));
+    const int isas[4] = {DECODE_SCALAR, DECODE_SSE4, DECODE_AVX2, DECODE_NEON};
+    for(int i=0;i<4;++i)
+    {
+        char what[64];
+        snprintf(what, sizeof(what), "%s filter and argmax bit-exact with scalar", IsaName(isas[i]));
+        if(!IsaSupported(isas[i], best))
+        {
+            printf("skip %s, not supported by this cpu\n", IsaName(isas[i]));
+            continue;
+        }
+        const int mismatch = CheckIsa(isas[i], loops);
+        if(mismatch > 0)
+        {
+            printf("%s: %d mismatches\n", IsaName(isas[i]), mismatch);
+        }
+        Check(0 == mismatch, what);
+    }
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,317 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     stereo_check.cpp
+*   Brief:    stereo dual-view host side checks, no GPU needed: zero-copy view split, one pass
+*             letterbox of both views against per view letterbox(output and time), stream
+*             delivery of a stereo pair through DetectViews, and left/right association on
+*             synthetic rectified scenes. use: ./Stereo_check [scenes] [objects per scene]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/preprocess.h"
+#include "inc/stereo.h"
+#include "inc/stream.h"
+#include "inc/trace.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+static cv::Mat MakeFrame(const int &width, const int &height, std::mt19937 &rng)
+{
+    cv::Mat frame(height, width, CV_8UC3, cv::Scalar(0, 0, 0));
+    for(int y=0;y<height;++y)
+    {
+        uint8_t *row = frame.data + (size_t)y * frame.step;
+        for(int x=0;x<width*3;++x)
+        {
+            row[x] = (uint8_t)(rng() & 0xff);
+        }
+    }
+    return frame;
+}
+
+static void CheckSplit()
+{
+    std::mt19937 rng(3);
+    cv::Mat frame = MakeFrame(2561, 4, rng);
+    std::vector<cv::Mat> views;
+    siran::SplitViews(frame, 2, views);
+    Check(views.size() == 2 && views[0].cols == 1280 && views[1].cols == 1281 && views[1].rows == 4,
+          "odd width: the right view takes the last column");
+    Check(views[0].data == frame.data && views[1].data == frame.data + 1280 * 3 && views[1].step == frame.step,
+          "views share the frame pixels, no copy");
+}
+
+static void CheckLetterbox(const int &width, const int &height, const int &rounds)
+{
+    std::mt19937 rng(11);
+    cv::Mat frame = MakeFrame(width, height, rng);
+    std::vector<cv::Mat> views;
+    siran::SplitViews(frame, 2, views);
+    const int dst = 640;
+    const size_t slot = (size_t)3 * dst * dst;
+    std::vector<float> together(2 * slot), apart(2 * slot);
+    siran::CpuLetterbox letterbox(dst, dst);
+
+    letterbox.RunViews(frame.data, frame.step, frame.cols, frame.rows, 2, together.data());
+    for(int v=0;v<2;++v)
+    {
+        /// @brief The old path, every view cloned to its own continuous image first.
+        const cv::Mat view = views[v].clone();
+        letterbox.Run(view.data, view.step, view.cols, view.rows, apart.data() + v * slot);
+    }
+    char what[128];
+    snprintf(what, sizeof(what), "%dx%d: one pass letterbox of both views equals per view letterbox of copies", width, height);
+    Check(0 == memcmp(together.data(), apart.data(), together.size() * sizeof(float)), what);
+
+    uint64_t clone_ns = 0, roi_ns = 0, views_ns = 0;
+    for(int i=0;i<rounds;++i)
+    {
+        uint64_t t0 = siran::NowNs();
+        for(int v=0;v<2;++v)
+        {
+            const cv::Mat view = views[v].clone();
+            letterbox.Run(view.data, view.step, view.cols, view.rows, apart.data() + v * slot);
+        }
+        clone_ns += siran::NowNs() - t0;
+        t0 = siran::NowNs();
+        for(int v=0;v<2;++v)
+        {
+            letterbox.Run(views[v].data, views[v].step, views[v].cols, views[v].rows, apart.data() + v * slot);
+        }
+        roi_ns += siran::NowNs() - t0;
+        t0 = siran::NowNs();
+        letterbox.RunViews(frame.data, frame.step, frame.cols, frame.rows, 2, together.data());
+        views_ns += siran::NowNs() - t0;
+    }
+    printf("     %dx%d letterbox of both views: clone + Run %.3fms, ROI Run x2 %.3fms, RunViews %.3fms\n", width, height,
+           clone_ns * 1e-6 / rounds, roi_ns * 1e-6 / rounds, views_ns * 1e-6 / rounds);
+}
+
+/// @brief Counts the calls, a box per view at a known place so the views can be told apart.
+class PairDetector : public siran::IStreamDetector
+{
+public:
+    PairDetector(const bool &batch):
+        batch_(batch),
+        detect_calls_(0),
+        views_calls_(0)
+    {
+    }
+
+    int Detect(const cv::Mat &view, siran::DetectionSpan *detections)
+    {
+        detect_calls_++;
+        boxes_[0] = MakeBox(view.cols, 0);
+        *detections = siran::DetectionSpan(boxes_, 1, false);
+        return 0;
+    }
+
+    int DetectViews(const cv::Mat &frame, const std::vector<cv::Mat> &views, siran::DetectionSpan *detections, int *status,
+                    std::vector<siran::StereoPair> &pairs)
+    {
+        if(!batch_)
+        {
+            return 1;
+        }
+        views_calls_++;
+        for(size_t v=0;v<views.size() && v<2;++v)
+        {
+            boxes_[v] = MakeBox(views[v].cols, (int)v);
+            detections[v] = siran::DetectionSpan(&boxes_[v], 1, false);
+            status[v] = views[v].data == frame.data + (size_t)frame.cols / 2 * 3 * v ? 0 : -1;
+        }
+        siran::StereoPair pair = {0, 0, 0.f, 0.f};
+        pairs.assign(1, pair);
+        return 0;
+    }
+
+    static siran::Detection MakeBox(const int &cols, const int &view)
+    {
+        siran::Detection det = {10.f, 10.f, 10.f + cols / 10, 50.f, view, 0.9f};
+        return det;
+    }
+
+    bool batch_;
+    std::atomic<int> detect_calls_;
+    std::atomic<int> views_calls_;
+    siran::Detection boxes_[2];
+};
+
+static void CheckStream(const int &frames)
+{
+    for(int batch=0;batch<2;++batch)
+    {
+        PairDetector detector(batch == 1);
+        siran::SyntheticSource source(2560, 960, -1., frames);
+        siran::StreamConfig config = siran::DefaultStreamConfig();
+        config.view_num = 2;
+        config.view_mask = 0x3;
+        config.ring_capacity = frames;
+        siran::StreamPipeline stream(&detector, &source, config);
+        std::vector<int> views;
+        bool paired = true;
+        /// @brief Per view Detect marks every box class 0, DetectViews marks the view and gives one
+        ///        pair, delivered with the right view.
+        stream.Start([&views, &paired, batch](const siran::StreamResult &result) {
+            paired = paired && 0 == result.status && result.detections.size() == 1 &&
+                     result.detections[0].class_id == result.view * batch && (int)views.size() % 2 == result.view &&
+                     (int)result.pairs.size() == result.view * batch;
+            views.push_back(result.view);
+        });
+        stream.Wait();
+        const bool calls = batch == 1 ? detector.views_calls_ == frames && detector.detect_calls_ == 0
+                                      : detector.views_calls_ == 0 && detector.detect_calls_ == 2 * frames;
+        Check(calls && paired && (int)views.size() == 2 * frames,
+              batch == 1 ? "stream: a stereo pair is one DetectViews call, left then right with the pairs delivered"
+                         : "stream: detector without DetectViews falls back to Detect per view");
+    }
+}
+
+/// @brief A rectified scene, f and baseline of a 1280x960 view, people and cars at 4..40m.
+static void MakeScene(const int &objects, std::mt19937 &rng, std::vector<siran::Detection> &left,
+                      std::vector<siran::Detection> &right, std::vector<std::pair<int, int> > &truth)
+{
+    const float focal = 1000.f;
+    const float baseline = 0.12f;
+    const float view_w = 1280.f;
+    const float view_h = 960.f;
+    std::uniform_real_distribution<float> uni(0.f, 1.f);
+    std::normal_distribution<float> noise(0.f, 1.f);
+    left.clear();
+    right.clear();
+    truth.clear();
+    for(int i=0;i<objects;++i)
+    {
+        const bool car = i % 4 == 0;
+        const float z = 4.f + 36.f * uni(rng);
+        const float h = focal * (car ? 1.5f : 1.7f) / z;
+        const float w = focal * (car ? 1.8f : 0.6f) / z;
+        const float d = focal * baseline / z;
+        const float x = (view_w - w) * uni(rng);
+        const float y = std::max(0.f, view_h * 0.5f - h * (0.2f + 0.6f * uni(rng)));
+        const int class_id = car ? 2 : 0;
+        int l = -1, r = -1;
+        /// @brief 5% misses per view, the right view loses what goes past its left edge.
+        if(uni(rng) > 0.05f)
+        {
+            siran::Detection det = {x + noise(rng), y + noise(rng), x + w + noise(rng), y + h + noise(rng), class_id, 0.8f};
+            l = (int)left.size();
+            left.push_back(det);
+        }
+        if(x - d >= 0.f && uni(rng) > 0.05f)
+        {
+            siran::Detection det = {x - d + noise(rng), y + noise(rng), x - d + w + noise(rng), y + h + noise(rng), class_id, 0.8f};
+            r = (int)right.size();
+            right.push_back(det);
+        }
+        if(l >= 0 && r >= 0)
+        {
+            truth.push_back(std::make_pair(l, r));
+        }
+    }
+    /// @brief One false positive per view.
+    for(int v=0;v<2;++v)
+    {
+        const float x = (view_w - 40.f) * uni(rng);
+        const float y = (view_h - 90.f) * uni(rng);
+        siran::Detection det = {x, y, x + 40.f, y + 90.f, 0, 0.5f};
+        (v == 0 ? left : right).push_back(det);
+    }
+}
+
+static void CheckAssociation(const int &scenes, const int &objects)
+{
+    siran::StereoAssociator associator;
+    const siran::StereoConfig config = siran::DefaultStereoConfig();
+    std::vector<siran::StereoPair> pairs;
+
+    /// @brief Five people side by side at one depth, the same rows and heights on both views.
+    std::vector<siran::Detection> left, right;
+    for(int i=0;i<5;++i)
+    {
+        siran::Detection det = {300.f + 60.f * i, 400.f, 340.f + 60.f * i, 520.f, 0, 0.9f};
+        left.push_back(det);
+        det.left -= 25.f;
+        det.right -= 25.f;
+        right.push_back(det);
+    }
+    std::reverse(right.begin(), right.end());
+    associator.Run(siran::DetectionSpan(left.data(), left.size(), false), siran::DetectionSpan(right.data(), right.size(), false),
+                   config, pairs);
+    bool ordered = pairs.size() == 5;
+    for(size_t i=0;i<pairs.size();++i)
+    {
+        ordered = ordered && pairs[i].right == 4 - pairs[i].left && fabsf(pairs[i].disparity - 25.f) < 1e-3f;
+    }
+    Check(ordered, "people side by side on one row keep their order");
+
+    /// @brief Other class, other rows or the wrong disparity sign never pair.
+    left.assign(1, left[0]);
+    right.clear();
+    siran::Detection other = left[0];
+    other.class_id = 2;
+    right.push_back(other);
+    other = left[0];
+    other.top += 30.f;
+    other.bottom += 30.f;
+    right.push_back(other);
+    other = left[0];
+    other.left += 20.f;
+    other.right += 20.f;
+    right.push_back(other);
+    Check(associator.Run(siran::DetectionSpan(left.data(), left.size(), false),
+                         siran::DetectionSpan(right.data(), right.size(), false), config, pairs) == 0,
+          "class, epipolar row and disparity range respected");
+
+    std::mt19937 rng(21);
+    std::vector<std::pair<int, int> > truth;
+    int64_t truth_num = 0, pair_num = 0, correct = 0;
+    uint64_t run_ns = 0;
+    for(int s=0;s<scenes;++s)
+    {
+        MakeScene(objects, rng, left, right, truth);
+        const uint64_t t0 = siran::NowNs();
+        associator.Run(siran::DetectionSpan(left.data(), left.size(), false),
+                       siran::DetectionSpan(right.data(), right.size(), false), config, pairs);
+        run_ns += siran::NowNs() - t0;
+        truth_num += truth.size();
+        pair_num += pairs.size();
+        for(size_t i=0;i<pairs.size();++i)
+        {
+            correct += std::find(truth.begin(), truth.end(), std::make_pair(pairs[i].left, pairs[i].right)) != truth.end() ? 1 : 0;
+        }
+    }
+    const double precision = pair_num > 0 ? (double)correct / pair_num : 0.;
+    const double recall = truth_num > 0 ? (double)correct / truth_num : 0.;
+    printf("     %d scenes, %d objects: %lld true pairs, %lld found, precision %.3f recall %.3f, %.1fus/scene\n", scenes,
+           objects, (long long)truth_num, (long long)pair_num, precision, recall, run_ns * 1e-3 / std::max(1, scenes));
+    Check(precision >= 0.95 && recall >= 0.95, "synthetic scenes: pair precision and recall >= 0.95");
+}
+
+int main(int arv, char** arg)
+{
+    const int scenes = arv > 1 ? atoi(arg[1]) : 500;
+    const int objects = arv > 2 ? atoi(arg[2]) : 30;
+    CheckSplit();
+    CheckLetterbox(2560, 960, 20);
+    CheckLetterbox(2561, 720, 5);
+    CheckStream(20);
+    CheckAssociation(scenes, objects);
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
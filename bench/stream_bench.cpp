@@ -0,0 +1,94 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     stream_bench.cpp
+*   Brief:    streaming pipeline latency test, synthetic camera and a fixed cost detector, no
+*             GPU or engine needed. Compares the drop-oldest ring with an unbounded queue.
+*             use: ./Stream_bench [fps] [infer ms] [seconds] [views]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+/// @brief Stand-in detector, sleeps infer_ms per view and reports one box at the view center.
+class SleepDetector : public siran::IStreamDetector
+{
+public:
+    explicit SleepDetector(const double &infer_ms):
+        infer_ms_(infer_ms),
+        arena_(4)
+    {
+    }
+
+    int Detect(const cv::Mat &view, siran::DetectionSpan *detections)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(infer_ms_ * 1000)));
+        arena_.Reset();
+        siran::Detection det;
+        det.left = view.cols * 0.25f;
+        det.top = view.rows * 0.25f;
+        det.right = view.cols * 0.75f;
+        det.bottom = view.rows * 0.75f;
+        det.class_id = 0;
+        det.prob = 0.9f;
+        arena_.Push(det);
+        *detections = arena_.View();
+        return 0;
+    }
+
+private:
+    double infer_ms_;
+    siran::DetectionArena arena_;
+};
+
+/// @brief Run one configuration, return the number of ordering errors seen in the callback.
+static int RunOnce(const char *name, const int &ring_capacity, const double &fps, const double &infer_ms,
+                   const double &seconds, const int &views)
+{
+    siran::SyntheticSource source(1280 * views, 720, fps, (int64_t)(fps * seconds));
+    SleepDetector detector(infer_ms);
+    siran::StreamConfig config = siran::DefaultStreamConfig();
+    config.ring_capacity = ring_capacity;
+    config.view_num = views;
+    siran::StreamPipeline stream(&detector, &source, config);
+
+    int64_t last_seq = -1;
+    int last_view = -1;
+    int errors = 0;
+    stream.Start([&](const siran::StreamResult &result) {
+        /// @brief Frames in capture order, views of a frame in view order.
+        const bool ordered = result.seq > last_seq || (result.seq == last_seq && result.view > last_view);
+        errors += ordered && result.detections.size() == 1 ? 0 : 1;
+        last_seq = result.seq;
+        last_view = result.view;
+    });
+    stream.Wait();
+
+    const siran::StreamStats stats = stream.GetStats();
+    printf("%-10s captured %lld  dropped %lld  inferred %lld  delivered %lld  latency mean %.1fms p50 %.1fms p99 %.1fms max %.1fms\n",
+           name, (long long)stats.captured, (long long)stats.dropped, (long long)stats.inferred, (long long)stats.delivered,
+           stats.latency_mean_ns * 1e-6, stats.latency_p50_ns * 1e-6, stats.latency_p99_ns * 1e-6, stats.latency_max_ns * 1e-6);
+    return errors;
+}
+
+int main(int arv, char** arg)
+{
+    const double fps = arv > 1 ? atof(arg[1]) : 30.;
+    const double infer_ms = arv > 2 ? atof(arg[2]) : 50.;
+    const double seconds = arv > 3 ? atof(arg[3]) : 3.;
+    const int views = arv > 4 ? atoi(arg[4]) : 1;
+    printf("camera %.0ffps, detector %.1fms per view, %d view(s), %.1fs\n", fps, infer_ms, views, seconds);
+
+    int errors = RunOnce("ring(2)", 2, fps, infer_ms, seconds, views);
+    errors += RunOnce("unbounded", 1 << 20, fps, infer_ms, seconds, views);
+    if(errors > 0)
+    {
+        printf("%d results out of order or incomplete\n", errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,301 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     tile_check.cpp
+*   Brief:    tiled inference host side checks, no GPU needed: tile plan coverage and overlap,
+*             seam merge cases, then a synthetic 4K frame of small and large objects seen by
+*             a simulated per tile detector, recall and precision against the truth boxes
+*             with and without the merge. use: ./Tile_check [objects] [frames]
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/tile.h"
+#include "inc/det_eval.h"
+#include "inc/trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+static int g_failed = 0;
+
+static void Check(const bool &ok, const char *what)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    g_failed += ok ? 0 : 1;
+}
+
+static siran::Detection Box(const float &left, const float &top, const float &right, const float &bottom,
+                            const int &class_id, const float &prob)
+{
+    siran::Detection det = {left, top, right, bottom, class_id, prob};
+    return det;
+}
+
+/// @brief Every pixel covered, tiles inside the frame, neighbours share at least min_overlap.
+static bool PlanValid(const int &frame_w, const int &frame_h, const siran::TileConfig &config,
+                      const std::vector<siran::TileRect> &tiles)
+{
+    const size_t grid = config.full_frame && tiles.size() > 1 ? tiles.size() - 1 : tiles.size();
+    std::vector<int> xs, ys;
+    for(size_t i=0;i<grid;++i)
+    {
+        const siran::TileRect &tile = tiles[i];
+        if(tile.x < 0 || tile.y < 0 || tile.x + tile.width > frame_w || tile.y + tile.height > frame_h ||
+           tile.width != std::min(config.tile_w, frame_w) || tile.height != std::min(config.tile_h, frame_h))
+        {
+            return false;
+        }
+        xs.push_back(tile.x);
+        ys.push_back(tile.y);
+    }
+    std::sort(xs.begin(), xs.end());
+    xs.erase(std::unique(xs.begin(), xs.end()), xs.end());
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+    if(xs.size() * ys.size() != grid || xs.front() != 0 || ys.front() != 0 ||
+       xs.back() + tiles[0].width != frame_w || ys.back() + tiles[0].height != frame_h)
+    {
+        return false;
+    }
+    for(size_t i=1;i<xs.size();++i)
+    {
+        if(xs[i-1] + tiles[0].width - xs[i] < config.min_overlap)
+        {
+            return false;
+        }
+    }
+    for(size_t i=1;i<ys.size();++i)
+    {
+        if(ys[i-1] + tiles[0].height - ys[i] < config.min_overlap)
+        {
+            return false;
+        }
+    }
+    if(grid != tiles.size())
+    {
+        const siran::TileRect &frame = tiles.back();
+        return frame.x == 0 && frame.y == 0 && frame.width == frame_w && frame.height == frame_h;
+    }
+    return true;
+}
+
+static void CheckPlan()
+{
+    const siran::TileConfig config = siran::DefaultTileConfig();
+    std::vector<siran::TileRect> tiles;
+    Check(siran::PlanTiles(2560, 960, config, tiles) == 11 && PlanValid(2560, 960, config, tiles),
+          "2560x960: 5x2 tiles and the whole frame, covered with min overlap");
+    Check(siran::PlanTiles(3840, 2160, config, tiles) == 33 && PlanValid(3840, 2160, config, tiles),
+          "3840x2160: 8x4 tiles and the whole frame, covered with min overlap");
+    Check(siran::PlanTiles(640, 640, config, tiles) == 1 && PlanValid(640, 640, config, tiles), "640x640: one tile");
+    Check(siran::PlanTiles(500, 300, config, tiles) == 1 && tiles[0].width == 500 && tiles[0].height == 300,
+          "frame smaller than a tile: one tile of the frame size");
+    Check(siran::PlanTiles(1280, 400, config, tiles) == 4 && PlanValid(1280, 400, config, tiles),
+          "1280x400: 3x1 tiles of 640x400");
+    Check(siran::PlanTiles(0, 720, config, tiles) == 0 && tiles.empty(), "empty frame: no tile");
+
+    siran::TileConfig no_frame = config;
+    no_frame.full_frame = false;
+    no_frame.min_overlap = 200;
+    Check(siran::PlanTiles(2560, 960, no_frame, tiles) == 12 && PlanValid(2560, 960, no_frame, tiles),
+          "full_frame off, overlap 200: 6x2 tiles");
+}
+
+static void CheckMerge()
+{
+    siran::TileMerger merger;
+    std::vector<siran::Detection> merged;
+    /// @brief Two tiles side by side sharing x 512..640, tile pixels.
+    const std::vector<siran::TileRect> tiles = {{0, 0, 640, 640}, {512, 0, 640, 640}};
+
+    /// @brief A person 460..700 cut by the seam, left part in tile 0, right part in tile 1.
+    std::vector<siran::Detection> a = {Box(460, 100, 640, 300, 0, 0.8f)};
+    std::vector<siran::Detection> b = {Box(0, 100, 188, 300, 0, 0.7f)};
+    siran::DetectionSpan spans[2] = {siran::DetectionSpan(a.data(), a.size(), false),
+                                     siran::DetectionSpan(b.data(), b.size(), false)};
+    merger.Run(tiles, spans, 0.5f, merged);
+    Check(merged.size() == 1 && merged[0].left == 460 && merged[0].right == 700 && merged[0].prob == 0.8f,
+          "parts cut at a seam become their union");
+
+    /// @brief The same box seen whole by both tiles inside the overlap.
+    a = {Box(540, 200, 600, 320, 2, 0.6f)};
+    b = {Box(29, 201, 89, 322, 2, 0.9f)};
+    spans[0] = siran::DetectionSpan(a.data(), a.size(), false);
+    spans[1] = siran::DetectionSpan(b.data(), b.size(), false);
+    merger.Run(tiles, spans, 0.5f, merged);
+    Check(merged.size() == 1 && merged[0].prob == 0.9f && merged[0].left == 541, "duplicate in the overlap keeps the higher score");
+
+    /// @brief Different classes, and two touching people, are never merged.
+    a = {Box(540, 200, 600, 320, 2, 0.6f), Box(500, 400, 560, 560, 0, 0.8f)};
+    b = {Box(28, 200, 88, 320, 3, 0.9f), Box(48, 400, 100, 560, 0, 0.8f)};
+    spans[0] = siran::DetectionSpan(a.data(), a.size(), false);
+    spans[1] = siran::DetectionSpan(b.data(), b.size(), false);
+    merger.Run(tiles, spans, 0.5f, merged);
+    Check(merged.size() == 4, "other class and adjacent objects kept");
+
+    /// @brief Boxes away from the seam pass through in frame pixels.
+    a = {Box(10, 10, 50, 90, 1, 0.5f)};
+    b = {Box(600, 10, 630, 90, 1, 0.7f)};
+    spans[0] = siran::DetectionSpan(a.data(), a.size(), false);
+    spans[1] = siran::DetectionSpan(b.data(), b.size(), false);
+    merger.Run(tiles, spans, 0.5f, merged);
+    Check(merged.size() == 2 && merged[0].left == 1112 && merged[1].left == 10, "tile offsets applied, sorted by score");
+
+    /// @brief Whole frame slot: a large person and a small person in front of it, the tiles
+    ///        see the large one whole or cut and the small one whole.
+    const std::vector<siran::TileRect> with_frame = {{0, 0, 640, 640}, {512, 0, 640, 640}, {0, 0, 1152, 640}};
+    a = {Box(300, 50, 612, 600, 0, 0.9f), Box(520, 300, 560, 400, 0, 0.8f)};
+    b = {Box(0, 50, 100, 600, 0, 0.6f), Box(8, 300, 48, 400, 0, 0.85f)};
+    std::vector<siran::Detection> c = {Box(302, 48, 610, 604, 0, 0.7f)};
+    siran::DetectionSpan frame_spans[3] = {siran::DetectionSpan(a.data(), a.size(), false),
+                                           siran::DetectionSpan(b.data(), b.size(), false),
+                                           siran::DetectionSpan(c.data(), c.size(), false)};
+    merger.Run(with_frame, frame_spans, 0.5f, merged);
+    bool small_kept = false;
+    bool large_joined = false;
+    for(size_t i=0;i<merged.size();++i)
+    {
+        small_kept = small_kept || (merged[i].right - merged[i].left == 40.f);
+        large_joined = large_joined || (merged[i].left == 300 && merged[i].right == 612);
+    }
+    Check(merged.size() == 2 && small_kept && large_joined, "small object inside a larger box of its class kept");
+
+    spans[0] = siran::DetectionSpan();
+    spans[1] = siran::DetectionSpan();
+    Check(merger.Run(tiles, spans, 0.5f, merged) == 0 && merged.empty(), "no detections");
+}
+
+/// @brief Truth boxes of a frame, small people and a few large vehicles, not intersecting.
+static void MakeTruths(const int &frame_w, const int &frame_h, const int &objects, std::mt19937 &rng,
+                       std::vector<siran::Detection> &truths)
+{
+    truths.clear();
+    std::uniform_real_distribution<float> uni(0.f, 1.f);
+    for(int tries=0;(int)truths.size()<objects && tries<objects*50;++tries)
+    {
+        const bool large = truths.size() % 16 == 0;
+        const float w = large ? 500.f + 700.f * uni(rng) : 14.f + 30.f * uni(rng);
+        const float h = large ? 300.f + 500.f * uni(rng) : 30.f + 70.f * uni(rng);
+        const float left = (frame_w - w) * uni(rng);
+        const float top = (frame_h - h) * uni(rng);
+        const siran::Detection det = Box(left, top, left + w, top + h, large ? 2 : 0, 1.f);
+        bool free = true;
+        for(size_t i=0;i<truths.size() && free;++i)
+        {
+            free = siran::BoxIou(det, truths[i]) == 0.f && !(det.right > truths[i].left && det.left < truths[i].right &&
+                   det.bottom > truths[i].top && det.top < truths[i].bottom);
+        }
+        if(free)
+        {
+            truths.push_back(det);
+        }
+    }
+}
+
+/**
+ * @brief SimulateTile -- What the detector returns for one tile, in tile pixels: a truth box
+ *        clipped by the tile when enough of it is visible and at least min_side network pixels
+ *        after the letterbox, corners jittered by about one network pixel.
+ */
+static void SimulateTile(const siran::TileRect &tile, const std::vector<siran::Detection> &truths, const int &net_size,
+                         std::mt19937 &rng, std::vector<siran::Detection> &dets)
+{
+    dets.clear();
+    const float scale = std::min(1.f, std::min((float)net_size / tile.width, (float)net_size / tile.height));
+    std::normal_distribution<float> jitter(0.f, 0.5f / scale);
+    std::uniform_real_distribution<float> uni(0.f, 1.f);
+    const float min_side = 8.f;
+    for(size_t i=0;i<truths.size();++i)
+    {
+        const siran::Detection &truth = truths[i];
+        const float left = std::max(truth.left, (float)tile.x);
+        const float top = std::max(truth.top, (float)tile.y);
+        const float right = std::min(truth.right, (float)(tile.x + tile.width));
+        const float bottom = std::min(truth.bottom, (float)(tile.y + tile.height));
+        if(right <= left || bottom <= top)
+        {
+            continue;
+        }
+        const float visible = (right - left) * (bottom - top) / ((truth.right - truth.left) * (truth.bottom - truth.top));
+        if(visible < 0.2f || (right - left) * scale < min_side || (bottom - top) * scale < min_side)
+        {
+            continue;
+        }
+        siran::Detection det = Box(left - tile.x, top - tile.y, right - tile.x, bottom - tile.y, truth.class_id,
+                                   0.4f + 0.3f * visible + 0.2f * uni(rng));
+        det.left = std::max(0.f, det.left + jitter(rng));
+        det.top = std::max(0.f, det.top + jitter(rng));
+        det.right = std::min((float)tile.width, det.right + jitter(rng));
+        det.bottom = std::min((float)tile.height, det.bottom + jitter(rng));
+        dets.push_back(det);
+    }
+}
+
+static void CheckFrames(const int &objects, const int &frames)
+{
+    const int frame_w = 3840;
+    const int frame_h = 2160;
+    const siran::TileConfig config = siran::DefaultTileConfig();
+    std::vector<siran::TileRect> tiles;
+    siran::PlanTiles(frame_w, frame_h, config, tiles);
+
+    std::mt19937 rng(7);
+    std::vector<siran::Detection> truths;
+    std::vector<std::vector<siran::Detection> > tile_dets(tiles.size());
+    std::vector<siran::DetectionSpan> spans(tiles.size());
+    std::vector<siran::Detection> merged, concat, whole;
+    siran::TileMerger merger;
+    siran::MatchStats whole_stats = siran::EmptyMatchStats();
+    siran::MatchStats concat_stats = siran::EmptyMatchStats();
+    siran::MatchStats merged_stats = siran::EmptyMatchStats();
+    uint64_t merge_ns = 0;
+    for(int f=0;f<frames;++f)
+    {
+        MakeTruths(frame_w, frame_h, objects, rng, truths);
+        concat.clear();
+        for(size_t t=0;t<tiles.size();++t)
+        {
+            SimulateTile(tiles[t], truths, config.tile_w, rng, tile_dets[t]);
+            spans[t] = siran::DetectionSpan(tile_dets[t].data(), tile_dets[t].size(), false);
+            for(size_t k=0;k<tile_dets[t].size();++k)
+            {
+                siran::Detection det = tile_dets[t][k];
+                det.left += tiles[t].x;
+                det.right += tiles[t].x;
+                det.top += tiles[t].y;
+                det.bottom += tiles[t].y;
+                concat.push_back(det);
+            }
+        }
+        /// @brief The whole frame slot alone is the untiled Yolov7Detect.
+        whole = tile_dets.back();
+        const uint64_t t0 = siran::NowNs();
+        merger.Run(tiles, spans.data(), config.match_thresh, merged);
+        merge_ns += siran::NowNs() - t0;
+
+        siran::MatchDetections(whole.data(), whole.size(), truths.data(), truths.size(), 0.5f, whole_stats);
+        siran::MatchDetections(concat.data(), concat.size(), truths.data(), truths.size(), 0.5f, concat_stats);
+        siran::MatchDetections(merged.data(), merged.size(), truths.data(), truths.size(), 0.5f, merged_stats);
+    }
+    printf("%d frames %dx%d, %zu slots, %d objects per frame, merge %.3fms/frame\n", frames, frame_w, frame_h,
+           tiles.size(), objects, merge_ns * 1e-6 / std::max(1, frames));
+    printf("%-16s recall %.3f precision %.3f\n", "whole frame", siran::Recall(whole_stats), siran::Precision(whole_stats));
+    printf("%-16s recall %.3f precision %.3f\n", "tiles, no merge", siran::Recall(concat_stats), siran::Precision(concat_stats));
+    printf("%-16s recall %.3f precision %.3f\n", "tiles, merged", siran::Recall(merged_stats), siran::Precision(merged_stats));
+    Check(siran::Recall(merged_stats) > siran::Recall(whole_stats) + 0.5, "tiling finds the small objects the whole frame misses");
+    Check(siran::Recall(merged_stats) >= 0.97 && siran::Precision(merged_stats) >= 0.97, "merged recall and precision >= 0.97");
+    Check(siran::Precision(merged_stats) > siran::Precision(concat_stats) + 0.05, "merge removes the cross tile duplicates");
+}
+
+int main(int arv, char** arg)
+{
+    const int objects = arv > 1 ? atoi(arg[1]) : 160;
+    const int frames = arv > 2 ? atoi(arg[2]) : 50;
+    CheckPlan();
+    CheckMerge();
+    CheckFrames(objects, frames);
+    printf(g_failed == 0 ? "all checks passed\n" : "%d check(s) failed\n", g_failed);
+    return g_failed == 0 ? 0 : 1;
+}
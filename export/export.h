@@ -42,12 +42,100 @@ typedef struct ObjResult_
     int  obj_num;
 }ObjResult;
 
+/// @brief One object seen by both views of a stereo frame.
+typedef struct StereoMatch_
+{
+    int     left;        // index into views[0].obj_info
+    int     right;       // index into views[1].obj_info
+    float   disparity;   // left center x - right center x, pixels
+}StereoMatch;
+
+/// @brief Stereo association limits, see StereoConfig in stereo.h for the defaults.
+typedef struct StereoParam_
+{
+    float   max_row_diff;      // top and bottom rows of a pair within it, pixels
+    float   max_height_ratio;  // larger over smaller box height of a pair
+    float   min_disparity;     // pixels, objects at infinity are 0
+    float   max_disparity;     // nearest object expected, pixels
+}StereoParam;
+
+typedef struct StereoResult_
+{
+    ObjResult    views[2];     // left, right, boxes in view pixels
+    StereoMatch  matches[YOLOV7_MAX_OBJ_NUM];
+    int          match_num;
+}StereoResult;
+
 
 int Yolov7Infer(const void* src, ObjResult *pobj_result, const bool &verbos = false);
 
 int Yolov7Infer2(const std::__cxx11::string &path, ObjResult *pobj_result, const bool &verbos = false);
 
-int Yolov7Infer3(const int &camera_index, ObjResult *pobj_result, const bool &verbos = false);
+/**
+ * @brief Yolov7Infer3 -- Left view of the stereo camera, pobj_result holds the latest frame.
+ * @param gate             -- motion gate, still frames reuse the last result and moving regions
+ *                            are detected alone
+ */
+int Yolov7Infer3(const int &camera_index, ObjResult *pobj_result, const bool &verbos = false, const bool &gate = false);
+
+/**
+ * @brief Yolov7InferStereo -- Both views of a side by side stereo frame(e.g. 2560x960) as one
+ *        batch of 2, views are not copied. Left/right boxes of one object are paired along
+ *        the epipolar rows when associate is set, the views must be rectified.
+ * @param src              -- cv::Mat pointer, left view in the left half
+ * @param presult          -- output views and matches
+ * @param param            -- association limits, nullptr for the defaults
+ * @return                 -- 0--success, -1--input error, -999--no object in either view
+ */
+int Yolov7InferStereo(const void *src, StereoResult *presult, const bool &associate = true, const bool &verbos = false,
+                      const StereoParam *param = nullptr);
+
+/**
+ * @brief Yolov7Infer3Stereo -- Yolov7Infer3 with both views of the stereo camera detected and
+ *        associated, presult holds the latest frame.
+ * @param param            -- association limits, nullptr for the defaults
+ */
+int Yolov7Infer3Stereo(const int &camera_index, StereoResult *presult, const bool &verbos = false,
+                       const StereoParam *param = nullptr);
+
+/**
+ * @brief Yolov7InferTiled -- Detect small objects in a frame much larger than the network input,
+ *        e.g. 2560x960 or 3840x2160: overlapping 640x640 tiles and the whole frame run as one
+ *        batch, boxes in frame pixels merged across tile seams.
+ * @param src              -- cv::Mat pointer
+ * @param pobj_result      -- output ObjResult, the highest YOLOV7_MAX_OBJ_NUM scores
+ * @return                 -- 0--success, -1--input error, -999--no object
+ */
+int Yolov7InferTiled(const void *src, ObjResult *pobj_result, const bool &verbos = false);
+
+/**
+ * @brief Yolov7InferBatch -- Batch inference over batch_size frames in one engine call.
+ * @param src              -- cv::Mat array with batch_size entries
+ * @param batch_size       -- number of frames
+ * @param pobj_results     -- output ObjResult array with batch_size entries
+ * @return                 -- 0--success, -1--input error
+ */
+int Yolov7InferBatch(const void *src, const int &batch_size, ObjResult *pobj_results, const bool &verbos = false);
+
+/**
+ * @brief Yolov7InferBatch2 -- Batch inference over image files.
+ * @param paths            -- image paths
+ * @param pobj_results     -- output ObjResult array with paths.size() entries
+ * @return                 -- 0--success, -1--input error
+ */
+int Yolov7InferBatch2(const std::vector<std::string> &paths, ObjResult *pobj_results, const bool &verbos = false);
+
+/**
+ * @brief Yolov7InferFolder -- Detect every image under a folder, listed and decoded in parallel
+ *        ahead of inference, one result line per detection "path class prob left top right bottom".
+ * @param folder            -- input folder path, searched recursively
+ * @param result_file       -- output text file, empty for stdout; a .bin or .jsonl name writes
+ *                             binary records or JSON lines in the background, rotated files
+ *                             <name>_000000.bin ..., see ResultWriter
+ * @return                  -- 0--success, -1--folder error, -2--result file error, -3--detection
+ *                             failed on at least one image, its lines are written as "error"
+ */
+int Yolov7InferFolder(const std::string &folder, const std::string &result_file, const bool &verbos = false);
 
 /**
  * @brief GetFilePath   -- Get all file paths in a folder.
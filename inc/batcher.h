@@ -0,0 +1,153 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     batcher.h
+*   Brief:    dynamic micro-batching, frames from many producers are grouped into one
+*             engine batch by size or by deadline, whichever comes first.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_BATCHER_H_
+#define YOLOV7TRT_BATCHER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "inc/histogram.h"
+
+namespace siran
+{
+
+/// @brief Batch executor, payloads belong to the submitters and carry inputs and outputs.
+class IBatchBackend
+{
+public:
+    virtual ~IBatchBackend() {}
+    /// @brief Batch sizes the engine is tuned for, e.g. the optimization profile min/opt/max, ascending.
+    virtual std::vector<int> BatchSizes() const = 0;
+    /**
+     * @brief RunBatch -- Run payloads as one batch.
+     * @param payloads     -- payloads.size() <= profile_batch
+     * @param profile_batch -- smallest BatchSizes() entry holding the batch, backends may pad to it
+     * @param status       -- output, one return code per payload
+     */
+    virtual int RunBatch(const std::vector<void*> &payloads, const int &profile_batch, std::vector<int> &status) = 0;
+};
+
+typedef struct BatcherConfig_
+{
+    /// @brief Upper batch size, clamped to the largest backend batch size.
+    int max_batch;
+    /// @brief Longest time the oldest queued frame waits for more frames, microseconds.
+    int max_wait_us;
+    /// @brief Queued frames beyond this are rejected with -2.
+    int queue_capacity;
+}BatcherConfig;
+
+inline BatcherConfig DefaultBatcherConfig()
+{
+    BatcherConfig config;
+    config.max_batch = 8;
+    config.max_wait_us = 5000;
+    config.queue_capacity = 256;
+    return config;
+}
+
+typedef struct BatcherStats_
+{
+    int64_t frames;
+    int64_t batches;
+    int64_t rejected;
+    /// @brief Frames / profile batch of every batch, 0~1.
+    Histogram fill_ratio;
+    /// @brief Submit to batch start, microseconds.
+    Histogram queue_delay_us;
+    /// @brief Batches run per profile batch size, same order as IBatchBackend::BatchSizes.
+    std::vector<int64_t> profile_hits;
+}BatcherStats;
+
+class MicroBatcher
+{
+public:
+    MicroBatcher(IBatchBackend *backend, const BatcherConfig &config = DefaultBatcherConfig());
+    ~MicroBatcher();
+
+    /// @brief Start the dispatch thread.
+    int Start();
+    /// @brief Run what is queued and stop.
+    void Stop();
+
+    /**
+     * @brief Submit -- Queue one frame payload, thread safe.
+     * @return       -- future of the frame status, ready at once with -1(stopped) or -2(queue full)
+     */
+    std::future<int> Submit(void *payload);
+
+    /// @brief Batch size used for n frames, smallest backend batch size >= n.
+    int ProfileBatch(const int &n) const;
+
+    BatcherStats GetStats() const;
+    int QueueDepth() const;
+
+private:
+    MicroBatcher(const MicroBatcher&);
+    MicroBatcher& operator=(const MicroBatcher&);
+
+    typedef std::chrono::steady_clock Clock;
+    typedef struct Pending_
+    {
+        void *payload;
+        std::promise<int> promise;
+        Clock::time_point enqueue_time;
+    }Pending;
+
+    void DispatchLoop();
+    void RunBatch(std::vector<Pending> &batch);
+
+    IBatchBackend *backend_;
+    BatcherConfig config_;
+    std::vector<int> batch_sizes_;
+    int target_batch_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Pending> queue_;
+    bool running_;
+    std::thread dispatcher_;
+
+    mutable std::mutex stats_mutex_;
+    BatcherStats stats_;
+};
+
+/// @brief Cpu stand-in backend, a batch costs fixed_us + per_frame_us * profile_batch of sleep,
+///        i.e. the engine runs padded to the profile size.
+class SimBatchBackend : public IBatchBackend
+{
+public:
+    SimBatchBackend(const std::vector<int> &batch_sizes, const int &fixed_us, const int &per_frame_us);
+    std::vector<int> BatchSizes() const;
+    int RunBatch(const std::vector<void*> &payloads, const int &profile_batch, std::vector<int> &status);
+
+    int64_t Batches() const;
+    /// @brief Total simulated busy time, microseconds.
+    int64_t BusyUs() const;
+
+private:
+    std::vector<int> batch_sizes_;
+    int fixed_us_;
+    int per_frame_us_;
+    /// @brief Read from other threads while the dispatcher runs batches.
+    std::atomic<int64_t> batches_;
+    std::atomic<int64_t> busy_us_;
+};
+
+}
+
+#endif
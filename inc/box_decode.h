@@ -0,0 +1,218 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     box_decode.h
+*   Brief:    yolov7 box decode, threshold, compaction and NMS on device or host,
+*             only the kept boxes leave the device.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_BOX_DECODE_H_
+#define YOLOV7TRT_BOX_DECODE_H_
+
+#include <vector>
+#include <cuda_runtime_api.h>
+
+#include "inc/nms.h"
+
+#ifdef __CUDACC__
+#define BD_HOST_DEVICE __host__ __device__
+#else
+#define BD_HOST_DEVICE
+#endif
+
+/// @brief Device code keeps the host rounding, no fma contraction.
+#if defined(__CUDA_ARCH__)
+#define BD_MUL(a, b) __fmul_rn(a, b)
+#define BD_ADD(a, b) __fadd_rn(a, b)
+#define BD_SUB(a, b) __fsub_rn(a, b)
+#define BD_DIV(a, b) __fdiv_rn(a, b)
+#else
+#define BD_MUL(a, b) ((a) * (b))
+#define BD_ADD(a, b) ((a) + (b))
+#define BD_SUB(a, b) ((a) - (b))
+#define BD_DIV(a, b) ((a) / (b))
+#endif
+
+namespace siran
+{
+
+/// @brief Most boxes a frame keeps, same as Yolov7 MAX_OBJECTS.
+static const int kMaxDecodeBoxes = 512;
+
+/// @brief Per output row decode table, grid offset, grid size and anchor in input pixels.
+typedef struct DecodeRowInfo_
+{
+    float gx;
+    float gy;
+    float feat_w;
+    float feat_h;
+    float anchor_w;
+    float anchor_h;
+}DecodeRowInfo;
+
+/// @brief Decoded box, normalized 0~1 coordinates like Yolov7 before NMS, row is the output row.
+typedef struct DecodeBox_
+{
+    float left;
+    float right;
+    float low;
+    float high;
+    int id;
+    float prob;
+    int row;
+}DecodeBox;
+
+typedef struct DecodeParams_
+{
+    int rows;
+    int class_num;
+    int input_w;
+    int input_h;
+    float conf_thresh;
+    float nms_thresh;
+}DecodeParams;
+
+/// @brief std::max(0.f, std::min(1.f, v)), same operand order so signed zeros match too.
+BD_HOST_DEVICE inline float Clamp01(const float &v)
+{
+    const float m = (v < 1.f) ? v : 1.f;
+    return (0.f < m) ? m : 0.f;
+}
+
+/**
+ * @brief DecodeGeometry -- Box of one candidate row, the arithmetic of Yolov7::YoloProcess.
+ * @param gx, gy          -- grid cell
+ * @param feat_w, feat_h  -- grid size of the level
+ * @param anchor_w, anchor_h -- anchor in input pixels
+ */
+BD_HOST_DEVICE inline void DecodeGeometry(const float *feat, const float &gx, const float &gy, const float &feat_w, const float &feat_h,
+                                          const float &anchor_w, const float &anchor_h, const int &input_w, const int &input_h, DecodeBox &box)
+{
+    const float cx = BD_DIV(BD_ADD(BD_SUB(BD_MUL(feat[0], 2.f), 0.5f), gx), feat_w);
+    const float cy = BD_DIV(BD_ADD(BD_SUB(BD_MUL(feat[1], 2.f), 0.5f), gy), feat_h);
+    /// @brief Squares of a float are exact in double, same value as pow(x, 2).
+    const double tw = BD_MUL(feat[2], 2.f);
+    const double th = BD_MUL(feat[3], 2.f);
+    const float w = tw * tw * anchor_w / input_w;
+    const float h = th * th * anchor_h / input_h;
+    const float hw = BD_DIV(w, 2.f);
+    const float hh = BD_DIV(h, 2.f);
+    box.left  = Clamp01(BD_SUB(cx, hw));
+    box.right = Clamp01(BD_ADD(cx, hw));
+    box.low   = Clamp01(BD_SUB(cy, hh));
+    box.high  = Clamp01(BD_ADD(cy, hh));
+}
+
+/**
+ * @brief DecodeRowBox -- One output row, objectness test, first-max class argmax, conf test and
+ *        box, shared by the kernel and the cpu reference.
+ * @return              -- true when the row is a candidate
+ */
+BD_HOST_DEVICE inline bool DecodeRowBox(const float *feat, const DecodeRowInfo &info, const DecodeParams &params, DecodeBox &box)
+{
+    const float obj_conf = feat[4];
+    if (!(obj_conf > params.conf_thresh))
+    {
+        return false;
+    }
+    float max_conf = 0.f;
+    int max_index = 0;
+    for (int c = 0; c < params.class_num; ++c)
+    {
+        if (feat[5 + c] > max_conf)
+        {
+            max_conf = feat[5 + c];
+            max_index = c;
+        }
+    }
+    const float conf = BD_MUL(max_conf, obj_conf);
+    if (!(conf > params.conf_thresh))
+    {
+        return false;
+    }
+    DecodeGeometry(feat, info.gx, info.gy, info.feat_w, info.feat_h, info.anchor_w, info.anchor_h, params.input_w, params.input_h, box);
+    box.prob  = conf;
+    box.id    = max_index;
+    return true;
+}
+
+/// @brief Compact decode result of one frame, the only device to host copy of DeviceBoxDecoder.
+typedef struct DecodeOutput_
+{
+    int count;       // boxes written
+    int candidates;  // rows over the thresholds, may exceed kMaxDecodeBoxes
+    DecodeBox boxes[kMaxDecodeBoxes];
+}DecodeOutput;
+
+class DeviceTracer;
+
+/// @brief Decoder interface, boxes come back after NMS in row order, normalized coordinates.
+class IBoxDecoder
+{
+public:
+    virtual ~IBoxDecoder() {}
+    /**
+     * @brief Decode -- One frame of network output.
+     * @param fea_out  -- rows x (class_num + 5) floats, host or device memory depending on the decoder
+     * @param boxes    -- output kept boxes, at most kMaxDecodeBoxes
+     * @param stream   -- cuda stream the output is produced on, unused by host decoders
+     * @return         -- 0--success, -999--no object, -1--input error
+     */
+    virtual int Decode(const float *fea_out, std::vector<DecodeBox> &boxes, cudaStream_t stream) = 0;
+    /// @brief The last Decode had more than kMaxDecodeBoxes candidates, the later rows were dropped.
+    virtual bool Truncated() const = 0;
+};
+
+/// @brief Cpu reference, host fea_out, the row loop of DecodeRowBox and NmsEngine.
+class CpuBoxDecoder : public IBoxDecoder
+{
+public:
+    CpuBoxDecoder(const DecodeParams &params, const std::vector<DecodeRowInfo> &row_info);
+    int Decode(const float *fea_out, std::vector<DecodeBox> &boxes, cudaStream_t stream = 0);
+    bool Truncated() const;
+
+private:
+    DecodeParams params_;
+    bool truncated_;
+    std::vector<DecodeRowInfo> row_info_;
+    std::vector<DecodeBox> candidates_;
+    std::vector<int> valid_;
+    NmsEngine nms_;
+};
+
+/// @brief Device decoder, device fea_out. A row kernel flags and decodes candidates, one block
+///        compacts them in row order(prefix sum), runs NMS in shared memory and writes the kept
+///        boxes, only that compact list(a few KB instead of rows x (class_num+5) floats) is copied back.
+class DeviceBoxDecoder : public IBoxDecoder
+{
+public:
+    /// @brief device_nms false copies the compact candidates back and runs NmsEngine on host.
+    DeviceBoxDecoder(const DecodeParams &params, const std::vector<DecodeRowInfo> &row_info, const bool &device_nms = true);
+    ~DeviceBoxDecoder();
+    int Decode(const float *fea_out, std::vector<DecodeBox> &boxes, cudaStream_t stream);
+    bool Truncated() const;
+    /// @brief Mark TRACE_DECODE and TRACE_D2H on tracer before the host sync of Decode, nullptr none.
+    void SetTracer(DeviceTracer *tracer);
+
+private:
+    DeviceBoxDecoder(const DeviceBoxDecoder&);
+    DeviceBoxDecoder& operator=(const DeviceBoxDecoder&);
+
+    DecodeParams params_;
+    bool device_nms_;
+    bool truncated_;
+    DeviceTracer *tracer_;
+    DecodeRowInfo *row_info_;
+    int *flags_;
+    DecodeBox *scratch_;
+    DecodeOutput *output_;
+    /// @brief Pinned mirror of output_.
+    DecodeOutput *host_output_;
+    std::vector<int> valid_;
+    NmsEngine nms_;
+};
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     buffer_pool.h
+*   Brief:    device/pinned host buffer pool, buffers keyed by kind and size bucket, cached
+*             memory capped.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_BUFFER_POOL_H_
+#define YOLOV7TRT_BUFFER_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace siran
+{
+
+/// @brief Memory kind of a pooled buffer.
+enum MemKind
+{
+    MEM_DEVICE = 0,  // cudaMalloc
+    MEM_PINNED = 1   // cudaMallocHost
+};
+
+/// @brief Pool counters, allocations are real allocator calls.
+typedef struct PoolStats_
+{
+    int64_t allocations;
+    int64_t frees;
+    int64_t hits;
+    int64_t misses;
+    int64_t bytes_in_use;
+    int64_t bytes_cached;
+}PoolStats;
+
+typedef void* (*PoolAllocFunc)(const size_t &bytes, const int &kind);
+typedef void  (*PoolFreeFunc)(void *ptr, const int &kind);
+
+/// @brief Default cap of released memory kept by a pool.
+const size_t kPoolMaxCachedBytes = (size_t)256 << 20;
+
+/**
+ * @brief BufferPoolBucket -- Allocation size of a request, four buckets per power of two(at most
+ *        25% over the request, 256 bytes at least), so varying input sizes share buffers.
+ */
+size_t BufferPoolBucket(const size_t &bytes);
+
+class BufferPool
+{
+public:
+    /// @brief BufferPool construct function, default allocator is cuda runtime,
+    ///        a host allocator can be plugged in to exercise the pool without GPU.
+    ///        Released memory beyond max_cached_bytes is freed, the largest buffers first.
+    explicit BufferPool(PoolAllocFunc alloc_func = nullptr, PoolFreeFunc free_func = nullptr,
+                        const size_t &max_cached_bytes = kPoolMaxCachedBytes);
+    ~BufferPool();
+
+    /// @brief Get a buffer of at least bytes(its BufferPoolBucket), reuse a released one of
+    ///        the same kind and bucket.
+    void* Acquire(const size_t &bytes, const int &kind = MEM_DEVICE);
+
+    /// @brief Give a buffer back to the pool, memory is kept for the next Acquire up to the cap.
+    void Release(void *ptr);
+
+    /// @brief Free every cached buffer, buffers in use are untouched.
+    void Trim();
+
+    PoolStats GetStats() const;
+
+private:
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    typedef std::pair<int, size_t> PoolKey;
+
+    /// @brief Free cached buffers until bytes_cached is within max_cached_bytes_, mutex_ held.
+    void Evict();
+
+    PoolAllocFunc alloc_func_;
+    PoolFreeFunc free_func_;
+    size_t max_cached_bytes_;
+    std::multimap<PoolKey, void*> free_list_;
+    std::map<void*, PoolKey> in_use_;
+    PoolStats stats_;
+    mutable std::mutex mutex_;
+};
+
+}
+
+#endif
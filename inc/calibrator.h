@@ -0,0 +1,134 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     calibrator.h
+*   Brief:    INT8 calibration, letterboxed batches streamed from a frame source through a
+*             bounded prefetch queue, calibration cache file and TRT entropy/minmax calibrators.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_CALIBRATOR_H_
+#define YOLOV7TRT_CALIBRATOR_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inc/preprocess.h"
+#include "inc/stream.h"
+
+namespace nvinfer1
+{
+class IInt8Calibrator;
+}
+
+namespace siran
+{
+
+enum CalibrationAlgorithm
+{
+    CALIB_ENTROPY = 0,   // IInt8EntropyCalibrator2, the TRT default for CNNs
+    CALIB_MINMAX  = 1,   // IInt8MinMaxCalibrator, keeps the full range, for outlier sensitive heads
+};
+
+/// @brief Algorithm tag of the calibration cache header, "TRT-<version>-<tag>".
+const char* CalibrationAlgorithmName(const int &algorithm);
+
+typedef struct CalibrationConfig_
+{
+    int batch_size;
+    int input_w;
+    int input_h;
+    int max_batches;     // <= 0 until the source ends
+    int prefetch;        // batches queued ahead of the calibrator
+    int thread_num;      // letterbox threads, <= 0 every hardware thread
+}CalibrationConfig;
+
+inline CalibrationConfig DefaultCalibrationConfig()
+{
+    CalibrationConfig config;
+    config.batch_size = 8;
+    config.input_w = 640;
+    config.input_h = 640;
+    config.max_batches = 64;
+    config.prefetch = 2;
+    config.thread_num = 0;
+    return config;
+}
+
+/**
+ * @brief CalibrationBatchStream -- NCHW f32 batches of letterboxed frames, same preprocessing as
+ *        inference(CpuLetterbox). A loader thread fills at most prefetch batches ahead, memory
+ *        stays bounded however large the image set is. A short last batch is dropped.
+ */
+class CalibrationBatchStream
+{
+public:
+    /// @brief source belongs to the caller, read once from the loader thread.
+    CalibrationBatchStream(IFrameSource *source, const CalibrationConfig &config = DefaultCalibrationConfig());
+    ~CalibrationBatchStream();
+
+    /// @brief Start the loader, Next starts it too.
+    void Start();
+    /**
+     * @brief Next  -- Next batch, blocks while the loader works on it.
+     * @param batch -- output batch_size x 3 x input_h x input_w, a batch passed in is recycled
+     * @return      -- true--batch, false--source ended
+     */
+    bool Next(std::vector<float> &batch);
+    void Stop();
+
+    int BatchSize() const;
+    size_t BatchFloats() const;
+    int64_t Batches() const;
+    int64_t Images() const;
+    int64_t Dropped() const;
+
+private:
+    CalibrationBatchStream(const CalibrationBatchStream&);
+    CalibrationBatchStream& operator=(const CalibrationBatchStream&);
+
+    void LoaderLoop();
+
+    IFrameSource *source_;
+    CalibrationConfig config_;
+    CpuLetterbox letterbox_;
+    BlockingRing<std::vector<float> > ready_;
+    /// @brief Batches given back by Next, reused by the loader.
+    std::vector<std::vector<float> > free_;
+    std::mutex free_mutex_;
+    std::thread loader_;
+    std::atomic<bool> started_;
+    std::atomic<bool> stop_;
+    std::atomic<int64_t> batches_;
+    std::atomic<int64_t> images_;
+    std::atomic<int64_t> dropped_;
+};
+
+/**
+ * @brief ReadCalibrationCache -- Cache written by a calibrator of the same algorithm.
+ * @return                     -- 0--success, -1--no cache, -2--other algorithm or not a TRT cache
+ */
+int ReadCalibrationCache(const std::string &path, const int &algorithm, std::string &data);
+/// @brief Write through a temporary file and rename, 0--success.
+int WriteCalibrationCache(const std::string &path, const std::string &data);
+
+/// @brief Id of a calibration set for the engine cache key, from the image list, algorithm,
+///        input size and batches used.
+std::string CalibrationId(const std::vector<std::string> &images, const int &algorithm, const CalibrationConfig &config);
+
+/**
+ * @brief CreateInt8Calibrator -- TRT calibrator over stream. A valid cache_file is used instead
+ *        of the batches, a new calibration is written to it. Caller deletes the calibrator
+ *        after the build, stream must outlive it.
+ */
+nvinfer1::IInt8Calibrator* CreateInt8Calibrator(CalibrationBatchStream *stream, const std::string &cache_file,
+                                                const int &algorithm = CALIB_ENTROPY);
+
+}
+
+#endif
@@ -8,6 +8,8 @@
 #include <NvInferRuntimeCommon.h>
 #include "NvOnnxParser.h"
 #include "inc/logging.h"
+#include "inc/engine_loader.h"
+#include "inc/device_group.h"
 
 //printf("\033[32m%s (%d) - <%s>\033[0m\n", str);
 #define LOG() (printf("\033[32m%s (%d) - <%s>\033[0m\n",__FILE__,__LINE__,__FUNCTION__))
@@ -114,22 +116,18 @@ static const char* class_names[] =
 
 
 /**
- * @brief GaofaSetCudaDevice -- Select algorithm running platform.
- * @param deviceID           -- GPU ID, e.g. support input 0 or 1
+ * @brief SetCudaDevice -- Select algorithm running platform, the device count is cached.
+ * @param deviceID      -- GPU ID, 0 ~ CudaDeviceCount()-1
+ * @return              -- 0--success, -1--no such device, the current device is kept
  */
-static void SetCudaDevice(const int &deviceID)
+static int SetCudaDevice(const int &deviceID)
 {
-    int countGpus=0;
-    cudaGetDeviceCount(&countGpus);
-    //std::cout<<"########## gpu num "<<countGpus<<" ##########"<<std::endl;
-    if(deviceID > countGpus -1)
+    if(deviceID < 0 || deviceID >= CudaDeviceCount())
     {
-        std::cout<<"########## select error gpu id"<<" ##########"<<std::endl;
-        cudaSetDevice(0);
-        return;
+        std::cout<<"########## invalid gpu id "<<deviceID<<", "<<CudaDeviceCount()<<" device(s) ##########"<<std::endl;
+        return -1;
     }
-    cudaSetDevice(deviceID);
-    //std::cout<<"########## select gpu id "<<deviceID<<" ##########"<<std::endl;
+    return cudaSetDevice(deviceID) == cudaSuccess ? 0 : -1;
 }
 
 
@@ -211,77 +209,38 @@ static std::vector<std::string>readFolder(const std::string &image_path)
     return image_names;
 }
 
+/// @brief runtime must outlive engine, the caller deletes engine then runtime(TRT 8 objects are
+///        released with delete), both are null on failure.
 static bool readTrtFile(const std::string &engineFile, //name of the engine file
-                 nvinfer1::ICudaEngine *&engine)
+                 nvinfer1::ICudaEngine *&engine,
+                 nvinfer1::IRuntime *&runtime)
 {
-    std::string cached_engine;
-    std::fstream file;
     std::cout << "loading filename from:" << engineFile << std::endl;
 
-    file.open(engineFile, std::ios::binary | std::ios::in);
-
-    if (!file.is_open())
-    {
-        std::cout << "read file error: " << engineFile << std::endl;
-        cached_engine = "";
-    }
-
-    while (file.peek() != EOF)
+    engine = nullptr;
+    runtime = nvinfer1::createInferRuntime(gLogger.getTRTLogger());
+    nvinfer1::IRuntime *trtRuntime = runtime;
+    MmapFileSource source;
+    EngineLoadReport report;
+    /// @brief The mapping is handed to TRT as is, no copy of the plan on the host.
+    int iret = LoadEngineFile(source, engineFile, [&](const void *data, size_t size) {
+        engine = trtRuntime->deserializeCudaEngine(data, size);
+        return engine != nullptr;
+    }, &report);
+    if(iret != 0)
     {
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        cached_engine.append(buffer.str());
+        std::cout << "load engine error: " << engineFile << " code " << iret << std::endl;
+        delete engine;
+        engine = nullptr;
+        delete runtime;
+        runtime = nullptr;
+        return false;
     }
-    file.close();
-    nvinfer1::IRuntime *trtRuntime;
-
-    trtRuntime = nvinfer1::createInferRuntime(gLogger.getTRTLogger());
-    engine = trtRuntime->deserializeCudaEngine(cached_engine.data(),cached_engine.size());
-    std::cout << "deserialize done" << std::endl;
-
+    printf("deserialize done, %.1fMB, open %.2fms, deserialize %.2fms, total %.2fms\n",
+           report.file_size / 1048576.0, report.open_ms, report.deserialize_ms, report.total_ms);
     return true;
 }
 
-static void onnxToTRTModel(const std::string &modelFile, // name of the onnx model
-                    const std::string &filename,  // name of saved engine
-                    nvinfer1::ICudaEngine *&engine, const int &BATCH_SIZE)
-{
-    // create the builder
-    nvinfer1::IBuilder *builder = nvinfer1::createInferBuilder(gLogger.getTRTLogger());
-    assert(builder != nullptr);
-
-    const auto explicitBatch = 1U << static_cast<uint32_t>(nvinfer1::NetworkDefinitionCreationFlag::kEXPLICIT_BATCH);
-    auto network = builder->createNetworkV2(explicitBatch);
-    auto config = builder->createBuilderConfig();
-
-    auto parser = nvonnxparser::createParser(*network, gLogger.getTRTLogger());
-    if (!parser->parseFromFile(modelFile.c_str(), static_cast<int>(gLogger.getReportableSeverity()))) {
-        gLogError << "Failure while parsing ONNX file" << std::endl;
-    }
-    // Build the engine
-    builder->setMaxBatchSize(BATCH_SIZE);
-    config->setMaxWorkspaceSize(1_GiB);
-    config->setFlag(nvinfer1::BuilderFlag::kFP16);
-
-    std::cout << "start building engine" << std::endl;
-    engine = builder->buildEngineWithConfig(*network, *config);
-    std::cout << "build engine done" << std::endl;
-    assert(engine);
-    // we can destroy the parser
-    parser->destroy();
-    // save engine
-    nvinfer1::IHostMemory *data = engine->serialize();
-    std::ofstream file;
-    file.open(filename, std::ios::binary | std::ios::out);
-    std::cout << "writing engine file..." << std::endl;
-    file.write((const char *) data->data(), data->size());
-    std::cout << "save engine file done" << std::endl;
-    file.close();
-    // then close everything down
-    network->destroy();
-    builder->destroy();
-}
-
 static std::map<int, std::string> readImageNetLabel(const std::string &fileName)
 {
     std::map<int, std::string> imagenet_label;
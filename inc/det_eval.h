@@ -0,0 +1,68 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     det_eval.h
+*   Brief:    detection evaluation on a labeled set, yolo txt labels, IoU matching and
+*             precision/recall counters, e.g. INT8 vs FP16 engines.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_DET_EVAL_H_
+#define YOLOV7TRT_DET_EVAL_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "inc/detection.h"
+
+namespace siran
+{
+
+/**
+ * @brief YoloLabelPath -- Label file of an image, .../images/x.jpg --> .../labels/x.txt, the
+ *        same directory with .txt extension when the path has no images directory.
+ */
+std::string YoloLabelPath(const std::string &image_file);
+
+/**
+ * @brief LoadYoloLabels -- "class cx cy w h" lines, normalized to the image size.
+ * @param truths         -- output boxes in image pixels, prob 1
+ * @return               -- 0--success, -1--file not exists, -2--bad line
+ */
+int LoadYoloLabels(const std::string &label_file, const int &img_w, const int &img_h, std::vector<Detection> &truths);
+
+float BoxIou(const Detection &a, const Detection &b);
+
+typedef struct MatchStats_
+{
+    int64_t tp;
+    int64_t fp;
+    int64_t fn;
+    double iou_sum;     // over tp
+}MatchStats;
+
+inline MatchStats EmptyMatchStats()
+{
+    MatchStats stats;
+    stats.tp = 0;
+    stats.fp = 0;
+    stats.fn = 0;
+    stats.iou_sum = 0.;
+    return stats;
+}
+
+/**
+ * @brief MatchDetections -- Greedy match by score, a prediction matches the unmatched truth of
+ *        its class with the highest IoU >= iou_thresh, counts are added to stats.
+ */
+void MatchDetections(const Detection *preds, const int &pred_num, const Detection *truths, const int &truth_num,
+                     const float &iou_thresh, MatchStats &stats);
+
+double Precision(const MatchStats &stats);
+double Recall(const MatchStats &stats);
+double MeanIou(const MatchStats &stats);
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     detection.h
+*   Brief:    structured detection result, a reusable per-context arena and a span view
+*             over it, ObjResult is an adapter over the view.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_DETECTION_H_
+#define YOLOV7TRT_DETECTION_H_
+
+#include <vector>
+
+/// @brief C result of export.h, declared here so postprocess headers do not pull in the C api.
+struct ObjResult_;
+
+namespace siran
+{
+
+/// @brief One detection, box in source image pixels.
+typedef struct Detection_
+{
+    float left;
+    float top;
+    float right;
+    float bottom;
+    int class_id;
+    float prob;
+}Detection;
+
+/// @brief Read-only view over the detections of one frame, valid until the owner is reused.
+class DetectionSpan
+{
+public:
+    DetectionSpan():
+        data_(nullptr),
+        count_(0),
+        truncated_(false)
+    {
+    }
+
+    DetectionSpan(const Detection *data, const int &count, const bool &truncated):
+        data_(data),
+        count_(count),
+        truncated_(truncated)
+    {
+    }
+
+    const Detection* begin() const { return data_; }
+    const Detection* end() const { return data_ + count_; }
+    const Detection& operator[](const int &i) const { return data_[i]; }
+    const Detection* Data() const { return data_; }
+    int Count() const { return count_; }
+    bool Empty() const { return 0 == count_; }
+    /// @brief More candidates than the producer could hold, the lowest rows were dropped.
+    bool Truncated() const { return truncated_; }
+
+private:
+    const Detection *data_;
+    int count_;
+    bool truncated_;
+};
+
+/// @brief Fixed capacity detection buffer, allocated once, Reset per frame, no allocation after construct.
+class DetectionArena
+{
+public:
+    explicit DetectionArena(const int &capacity = 512);
+
+    /// @brief Start a new frame, keeps the storage.
+    void Reset();
+    /// @brief Append one detection, false and truncated when full.
+    bool Push(const Detection &det);
+    /// @brief The producer dropped candidates upstream, e.g. the decode candidate cap.
+    void SetTruncated();
+
+    int Count() const;
+    int Capacity() const;
+    bool Truncated() const;
+    DetectionSpan View() const;
+
+private:
+    std::vector<Detection> storage_;
+    int count_;
+    bool truncated_;
+};
+
+/**
+ * @brief ToObjResult -- Export a frame to the C result, boxes truncated to int pixels. Frames with
+ *        more than YOLOV7_MAX_OBJ_NUM detections keep the highest scores, in their original order.
+ * @param detections  -- input detections
+ * @param pobj_result -- output result
+ * @param source      -- output, optional, YOLOV7_MAX_OBJ_NUM entries, index into detections of
+ *                       each obj_info entry
+ * @return            -- 0--success, -1--input error, -999--no object
+ */
+int ToObjResult(const DetectionSpan &detections, struct ObjResult_ *pobj_result, int *source = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,120 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     device_group.h
+*   Brief:    multi-GPU device group, one inference server(engine replica + context pool)
+*             per device, tasks go to the device with the least outstanding work.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_DEVICE_GROUP_H_
+#define YOLOV7TRT_DEVICE_GROUP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "inc/infer_server.h"
+
+namespace siran
+{
+
+/// @brief One CUDA device, numa_node is -1 when the platform does not report it.
+typedef struct CudaDeviceInfo_
+{
+    int id;
+    std::string name;
+    std::string pci_bus_id;
+    int numa_node;
+    int sm_major;
+    int sm_minor;
+    size_t total_mem;
+}CudaDeviceInfo;
+
+/// @brief Devices of this process, queried on first use and cached, the device list does
+///        not change while a process runs.
+const std::vector<CudaDeviceInfo>& CudaDevices();
+int CudaDeviceCount();
+
+/**
+ * @brief PinThreadToNumaNode -- Restrict the calling thread to the cpus of a NUMA node.
+ * @return                    -- 0--success, -1--unknown node or affinity not supported
+ */
+int PinThreadToNumaNode(const int &numa_node);
+
+enum DispatchPolicy
+{
+    DISPATCH_LEAST_OUTSTANDING = 0,   // queued + running tasks per context, lowest first
+    DISPATCH_ROUND_ROBIN       = 1,   // for comparison
+};
+
+/// @brief Per device counters, outstanding is queued plus running.
+typedef struct DeviceLoad_
+{
+    int device_id;
+    int numa_node;
+    int instances;
+    int64_t submitted;
+    int64_t completed;
+    int64_t outstanding;
+}DeviceLoad;
+
+class DeviceGroup
+{
+public:
+    explicit DeviceGroup(const int &policy = DISPATCH_LEAST_OUTSTANDING, const int &queue_capacity = 64);
+    ~DeviceGroup();
+
+    /**
+     * @brief AddDevice -- Serve device_id with backend, before Start. Worker threads of the device
+     *        are pinned to numa_node, < 0 leaves them unpinned. backend belongs to the caller.
+     * @return          -- 0--success, -1--running or no backend
+     */
+    int AddDevice(const int &device_id, IInferBackend *backend, const int &numa_node = -1);
+
+    int Start();
+    void Stop();
+
+    /**
+     * @brief Submit -- Non blocking, to the least loaded device, the next ones when its queue is full.
+     * @return       -- 0--queued, -1--not running, -2--every queue full
+     */
+    int Submit(InferTask *task);
+    /// @brief Synchronous call on the least loaded device, return task->status.
+    int Run(InferTask *task);
+
+    int NumDevices() const;
+    std::vector<DeviceLoad> GetLoads() const;
+
+private:
+    DeviceGroup(const DeviceGroup&);
+    DeviceGroup& operator=(const DeviceGroup&);
+
+    /// @brief Devices by dispatch preference for the next task.
+    void Order(std::vector<int> &order) const;
+    int64_t Outstanding(const int &device) const;
+
+    typedef struct Device_
+    {
+        int device_id;
+        int numa_node;
+        IInferBackend *backend;
+        std::unique_ptr<InferServer> server;
+        /// @brief Tasks between the dispatch decision and the server accounting for them, so
+        ///        concurrent dispatchers do not all pick the same idle device.
+        std::atomic<int64_t> pending;
+    }Device;
+
+    int policy_;
+    int queue_capacity_;
+    bool running_;
+    std::vector<std::unique_ptr<Device> > devices_;
+    std::atomic<uint64_t> next_;
+};
+
+}
+
+#endif
@@ -0,0 +1,215 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     engine_cache.h
+*   Brief:    TRT engine build and cache manager, engines are built from ONNX on demand and
+*             cached per model hash, GPU, TRT version, precision and optimization profiles.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_ENGINE_CACHE_H_
+#define YOLOV7TRT_ENGINE_CACHE_H_
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace nvinfer1
+{
+class IInt8Calibrator;
+}
+
+namespace siran
+{
+
+enum EnginePrecision
+{
+    PRECISION_FP32 = 0,
+    PRECISION_FP16 = 1,
+    PRECISION_INT8 = 2,   // int8 with fp16 fallback, needs a calibrator or its cache
+};
+
+const char* EnginePrecisionName(const int &precision);
+
+/// @brief Optimization profile of one input, NCHW min/opt/max dims.
+typedef struct EngineProfile_
+{
+    std::string input_name;
+    std::vector<int> min_dims;
+    std::vector<int> opt_dims;
+    std::vector<int> max_dims;
+}EngineProfile;
+
+/// @brief Dynamic batch profile, batch 1 ~ max_batch, tuned for opt_batch.
+EngineProfile BatchProfile(const std::string &input_name, const int &c, const int &h, const int &w,
+                           const int &opt_batch, const int &max_batch);
+
+/// @brief What to build. profiles empty: inputs with a dynamic batch get 1/max_batch/max_batch.
+typedef struct EngineBuildConfig_
+{
+    std::string onnx_file;
+    int precision;
+    int max_batch;
+    int workspace_mb;
+    std::vector<EngineProfile> profiles;
+    /// @brief INT8 only, owned by the caller; calibration_id names its data set or cache and is
+    ///        part of the cache key, engines calibrated on different data are different engines.
+    nvinfer1::IInt8Calibrator *calibrator;
+    std::string calibration_id;
+}EngineBuildConfig;
+
+inline EngineBuildConfig DefaultEngineBuildConfig()
+{
+    EngineBuildConfig config;
+    config.precision = PRECISION_FP16;
+    config.max_batch = 1;
+    config.workspace_mb = 1024;
+    config.calibrator = nullptr;
+    return config;
+}
+
+/// @brief Target of a build, engines only run on the GPU architecture and TRT version they were built with.
+typedef struct EnginePlatform_
+{
+    std::string gpu_name;
+    int sm_major;
+    int sm_minor;
+    int trt_version;      // e.g. 8401 for 8.4.1
+}EnginePlatform;
+
+/// @brief Builds a serialized engine, the TRT builder in production and a fake in checks.
+class IEngineBuilder
+{
+public:
+    virtual ~IEngineBuilder() {}
+    virtual EnginePlatform Platform() const = 0;
+    /**
+     * @brief Build        -- Build config.onnx_file into engine_file.
+     * @param timing_cache -- in: serialized timing cache of this platform(may be empty), out: updated cache
+     * @return             -- 0--success, -1--parse failed, -2--invalid config, -3--build failed
+     */
+    virtual int Build(const EngineBuildConfig &config, std::string &timing_cache, const std::string &engine_file) = 0;
+};
+
+typedef struct EngineCacheConfig_
+{
+    std::string cache_dir;
+    int max_entries;          // engines kept, least recently used evicted first, <= 0 unlimited
+    int64_t max_bytes;        // total engine size, <= 0 unlimited
+    bool timing_cache;        // reuse the per-platform builder timing cache
+}EngineCacheConfig;
+
+inline EngineCacheConfig DefaultEngineCacheConfig()
+{
+    EngineCacheConfig config;
+    config.cache_dir = "./engine_cache";
+    config.max_entries = 8;
+    config.max_bytes = 0;
+    config.timing_cache = true;
+    return config;
+}
+
+typedef struct EngineCacheEntry_
+{
+    std::string engine_file;
+    int64_t size;
+    int64_t last_used;        // ns since epoch, mtime of the .key file
+}EngineCacheEntry;
+
+typedef struct EngineCacheStats_
+{
+    int64_t hits;
+    int64_t misses;
+    int64_t builds;
+    int64_t build_failures;
+    int64_t evictions;
+    double last_build_ms;
+}EngineCacheStats;
+
+/// @brief 64-bit FNV-1a, content hash of models and keys.
+uint64_t Fnv1a64(const void *data, const size_t &size, const uint64_t &seed = 14695981039346656037ULL);
+/// @brief Content hash of a file, 0 when it cannot be read.
+uint64_t HashFile(const std::string &path);
+
+/**
+ * @brief EngineCache -- Engines live in cache_dir as <model>_sm<xy>_trt<ver>_<precision>_<key hash>.trt
+ *        with a .key file holding the full key and a copy of the model .cfg. A .key that does not
+ *        match is a miss, the engine is rebuilt. Files without a .key are never touched.
+ */
+class EngineCache
+{
+public:
+    /// @brief builder belongs to the caller.
+    EngineCache(IEngineBuilder *builder, const EngineCacheConfig &config = DefaultEngineCacheConfig());
+
+    /// @brief Full cache key, one "name=value" per line.
+    std::string Key(const EngineBuildConfig &build);
+    std::string EnginePath(const EngineBuildConfig &build);
+
+    /**
+     * @brief GetEngine   -- Cached engine of build, built and stored on a miss, then the cache is
+     *        trimmed to its limits(the returned engine is kept).
+     * @param engine_file -- output engine path, loadable by Yolov7Trt
+     * @return            -- 0--success, -1--onnx not readable, -2--cache dir not writable, -3--build failed
+     */
+    int GetEngine(const EngineBuildConfig &build, std::string &engine_file);
+
+    /// @brief Cached engines, least recently used first.
+    std::vector<EngineCacheEntry> Entries() const;
+    /// @brief Evict least recently used engines over the limits, never keep_file, return the number removed.
+    int Trim(const std::string &keep_file = "");
+    EngineCacheStats GetStats() const;
+
+private:
+    EngineCache(const EngineCache&);
+    EngineCache& operator=(const EngineCache&);
+
+    /// @brief Callers hold mutex_.
+    std::string KeyLocked(const EngineBuildConfig &build);
+    std::string PathOf(const EngineBuildConfig &build, const std::string &key) const;
+    std::vector<EngineCacheEntry> EntriesLocked() const;
+    int TrimLocked(const std::string &keep_file);
+    std::string TimingCachePath() const;
+    uint64_t ModelHash(const std::string &onnx_file);
+    void RemoveEntry(const std::string &engine_file);
+
+    IEngineBuilder *builder_;
+    EngineCacheConfig config_;
+    EnginePlatform platform_;
+    /// @brief Model hashes by path, rehashed when size or mtime change.
+    typedef struct HashMemo_
+    {
+        int64_t size;
+        int64_t mtime;
+        uint64_t hash;
+    }HashMemo;
+    std::map<std::string, HashMemo> hash_memo_;
+    mutable std::mutex mutex_;
+    EngineCacheStats stats_;
+};
+
+/// @brief TensorRT builder on device_id, ONNX parser, FP32/FP16/INT8 and optimization profiles.
+class TrtEngineBuilder : public IEngineBuilder
+{
+public:
+    explicit TrtEngineBuilder(const int &device_id = 0);
+    EnginePlatform Platform() const;
+    int Build(const EngineBuildConfig &config, std::string &timing_cache, const std::string &engine_file);
+
+private:
+    int device_id_;
+};
+
+/**
+ * @brief GetCachedEngine -- Engine of an ONNX model on device_id from <onnx dir>/engine_cache,
+ *        built with the TRT builder on a miss. Yolov7Trt calls it when given a .onnx file.
+ * @return                -- see EngineCache::GetEngine
+ */
+int GetCachedEngine(const std::string &onnx_file, const int &device_id, std::string &engine_file,
+                    const int &precision = PRECISION_FP16, const int &max_batch = 1);
+
+}
+
+#endif
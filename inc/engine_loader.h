@@ -0,0 +1,98 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     engine_loader.h
+*   Brief:    TRT engine file loading, mmap source and zero-copy deserialize.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_ENGINE_LOADER_H_
+#define YOLOV7TRT_ENGINE_LOADER_H_
+
+#include <stddef.h>
+#include <functional>
+#include <string>
+
+namespace siran
+{
+
+/// @brief Smallest plausible serialized engine, anything shorter is a truncated file.
+static const size_t kMinEngineSize = 1024;
+
+/// @brief Engine load timing, milliseconds.
+typedef struct EngineLoadReport_
+{
+    size_t file_size;
+    double open_ms;
+    double deserialize_ms;
+    double total_ms;
+}EngineLoadReport;
+
+/// @brief Read-only view of an engine file, the view stays valid until Close.
+class IEngineFileSource
+{
+public:
+    virtual ~IEngineFileSource() {}
+    virtual int Open(const std::string &path) = 0;
+    virtual const void* Data() const = 0;
+    virtual size_t Size() const = 0;
+    virtual void Close() = 0;
+};
+
+/// @brief mmap source, pages are read ahead sequentially and never copied.
+class MmapFileSource : public IEngineFileSource
+{
+public:
+    MmapFileSource();
+    ~MmapFileSource();
+    int Open(const std::string &path);
+    const void* Data() const;
+    size_t Size() const;
+    void Close();
+
+private:
+    MmapFileSource(const MmapFileSource&);
+    MmapFileSource& operator=(const MmapFileSource&);
+
+    int fd_;
+    void *data_;
+    size_t size_;
+};
+
+/// @brief In-memory source, e.g. an embedded engine or a fake file in tests.
+class MemoryFileSource : public IEngineFileSource
+{
+public:
+    explicit MemoryFileSource(const std::string &content);
+    int Open(const std::string &path);
+    const void* Data() const;
+    size_t Size() const;
+    void Close();
+
+private:
+    std::string content_;
+    bool opened_;
+};
+
+/**
+ * @brief CheckEngineHeader -- Size and plan magic check before deserialize.
+ * @param strict            -- unknown magic is an error when true, a warning otherwise
+ * @return                  -- 0--ok, -1--too small, -2--unknown magic(strict only)
+ */
+int CheckEngineHeader(const void *data, const size_t &size, const bool &strict = false);
+
+/**
+ * @brief LoadEngineFile -- Open the source, check it, hand the mapping to deserialize without a copy.
+ * @param source         -- file source
+ * @param path           -- engine path
+ * @param deserialize    -- runtime hook, e.g. IRuntime::deserializeCudaEngine, returns false on failure
+ * @param report         -- optional timing report
+ * @return               -- 0--success, -1--open failed, -2--header check failed, -3--deserialize failed
+ */
+int LoadEngineFile(IEngineFileSource &source, const std::string &path,
+                   const std::function<bool(const void*, size_t)> &deserialize,
+                   EngineLoadReport *report = nullptr);
+
+}
+
+#endif
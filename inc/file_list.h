@@ -0,0 +1,31 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     file_list.h
+*   Brief:    parallel directory listing, no OpenCV or cuda dependency so utils can use it.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_FILE_LIST_H_
+#define YOLOV7TRT_FILE_LIST_H_
+
+#include <string>
+#include <vector>
+
+namespace siran
+{
+
+/**
+ * @brief ListFiles    -- Regular files under root, subdirectories listed by thread_num threads,
+ *        entry types from d_type(stat only when the filesystem does not report it), symlinks
+ *        followed to files only. Output sorted.
+ * @param extensions   -- lower case extensions without the dot, empty for every file
+ * @param thread_num   -- <= 0 every hardware thread
+ * @return             -- 0--success, -1--root not a readable directory
+ */
+int ListFiles(const std::string &root, const std::vector<std::string> &extensions, const int &thread_num,
+              std::vector<std::string> &files);
+
+}
+
+#endif
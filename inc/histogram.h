@@ -0,0 +1,58 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     histogram.h
+*   Brief:    fixed bucket histogram for latency and ratio metrics.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_HISTOGRAM_H_
+#define YOLOV7TRT_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace siran
+{
+
+/// @brief Bucket i counts values <= bounds[i], the extra last bucket counts the rest.
+///        Not thread safe, owners guard it.
+class Histogram
+{
+public:
+    Histogram();
+    /// @brief bounds are bucket upper bounds, ascending.
+    explicit Histogram(const std::vector<double> &bounds);
+
+    /// @brief Upper bounds first, first * factor, ... , up to last.
+    static std::vector<double> ExponentialBounds(const double &first, const double &factor, const double &last);
+    static std::vector<double> LinearBounds(const double &first, const double &step, const int &num);
+
+    void Add(const double &value);
+    /// @brief Add raw bucket counts of a histogram with the same bounds, -1 when sizes differ.
+    int Merge(const std::vector<int64_t> &counts, const double &sum, const double &max);
+    void Reset();
+
+    int64_t Count() const;
+    double Mean() const;
+    double Max() const;
+    /// @brief Upper bound of the bucket holding quantile q(0~1), Max() for the overflow bucket.
+    double Percentile(const double &q) const;
+
+    const std::vector<double>& Bounds() const;
+    const std::vector<int64_t>& Counts() const;
+    /// @brief One line per non-empty bucket, "<= bound: count".
+    std::string ToString() const;
+
+private:
+    std::vector<double> bounds_;
+    std::vector<int64_t> counts_;
+    int64_t count_;
+    double sum_;
+    double max_;
+};
+
+}
+
+#endif
@@ -0,0 +1,140 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     infer_server.h
+*   Brief:    multi-instance inference server, N backend instances fed from one request queue.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_INFER_SERVER_H_
+#define YOLOV7TRT_INFER_SERVER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "inc/mpmc_queue.h"
+
+namespace siran
+{
+
+/// @brief One queued request, payload belongs to the caller and is only read by the backend,
+///        done runs on the worker thread after the backend returned.
+typedef struct InferTask_
+{
+    void *payload;
+    int status;
+    std::function<void(InferTask_ *task)> done;
+}InferTask;
+
+/// @brief Execution backend, instance i is only ever used by worker i, so an instance needs
+///        no locking of its own.
+class IInferBackend
+{
+public:
+    virtual ~IInferBackend() {}
+    virtual int NumInstances() const = 0;
+    /// @brief Run one task on instance, return the status stored in task->status.
+    virtual int Run(const int &instance, InferTask *task) = 0;
+};
+
+/// @brief Server counters, queue_depth is a snapshot.
+typedef struct ServerStats_
+{
+    int64_t submitted;
+    int64_t completed;
+    int64_t rejected;
+    int queue_depth;
+    int max_queue_depth;
+}ServerStats;
+
+class InferServer
+{
+public:
+    /// @brief queue_capacity bounds the requests waiting for an instance, Submit rejects beyond it.
+    InferServer(IInferBackend *backend, const int &queue_capacity = 64);
+    ~InferServer();
+
+    /// @brief Called first on every worker thread with its instance, e.g. cpu affinity, before Start.
+    void SetThreadInit(const std::function<void(const int &instance)> &init);
+
+    /// @brief One worker per backend instance.
+    int Start();
+    /// @brief Stop accepting, finish queued tasks and join the workers.
+    void Stop();
+
+    /**
+     * @brief Submit -- Non blocking enqueue.
+     * @return       -- 0--queued, -1--server not running, -2--queue full(backpressure)
+     */
+    int Submit(InferTask *task);
+
+    /**
+     * @brief SubmitWait -- Enqueue, waiting up to timeout_ms for room, timeout_ms < 0 waits forever.
+     * @return           -- 0--queued, -1--server not running, -2--timed out
+     */
+    int SubmitWait(InferTask *task, const int &timeout_ms = -1);
+
+    /// @brief Synchronous call, queue the task and wait for its completion, return task->status.
+    int Run(InferTask *task);
+
+    int QueueDepth() const;
+    ServerStats GetStats() const;
+
+private:
+    InferServer(const InferServer&);
+    InferServer& operator=(const InferServer&);
+
+    /// @brief Push and account one task, false when the queue is full.
+    bool Enqueue(InferTask *task);
+    void WorkerLoop(const int &instance);
+    void WakeWorker();
+
+    IInferBackend *backend_;
+    std::function<void(const int &instance)> thread_init_;
+    MpmcQueue<InferTask*> queue_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> running_;
+
+    /// @brief Idle workers park here, producers only take the mutex when someone is parked.
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cond_;
+    std::atomic<int> sleepers_;
+
+    std::atomic<int64_t> submitted_;
+    std::atomic<int64_t> completed_;
+    std::atomic<int64_t> rejected_;
+    std::atomic<int> max_queue_depth_;
+};
+
+/// @brief Cpu stand-in backend, every task costs cost_us of sleep, counts per instance runs
+///        and instances entered twice at the same time.
+class MockInferBackend : public IInferBackend
+{
+public:
+    MockInferBackend(const int &instance_num, const int &cost_us);
+    int NumInstances() const;
+    int Run(const int &instance, InferTask *task);
+
+    std::vector<int64_t> InstanceRuns() const;
+    /// @brief Must stay 0, an instance was used by two threads at once otherwise.
+    int64_t Overlaps() const;
+    /// @brief Most instances running at the same time.
+    int MaxConcurrent() const;
+
+private:
+    int cost_us_;
+    std::vector<std::atomic<int64_t> > runs_;
+    std::vector<std::atomic<int> > busy_;
+    std::atomic<int64_t> overlaps_;
+    std::atomic<int> running_;
+    std::atomic<int> max_concurrent_;
+};
+
+}
+
+#endif
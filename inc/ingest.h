@@ -0,0 +1,168 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     ingest.h
+*   Brief:    batch image ingest for offline jobs, parallel directory listing, a decode thread
+*             pool behind a bounded prefetch window, reduced-scale JPEG decode and result sinks.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_INGEST_H_
+#define YOLOV7TRT_INGEST_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "inc/detection.h"
+#include "inc/file_list.h"
+#include "inc/stream.h"
+
+namespace siran
+{
+
+/**
+ * @brief ReadJpegSize -- Width and height from the JPEG frame header, without decoding.
+ * @return             -- 0--success, -1--not a JPEG or no frame header
+ */
+int ReadJpegSize(const std::string &path, int &width, int &height);
+
+/// @brief Largest JPEG decode reduction(1, 2, 4 or 8) that still leaves at least the letterbox
+///        resolution of a target_w x target_h input, 1 when target_w <= 0.
+int ReducedScale(const int &width, const int &height, const int &target_w, const int &target_h);
+
+typedef struct IngestConfig_
+{
+    int list_threads;
+    int decode_threads;
+    int prefetch;            // decoded images ahead of the consumer, bounds memory
+    int target_w;            // network input, JPEGs larger than it decode at 1/2, 1/4 or 1/8
+    int target_h;            // scale(IMREAD_REDUCED_COLOR_*), <= 0 always full size
+    bool keep_order;         // deliver in file order, otherwise as soon as decoded
+    std::vector<std::string> extensions;
+}IngestConfig;
+
+inline IngestConfig DefaultIngestConfig()
+{
+    IngestConfig config;
+    config.list_threads = 4;
+    config.decode_threads = 4;
+    config.prefetch = 16;
+    config.target_w = 640;
+    config.target_h = 640;
+    config.keep_order = true;
+    config.extensions = {"jpg", "jpeg", "png", "bmp"};
+    return config;
+}
+
+/// @brief One decoded file, image may be reduced, src_w/src_h is the size in the file and the
+///        factor from image coordinates back to it.
+typedef struct IngestItem_
+{
+    int64_t index;
+    std::string path;
+    cv::Mat image;
+    int status;              // 0--decoded, -1--unreadable
+    int src_w;
+    int src_h;
+    int reduce;              // 1 full size, 2/4/8 reduced JPEG decode
+}IngestItem;
+
+typedef struct IngestStats_
+{
+    int64_t files;
+    int64_t decoded;
+    int64_t failed;
+    int64_t reduced;
+    double decode_ms;        // sum over decode threads
+    double wait_ms;          // consumers waiting for a decoded image, > 0 means decode bound
+}IngestStats;
+
+/**
+ * @brief ImageIngest -- Decodes files on decode_threads threads, at most prefetch images decoding
+ *        or decoded and not yet taken, so memory stays bounded on any directory size.
+ */
+class ImageIngest
+{
+public:
+    ImageIngest(const std::vector<std::string> &files, const IngestConfig &config = DefaultIngestConfig());
+    ~ImageIngest();
+
+    void Start();
+    /// @brief Next decoded file, thread safe, false when every file was delivered or after Stop.
+    bool Next(IngestItem &item);
+    void Stop();
+    IngestStats GetStats() const;
+
+private:
+    ImageIngest(const ImageIngest&);
+    ImageIngest& operator=(const ImageIngest&);
+
+    void DecodeLoop();
+    void Decode(IngestItem &item);
+
+    std::vector<std::string> files_;
+    IngestConfig config_;
+    std::vector<std::thread> decoders_;
+    std::map<int64_t, IngestItem> ready_;
+    /// @brief Next file to decode, next to deliver, and files being decoded now.
+    int64_t next_decode_;
+    int64_t next_deliver_;
+    int decoding_;
+    bool started_;
+    bool stop_;
+    mutable std::mutex mutex_;
+    std::condition_variable decode_cond_;
+    std::condition_variable ready_cond_;
+    IngestStats stats_;
+};
+
+/// @brief Destination of ingest results, Write calls are serialized by the runner.
+class IResultSink
+{
+public:
+    virtual ~IResultSink() {}
+    /// @brief detections in the pixels of the file, 0--success.
+    virtual int Write(const IngestItem &item, const int &status, const DetectionSpan &detections) = 0;
+    virtual int Flush() = 0;
+};
+
+/// @brief One text line per detection "path class prob left top right bottom", a line
+///        "path -" for files without detections, stdout when the path is empty.
+class TextResultSink : public IResultSink
+{
+public:
+    explicit TextResultSink(const std::string &path = "");
+    ~TextResultSink();
+    bool IsOpened() const;
+    int Write(const IngestItem &item, const int &status, const DetectionSpan &detections);
+    int Flush();
+
+private:
+    TextResultSink(const TextResultSink&);
+    TextResultSink& operator=(const TextResultSink&);
+
+    FILE *fp_;
+    bool owned_;
+};
+
+/**
+ * @brief RunIngest -- Drain ingest through detectors, one thread per detector(e.g. one per
+ *        execution context), boxes scaled back to file pixels and written to sink in completion
+ *        order(IngestItem::index gives the file order).
+ * @param detect_failed -- output, images the detector failed on(status other than 0 and -999),
+ *                         nullptr to ignore; they are still written to sink with their status
+ * @return          -- 0--success, -1--no detector, others the first sink error
+ */
+int RunIngest(ImageIngest &ingest, const std::vector<IStreamDetector*> &detectors, IResultSink *sink,
+              int64_t *detect_failed = nullptr);
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     model_desc.h
+*   Brief:    runtime model descriptor, loaded from a sidecar file next to the engine.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_MODEL_DESC_H_
+#define YOLOV7TRT_MODEL_DESC_H_
+
+#include <string>
+#include <vector>
+
+namespace siran
+{
+
+/// @brief Model descriptor, anchors are levels x num_anchors x (w, h) in input pixels.
+typedef struct ModelDesc_
+{
+    int input_c;
+    int input_h;
+    int input_w;
+    int num_classes;
+    int num_anchors;
+    std::string input_blob;
+    std::string output_blob;
+    float conf_thresh;
+    float nms_thresh;
+    std::vector<int> strides;
+    std::vector<float> anchors;
+}ModelDesc;
+
+/**
+ * @brief DefaultModelDesc -- yolov7 640x640 COCO, the values compiled in before descriptors existed.
+ */
+inline ModelDesc DefaultModelDesc()
+{
+    ModelDesc desc;
+    desc.input_c = 3;
+    desc.input_h = 640;
+    desc.input_w = 640;
+    desc.num_classes = 80;
+    desc.num_anchors = 3;
+    desc.input_blob = "images";
+    desc.output_blob = "output";
+    desc.conf_thresh = 0.5f;
+    desc.nms_thresh = 0.45f;
+    desc.strides = {8, 16, 32};
+    desc.anchors = {12, 16, 19, 36, 40, 28,      //8
+                    36, 75, 76, 55, 72, 146,     //16
+                    142, 110, 192, 243, 459, 401};//32
+    return desc;
+}
+
+/**
+ * @brief ModelDescPath -- Sidecar path of an engine, extension replaced by .cfg,
+ *        e.g. ../models/yolov7_960.trt --> ../models/yolov7_960.cfg
+ */
+std::string ModelDescPath(const std::string &engine_file);
+
+/**
+ * @brief LoadModelDesc -- Parse "key: value" lines, '#' starts a comment, missing keys keep
+ *        the DefaultModelDesc value. Keys: input_c input_h input_w num_classes num_anchors
+ *        input_blob output_blob conf_thresh nms_thresh strides anchors(space separated lists).
+ * @param path          -- descriptor file path
+ * @param desc          -- output descriptor
+ * @return              -- 0--success, -1--file not exists, -2--invalid descriptor
+ */
+int LoadModelDesc(const std::string &path, ModelDesc &desc);
+
+/// @brief Check anchors/strides/input size consistency, 0--valid.
+int CheckModelDesc(const ModelDesc &desc);
+
+}
+
+#endif
@@ -0,0 +1,127 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     motion_gate.h
+*   Brief:    motion gate of video streams, frame difference on a small copy decides
+*             per frame between full inference, inference of the moving regions only and
+*             reusing the last detections.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_MOTION_GATE_H_
+#define YOLOV7TRT_MOTION_GATE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+namespace siran
+{
+
+enum GateAction
+{
+    GATE_FULL = 0,      // whole frame inference
+    GATE_ROI = 1,       // inference of GateDecision::rois, detections elsewhere are reused
+    GATE_SKIP = 2,      // no inference, the last detections are reused
+};
+
+typedef struct MotionGateConfig_
+{
+    bool enable;
+    int scale_width;         // motion is measured on a copy of this width
+    int pixel_thresh;        // level difference of a changed pixel in any channel
+    int cell_size;           // changed pixels are counted per cell_size x cell_size cell of the copy
+    float cell_ratio;        // a cell with more changed pixels than this part of it is moving
+    int keyframe_interval;   // whole frame inference at least every N frames, <= 0 never forced
+    bool crop_roi;           // moving regions only instead of the whole frame
+    int roi_margin;          // frame pixels added around a moving region
+    int roi_min_w;           // regions grow to at least the network input, no upscaled crops
+    int roi_min_h;
+    int max_rois;            // more regions run the whole frame
+    float max_roi_ratio;     // regions covering more of the frame run the whole frame
+}MotionGateConfig;
+
+inline MotionGateConfig DefaultMotionGateConfig()
+{
+    MotionGateConfig config;
+    config.enable = false;
+    config.scale_width = 160;
+    config.pixel_thresh = 20;
+    config.cell_size = 8;
+    config.cell_ratio = 0.05f;
+    config.keyframe_interval = 30;
+    config.crop_roi = true;
+    config.roi_margin = 32;
+    config.roi_min_w = 640;
+    config.roi_min_h = 640;
+    config.max_rois = 2;
+    config.max_roi_ratio = 0.5f;
+    return config;
+}
+
+typedef struct GateDecision_
+{
+    int action;              // GateAction
+    bool keyframe;           // GATE_FULL forced by keyframe_interval
+    float moving_ratio;      // moving cells over all cells
+    std::vector<cv::Rect> rois;
+}GateDecision;
+
+typedef struct GateStats_
+{
+    int64_t frames;
+    int64_t full;
+    int64_t keyframes;       // part of full
+    int64_t roi;
+    int64_t skipped;
+}GateStats;
+
+/**
+ * @brief MotionGate -- One per camera view. Every frame is reduced to a scale_width BGR copy
+ *        (a few sampled pixels per block, well under a millisecond for 1080p) and compared with
+ *        the copy of the last inferred frame, so slow changes add up until they are seen. No
+ *        moving cell skips the frame; moving cells are joined into regions, grown by roi_margin
+ *        and to roi_min_w x roi_min_h; too many or too large regions, the first frame, a new
+ *        frame size and keyframe_interval run the whole frame.
+ */
+class MotionGate
+{
+public:
+    explicit MotionGate(const MotionGateConfig &config = DefaultMotionGateConfig());
+
+    /**
+     * @brief Update -- Decide for frame, the reference becomes frame unless it is skipped.
+     * @return       -- 0--success, -1--input error
+     */
+    int Update(const cv::Mat &frame, GateDecision &decision);
+    /// @brief The inference of the last decided frame failed, the next frame runs whole.
+    void Invalidate();
+
+    GateStats GetStats() const;
+
+private:
+    void Downscale(const cv::Mat &frame, std::vector<uint8_t> &small);
+    /// @brief Moving cells of current_ against reference_, return their number.
+    int MarkCells();
+    /// @brief Connected moving cells to frame pixel regions, grown and merged.
+    void CellRegions(std::vector<cv::Rect> &rois);
+
+    MotionGateConfig config_;
+    int frame_w_;
+    int frame_h_;
+    int small_w_;
+    int small_h_;
+    int cells_x_;
+    int cells_y_;
+    std::vector<uint8_t> reference_;
+    std::vector<uint8_t> current_;
+    std::vector<uint8_t> cells_;
+    std::vector<int> stack_;
+    bool valid_;
+    int64_t since_key_;
+    GateStats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     mpmc_queue.h
+*   Brief:    bounded lock-free multi-producer multi-consumer queue.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_MPMC_QUEUE_H_
+#define YOLOV7TRT_MPMC_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+namespace siran
+{
+
+/// @brief Ring of sequence-numbered cells, a cell is free for the producer of position pos
+///        when seq == pos and ready for the consumer when seq == pos + 1 (D. Vyukov).
+template <typename T>
+class MpmcQueue
+{
+public:
+    /// @brief capacity is rounded up to a power of two, at least 2.
+    explicit MpmcQueue(const size_t &capacity)
+    {
+        size_t size = 2;
+        while(size < capacity)
+        {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for(size_t i=0;i<size;++i)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+    }
+
+    /// @brief false when the queue is full.
+    bool TryPush(const T &value)
+    {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell &cell = cells_[pos & mask_];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if(diff == 0)
+            {
+                if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.data = value;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @brief false when the queue is empty.
+    bool TryPop(T &value)
+    {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            Cell &cell = cells_[pos & mask_];
+            const size_t seq = cell.seq.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(diff == 0)
+            {
+                if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.data;
+                    cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t Capacity() const
+    {
+        return mask_ + 1;
+    }
+
+    /// @brief Snapshot of queued items, exact only when producers and consumers are idle.
+    size_t Size() const
+    {
+        const size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+        const size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+private:
+    MpmcQueue(const MpmcQueue&);
+    MpmcQueue& operator=(const MpmcQueue&);
+
+    typedef struct Cell_
+    {
+        std::atomic<size_t> seq;
+        T data;
+    }Cell;
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    /// @brief Producer and consumer cursors on separate cache lines. Padding instead of alignas(64):
+    ///        c++14 operator new ignores over-alignment, and the queue is held by heap objects.
+    char pad0_[64];
+    std::atomic<size_t> enqueue_pos_;
+    char pad1_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeue_pos_;
+    char pad2_[64 - sizeof(std::atomic<size_t>)];
+};
+
+}
+
+#endif
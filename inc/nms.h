@@ -0,0 +1,83 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     nms.h
+*   Brief:    per-class greedy NMS, x-sorted SoA boxes, sweep-line pruning and SIMD IoU.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_NMS_H_
+#define YOLOV7TRT_NMS_H_
+
+#include <stdint.h>
+#include <vector>
+
+namespace siran
+{
+
+/**
+ * @brief IouMask -- mask[j] = IoU(box, j) > thresh over n SoA boxes, IoU as inter / (area + area[j] - inter).
+ * @param isa     -- DecodeIsa, see yolov7_simd.hpp
+ */
+void IouMask(const int &isa, const float *x1, const float *y1, const float *x2, const float *y2, const float *area,
+             const int &n, const float box[4], const float &box_area, const float &thresh, uint8_t *mask);
+
+/// @brief Greedy NMS with the same result as the all-pairs sort-and-sweep: boxes are visited
+///        by score, a kept box suppresses lower scored boxes of its class with IoU > thresh.
+///        Every class is sorted by x1 once, a kept box only tests the x1 window its
+///        widest possible neighbour can start in. Buffers are kept between calls.
+class NmsEngine
+{
+public:
+    NmsEngine();
+
+    /// @brief Force IoU kernel path, DecodeIsa.
+    void SetIsa(const int &isa);
+
+    /**
+     * @brief Run -- objects with left/right/low/high/id/prob fields, e.g. object_t.
+     * @param valid   -- in: 0 skips an object, out: 0 for suppressed objects
+     * @return        -- number of kept objects
+     */
+    template <typename Obj>
+    int Run(const Obj *objects, const int &num, const float &iou_thresh, int *valid)
+    {
+        Reserve(num);
+        for (int i = 0; i < num; ++i)
+        {
+            in_x1_[i] = objects[i].left;
+            in_y1_[i] = objects[i].low;
+            in_x2_[i] = objects[i].right;
+            in_y2_[i] = objects[i].high;
+            in_score_[i] = objects[i].prob;
+            in_cls_[i] = objects[i].id;
+        }
+        return Suppress(num, iou_thresh, valid);
+    }
+
+    /// @brief Same over caller arrays, boxes are num x (x1, y1, x2, y2).
+    int Run(const float *boxes, const float *scores, const int *classes, const int &num, const float &iou_thresh, int *valid);
+
+private:
+    void Reserve(const int &num);
+    int Suppress(const int &num, const float &iou_thresh, int *valid);
+    int SuppressClass(const int *idx, const int &n, const float &iou_thresh, int *valid);
+
+    int isa_;
+    /// @brief Input staging, original order.
+    std::vector<float> in_x1_, in_y1_, in_x2_, in_y2_, in_score_;
+    std::vector<int> in_cls_;
+    /// @brief Class partition, object indices grouped by class.
+    std::vector<int> by_class_;
+    std::vector<int> class_begin_, class_fill_;
+    /// @brief Rank in score order, by object index.
+    std::vector<int> score_rank_;
+    /// @brief One class at a time, SoA in x1 order, rank_ is the score rank of a position.
+    std::vector<float> x1_, y1_, x2_, y2_, area_;
+    std::vector<int> orig_, rank_, pos_of_rank_, order_;
+    std::vector<uint8_t> alive_, mask_;
+};
+
+}
+
+#endif
@@ -0,0 +1,94 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     pipeline.h
+*   Brief:    stage pipeline scheduler, frame N+s runs stage 0 while frame N runs stage s.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_PIPELINE_H_
+#define YOLOV7TRT_PIPELINE_H_
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+
+namespace siran
+{
+
+/// @brief Inference pipeline stages, Yolov7Trt runs 0~2 on gpu streams and 3 on host.
+enum PipelineStage
+{
+    STAGE_PREPROCESS  = 0,  // upload, letterbox, permute
+    STAGE_INFER       = 1,  // enqueue
+    STAGE_D2H         = 2,  // output copy
+    STAGE_POSTPROCESS = 3,  // decode, nms, callback
+    STAGE_NUM         = 4
+};
+
+/// @brief Stage executor, Launch must only order work behind stage-1 of the same frame,
+///        the scheduler guarantees a slot is not reused before its frame left the last stage.
+class IStageExecutor
+{
+public:
+    virtual ~IStageExecutor() {}
+    virtual int Launch(const int &stage, const int &slot, const int64_t &frame_id) = 0;
+};
+
+class PipelineScheduler
+{
+public:
+    /// @brief num_stages frames are in flight at most, one slot each.
+    PipelineScheduler(IStageExecutor *executor, const int &num_stages = STAGE_NUM);
+
+    /// @brief Slot of a frame, callers stage frame data there before Push.
+    int Slot(const int64_t &frame_id) const;
+
+    /// @brief Enter a frame and advance every in-flight frame by one stage.
+    int Push(const int64_t &frame_id);
+
+    /// @brief Advance without new frames until nothing is in flight.
+    int Flush();
+
+    int InFlight() const;
+
+private:
+    int Tick();
+
+    IStageExecutor *executor_;
+    int num_stages_;
+    /// @brief In-flight frames with the stage they run next, oldest first.
+    std::deque<std::pair<int64_t, int> > in_flight_;
+};
+
+/// @brief Timeline record of SimStageExecutor.
+typedef struct StageSpan_
+{
+    int64_t frame_id;
+    int stage;
+    double start;
+    double end;
+}StageSpan;
+
+/// @brief Cpu stand-in executor, every stage is a serial resource with a fixed cost,
+///        a stage starts after the same frame's previous stage and the resource's previous job.
+class SimStageExecutor : public IStageExecutor
+{
+public:
+    explicit SimStageExecutor(const std::vector<double> &stage_cost);
+    int Launch(const int &stage, const int &slot, const int64_t &frame_id);
+
+    const std::vector<StageSpan>& Timeline() const;
+    /// @brief End time of the last finished frame.
+    double Makespan() const;
+
+private:
+    std::vector<double> stage_cost_;
+    std::vector<double> stage_free_;
+    std::vector<double> slot_ready_;
+    std::vector<StageSpan> timeline_;
+};
+
+}
+
+#endif
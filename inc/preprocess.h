@@ -0,0 +1,166 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     preprocess.h
+*   Brief:    fused letterbox + BGR->RGB + 1/255 + HWC->CHW preprocessing.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_PREPROCESS_H_
+#define YOLOV7TRT_PREPROCESS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <utility>
+#include <vector>
+#include <cuda_runtime_api.h>
+
+#include "inc/thread_pool.h"
+
+#ifdef __CUDACC__
+#define LB_HOST_DEVICE __host__ __device__
+#else
+#define LB_HOST_DEVICE
+#endif
+
+namespace siran
+{
+
+/// @brief Letterbox pad value of yolov7 training.
+static const int kLetterboxPad = 114;
+
+/// @brief Bilinear coefficients in cv::resize INTER_LINEAR 8U fixed point(11 bits),
+///        x0/x1 are byte offsets in a BGR row, y0/y1 are clamped rows.
+typedef struct LetterboxTable_
+{
+    int src_w;
+    int src_h;
+    int unpad_w;
+    int unpad_h;
+    std::vector<int> x0;
+    std::vector<int> x1;
+    std::vector<short> alpha;  // 2 per dst column
+    std::vector<int> y0;
+    std::vector<int> y1;
+    std::vector<short> beta;   // 2 per dst row
+}LetterboxTable;
+
+/// @brief Build coefficient tables for a src_w x src_h frame letterboxed into dst_w x dst_h.
+///        An exact 2x downscale(1280x720 -> 640x360) is INTER_AREA inside cv::resize, the
+///        0.5/0.5 weights give the same (a+b+c+d+2)>>2 average, so it stays bit-exact.
+void BuildLetterboxTable(const int &src_w, const int &src_h, const int &dst_w, const int &dst_h, LetterboxTable &table);
+
+/**
+ * @brief LetterboxPixel -- One resized BGR pixel, horizontal pass then vertical pass with the
+ *        rounding of cv::resize vectorized 8U path, shared by the cuda kernel and cpu reference.
+ */
+LB_HOST_DEVICE inline void LetterboxPixel(const uint8_t *src, const size_t &src_step,
+                                          const int &x0, const int &x1, const short *alpha,
+                                          const int &y0, const int &y1, const short *beta, uint8_t *bgr)
+{
+    const uint8_t *r0 = src + (size_t)y0 * src_step;
+    const uint8_t *r1 = src + (size_t)y1 * src_step;
+    for (int c = 0; c < 3; ++c)
+    {
+        int h0 = r0[x0 + c] * alpha[0] + r0[x1 + c] * alpha[1];
+        int h1 = r1[x0 + c] * alpha[0] + r1[x1 + c] * alpha[1];
+        int v = (((beta[0] * (h0 >> 4)) >> 16) + ((beta[1] * (h1 >> 4)) >> 16) + 2) >> 2;
+        bgr[c] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+}
+
+/**
+ * @brief LetterboxRef -- Cpu reference of the fused preprocessing.
+ * @param src          -- 8UC3 BGR frame
+ * @param src_step     -- row step in bytes
+ * @param table        -- BuildLetterboxTable output for this frame size
+ * @param dst          -- planar RGB f32 3 x dst_h x dst_w, pad area 114/255
+ * @return             -- 0--success, -1--input error
+ */
+int LetterboxRef(const uint8_t *src, const size_t &src_step, const LetterboxTable &table,
+                 float *dst, const int &dst_w, const int &dst_h);
+
+/**
+ * @brief StaticResize -- cv::resize reference of the letterbox(resize, pad 114 bottom/right,
+ *        1/255), written planar RGB like LetterboxRef so the two compare element by element.
+ * @param src          -- 8UC3 BGR frame
+ * @param src_step     -- row step in bytes
+ * @param dst          -- planar RGB f32 3 x dst_h x dst_w
+ * @return             -- 0--success, -1--input error
+ */
+int StaticResize(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h,
+                 float *dst, const int &dst_w, const int &dst_h);
+
+/// @brief Cpu preprocessing engine, same output as FusedLetterbox/LetterboxRef. Each band of
+///        output rows runs the horizontal pass into planar int rows and a vectorizable vertical
+///        pass straight into the caller buffer(pinned memory keeps the later H2D copy async).
+class CpuLetterbox
+{
+public:
+    /// @brief thread_num <= 0 uses every hardware thread.
+    CpuLetterbox(const int &dst_w, const int &dst_h, const int &thread_num = 0);
+
+    /**
+     * @brief Run -- Letterbox a BGR frame into planar RGB f32 3 x dst_h x dst_w.
+     * @param src          -- 8UC3 BGR frame
+     * @param src_step     -- row step in bytes
+     * @return             -- 0--success, -1--input error
+     */
+    int Run(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h, float *dst);
+    /**
+     * @brief RunViews -- Letterbox the view_num side by side views of a frame(the column bands
+     *        of SplitViews) into view_num consecutive 3 x dst_h x dst_w slots, in one pass.
+     * @return             -- 0--success, -1--input error
+     */
+    int RunViews(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h,
+                 const int &view_num, float *dst);
+
+private:
+    const LetterboxTable& GetTable(const int &src_w, const int &src_h);
+    void RunBand(const uint8_t *src, const size_t &src_step, const LetterboxTable &table,
+                 float *dst, const int &row_begin, const int &row_end);
+
+    int dst_w_;
+    int dst_h_;
+    ThreadPool pool_;
+    std::map<std::pair<int, int>, LetterboxTable> tables_;
+    std::mutex mutex_;
+};
+
+/// @brief Fused gpu preprocessing, one kernel from the uploaded 8-bit frame to the TRT input binding,
+///        coefficient tables are kept on device per source size.
+class FusedLetterbox
+{
+public:
+    FusedLetterbox(const int &dst_w, const int &dst_h);
+    ~FusedLetterbox();
+
+    /// @brief src is a device 8UC3 BGR frame, dst a device planar RGB f32 tensor.
+    int Run(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h,
+            float *dst, cudaStream_t stream);
+
+private:
+    FusedLetterbox(const FusedLetterbox&);
+    FusedLetterbox& operator=(const FusedLetterbox&);
+
+    typedef struct DeviceTable_
+    {
+        int unpad_w;
+        int unpad_h;
+        int *x;       // x0 | x1
+        short *alpha;
+        int *y;       // y0 | y1
+        short *beta;
+    }DeviceTable;
+
+    const DeviceTable* GetTable(const int &src_w, const int &src_h, cudaStream_t stream);
+
+    int dst_w_;
+    int dst_h_;
+    std::map<std::pair<int, int>, DeviceTable> tables_;
+};
+
+}
+
+#endif
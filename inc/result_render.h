@@ -0,0 +1,99 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     result_render.h
+*   Brief:    optional annotated result images, drawn and JPEG encoded on a worker pool off the
+*             inference thread, bounded so rendering can never hold inference back.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_RESULT_RENDER_H_
+#define YOLOV7TRT_RESULT_RENDER_H_
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "inc/detection.h"
+#include "inc/thread_pool.h"
+
+namespace siran
+{
+
+/// @brief Boxes and "class prob%" labels into image, in place, COCO colors and names by class % 80.
+void DrawDetections(cv::Mat &image, const Detection *detections, const int &count);
+
+typedef struct RenderConfig_
+{
+    std::string save_dir;
+    int thread_num;
+    int max_pending;         // frames queued or rendering, more are dropped(counted)
+    int every_n;             // render one frame in every_n, 1 all
+    int jpeg_quality;
+}RenderConfig;
+
+inline RenderConfig DefaultRenderConfig()
+{
+    RenderConfig config;
+    config.save_dir = "./result";
+    config.thread_num = 1;
+    config.max_pending = 8;
+    config.every_n = 1;
+    config.jpeg_quality = 90;
+    return config;
+}
+
+typedef struct RenderStats_
+{
+    int64_t submitted;
+    int64_t rendered;
+    int64_t skipped;         // every_n
+    int64_t dropped;         // queue full
+    int64_t failed;          // write errors
+    double render_ms;        // draw + encode, sum over workers
+}RenderStats;
+
+/**
+ * @brief AsyncRenderer -- Submit takes the frame over(no copy) with a copy of the detections,
+ *        a worker draws the boxes into the frame itself and writes <save_dir>/<name>.jpg.
+ *        The caller must not touch the frame pixels after Submit, pass a clone otherwise.
+ */
+class AsyncRenderer
+{
+public:
+    explicit AsyncRenderer(const RenderConfig &config = DefaultRenderConfig());
+    ~AsyncRenderer();
+
+    /**
+     * @brief Submit -- Queue one frame.
+     * @param name    -- file name without extension, empty for frame_<n>
+     * @return        -- 0--queued, 1--skipped by every_n, -1--empty frame, -2--dropped, queue full
+     */
+    int Submit(const cv::Mat &frame, const std::string &name, const DetectionSpan &detections);
+    /// @brief Block until every queued frame is written.
+    void Wait();
+    RenderStats GetStats() const;
+
+private:
+    AsyncRenderer(const AsyncRenderer&);
+    AsyncRenderer& operator=(const AsyncRenderer&);
+
+    void Render(const cv::Mat &frame, const std::string &name, const std::vector<Detection> &detections);
+
+    RenderConfig config_;
+    int64_t frame_count_;
+    int pending_;
+    bool dir_ready_;
+    mutable std::mutex mutex_;
+    std::condition_variable idle_cond_;
+    RenderStats stats_;
+    /// @brief Last member, its workers are joined before the state above goes away.
+    ThreadPool pool_;
+};
+
+}
+
+#endif
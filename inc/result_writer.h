@@ -0,0 +1,214 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     result_writer.h
+*   Brief:    bulk detection output, length-prefixed binary records or JSON lines written by a
+*             background thread in large batched writes, with file rotation and retention.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_RESULT_WRITER_H_
+#define YOLOV7TRT_RESULT_WRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "inc/detection.h"
+#include "inc/ingest.h"
+
+namespace siran
+{
+
+enum ResultFormat
+{
+    RESULT_BINARY = 0,       // layout below
+    RESULT_JSONL  = 1,       // {"frame":..,"ts":..,"name":"..","w":..,"h":..,"status":..,"dets":[[l,t,r,b,class,prob],..]}
+};
+
+/**
+ * Binary file layout, host byte order(little endian on every supported platform):
+ *   file header   u32 magic 'Y7RS', u16 version 1, u16 reserved
+ *   record        u32 payload bytes, then payload
+ *   payload       i64 frame_id, u64 timestamp_ns, i32 width, i32 height, i32 status,
+ *                 u32 det_num, u16 name_len, name bytes, det_num x {f32 left, top, right,
+ *                 bottom, i32 class_id, f32 prob}
+ * Every file starts with the header and holds whole records, so each file reads on its own.
+ */
+#define RESULT_FILE_MAGIC       0x53523759u
+#define RESULT_FILE_VERSION     1
+#define RESULT_FILE_HEADER_SIZE 8
+
+typedef struct ResultWriterConfig_
+{
+    /// @brief Files are <path_prefix>_<index>.bin or .jsonl, the index continues after the
+    ///        files already there so a new run never overwrites an old one.
+    std::string path_prefix;
+    int format;
+    size_t buffer_bytes;       // one write call per full buffer
+    size_t max_pending_bytes;  // encoded records not yet written, Write blocks or drops beyond it
+    bool drop_when_full;       // true drops the record(counted) instead of blocking the caller
+    int flush_ms;              // a partial buffer is written at least this often
+    uint64_t max_file_bytes;   // rotate past it(at a buffer boundary), 0 one file
+    int max_files;             // oldest files deleted beyond it, 0 keeps every file
+}ResultWriterConfig;
+
+inline ResultWriterConfig DefaultResultWriterConfig()
+{
+    ResultWriterConfig config;
+    config.path_prefix = "./result/detections";
+    config.format = RESULT_BINARY;
+    config.buffer_bytes = 1 << 20;
+    config.max_pending_bytes = 16 << 20;
+    config.drop_when_full = false;
+    config.flush_ms = 200;
+    config.max_file_bytes = (uint64_t)256 << 20;
+    config.max_files = 0;
+    return config;
+}
+
+/// @brief Per frame fields of a record, name is copied, nullptr for none.
+typedef struct ResultMeta_
+{
+    int64_t frame_id;
+    uint64_t timestamp_ns;     // 0 takes the wall clock at Write
+    int width;
+    int height;
+    int status;
+    const char *name;
+}ResultMeta;
+
+/// @brief One record read back.
+typedef struct ResultRecord_
+{
+    int64_t frame_id;
+    uint64_t timestamp_ns;
+    int width;
+    int height;
+    int status;
+    std::string name;
+    std::vector<Detection> detections;
+}ResultRecord;
+
+typedef struct ResultWriterStats_
+{
+    int64_t records;
+    int64_t dropped;
+    uint64_t bytes;            // written to files
+    int64_t write_calls;
+    int64_t files;             // opened by this writer
+    size_t max_pending;        // high water of encoded bytes waiting
+    double blocked_ms;         // callers blocked on a full queue
+}ResultWriterStats;
+
+/**
+ * @brief ResultWriter -- Write encodes a binary record on the calling thread into a shared
+ *        buffer, the writer thread swaps it out, turns it into JSON lines if asked and writes it
+ *        with one call, so the inference thread never formats text or waits on the disk unless
+ *        max_pending_bytes is reached. Thread safe.
+ */
+class ResultWriter
+{
+public:
+    explicit ResultWriter(const ResultWriterConfig &config = DefaultResultWriterConfig());
+    ~ResultWriter();
+
+    /**
+     * @brief Open -- Create the directory of path_prefix if needed, open the first file and
+     *        start the writer thread.
+     * @return      -- 0--success, -1--already open, -2--file error
+     */
+    int Open();
+    /**
+     * @brief Write -- Queue one frame.
+     * @return      -- 0--success, -1--not open or a write failed, -2--dropped on a full queue
+     */
+    int Write(const ResultMeta &meta, const DetectionSpan &detections);
+    /// @brief Block until every queued record is written, 0--success, -1--write error.
+    int Flush();
+    /// @brief Flush, stop the writer thread and close the file.
+    int Close();
+    /// @brief Current output file.
+    std::string CurrentFile() const;
+    ResultWriterStats GetStats() const;
+
+private:
+    ResultWriter(const ResultWriter&);
+    ResultWriter& operator=(const ResultWriter&);
+
+    void WriterLoop();
+    int OpenNextFile();
+    int WriteAll(const char *data, const size_t &size);
+    void ApplyRetention();
+    std::string FilePath(const int &index) const;
+
+    ResultWriterConfig config_;
+    std::thread writer_;
+    /// @brief Records are appended to front_, the writer thread swaps it with back_.
+    std::string front_;
+    std::string back_;
+    /// @brief JSON lines of back_, writer thread only.
+    std::string json_;
+    std::string json_name_;
+    std::vector<Detection> json_detections_;
+    int fd_;
+    int file_index_;
+    uint64_t file_bytes_;
+    std::vector<int> file_indices_;
+    std::string current_file_;
+    bool opened_;
+    bool stop_;
+    bool failed_;
+    /// @brief Records appended, records in front_, records written and the count a Flush
+    ///        waits for.
+    int64_t appended_;
+    int64_t front_records_;
+    int64_t written_;
+    int64_t flush_target_;
+    mutable std::mutex mutex_;
+    std::condition_variable writer_cond_;
+    std::condition_variable space_cond_;
+    std::condition_variable written_cond_;
+    ResultWriterStats stats_;
+};
+
+/// @brief Sequential reader of one binary result file.
+class ResultReader
+{
+public:
+    ResultReader();
+    ~ResultReader();
+
+    /// @brief 0--success, -1--cannot open, -2--not a result file or another version.
+    int Open(const std::string &path);
+    /// @brief 0--record read, 1--end of file, -1--truncated or corrupt record.
+    int Next(ResultRecord &record);
+    void Close();
+
+private:
+    ResultReader(const ResultReader&);
+    ResultReader& operator=(const ResultReader&);
+
+    FILE *fp_;
+    std::vector<char> payload_;
+};
+
+/// @brief Batch ingest into a ResultWriter, frame_id is the file index and name the path.
+class ResultWriterSink : public IResultSink
+{
+public:
+    explicit ResultWriterSink(ResultWriter *writer);
+    int Write(const IngestItem &item, const int &status, const DetectionSpan &detections);
+    int Flush();
+
+private:
+    ResultWriter *writer_;
+};
+
+}
+
+#endif
@@ -0,0 +1,75 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     stereo.h
+*   Brief:    stereo dual-view detection, left/right boxes of one object associated along
+*             the epipolar rows of a rectified side by side camera.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_STEREO_H_
+#define YOLOV7TRT_STEREO_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "inc/detection.h"
+
+namespace siran
+{
+
+typedef struct StereoConfig_
+{
+    float max_row_diff;      // rectified views: top and bottom of a pair within it, pixels
+    float max_height_ratio;  // larger over smaller box height of a pair
+    float min_disparity;     // left center x - right center x, pixels, objects at infinity are 0
+    float max_disparity;     // nearest object expected
+    float disparity_weight;  // cost per pixel of disparity, among pairs on the same rows the
+                             // smaller disparity wins, objects side by side stay in order
+}StereoConfig;
+
+inline StereoConfig DefaultStereoConfig()
+{
+    StereoConfig config;
+    config.max_row_diff = 8.f;
+    config.max_height_ratio = 1.3f;
+    config.min_disparity = 0.f;
+    config.max_disparity = 400.f;
+    config.disparity_weight = 0.02f;
+    return config;
+}
+
+/// @brief One object seen by both views, indices into the left and right detections.
+typedef struct StereoPair_
+{
+    int left;
+    int right;
+    float disparity;
+    /// @brief Row and height difference in pixels plus disparity_weight x disparity.
+    float cost;
+}StereoPair;
+
+/**
+ * @brief StereoAssociator -- Pair left and right detections of a rectified stereo frame, both in
+ *        view pixels. Candidates have the same class, top and bottom rows within max_row_diff,
+ *        similar heights and a disparity in [min_disparity, max_disparity]; pairs are taken
+ *        greedily by cost, each box in one pair at most. Buffers are kept between calls.
+ */
+class StereoAssociator
+{
+public:
+    StereoAssociator();
+
+    /// @return -- number of pairs
+    int Run(const DetectionSpan &left, const DetectionSpan &right, const StereoConfig &config,
+            std::vector<StereoPair> &pairs);
+
+private:
+    std::vector<StereoPair> candidates_;
+    std::vector<uint8_t> left_used_;
+    std::vector<uint8_t> right_used_;
+};
+
+}
+
+#endif
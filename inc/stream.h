@@ -0,0 +1,373 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     stream.h
+*   Brief:    streaming video pipeline, capture, inference and result delivery on their own
+*             threads, a drop-oldest frame ring keeps latency bounded under slow inference.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_STREAM_H_
+#define YOLOV7TRT_STREAM_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "inc/detection.h"
+#include "inc/histogram.h"
+#include "inc/motion_gate.h"
+#include "inc/stereo.h"
+
+namespace siran
+{
+
+/// @brief Bounded blocking queue. drop_oldest Push never waits, a full queue loses its oldest
+///        item instead; otherwise Push waits for room. Pop drains what is left after Close.
+template <typename T>
+class BlockingRing
+{
+public:
+    BlockingRing(const size_t &capacity, const bool &drop_oldest):
+        capacity_(capacity > 0 ? capacity : 1),
+        drop_oldest_(drop_oldest),
+        closed_(false)
+    {
+    }
+
+    /// @brief 1--the oldest item was dropped for it, 0--queued, -1--closed.
+    int Push(T &&value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int iret = 0;
+        if(!drop_oldest_)
+        {
+            not_full_.wait(lock, [this]() { return closed_ || items_.size() < capacity_; });
+        }
+        if(closed_)
+        {
+            return -1;
+        }
+        if(items_.size() >= capacity_)
+        {
+            items_.pop_front();
+            iret = 1;
+        }
+        items_.push_back(std::move(value));
+        not_empty_.notify_one();
+        return iret;
+    }
+
+    /// @brief 0--value popped, -1--closed and empty.
+    int Pop(T &value)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+        if(items_.empty())
+        {
+            return -1;
+        }
+        value = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return 0;
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    /// @brief Reopen an empty ring for a new run.
+    void Reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        items_.clear();
+        closed_ = false;
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return items_.size();
+    }
+
+private:
+    BlockingRing(const BlockingRing&);
+    BlockingRing& operator=(const BlockingRing&);
+
+    size_t capacity_;
+    bool drop_oldest_;
+    bool closed_;
+    std::deque<T> items_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+};
+
+
+/// @brief Frame source, Read gives a newly allocated frame each call, sources of recorded
+///        or generated frames pace themselves to their frame rate like a camera would.
+class IFrameSource
+{
+public:
+    virtual ~IFrameSource() {}
+    /// @brief 0--frame read, -1--end of stream or device error.
+    virtual int Read(cv::Mat &frame) = 0;
+};
+
+/// @brief Sleeps until the next frame time of a fixed rate, fps <= 0 never sleeps.
+class FramePacer
+{
+public:
+    explicit FramePacer(const double &fps);
+    void Wait();
+
+private:
+    double period_ns_;
+    uint64_t next_ns_;
+};
+
+class CameraSource : public IFrameSource
+{
+public:
+    /// @brief width/height <= 0 keep the device default.
+    CameraSource(const int &camera_index, const int &width = 0, const int &height = 0);
+    bool IsOpened() const;
+    int Read(cv::Mat &frame);
+
+private:
+    cv::VideoCapture cap_;
+};
+
+/// @brief Video file or image sequence pattern(e.g. img_%04d.jpg) through cv::VideoCapture.
+class VideoFileSource : public IFrameSource
+{
+public:
+    /// @brief fps 0 plays at the file frame rate, < 0 as fast as it decodes. loop restarts at the end.
+    VideoFileSource(const std::string &path, const double &fps = 0., const bool &loop = false);
+    bool IsOpened() const;
+    int Read(cv::Mat &frame);
+
+private:
+    std::string path_;
+    bool loop_;
+    cv::VideoCapture cap_;
+    FramePacer pacer_;
+};
+
+/// @brief Image files, e.g. from GetFilePath, unreadable files are skipped.
+class ImageListSource : public IFrameSource
+{
+public:
+    ImageListSource(const std::vector<std::string> &paths, const double &fps = 25., const bool &loop = false);
+    int Read(cv::Mat &frame);
+
+private:
+    std::vector<std::string> paths_;
+    bool loop_;
+    size_t next_;
+    FramePacer pacer_;
+};
+
+/// @brief Generated frames, a few boxes moving over a gray background, frame_num < 0 never ends.
+class SyntheticSource : public IFrameSource
+{
+public:
+    SyntheticSource(const int &width, const int &height, const double &fps = 30., const int64_t &frame_num = -1);
+    int Read(cv::Mat &frame);
+
+private:
+    int width_;
+    int height_;
+    int64_t frame_num_;
+    int64_t index_;
+    FramePacer pacer_;
+};
+
+
+/// @brief Detector of the inference stage, the span stays valid until the next Detect.
+class IStreamDetector
+{
+public:
+    virtual ~IStreamDetector() {}
+    /// @brief 0--success, -999--no object, others are errors.
+    virtual int Detect(const cv::Mat &view, DetectionSpan *detections) = 0;
+    /**
+     * @brief DetectViews -- Every view of a frame in one call, e.g. a stereo pair as one batch.
+     *        views are the SplitViews of frame, detections[v] and status[v] are filled for each
+     *        view and stay valid until the next call.
+     * @param pairs        -- output, left/right pairs of a stereo frame, indices into detections[0]
+     *                        and detections[1], left empty by detectors that do not associate
+     * @return             -- 0--done, 1--not supported, Detect is called per view instead
+     */
+    virtual int DetectViews(const cv::Mat &frame, const std::vector<cv::Mat> &views, DetectionSpan *detections, int *status,
+                            std::vector<StereoPair> &pairs)
+    {
+        (void)frame;
+        (void)views;
+        (void)detections;
+        (void)status;
+        (void)pairs;
+        return 1;
+    }
+};
+
+/// @brief Zero-copy side by side split, views[i] is column band i of frame, no pixel copy.
+void SplitViews(const cv::Mat &frame, const int &view_num, std::vector<cv::Mat> &views);
+
+typedef struct StreamConfig_
+{
+    /// @brief Captured frames waiting for inference, the oldest is dropped beyond it.
+    int ring_capacity;
+    /// @brief Side by side views per frame, 2 for a stereo camera, split without copying.
+    int view_num;
+    /// @brief Views detected and delivered, bit i for view i. With every view selected the
+    ///        detector gets them together through DetectViews.
+    unsigned int view_mask;
+    /// @brief Results waiting for the callback, inference waits beyond it.
+    int result_capacity;
+    /// @brief Motion gate per view, unchanged frames reuse the last detections and moving
+    ///        regions are detected alone. Gated views go to Detect, never DetectViews.
+    MotionGateConfig gate;
+}StreamConfig;
+
+inline StreamConfig DefaultStreamConfig()
+{
+    StreamConfig config;
+    config.ring_capacity = 2;
+    config.view_num = 1;
+    config.view_mask = ~0u;
+    config.result_capacity = 16;
+    config.gate = DefaultMotionGateConfig();
+    return config;
+}
+
+/// @brief One view of one frame, seq counts captured frames from 0 including dropped ones.
+typedef struct StreamResult_
+{
+    int64_t seq;
+    /// @brief Monotonic capture time and inference end time, see NowNs.
+    uint64_t timestamp_ns;
+    uint64_t infer_done_ns;
+    int view;
+    /// @brief Detector return code, 0 or -999 for a frame without objects.
+    int status;
+    bool truncated;
+    /// @brief GateAction of the view, GATE_FULL without the gate.
+    int gate;
+    std::vector<Detection> detections;
+    /// @brief Last view of a frame detected through DetectViews, the pairs of that call.
+    std::vector<StereoPair> pairs;
+}StreamResult;
+
+typedef std::function<void(const StreamResult &result)> StreamCallback;
+
+/// @brief Frame counters, inferred counts frames the detector ran on(not frames every gated view
+///        reused), delivered counts results(one per detected view), latency is capture to callback return, ns.
+typedef struct StreamStats_
+{
+    int64_t captured;
+    int64_t dropped;
+    int64_t inferred;
+    int64_t delivered;
+    int64_t failed;
+    /// @brief Gated view results, reused without inference, from moving regions, forced keyframes.
+    int64_t gate_skipped;
+    int64_t gate_roi;
+    int64_t gate_keyframes;
+    double latency_mean_ns;
+    double latency_p50_ns;
+    double latency_p99_ns;
+    double latency_max_ns;
+}StreamStats;
+
+/// @brief Capture thread --> drop-oldest frame ring --> inference thread --> result queue -->
+///        callback thread. A slow detector loses frames at the ring instead of queueing them,
+///        so capture to result latency stays bounded by ring_capacity frames.
+class StreamPipeline
+{
+public:
+    /// @brief detector and source belong to the caller and must outlive the pipeline.
+    StreamPipeline(IStreamDetector *detector, IFrameSource *source, const StreamConfig &config = DefaultStreamConfig());
+    ~StreamPipeline();
+
+    /**
+     * @brief Start -- Start the three threads, callback runs on the delivery thread in frame order.
+     * @return      -- 0--success, -1--already running or no callback
+     */
+    int Start(const StreamCallback &callback);
+    /// @brief Block until the source ended and every captured frame was delivered.
+    void Wait();
+    /// @brief Stop capture, deliver the frames already queued and join.
+    void Stop();
+    bool Running() const;
+
+    StreamStats GetStats() const;
+
+private:
+    StreamPipeline(const StreamPipeline&);
+    StreamPipeline& operator=(const StreamPipeline&);
+
+    void CaptureLoop();
+    void InferLoop();
+    void DeliverLoop();
+
+    typedef struct StreamFrame_
+    {
+        int64_t seq;
+        uint64_t timestamp_ns;
+        cv::Mat image;
+    }StreamFrame;
+
+    /// @brief Motion gate of one view and the detections it reuses.
+    typedef struct GateState_
+    {
+        MotionGate gate;
+        GateDecision decision;
+        std::vector<Detection> last;
+        int status;
+        bool truncated;
+    }GateState;
+
+    /// @brief Detect view as state.gate decides, result gets status, gate and detections.
+    ///        False when the last result was reused without running the detector.
+    bool GatedDetect(const cv::Mat &view, GateState &state, StreamResult &result);
+
+    IStreamDetector *detector_;
+    IFrameSource *source_;
+    StreamConfig config_;
+    StreamCallback callback_;
+
+    BlockingRing<StreamFrame> frames_;
+    BlockingRing<StreamResult> results_;
+    std::atomic<bool> running_;
+    std::thread capture_thread_;
+    std::thread infer_thread_;
+    std::thread deliver_thread_;
+
+    std::atomic<int64_t> captured_;
+    std::atomic<int64_t> dropped_;
+    std::atomic<int64_t> inferred_;
+    std::atomic<int64_t> delivered_;
+    std::atomic<int64_t> failed_;
+    std::atomic<int64_t> gate_skipped_;
+    std::atomic<int64_t> gate_roi_;
+    std::atomic<int64_t> gate_keyframes_;
+    mutable std::mutex latency_mutex_;
+    Histogram latency_ns_;
+};
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     tensor_dump.h
+*   Brief:    raw network output dumps for offline replay of the postprocess.
+*             layout: header {"Y7TD", version, rows, row_len}, then per frame
+*             {src_w, src_h} and rows x row_len floats, all little endian.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_TENSOR_DUMP_H_
+#define YOLOV7TRT_TENSOR_DUMP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+
+#include "inc/engine_loader.h"
+
+namespace siran
+{
+
+static const int kTensorDumpVersion = 1;
+
+typedef struct TensorDumpHeader_
+{
+    char magic[4];
+    int32_t version;
+    int32_t rows;
+    int32_t row_len;
+}TensorDumpHeader;
+
+/// @brief Frame header, the source image size the boxes are scaled to.
+typedef struct TensorDumpFrame_
+{
+    int32_t src_w;
+    int32_t src_h;
+}TensorDumpFrame;
+
+/// @brief Appends frames to a dump, thread safe.
+class TensorDumpWriter
+{
+public:
+    TensorDumpWriter();
+    ~TensorDumpWriter();
+
+    /**
+     * @brief Open -- Create or truncate path and write the header.
+     * @return      -- 0--success, -1--open failed, -2--bad shape
+     */
+    int Open(const std::string &path, const int &rows, const int &row_len);
+    /// @brief Append one frame output, rows x row_len floats.
+    int Write(const float *output, const int &src_w, const int &src_h);
+    void Close();
+    bool IsOpen() const;
+    int64_t Frames() const;
+
+private:
+    TensorDumpWriter(const TensorDumpWriter&);
+    TensorDumpWriter& operator=(const TensorDumpWriter&);
+
+    mutable std::mutex mutex_;
+    FILE *fp_;
+    int rows_;
+    int row_len_;
+    int64_t frames_;
+};
+
+/// @brief mmap reader, frames are views into the mapping, valid until Close.
+class TensorDumpReader
+{
+public:
+    TensorDumpReader();
+
+    /**
+     * @brief Open -- Map path and check the header.
+     * @return      -- 0--success, -1--open failed, -2--not a dump or unknown version
+     */
+    int Open(const std::string &path);
+    void Close();
+
+    int Rows() const;
+    int RowLen() const;
+    /// @brief Complete frames, a partly written last frame is ignored.
+    int64_t Frames() const;
+    /// @brief Output of frame i, null when out of range.
+    const float* Frame(const int64_t &i, int *src_w = nullptr, int *src_h = nullptr) const;
+
+private:
+    MmapFileSource source_;
+    int rows_;
+    int row_len_;
+    int64_t frames_;
+    size_t frame_bytes_;
+};
+
+}
+
+#endif
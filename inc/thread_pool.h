@@ -0,0 +1,53 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     thread_pool.h
+*   Brief:    fixed size worker pool, used to split host work by bands.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_THREAD_POOL_H_
+#define YOLOV7TRT_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace siran
+{
+
+class ThreadPool
+{
+public:
+    /// @brief thread_num <= 0 means std::thread::hardware_concurrency().
+    explicit ThreadPool(const int &thread_num = 0);
+    ~ThreadPool();
+
+    int Size() const;
+
+    /// @brief Queue a task, it runs on a worker thread.
+    void Submit(const std::function<void()> &task);
+
+    /// @brief Split [begin, end) into at most Size() bands and run func(band_begin, band_end)
+    ///        on the workers, the caller thread runs the last band and returns when all are done.
+    void ParallelFor(const int &begin, const int &end, const std::function<void(int, int)> &func);
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void WorkerLoop();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_;
+};
+
+}
+
+#endif
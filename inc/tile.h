@@ -0,0 +1,90 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     tile.h
+*   Brief:    tiled inference of large frames, overlapping network sized tiles run as one batch,
+*             tile detections mapped back to the frame and merged across tile seams.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_TILE_H_
+#define YOLOV7TRT_TILE_H_
+
+#include <stdint.h>
+#include <vector>
+
+#include "inc/detection.h"
+
+namespace siran
+{
+
+typedef struct TileRect_
+{
+    int x;
+    int y;
+    int width;
+    int height;
+}TileRect;
+
+typedef struct TileConfig_
+{
+    int tile_w;              // network input, tiles then run without any resize
+    int tile_h;
+    int min_overlap;         // pixels shared by neighbouring tiles at least, about the smallest
+                             // object that must be seen whole in one tile
+    bool full_frame;         // one more slot with the whole frame letterboxed, catches objects
+                             // larger than a tile
+    float match_thresh;      // cross tile duplicates: IoU above it, or for a part cut by a tile
+                             // border, intersection over the smaller box above it
+}TileConfig;
+
+inline TileConfig DefaultTileConfig()
+{
+    TileConfig config;
+    config.tile_w = 640;
+    config.tile_h = 640;
+    config.min_overlap = 128;
+    config.full_frame = true;
+    config.match_thresh = 0.5f;
+    return config;
+}
+
+/**
+ * @brief PlanTiles -- Cover a frame with tile_w x tile_h tiles, evenly spread on each axis with
+ *        at least min_overlap pixels between neighbours, the first and last tile on the frame
+ *        edges. An axis shorter than a tile gets one tile of the frame size. With full_frame the
+ *        whole frame is appended last when more than one tile was needed.
+ * @return           -- number of tiles, 0 for an empty frame
+ */
+int PlanTiles(const int &frame_w, const int &frame_h, const TileConfig &config, std::vector<TileRect> &tiles);
+
+/**
+ * @brief TileMerger -- Detections of every tile(tile pixels) to frame pixels, then duplicates
+ *        of one object seen by several tiles merged. Only boxes that reach into another tile
+ *        are compared, and only with boxes of other tiles, the per tile NMS already ran. Boxes
+ *        of a class with IoU > match_thresh are one object, the higher score is kept. When the
+ *        smaller box is cut by an inner tile border and intersection / smaller area is above
+ *        match_thresh, the higher scored box grows to the union of both, so parts cut at a
+ *        seam become one box. Buffers are kept between calls.
+ */
+class TileMerger
+{
+public:
+    TileMerger();
+
+    /// @brief tile_dets[i] belongs to tiles[i], merged is sorted by score.
+    int Run(const std::vector<TileRect> &tiles, const DetectionSpan *tile_dets, const float &match_thresh,
+            std::vector<Detection> &merged);
+
+private:
+    std::vector<Detection> boxes_;
+    std::vector<int> tile_of_;
+    /// @brief Box ends on an inner border of its tile, the object goes on in the next tile.
+    std::vector<uint8_t> cut_;
+    std::vector<int> seam_;
+    std::vector<uint8_t> alive_;
+};
+
+}
+
+#endif
@@ -0,0 +1,141 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     trace.h
+*   Brief:    stage level tracing, per-thread latency histograms, chrome trace export.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_TRACE_H_
+#define YOLOV7TRT_TRACE_H_
+
+#include <stdint.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cuda_runtime_api.h>
+
+#include "inc/histogram.h"
+
+namespace siran
+{
+
+/// @brief Traced stages of one frame. Resize, BGR->RGB, normalize and permute run as one
+///        fused kernel(FusedLetterbox/CpuLetterbox), so they are one letterbox stage.
+enum TraceStage
+{
+    TRACE_NONE      = -1,   // device boundary only, see DeviceTracer::Mark
+    TRACE_UPLOAD    = 0,    // host frame to device, or the planar tensor of cpu preprocess
+    TRACE_LETTERBOX = 1,    // resize, pad, BGR->RGB, 1/255 and HWC->CHW
+    TRACE_INFER     = 2,
+    TRACE_D2H       = 3,
+    TRACE_DECODE    = 4,    // threshold and box decode, device decode includes its NMS
+    TRACE_NMS       = 5,
+    TRACE_DRAW      = 6,
+    TRACE_STAGE_NUM = 7,
+};
+
+/// @brief Latency of one stage over all threads since enable or the last TraceReset, ns.
+typedef struct StageLatency_
+{
+    int stage;
+    int64_t count;
+    double mean_ns;
+    double p50_ns;
+    double p99_ns;
+    double p999_ns;
+    double max_ns;
+}StageLatency;
+
+/// @brief Monotonic clock, ns.
+inline uint64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* TraceStageName(const int &stage);
+
+/**
+ * @brief TraceEnable -- Turn recording on or off for all threads, off by default.
+ * @param events      -- also keep the last spans of every thread for TraceExportChrome
+ */
+void TraceEnable(const bool &enable, const bool &events = false);
+bool TraceEnabled();
+
+/**
+ * @brief TraceRecord -- Add one span to the calling thread histograms(and event ring), no lock
+ *        once the thread has its buffer. Dropped when tracing is off.
+ * @param device      -- span measured on the device timeline, exported on its own track
+ */
+void TraceRecord(const int &stage, const uint64_t &start_ns, const uint64_t &end_ns, const bool &device = false);
+
+/// @brief Pull API, stages with at least one span, merged over all threads.
+std::vector<StageLatency> TraceLatencies();
+/// @brief Merged histogram of one stage, ns buckets.
+Histogram TraceHistogram(const int &stage);
+/// @brief Zero all histograms and event rings, spans racing with it may be lost.
+void TraceReset();
+
+/**
+ * @brief TraceExportChrome -- Write kept spans as chrome trace json(chrome://tracing, ui.perfetto.dev),
+ *        host spans under pid 1, device spans under pid 2, one tid per thread buffer.
+ * @return                  -- 0--success, -1--open failed
+ */
+int TraceExportChrome(const std::string &path);
+
+
+/// @brief Scoped host span, a flag load when tracing is off. elapsed_ns, when given, gets the
+///        span length whether tracing is on or not, for callers printing their own timings.
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const int &stage, uint64_t *elapsed_ns = nullptr);
+    ~TraceSpan();
+
+private:
+    TraceSpan(const TraceSpan &);
+    TraceSpan& operator=(const TraceSpan &);
+
+    int stage_;
+    uint64_t *elapsed_ns_;
+    uint64_t start_ns_;
+};
+
+
+/// @brief Device stage spans of one frame from timing events on its streams. Mark closes the
+///        stage started at the previous mark, End resolves the spans after the last mark has
+///        completed and dates them on the host clock. One frame at a time, not thread safe.
+class DeviceTracer
+{
+public:
+    DeviceTracer();
+    ~DeviceTracer();
+
+    /// @brief Start a frame on stream, inactive(no event) unless tracing is on or force.
+    void Begin(cudaStream_t stream, const bool &force = false);
+    /// @brief End stage at this point of stream, TRACE_NONE only moves the boundary, e.g. after
+    ///        a cross stream wait or host work, so queueing is not charged to the next stage.
+    void Mark(const int &stage, cudaStream_t stream);
+    /// @brief Wait for the last mark, record the spans, 0--success, -1--inactive.
+    int End();
+    bool Active() const;
+    /// @brief Device time of stage in the last ended frame, summed over its marks, ns.
+    uint64_t StageNs(const int &stage) const;
+
+    static const int kMaxMarks = 64;
+
+private:
+    DeviceTracer(const DeviceTracer &);
+    DeviceTracer& operator=(const DeviceTracer &);
+
+    bool active_;
+    int marks_;
+    cudaEvent_t events_[kMaxMarks];
+    int stages_[kMaxMarks];
+    uint64_t stage_ns_[TRACE_STAGE_NUM];
+};
+
+}
+
+#endif
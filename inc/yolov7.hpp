@@ -15,6 +15,14 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "inc/yolov7_simd.hpp"
+#include "inc/model_desc.h"
+#include "inc/nms.h"
+#include "inc/box_decode.h"
+#include "inc/detection.h"
+#include "inc/host_decode.h"
+#include "inc/trace.h"
+
 #define MAX_OBJ_NUM 20
 #define YOLOv7_WIDTH 640
 #define YOLOv7_HEIGHT 640
@@ -51,6 +59,9 @@ typedef struct  OBJ_INFO_
 }obj_info, *pObj_info;
 
 
+/// @brief Per output row decode table, shared with the device decoder.
+typedef siran::DecodeRowInfo row_info_t;
+
 class Yolov7
 {
 private:
@@ -58,158 +69,148 @@ private:
     int input_w;
     int input_h;
     int output_align_len;
-    int outputs_pixel[3][2];
-    int stride[3];
     int MAX_OBJECTS;
-    float anchors[3][3][2];
+    float nms_thresh;
+    siran::NmsEngine nms_engine;
+    int total_rows;
+    /// @brief Row --> (stride, anchor, h, w), built once from the model descriptor.
+    std::vector<row_info_t> row_info;
+
+    void Init(const siran::ModelDesc &desc)
+    {
+        const int level_num = desc.strides.size();
+        total_rows = 0;
+        for (int i = 0; i < level_num; ++i)
+        {
+            total_rows += desc.num_anchors * (input_h / desc.strides[i]) * (input_w / desc.strides[i]);
+        }
+        row_info.resize(total_rows);
+        int row = 0;
+        for (int i = 0; i < level_num; ++i)
+        {
+            const int feat_h = input_h / desc.strides[i];
+            const int feat_w = input_w / desc.strides[i];
+            for (int ac_i = 0; ac_i < desc.num_anchors; ++ac_i)
+            {
+                const float *anchor = &desc.anchors[(i * desc.num_anchors + ac_i) * 2];
+                for (int h_i = 0; h_i < feat_h; ++h_i)
+                {
+                    for (int w_i = 0; w_i < feat_w; ++w_i)
+                    {
+                        row_info_t &info = row_info[row++];
+                        info.gx = w_i;
+                        info.gy = h_i;
+                        info.feat_w = feat_w;
+                        info.feat_h = feat_h;
+                        info.anchor_w = anchor[0];
+                        info.anchor_h = anchor[1];
+                    }
+                }
+            }
+        }
+        objects = new object_t[MAX_OBJECTS];
+        valid = new int[MAX_OBJECTS];
+        boxes = new siran::DecodeBox[MAX_OBJECTS];
+        host_decoder = siran::CreateHostDecoder(desc);
+        decode_isa = DetectDecodeIsa();
+    }
 
 public:
     object_t *objects;
     int *valid;
+    /// @brief Candidates of the last frame before NMS.
     int object_num;
+    /// @brief Decoded candidates, row order.
+    siran::DecodeBox *boxes;
+    /// @brief Host decoder, tables built from the model descriptor.
+    siran::IHostDecoder *host_decoder;
+    /// @brief Decode path, see DecodeIsa, detected at construct time.
+    int decode_isa;
+    Yolov7(const siran::ModelDesc &desc)
+        : class_num(desc.num_classes),
+          input_w(desc.input_w),
+          input_h(desc.input_h),
+          output_align_len((desc.num_classes + 5) * desc.num_anchors),
+          MAX_OBJECTS(512),
+          nms_thresh(desc.nms_thresh),
+          object_num(0)
+    {
+        Init(desc);
+    }
+
     Yolov7(const int &classNum)
-        : input_w(YOLOv7_WIDTH),
+        : class_num(classNum),
+          input_w(YOLOv7_WIDTH),
           input_h(YOLOv7_HEIGHT),
-          class_num(classNum),
-          stride({8, 16, 32}),
-          outputs_pixel({
-    {80, 80},
-    {40, 40},
-    {20, 20}}),
-          anchors({
-    {{12, 16}, {19, 36}, {40, 28}}, //8
-    {{36, 75}, {76, 55}, {72, 146}}, //16
-    {{142, 110}, {192, 243}, {459, 401}}}//32
-                  ),
-
+          output_align_len(((classNum + 5)*3)),
           MAX_OBJECTS(512),
-          object_num(0),
-          output_align_len(((class_num + 5)*3))
+          nms_thresh(siran::DefaultModelDesc().nms_thresh),
+          object_num(0)
     {
-        for (int i = 0; i < 3; ++i)
-        {
-            for (int j = 0; j < 2; ++j)
-            {
-                printf("%d ", outputs_pixel[i][j]);
-            }
-            printf("\n");
-        }
-        memcpy(this->anchors, anchors, sizeof(this->anchors));
-        objects = new object_t[MAX_OBJECTS];
-        valid = new int[MAX_OBJECTS];
+        siran::ModelDesc desc = siran::DefaultModelDesc();
+        desc.num_classes = classNum;
+        Init(desc);
+    }
+
+    int InputWidth() const
+    {
+        return input_w;
+    }
+
+    int InputHeight() const
+    {
+        return input_h;
+    }
+
+    int ClassNum() const
+    {
+        return class_num;
+    }
+
+    const std::vector<row_info_t>& RowInfo() const
+    {
+        return row_info;
     }
 
     ~Yolov7()
     {
         delete[] objects;
         delete[] valid;
+        delete[] boxes;
+        delete host_decoder;
     }
+
+    /// @brief Force decode path, e.g. DECODE_SCALAR to compare against simd output.
+    void SetDecodeIsa(const int &isa)
+    {
+        decode_isa = isa;
+        host_decoder->SetIsa(isa);
+        nms_engine.SetIsa(isa);
+    }
+    /// @brief Per class greedy NMS at nms_thresh, valid_[i] is cleared for suppressed objects.
     void NMS(object_t *objects, const int &object_num, int *valid_)
     {
-        std::vector<int> idx(object_num);
-        std::iota(idx.begin(), idx.end(), 0);
-        object_t *objs = objects;
-        std::sort(idx.begin(), idx.end(),[&objs](int i1, int i2) { return objs[i1].prob > objs[i2].prob; });
-        for (int i_sort = 0; i_sort < object_num; ++i_sort)
-        {
-            int i = idx[i_sort];
-            if (!valid_[i])
-            {
-                continue;
-            }
-            const object_t &obj1 = objects[i];
-            float a1 = (obj1.right - obj1.left) * (obj1.high - obj1.low);
-
-            for (int j_sort = i_sort + 1; j_sort < object_num; ++j_sort)
-            {
-                int j = idx[j_sort];
-                if (!valid_[j] || objects[j].id != obj1.id)
-                {
-                    continue;
-                }
-                const object_t &obj2 = objects[j];
-                float a2 = (obj2.right - obj2.left) * (obj2.high - obj2.low);
-                float left = std::max(obj1.left, obj2.left);
-                float low = std::max(obj1.low, obj2.low);
-                float right = std::min(obj1.right, obj2.right);
-                float high = std::min(obj1.high, obj2.high);
-                float sa = std::max(0.f, right - left) * std::max(0.f, high - low);
-                float iou = sa * 1. / (a1 + a2 - sa);
-                if (iou > 0.4)
-                {
-                    valid_[j] = 0;
-                }
-            }
-        }
-        return;
+        nms_engine.Run(objects, object_num, nms_thresh, valid_);
     }
 
-    int YoloProcess(float *fea_out, const float &g_thresh, std::vector<object_t> *pObjInfo)
+    /**
+     * @brief YoloProcess -- Decode and NMS one frame, kept boxes in input pixels.
+     * @return            -- 0--success, -1--input error, -999--no object
+     */
+    int YoloProcess(const float *fea_out, const float &g_thresh, std::vector<object_t> *pObjInfo)
     {
-        int iret = 0;
         if(nullptr == fea_out || NULL == pObjInfo)
         {
             printf("input error\n");
             return -1;
         }
         pObjInfo->clear();
-        int feat = 0;
-        int object_num = 0;
-        const int ac_num = 3;
-
-        for (int stride_i = 0; stride_i < 3; stride_i++)
-        {
-            int feat_w = outputs_pixel[stride_i][1];
-            int feat_h = outputs_pixel[stride_i][0];
-            for (int ac_i = 0; ac_i < ac_num; ac_i++)
-            {
-                for (int h_i = 0; h_i < feat_h; h_i++)
-                {
-                    for (int w_i = 0; w_i < feat_w; w_i++)
-                    {
-                        float obj_conf = fea_out[4 + feat];
-                        if(obj_conf > g_thresh)
-                        {
-                            int max_class_index = 0;
-                            float max_class_conf = 0.f;
-                            for (int class_i = 0; class_i < class_num; ++class_i)
-                            {
-                                if (fea_out[5 + class_i + feat] > max_class_conf)//feat[5 + class_i] > max_class_conf
-                                {
-                                    max_class_conf = fea_out[5 + class_i + feat];
-                                    max_class_index = class_i;
-                                }
-                            }
-                            float conf = max_class_conf * obj_conf;//
-                            if (conf > g_thresh)
-                            {
-                                float cx = (fea_out[0 + feat] * 2.f - 0.5f + (float)w_i) / feat_w;
-                                float cy = (fea_out[1 + feat] * 2.f - 0.5f + (float)h_i) / feat_h;
-                                float w  = pow(fea_out[2 + feat] * 2.f, 2) * anchors[stride_i][ac_i][0] / input_w;
-                                float h  = pow(fea_out[3 + feat] * 2.f, 2) * anchors[stride_i][ac_i][1] / input_h;
-                                object_t &obj = objects[object_num];
-                                valid[object_num] = 1;
-                                obj.left  = std::max(0.f, std::min(1.f, cx - w / 2));
-                                obj.right = std::max(0.f, std::min(1.f, cx + w / 2));
-                                obj.low   = std::max(0.f, std::min(1.f, cy - h / 2));
-                                obj.high  = std::max(0.f, std::min(1.f, cy + h / 2));
-                                obj.prob  = conf;
-                                obj.id = max_class_index;
-                                ++object_num;
-                            }
-                        }
-                        feat += class_num + 5;
-                    }
-                }
-            }
-        }
-
+        bool truncated = false;
+        const int object_num = DecodeObjects(fea_out, g_thresh, truncated);
         if(0 == object_num)
         {
             return -999;
         }
-        NMS(objects, object_num, valid);
-        int j = 0;
         for(int idx=0;idx<object_num;idx++)
         {
             if(valid[idx])
@@ -222,10 +223,79 @@ public:
                 tt.id    = objects[idx].id;
                 tt.prob  = objects[idx].prob;
                 pObjInfo->push_back(tt);
-                j++;
             }
         }
-        return iret;
+        return 0;
+    }
+
+    /**
+     * @brief YoloProcess -- Same decode, kept boxes go to arena in source pixels, no allocation.
+     * @param scale       -- source pixels per input pixel, the letterbox ratio
+     * @param arena       -- output, reset first, truncated when the candidate cap was hit
+     * @return            -- 0--success, -1--input error, -999--no object
+     */
+    int YoloProcess(const float *fea_out, const float &g_thresh, const float &scale, siran::DetectionArena *arena)
+    {
+        if(nullptr == fea_out || nullptr == arena)
+        {
+            printf("input error\n");
+            return -1;
+        }
+        arena->Reset();
+        bool truncated = false;
+        const int object_num = DecodeObjects(fea_out, g_thresh, truncated);
+        if(truncated)
+        {
+            arena->SetTruncated();
+        }
+        if(0 == object_num)
+        {
+            return -999;
+        }
+        for(int idx=0;idx<object_num;idx++)
+        {
+            if(valid[idx])
+            {
+                /// @brief Input pixels first, then source pixels, the rounding of the two-step path.
+                siran::Detection det;
+                det.left     = objects[idx].left * input_w * scale;
+                det.top      = objects[idx].low * input_h * scale;
+                det.right    = objects[idx].right * input_w * scale;
+                det.bottom   = objects[idx].high * input_h * scale;
+                det.class_id = objects[idx].id;
+                det.prob     = objects[idx].prob;
+                arena->Push(det);
+            }
+        }
+        return 0;
+    }
+
+private:
+    /// @brief Threshold, decode up to MAX_OBJECTS candidates into objects and NMS them,
+    ///        valid[i] marks the kept ones. truncated is set when candidates were dropped.
+    int DecodeObjects(const float *fea_out, const float &g_thresh, bool &truncated)
+    {
+        {
+            siran::TraceSpan span(siran::TRACE_DECODE);
+            object_num = host_decoder->Decode(fea_out, g_thresh, boxes, MAX_OBJECTS, truncated);
+            for (int i = 0; i < object_num; ++i)
+            {
+                object_t &obj = objects[i];
+                obj.left  = boxes[i].left;
+                obj.right = boxes[i].right;
+                obj.low   = boxes[i].low;
+                obj.high  = boxes[i].high;
+                obj.prob  = boxes[i].prob;
+                obj.id    = boxes[i].id;
+                valid[i] = 1;
+            }
+        }
+        if (object_num > 0)
+        {
+            siran::TraceSpan span(siran::TRACE_NMS);
+            NMS(objects, object_num, valid);
+        }
+        return object_num;
     }
 
 };
@@ -0,0 +1,137 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     yolov7_backend.h
+*   Brief:    InferServer backend over Yolov7Trt instances sharing one engine.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#ifndef YOLOV7TRT_YOLOV7_BACKEND_H_
+#define YOLOV7TRT_YOLOV7_BACKEND_H_
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "inc/infer_server.h"
+#include "inc/batcher.h"
+#include "inc/stream.h"
+#include "inc/device_group.h"
+#include "inc/stereo.h"
+#include "inc/yolov7_trt.h"
+
+namespace siran
+{
+
+/// @brief How Yolov7Backend runs a request.
+enum Yolov7RequestMode
+{
+    REQUEST_FRAMES = 0,     // one frame runs Yolov7Infer, more run Yolov7InferBatch
+    REQUEST_TILED = 1,      // one large frame through Yolov7DetectTiled with DefaultTileConfig
+    REQUEST_STEREO = 2,     // one side by side frame through Yolov7DetectStereo, results left, right,
+                            // pairs when associate is set
+};
+
+/// @brief InferTask payload of Yolov7Backend, see Yolov7RequestMode.
+typedef struct Yolov7Request_
+{
+    std::vector<cv::Mat> srcs;
+    /// @brief Result image name when verbos, empty for none.
+    std::string name;
+    bool verbos;
+    int mode;
+    /// @brief REQUEST_STEREO: pair the views with stereo, on the float boxes before the export.
+    bool associate;
+    StereoConfig stereo;
+    std::vector<ObjResult> results;
+    /// @brief REQUEST_STEREO with associate, indices into results[0] and results[1] obj_info.
+    std::vector<StereoPair> pairs;
+}Yolov7Request;
+
+class Yolov7Backend : public IInferBackend
+{
+public:
+    /// @brief Deserialize engine_file once, instance_num execution contexts and streams over it.
+    Yolov7Backend(const std::string &engine_file, const int &instance_num, const int &iDeviceID = 0);
+    ~Yolov7Backend();
+
+    int NumInstances() const;
+    /// @brief Yolov7Trt::InitStatus of the engine owner, 0--ready.
+    int InitStatus() const;
+    /// @brief task->payload is a Yolov7Request.
+    int Run(const int &instance, InferTask *task);
+
+private:
+    Yolov7Backend(const Yolov7Backend&);
+    Yolov7Backend& operator=(const Yolov7Backend&);
+
+    /// @brief Stereo association of one instance, buffers kept between its requests.
+    typedef struct StereoState_
+    {
+        StereoAssociator associator;
+        std::vector<StereoPair> pairs;
+        /// @brief Exported obj_info index of every detection of a view, -1 when not exported.
+        std::vector<int> slots[2];
+    }StereoState;
+
+    int RunStereo(Yolov7Trt *trt, StereoState &state, Yolov7Request *request);
+
+    std::vector<Yolov7Trt*> instances_;
+    std::vector<StereoState> stereo_;
+};
+
+/// @brief MicroBatcher backend, every payload is a single-frame Yolov7Request, the batch runs
+///        as one Yolov7InferBatch call and results are scattered back into the requests.
+class Yolov7BatchBackend : public IBatchBackend
+{
+public:
+    explicit Yolov7BatchBackend(Yolov7Trt *trt);
+
+    /// @brief Optimization profile 0 min/opt/max batch, or the static batch.
+    std::vector<int> BatchSizes() const;
+    /// @brief Runs payloads.size() frames, dynamic shape engines need no padding to profile_batch.
+    int RunBatch(const std::vector<void*> &payloads, const int &profile_batch, std::vector<int> &status);
+
+private:
+    Yolov7Trt *trt_;
+};
+
+/// @brief One engine replica and instance_num contexts per GPU behind a DeviceGroup, requests go
+///        to the device with the least outstanding work, workers run on the device NUMA node.
+class Yolov7DeviceGroup
+{
+public:
+    /// @brief device_ids empty for every device, ids without a device and devices whose engine
+    ///        is not ready are skipped.
+    Yolov7DeviceGroup(const std::string &engine_file, const std::vector<int> &device_ids, const int &instance_num,
+                      const int &queue_capacity = 64);
+    ~Yolov7DeviceGroup();
+
+    int Start();
+    void Stop();
+    /// @brief Synchronous request, Yolov7Backend semantics.
+    int Run(Yolov7Request &request);
+    DeviceGroup& Group();
+
+private:
+    Yolov7DeviceGroup(const Yolov7DeviceGroup&);
+    Yolov7DeviceGroup& operator=(const Yolov7DeviceGroup&);
+
+    std::vector<Yolov7Backend*> backends_;
+    DeviceGroup group_;
+};
+
+/// @brief StreamPipeline detector over one Yolov7Trt instance, Yolov7Detect per view.
+class Yolov7StreamDetector : public IStreamDetector
+{
+public:
+    explicit Yolov7StreamDetector(Yolov7Trt *trt);
+    int Detect(const cv::Mat &view, DetectionSpan *detections);
+
+private:
+    Yolov7Trt *trt_;
+};
+
+}
+
+#endif
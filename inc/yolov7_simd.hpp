@@ -0,0 +1,304 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     yolov7_simd.hpp
+*   Brief:    yolov7 postprocess SIMD kernels, objectness filter and class argmax.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#pragma once
+#include <stddef.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define YOLOV7_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define YOLOV7_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+/// @brief Decode instruction set, picked at runtime by DetectDecodeIsa().
+enum DecodeIsa
+{
+    DECODE_SCALAR = 0,
+    DECODE_SSE4   = 1,
+    DECODE_AVX2   = 2,
+    DECODE_NEON   = 3
+};
+
+/**
+ * @brief DetectDecodeIsa -- Query the best decode path supported by the running cpu.
+ * @return                -- one of DecodeIsa
+ */
+inline int DetectDecodeIsa()
+{
+#if defined(YOLOV7_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return DECODE_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        return DECODE_SSE4;
+    }
+#elif defined(YOLOV7_SIMD_NEON)
+    return DECODE_NEON;
+#endif
+    return DECODE_SCALAR;
+}
+
+/**
+ * @brief FilterObjScalar -- Collect rows whose objectness is greater than thresh.
+ * @param fea_out         -- network output, rows x row_len floats
+ * @param rows            -- number of rows(anchors)
+ * @param row_len         -- floats per row, class_num + 5
+ * @param thresh          -- objectness thresh
+ * @param idx             -- output dense row index list, at least rows entries
+ * @return                -- number of survivors
+ */
+inline int FilterObjScalar(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+{
+    int n = 0;
+    const float *obj = fea_out + 4;
+    for (int r = 0; r < rows; ++r)
+    {
+        if (obj[(size_t)r * row_len] > thresh)
+        {
+            idx[n++] = r;
+        }
+    }
+    return n;
+}
+
+/**
+ * @brief ArgmaxScalar -- Max class conf and its first index, conf starts from 0.f, NaN scores
+ *        never compare greater and are skipped.
+ */
+inline float ArgmaxScalar(const float *cls, const int &class_num, int &max_index)
+{
+    float max_conf = 0.f;
+    max_index = 0;
+    for (int c = 0; c < class_num; ++c)
+    {
+        if (cls[c] > max_conf)
+        {
+            max_conf = cls[c];
+            max_index = c;
+        }
+    }
+    return max_conf;
+}
+
+/// @brief Resolve the first index holding max_conf, keeps the scalar tie rule.
+inline float ArgmaxResolve(const float *cls, const int &class_num, const float &max_conf, int &max_index)
+{
+    max_index = 0;
+    if (!(max_conf > 0.f))
+    {
+        return 0.f;
+    }
+    for (int c = 0; c < class_num; ++c)
+    {
+        if (cls[c] == max_conf)
+        {
+            max_index = c;
+            break;
+        }
+    }
+    return max_conf;
+}
+
+#if defined(YOLOV7_SIMD_X86)
+
+__attribute__((target("avx2")))
+inline int FilterObjAvx2(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+{
+    const __m256i offs = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(row_len));
+    const __m256 th = _mm256_set1_ps(thresh);
+    const float *obj = fea_out + 4;
+    const size_t step = (size_t)row_len * 8;
+    int n = 0;
+    int r = 0;
+    /// @brief Two gathers per iteration, 16 anchors tested per loop.
+    for (; r + 16 <= rows; r += 16)
+    {
+        const float *p = obj + (size_t)r * row_len;
+        __m256 v0 = _mm256_i32gather_ps(p, offs, 4);
+        __m256 v1 = _mm256_i32gather_ps(p + step, offs, 4);
+        unsigned int mask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(v0, th, _CMP_GT_OQ))
+                | ((unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(v1, th, _CMP_GT_OQ)) << 8);
+        while (mask)
+        {
+            idx[n++] = r + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; r < rows; ++r)
+    {
+        if (obj[(size_t)r * row_len] > thresh)
+        {
+            idx[n++] = r;
+        }
+    }
+    return n;
+}
+
+__attribute__((target("avx2")))
+inline float ArgmaxAvx2(const float *cls, const int &class_num, int &max_index)
+{
+    __m256 vmax = _mm256_setzero_ps();
+    int c = 0;
+    /// @brief max_ps returns its second operand for a NaN lane, the running max stays NaN free
+    ///        and NaN scores are skipped like the scalar compare does.
+    for (; c + 8 <= class_num; c += 8)
+    {
+        vmax = _mm256_max_ps(_mm256_loadu_ps(cls + c), vmax);
+    }
+    __m128 m4 = _mm_max_ps(_mm256_castps256_ps128(vmax), _mm256_extractf128_ps(vmax, 1));
+    m4 = _mm_max_ps(m4, _mm_movehl_ps(m4, m4));
+    m4 = _mm_max_ss(m4, _mm_shuffle_ps(m4, m4, 1));
+    float max_conf = _mm_cvtss_f32(m4);
+    for (; c < class_num; ++c)
+    {
+        max_conf = cls[c] > max_conf ? cls[c] : max_conf;
+    }
+    return ArgmaxResolve(cls, class_num, max_conf, max_index);
+}
+
+__attribute__((target("sse4.1")))
+inline int FilterObjSse4(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+{
+    const __m128 th = _mm_set1_ps(thresh);
+    const float *obj = fea_out + 4;
+    int n = 0;
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const float *p = obj + (size_t)r * row_len;
+        __m128 v = _mm_setr_ps(p[0], p[row_len], p[2 * row_len], p[3 * row_len]);
+        unsigned int mask = (unsigned int)_mm_movemask_ps(_mm_cmpgt_ps(v, th));
+        while (mask)
+        {
+            idx[n++] = r + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; r < rows; ++r)
+    {
+        if (obj[(size_t)r * row_len] > thresh)
+        {
+            idx[n++] = r;
+        }
+    }
+    return n;
+}
+
+__attribute__((target("sse4.1")))
+inline float ArgmaxSse4(const float *cls, const int &class_num, int &max_index)
+{
+    __m128 vmax = _mm_setzero_ps();
+    int c = 0;
+    for (; c + 4 <= class_num; c += 4)
+    {
+        vmax = _mm_max_ps(_mm_loadu_ps(cls + c), vmax);
+    }
+    vmax = _mm_max_ps(vmax, _mm_movehl_ps(vmax, vmax));
+    vmax = _mm_max_ss(vmax, _mm_shuffle_ps(vmax, vmax, 1));
+    float max_conf = _mm_cvtss_f32(vmax);
+    for (; c < class_num; ++c)
+    {
+        max_conf = cls[c] > max_conf ? cls[c] : max_conf;
+    }
+    return ArgmaxResolve(cls, class_num, max_conf, max_index);
+}
+
+#endif // YOLOV7_SIMD_X86
+
+#if defined(YOLOV7_SIMD_NEON)
+
+inline int FilterObjNeon(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+{
+    const float32x4_t th = vdupq_n_f32(thresh);
+    const uint32x4_t bits = {1, 2, 4, 8};
+    const float *obj = fea_out + 4;
+    int n = 0;
+    int r = 0;
+    for (; r + 4 <= rows; r += 4)
+    {
+        const float *p = obj + (size_t)r * row_len;
+        float32x4_t v = vdupq_n_f32(0.f);
+        v = vsetq_lane_f32(p[0], v, 0);
+        v = vsetq_lane_f32(p[row_len], v, 1);
+        v = vsetq_lane_f32(p[2 * row_len], v, 2);
+        v = vsetq_lane_f32(p[3 * row_len], v, 3);
+        unsigned int mask = vaddvq_u32(vandq_u32(vcgtq_f32(v, th), bits));
+        while (mask)
+        {
+            idx[n++] = r + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    for (; r < rows; ++r)
+    {
+        if (obj[(size_t)r * row_len] > thresh)
+        {
+            idx[n++] = r;
+        }
+    }
+    return n;
+}
+
+inline float ArgmaxNeon(const float *cls, const int &class_num, int &max_index)
+{
+    float32x4_t vmax = vdupq_n_f32(0.f);
+    int c = 0;
+    /// @brief vmaxq_f32 propagates NaN, select on a greater-than compare skips NaN scores instead.
+    for (; c + 4 <= class_num; c += 4)
+    {
+        const float32x4_t v = vld1q_f32(cls + c);
+        vmax = vbslq_f32(vcgtq_f32(v, vmax), v, vmax);
+    }
+    float max_conf = vmaxvq_f32(vmax);
+    for (; c < class_num; ++c)
+    {
+        max_conf = cls[c] > max_conf ? cls[c] : max_conf;
+    }
+    return ArgmaxResolve(cls, class_num, max_conf, max_index);
+}
+
+#endif // YOLOV7_SIMD_NEON
+
+/**
+ * @brief FilterObj -- Objectness filter dispatched by isa, survivors kept in row order.
+ */
+inline int FilterObj(const int &isa, const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+{
+    switch (isa)
+    {
+#if defined(YOLOV7_SIMD_X86)
+    case DECODE_AVX2: return FilterObjAvx2(fea_out, rows, row_len, thresh, idx);
+    case DECODE_SSE4: return FilterObjSse4(fea_out, rows, row_len, thresh, idx);
+#elif defined(YOLOV7_SIMD_NEON)
+    case DECODE_NEON: return FilterObjNeon(fea_out, rows, row_len, thresh, idx);
+#endif
+    default: return FilterObjScalar(fea_out, rows, row_len, thresh, idx);
+    }
+}
+
+/**
+ * @brief Argmax -- Class argmax dispatched by isa, bit-exact with ArgmaxScalar.
+ */
+inline float Argmax(const int &isa, const float *cls, const int &class_num, int &max_index)
+{
+    switch (isa)
+    {
+#if defined(YOLOV7_SIMD_X86)
+    case DECODE_AVX2: return ArgmaxAvx2(cls, class_num, max_index);
+    case DECODE_SSE4: return ArgmaxSse4(cls, class_num, max_index);
+#elif defined(YOLOV7_SIMD_NEON)
+    case DECODE_NEON: return ArgmaxNeon(cls, class_num, max_index);
+#endif
+    default: return ArgmaxScalar(cls, class_num, max_index);
+    }
+}
@@ -11,24 +11,111 @@
 
 #include <export/export.h>
 #include <vector>
+#include <functional>
 #include <opencv2/opencv.hpp>
 #include <NvInfer.h>
 
 #include "inc/yolov7.hpp"
+#include "inc/buffer_pool.h"
+#include "inc/pipeline.h"
+#include "inc/preprocess.h"
+#include "inc/model_desc.h"
+#include "inc/box_decode.h"
+#include "inc/detection.h"
+#include "inc/tile.h"
+#include "inc/tensor_dump.h"
+#include "inc/trace.h"
+
+/// @brief Default engine, its model descriptor is ../models/yolov7_sim_2070ti_fp16.cfg.
+#define ENGINE_ENHANCE_FILE_PATH "../models/yolov7_sim_2070ti_fp16.trt"
 
 namespace siran
 {
 
-class Yolov7Trt
+/// @brief Pipeline completion callback, status is the postprocess return code or the code of the failed
+///        preprocess/inference stage, called on the PushFrame thread.
+typedef std::function<void(const int64_t &frame_id, const int &status, const ObjResult &result)> InferCallback;
+
+class Yolov7Trt : private IStageExecutor
 {
 public:
     /// @brief Yolov7Trt construct function, load Enhance module TRT model, support
     ///        device id is 0 or 1, default parameter is 0, means using the first GPU.
     explicit Yolov7Trt(const int &iDeviceID = 0);
+    /// @brief Load engine_file, input size, classes, anchors and thresholds come from the
+    ///        .cfg model descriptor next to it, see LoadModelDesc. A .onnx file is built into
+    ///        an fp16 engine on first use and cached, see GetCachedEngine.
+    explicit Yolov7Trt(const std::string &engine_file, const int &iDeviceID = 0);
     ~Yolov7Trt();
-    /// @brief Yolov7Trt interface function, input img, logger pointer, output enhanced-gpumat.
+    /**
+     * @brief InitStatus -- Construction result, an instance that is not ready returns -1 from
+     *        every call.
+     * @return           -- 0--ready, -1--cuda device error, -2--engine load failed, -3--invalid model descriptor
+     */
+    int InitStatus() const;
+    /// @brief New instance sharing this engine, with its own execution context, stream and
+    ///        buffers, so instances can run on different threads. Caller deletes it before this
+    ///        instance, which owns the engine. nullptr when this instance is not ready.
+    Yolov7Trt* CreateInstance() const;
+    /// @brief Structured result, detections in source pixels over a per-instance arena, the view
+    ///        is valid until the next call on this instance, Truncated() marks dropped candidates.
+    int Yolov7Detect(const cv::Mat &src, DetectionSpan *detections, const bool &verbos = false);
+    /// @brief Yolov7Trt interface function, Yolov7Detect exported to ObjResult, the highest
+    ///        YOLOV7_MAX_OBJ_NUM scores when there are more.
     int Yolov7Infer(const cv::Mat &src, ObjResult *pobj_result, const std::string *path = nullptr, const bool &verbos = false);
+    /// @brief Yolov7Trt batch interface, N frames share one NCHW input and one inference call,
+    ///        batches larger than the engine max batch are run in chunks.
+    int Yolov7InferBatch(const std::vector<cv::Mat> &srcs, std::vector<ObjResult> &obj_results, const bool &verbos = false);
+    /// @brief Tiled mode for frames much larger than the network input, overlapping tiles(and
+    ///        the whole frame) run as one batch, detections in src pixels merged across tile
+    ///        seams, the view is valid until the next call on this instance.
+    int Yolov7DetectTiled(const cv::Mat &src, DetectionSpan *detections, const TileConfig &config = DefaultTileConfig(),
+                          const bool &verbos = false);
+    /// @brief Stereo mode, the left and right halves of a side by side frame as one batch of 2,
+    ///        uploaded and letterboxed in one pass without copying the views, detections in
+    ///        view pixels, both views valid until the next call on this instance.
+    int Yolov7DetectStereo(const cv::Mat &frame, DetectionSpan *left, DetectionSpan *right, const bool &verbos = false);
+    /// @brief Preprocess on host threads instead of the gpu kernel, for busy devices.
+    void SetCpuPreprocess(const bool &enable, const int &thread_num = 0);
+    /// @brief Decode, threshold and NMS on the device, only the kept boxes are copied back
+    ///        instead of the whole output tensor. device_nms false runs NMS on host over the
+    ///        compacted candidates. Sync modes only, the pipelined mode keeps host postprocess.
+    void SetDeviceDecode(const bool &enable, const bool &device_nms = true);
+
+    /// @brief Capture mode, every frame output(before decode) is appended to dump_file for
+    ///        offline replay, see Replay_bench. Device decode frames are copied back for it.
+    int StartCapture(const std::string &dump_file);
+    void StopCapture();
+
+    /// @brief Batch sizes the engine is tuned for, profile 0 min/opt/max, or the static batch.
+    std::vector<int> GetBatchSizes() const;
+
+    /// @brief Binding/staging buffer pool counters.
+    PoolStats GetPoolStats() const;
+
+    /// @brief Pipelined mode, frame N+1 upload/resize overlaps frame N inference and
+    ///        frame N-1 D2H copy, results arrive through callback in frame order.
+    int StartPipeline(const InferCallback &callback);
+    /// @brief Enter a frame, return its frame id, or -1 if the pipeline is not started or src
+    ///        is not a 8UC3 BGR frame.
+    int64_t PushFrame(const cv::Mat &src);
+    /// @brief Drain in-flight frames.
+    int FlushPipeline();
+    void StopPipeline();
 private:
+    Yolov7Trt(nvinfer1::ICudaEngine *engine, const std::string &engine_file, const ModelDesc &desc, const int &iDeviceID);
+    void Init();
+
+    /// @brief Batch slot result, index into the srcs of RunBatch, status is the prepare, inference or
+    ///        postprocess return code, detections are empty unless it is 0.
+    typedef std::function<void(const int &index, const int &status, const DetectionSpan &detections)> BatchResultFn;
+    /// @brief Batched inference shared by Yolov7InferBatch, Yolov7DetectTiled and Yolov7DetectStereo,
+    ///        srcs of a packed frame are its SplitViews and are prepared together when in one chunk.
+    int RunBatch(const std::vector<cv::Mat> &srcs, const BatchResultFn &on_result, const bool &verbos,
+                 const cv::Mat *packed = nullptr);
+
+    /// @brief IStageExecutor, one pipeline stage of the frame staged in slot.
+    int Launch(const int &stage, const int &slot, const int64_t &frame_id);
 
     /// @brief Load Enhance module TRT model.
     int LoadEngine();
@@ -36,28 +123,56 @@ private:
     /// @brief Limit input image size to even number.
     void LimitInputSize(const cv::cuda::GpuMat &img, int &dst_h, int &dst_w);
 
-    /// @brief Transform 3 channels mat to one-dimensional array.
-    int PreprocessImage(cv::cuda::GpuMat &img, float *data);
+    /// @brief Letterbox, BGR->RGB, normalize and permute an uploaded frame straight into data.
+    int PreprocessImage(const cv::cuda::GpuMat &img, float *data, cudaStream_t stream);
 
     void DetResizeImg(const cv::cuda::GpuMat &img,int max_size_len, float &ratio_h, float &ratio_w, cv::cuda::GpuMat &resize_img);
 
-    /// @brief Enhance model inference module, input gpumat, output one-dimensional array pointer.
-    float* DoInference(cv::cuda::GpuMat &img, const int &dst_h, const int &dst_w, const bool &verbos = false);
+    /// @brief Enhance model inference module, input binding already filled for batch_size slots,
+    ///        output one-dimensional array pointer.
+    float* DoInference(const int &batch_size, const int &dst_h, const int &dst_w);
 
-    int Yolov7Postprocess(float *trt_out, const cv::cuda::GpuMat &src, ObjResult *pobj_result);
+    int Yolov7Postprocess(float *trt_out, const cv::Size &src_size, DetectionArena &arena, Yolov7 *pyolov7 = nullptr);
+    /// @brief Postprocess of one frame of device output through device_decoder_, queued on cuda_stream_.
+    int DevicePostprocess(const float *gpu_out, const cv::Size &src_size, DetectionArena &arena);
+    /// @brief Append a device frame output to the capture dump, synchronizes cuda_stream_.
+    void CaptureDeviceOutput(const float *gpu_out, const cv::Size &src_size);
+
+    /// @brief Fill one input binding slot from a host frame, gpu or cpu preprocessing.
+    int PrepareInput(const cv::Mat &src, float *input, std::vector<cv::cuda::GpuMat> &stage);
+
+    /// @brief Fill view_num consecutive binding slots from the side by side views of frame, one
+    ///        upload of the whole frame(or one host letterbox pass) for all of them.
+    int PrepareViews(const cv::Mat &frame, const int &view_num, float *input, std::vector<cv::cuda::GpuMat> &stage);
+
+    /// @brief Staging GpuMat over pooled device memory, give back by ReleaseMats.
+    cv::cuda::GpuMat AcquireMat(const int &rows, const int &cols, const int &type);
+    void ReleaseMats(std::vector<cv::cuda::GpuMat> &mats);
+
+    /// @brief Binding buffers of one batch from the pool, released by ReleaseBindings.
+    void AcquireBindings(const int &batch_size);
+    void ReleaseBindings();
 
 private:
     /// @brief gpu device id
     int device_id_;
+    /// @brief InitStatus code, must stay declared before desc_.
+    int init_status_;
 
     /// @brief enhance TRT model path
     std::string engine_file_;
+    /// @brief Runtime model descriptor, must stay declared before letterbox_.
+    ModelDesc desc_;
     std::vector<int> input_shape_;
 
     int64_t input_size_;
     int64_t output_size_;
+    /// @brief Max batch of the engine, from the static batch dim or optimization profile 0.
+    int max_batch_size_;
 
-    /// @brief enhance model TRT init handle
+    /// @brief enhance model TRT init handle, the runtime is only set on the instance that
+    ///        deserialized the engine, which owns both.
+    nvinfer1::IRuntime* trt_runtime_;
     nvinfer1::ICudaEngine* trt_engine_;
     nvinfer1::IExecutionContext* trt_context_;
 
@@ -65,13 +180,74 @@ private:
     ///        feature maps with different scales, so nb_bindings_ is 1+3 = 4.
     int nb_bindings_;
     void* trt_out_buffers_[2];
+    /// @brief Pinned host output, max_batch_size_ x buffer_size_[1] floats.
     float* trt_cpu_out_buffers_;
     cudaStream_t cuda_stream_;
+    /// @brief Per-image binding size(batch dim excluded).
     std::vector<int64_t> buffer_size_;
     std::vector<float> output_vec_;
 
     /// @brief Yolov7 postprocess code.
     Yolov7 *pyolov7_;
+    /// @brief Per batch slot postprocess, slots run in parallel on batch_pool_(null for batch 1).
+    std::vector<Yolov7*> batch_yolov7_;
+    ThreadPool *batch_pool_;
+    /// @brief Results of the single frame and pipelined modes, and of every batch slot, reused per frame.
+    DetectionArena arena_;
+    std::vector<DetectionArena> batch_arenas_;
+    std::vector<int> batch_status_;
+    /// @brief Tiled mode state, tile ROIs of the current frame and their detections, reused per frame.
+    std::vector<TileRect> tiles_;
+    std::vector<cv::Mat> tile_srcs_;
+    std::vector<std::vector<Detection> > tile_dets_;
+    std::vector<DetectionSpan> tile_spans_;
+    TileMerger tile_merger_;
+    std::vector<Detection> merged_;
+    /// @brief Stereo mode views of the current frame and the right view results, the left go to arena_.
+    std::vector<cv::Mat> stereo_views_;
+    DetectionArena right_arena_;
+    /// @brief Staging mats of the single frame mode, kept for its capacity.
+    std::vector<cv::cuda::GpuMat> stage_;
+    /// @brief Output dump of the capture mode.
+    TensorDumpWriter capture_;
+    /// @brief Device stage spans of the single frame and batch modes, see TraceEnable.
+    DeviceTracer tracer_;
+    /// @brief Device decoder, null for host postprocess.
+    DeviceBoxDecoder *device_decoder_;
+    std::vector<DecodeBox> decode_boxes_;
+
+    /// @brief Binding buffers, staging mats and pinned host output, allocated once and reused.
+    BufferPool buffer_pool_;
+
+    /// @brief Fused preprocessing kernel, writes the TRT input binding directly.
+    FusedLetterbox letterbox_;
+    /// @brief Host preprocessing engine and its pinned staging input, null when disabled.
+    CpuLetterbox *cpu_letterbox_;
+    float *cpu_input_;
+
+    /// @brief Per in-flight frame state of the pipelined mode.
+    typedef struct PipelineSlot_
+    {
+        cv::Mat src;
+        std::vector<cv::cuda::GpuMat> stage;
+        void* bindings[2];
+        float* host_out;
+        cudaEvent_t pre_done;
+        cudaEvent_t infer_done;
+        cudaEvent_t d2h_done;
+        DeviceTracer *tracer;
+        /// @brief First failed stage code of the slot frame, its later stages are skipped
+        ///        and the code goes to callback_ instead of a decode of a stale output.
+        int status;
+    }PipelineSlot;
+
+    PipelineScheduler *scheduler_;
+    std::vector<PipelineSlot> slots_;
+    InferCallback callback_;
+    int64_t next_frame_id_;
+    /// @brief Preprocess and D2H streams, inference stays on cuda_stream_.
+    cudaStream_t upload_stream_;
+    cudaStream_t d2h_stream_;
 
 };
 
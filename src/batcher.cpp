@@ -0,0 +1,260 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     batcher.cpp
+*   Brief:    dynamic micro-batching src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/batcher.h"
+
+#include <algorithm>
+
+namespace siran
+{
+
+static std::future<int> ReadyFuture(const int &status)
+{
+    std::promise<int> promise;
+    promise.set_value(status);
+    return promise.get_future();
+}
+
+
+MicroBatcher::MicroBatcher(IBatchBackend *backend, const BatcherConfig &config):
+    backend_(backend),
+    config_(config),
+    target_batch_(1),
+    running_(false)
+{
+    if(backend_ != nullptr)
+    {
+        batch_sizes_ = backend_->BatchSizes();
+    }
+    std::sort(batch_sizes_.begin(), batch_sizes_.end());
+    batch_sizes_.erase(std::unique(batch_sizes_.begin(), batch_sizes_.end()), batch_sizes_.end());
+    batch_sizes_.erase(std::remove_if(batch_sizes_.begin(), batch_sizes_.end(), [](int b) { return b <= 0; }), batch_sizes_.end());
+    if(batch_sizes_.empty())
+    {
+        batch_sizes_.push_back(1);
+    }
+    /// @brief Full batch trigger, the largest profile size within max_batch.
+    target_batch_ = batch_sizes_[0];
+    for(size_t i=0;i<batch_sizes_.size();++i)
+    {
+        if(batch_sizes_[i] <= config_.max_batch)
+        {
+            target_batch_ = batch_sizes_[i];
+        }
+    }
+
+    stats_.frames = 0;
+    stats_.batches = 0;
+    stats_.rejected = 0;
+    stats_.fill_ratio = Histogram(Histogram::LinearBounds(0.1, 0.1, 10));
+    stats_.queue_delay_us = Histogram(Histogram::ExponentialBounds(50., 2., 200000.));
+    stats_.profile_hits.assign(batch_sizes_.size(), 0);
+}
+
+
+MicroBatcher::~MicroBatcher()
+{
+    Stop();
+}
+
+
+int MicroBatcher::Start()
+{
+    if(nullptr == backend_)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(running_)
+    {
+        return 0;
+    }
+    running_ = true;
+    dispatcher_ = std::thread(&MicroBatcher::DispatchLoop, this);
+    return 0;
+}
+
+
+void MicroBatcher::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!running_)
+        {
+            return;
+        }
+        running_ = false;
+    }
+    cond_.notify_all();
+    dispatcher_.join();
+}
+
+
+std::future<int> MicroBatcher::Submit(void *payload)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(!running_)
+    {
+        return ReadyFuture(-1);
+    }
+    if((int)queue_.size() >= config_.queue_capacity)
+    {
+        lock.unlock();
+        std::lock_guard<std::mutex> stats_lock(stats_mutex_);
+        stats_.rejected++;
+        return ReadyFuture(-2);
+    }
+    queue_.emplace_back();
+    Pending &pending = queue_.back();
+    pending.payload = payload;
+    pending.enqueue_time = Clock::now();
+    std::future<int> future = pending.promise.get_future();
+    const bool wake = (int)queue_.size() == 1 || (int)queue_.size() >= target_batch_;
+    lock.unlock();
+    if(wake)
+    {
+        cond_.notify_one();
+    }
+    return future;
+}
+
+
+int MicroBatcher::ProfileBatch(const int &n) const
+{
+    for(size_t i=0;i<batch_sizes_.size();++i)
+    {
+        if(batch_sizes_[i] >= n)
+        {
+            return batch_sizes_[i];
+        }
+    }
+    return batch_sizes_.back();
+}
+
+
+/**
+ * @brief MicroBatcher::DispatchLoop -- Wait until target_batch_ frames are queued or the oldest
+ *        frame reached its deadline, then run what is queued(up to target_batch_) as one batch.
+ */
+void MicroBatcher::DispatchLoop()
+{
+    const auto max_wait = std::chrono::microseconds(config_.max_wait_us);
+    for(;;)
+    {
+        std::vector<Pending> batch;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+            if(queue_.empty())
+            {
+                break;
+            }
+            const Clock::time_point deadline = queue_.front().enqueue_time + max_wait;
+            cond_.wait_until(lock, deadline, [this] { return !running_ || (int)queue_.size() >= target_batch_; });
+            const int n = std::min((int)queue_.size(), target_batch_);
+            batch.reserve(n);
+            for(int i=0;i<n;++i)
+            {
+                batch.push_back(std::move(queue_.front()));
+                queue_.pop_front();
+            }
+        }
+        RunBatch(batch);
+    }
+}
+
+
+void MicroBatcher::RunBatch(std::vector<Pending> &batch)
+{
+    const Clock::time_point start = Clock::now();
+    const int n = batch.size();
+    const int profile_batch = ProfileBatch(n);
+    std::vector<void*> payloads(n);
+    for(int i=0;i<n;++i)
+    {
+        payloads[i] = batch[i].payload;
+    }
+    std::vector<int> status(n, 0);
+    int iret = backend_->RunBatch(payloads, profile_batch, status);
+    status.resize(n, iret);
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.frames += n;
+        stats_.batches++;
+        stats_.fill_ratio.Add(n * 1.0 / profile_batch);
+        for(int i=0;i<n;++i)
+        {
+            stats_.queue_delay_us.Add(std::chrono::duration<double, std::micro>(start - batch[i].enqueue_time).count());
+        }
+        const size_t hit = std::lower_bound(batch_sizes_.begin(), batch_sizes_.end(), profile_batch) - batch_sizes_.begin();
+        if(hit < stats_.profile_hits.size())
+        {
+            stats_.profile_hits[hit]++;
+        }
+    }
+    for(int i=0;i<n;++i)
+    {
+        batch[i].promise.set_value(iret != 0 ? iret : status[i]);
+    }
+}
+
+
+BatcherStats MicroBatcher::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+
+int MicroBatcher::QueueDepth() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (int)queue_.size();
+}
+
+
+SimBatchBackend::SimBatchBackend(const std::vector<int> &batch_sizes, const int &fixed_us, const int &per_frame_us):
+    batch_sizes_(batch_sizes),
+    fixed_us_(fixed_us),
+    per_frame_us_(per_frame_us),
+    batches_(0),
+    busy_us_(0)
+{
+}
+
+
+std::vector<int> SimBatchBackend::BatchSizes() const
+{
+    return batch_sizes_;
+}
+
+
+int SimBatchBackend::RunBatch(const std::vector<void*> &payloads, const int &profile_batch, std::vector<int> &status)
+{
+    const int cost_us = fixed_us_ + per_frame_us_ * profile_batch;
+    std::this_thread::sleep_for(std::chrono::microseconds(cost_us));
+    batches_++;
+    busy_us_ += cost_us;
+    status.assign(payloads.size(), 0);
+    return 0;
+}
+
+
+int64_t SimBatchBackend::Batches() const
+{
+    return batches_.load();
+}
+
+
+int64_t SimBatchBackend::BusyUs() const
+{
+    return busy_us_.load();
+}
+
+}
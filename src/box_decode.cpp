@@ -0,0 +1,74 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     box_decode.cpp
+*   Brief:    cpu reference box decoder src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/box_decode.h"
+
+namespace siran
+{
+
+CpuBoxDecoder::CpuBoxDecoder(const DecodeParams &params, const std::vector<DecodeRowInfo> &row_info):
+    params_(params),
+    truncated_(false),
+    row_info_(row_info),
+    candidates_(kMaxDecodeBoxes),
+    valid_(kMaxDecodeBoxes)
+{
+    params_.rows = row_info_.size();
+}
+
+
+int CpuBoxDecoder::Decode(const float *fea_out, std::vector<DecodeBox> &boxes, cudaStream_t stream)
+{
+    /// @brief fea_out is host memory already synchronized by the caller.
+    (void)stream;
+    boxes.clear();
+    truncated_ = false;
+    if(nullptr == fea_out)
+    {
+        return -1;
+    }
+    const int row_len = params_.class_num + 5;
+    int n = 0;
+    int row = 0;
+    for(;row<params_.rows && n<kMaxDecodeBoxes;++row)
+    {
+        DecodeBox &box = candidates_[n];
+        if(DecodeRowBox(fea_out + (size_t)row * row_len, row_info_[row], params_, box))
+        {
+            box.row = row;
+            valid_[n] = 1;
+            ++n;
+        }
+    }
+    DecodeBox spare;
+    for(;row<params_.rows && !truncated_;++row)
+    {
+        truncated_ = DecodeRowBox(fea_out + (size_t)row * row_len, row_info_[row], params_, spare);
+    }
+    if(0 == n)
+    {
+        return -999;
+    }
+    nms_.Run(candidates_.data(), n, params_.nms_thresh, valid_.data());
+    for(int i=0;i<n;++i)
+    {
+        if(valid_[i])
+        {
+            boxes.push_back(candidates_[i]);
+        }
+    }
+    return 0;
+}
+
+
+bool CpuBoxDecoder::Truncated() const
+{
+    return truncated_;
+}
+
+}
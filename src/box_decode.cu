@@ -0,0 +1,243 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     box_decode.cu
+*   Brief:    device box decode, compaction and NMS kernels.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/box_decode.h"
+#include "inc/trace.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace siran
+{
+
+static const int kDecodeThreads = 256;
+/// @brief One block does the scan, compaction and NMS.
+static const int kCompactThreads = 1024;
+
+
+/// @brief One thread per row, flags[row] = candidate, the box goes to scratch[row].
+__global__ void DecodeRowsKernel(const float *fea_out, const DecodeRowInfo *row_info, const DecodeParams params,
+                                 int *flags, DecodeBox *scratch)
+{
+    const int row = blockIdx.x * blockDim.x + threadIdx.x;
+    if (row >= params.rows)
+    {
+        return;
+    }
+    DecodeBox box;
+    const bool pass = DecodeRowBox(fea_out + (size_t)row * (params.class_num + 5), row_info[row], params, box);
+    if (pass)
+    {
+        box.row = row;
+        scratch[row] = box;
+    }
+    flags[row] = pass ? 1 : 0;
+}
+
+
+/**
+ * @brief CompactNmsKernel -- Single block. Prefix sum over row flags keeps the first kMaxDecodeBoxes
+ *        candidates in row order(as the host loop does), score ranks give the greedy order, each
+ *        kept box clears lower ranked boxes of its class in parallel, survivors are written in row order.
+ */
+__global__ void CompactNmsKernel(const int *flags, const DecodeBox *scratch, const DecodeParams params,
+                                 const int do_nms, DecodeOutput *out)
+{
+    __shared__ int sums[kCompactThreads];
+    __shared__ DecodeBox boxes[kMaxDecodeBoxes];
+    __shared__ float area[kMaxDecodeBoxes];
+    __shared__ int rank[kMaxDecodeBoxes];
+    __shared__ int order[kMaxDecodeBoxes];
+    __shared__ uint8_t keep[kMaxDecodeBoxes];
+
+    const int tid = threadIdx.x;
+    const int chunk = (params.rows + blockDim.x - 1) / blockDim.x;
+    const int begin = min(params.rows, tid * chunk);
+    const int end = min(params.rows, begin + chunk);
+    int local = 0;
+    for (int r = begin; r < end; ++r)
+    {
+        local += flags[r];
+    }
+    sums[tid] = local;
+    __syncthreads();
+    for (int offset = 1; offset < blockDim.x; offset <<= 1)
+    {
+        const int v = tid >= offset ? sums[tid - offset] : 0;
+        __syncthreads();
+        sums[tid] += v;
+        __syncthreads();
+    }
+    const int total = sums[blockDim.x - 1];
+    int pos = sums[tid] - local;
+    for (int r = begin; r < end && pos < kMaxDecodeBoxes; ++r)
+    {
+        if (flags[r])
+        {
+            boxes[pos++] = scratch[r];
+        }
+    }
+    __syncthreads();
+
+    const int n = min(total, kMaxDecodeBoxes);
+    for (int t = tid; t < n; t += blockDim.x)
+    {
+        const DecodeBox &b = boxes[t];
+        int rk = 0;
+        for (int j = 0; j < n; ++j)
+        {
+            rk += (boxes[j].prob > b.prob) || (boxes[j].prob == b.prob && j < t);
+        }
+        rank[t] = rk;
+        order[rk] = t;
+        area[t] = __fmul_rn(__fsub_rn(b.right, b.left), __fsub_rn(b.high, b.low));
+        keep[t] = 1;
+    }
+    __syncthreads();
+
+    if (do_nms)
+    {
+        for (int r = 0; r < n; ++r)
+        {
+            const int i = order[r];
+            if (keep[i])
+            {
+                const DecodeBox bi = boxes[i];
+                for (int t = tid; t < n; t += blockDim.x)
+                {
+                    if (!keep[t] || rank[t] <= r || boxes[t].id != bi.id)
+                    {
+                        continue;
+                    }
+                    const float w = fmaxf(0.f, __fsub_rn(fminf(bi.right, boxes[t].right), fmaxf(bi.left, boxes[t].left)));
+                    const float h = fmaxf(0.f, __fsub_rn(fminf(bi.high, boxes[t].high), fmaxf(bi.low, boxes[t].low)));
+                    const float inter = __fmul_rn(w, h);
+                    if (__fdiv_rn(inter, __fsub_rn(__fadd_rn(area[i], area[t]), inter)) > params.nms_thresh)
+                    {
+                        keep[t] = 0;
+                    }
+                }
+            }
+            __syncthreads();
+        }
+    }
+
+    if (tid == 0)
+    {
+        int count = 0;
+        for (int t = 0; t < n; ++t)
+        {
+            if (keep[t])
+            {
+                out->boxes[count++] = boxes[t];
+            }
+        }
+        out->count = count;
+        out->candidates = total;
+    }
+}
+
+
+DeviceBoxDecoder::DeviceBoxDecoder(const DecodeParams &params, const std::vector<DecodeRowInfo> &row_info, const bool &device_nms):
+    params_(params),
+    device_nms_(device_nms),
+    truncated_(false),
+    tracer_(nullptr),
+    row_info_(nullptr),
+    flags_(nullptr),
+    scratch_(nullptr),
+    output_(nullptr),
+    host_output_(nullptr),
+    valid_(kMaxDecodeBoxes)
+{
+    params_.rows = row_info.size();
+    cudaMalloc((void**)&row_info_, row_info.size() * sizeof(DecodeRowInfo));
+    cudaMalloc((void**)&flags_, row_info.size() * sizeof(int));
+    cudaMalloc((void**)&scratch_, row_info.size() * sizeof(DecodeBox));
+    cudaMalloc((void**)&output_, sizeof(DecodeOutput));
+    cudaMallocHost((void**)&host_output_, sizeof(DecodeOutput));
+    cudaMemcpy(row_info_, row_info.data(), row_info.size() * sizeof(DecodeRowInfo), cudaMemcpyHostToDevice);
+}
+
+
+DeviceBoxDecoder::~DeviceBoxDecoder()
+{
+    cudaFree(row_info_);
+    cudaFree(flags_);
+    cudaFree(scratch_);
+    cudaFree(output_);
+    cudaFreeHost(host_output_);
+}
+
+
+int DeviceBoxDecoder::Decode(const float *fea_out, std::vector<DecodeBox> &boxes, cudaStream_t stream)
+{
+    boxes.clear();
+    truncated_ = false;
+    if(nullptr == fea_out || nullptr == output_ || params_.rows <= 0)
+    {
+        return -1;
+    }
+    const int blocks = (params_.rows + kDecodeThreads - 1) / kDecodeThreads;
+    DecodeRowsKernel<<<blocks, kDecodeThreads, 0, stream>>>(fea_out, row_info_, params_, flags_, scratch_);
+    CompactNmsKernel<<<1, kCompactThreads, 0, stream>>>(flags_, scratch_, params_, device_nms_ ? 1 : 0, output_);
+    if(tracer_)
+    {
+        tracer_->Mark(TRACE_DECODE, stream);
+    }
+    /// @brief Header first would cost a second sync, the whole compact buffer is only a few KB.
+    cudaMemcpyAsync(host_output_, output_, sizeof(DecodeOutput), cudaMemcpyDeviceToHost, stream);
+    if(tracer_)
+    {
+        tracer_->Mark(TRACE_D2H, stream);
+    }
+    cudaError_t err = cudaStreamSynchronize(stream);
+    if(err != cudaSuccess)
+    {
+        printf("device decode failed: %s\n", cudaGetErrorString(err));
+        return -1;
+    }
+    truncated_ = host_output_->candidates > kMaxDecodeBoxes;
+    const int n = host_output_->count;
+    if(0 == n)
+    {
+        return -999;
+    }
+    if(device_nms_)
+    {
+        boxes.assign(host_output_->boxes, host_output_->boxes + n);
+        return 0;
+    }
+    for(int i=0;i<n;++i)
+    {
+        valid_[i] = 1;
+    }
+    nms_.Run(host_output_->boxes, n, params_.nms_thresh, valid_.data());
+    for(int i=0;i<n;++i)
+    {
+        if(valid_[i])
+        {
+            boxes.push_back(host_output_->boxes[i]);
+        }
+    }
+    return 0;
+}
+
+
+bool DeviceBoxDecoder::Truncated() const
+{
+    return truncated_;
+}
+
+
+void DeviceBoxDecoder::SetTracer(DeviceTracer *tracer)
+{
+    tracer_ = tracer;
+}
+
+}
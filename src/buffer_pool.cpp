@@ -0,0 +1,174 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     buffer_pool.cpp
+*   Brief:    device/pinned host buffer pool src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/buffer_pool.h"
+
+#include <string.h>
+#include <cuda_runtime_api.h>
+
+namespace siran
+{
+
+static void* CudaAlloc(const size_t &bytes, const int &kind)
+{
+    void *ptr = nullptr;
+    cudaError_t err = (kind == MEM_PINNED) ? cudaMallocHost(&ptr, bytes) : cudaMalloc(&ptr, bytes);
+    if(err != cudaSuccess)
+    {
+        return nullptr;
+    }
+    return ptr;
+}
+
+static void CudaFree(void *ptr, const int &kind)
+{
+    if(kind == MEM_PINNED)
+    {
+        cudaFreeHost(ptr);
+    }
+    else
+    {
+        cudaFree(ptr);
+    }
+}
+
+
+size_t BufferPoolBucket(const size_t &bytes)
+{
+    const size_t min_bucket = 256;
+    if(bytes <= min_bucket)
+    {
+        return min_bucket;
+    }
+    /// @brief bytes in (2^s, 2^(s+1)] rounds up to a multiple of 2^s / 4.
+    size_t top = min_bucket;
+    while(top * 2 < bytes)
+    {
+        top *= 2;
+    }
+    const size_t step = top / 4;
+    return (bytes + step - 1) / step * step;
+}
+
+
+BufferPool::BufferPool(PoolAllocFunc alloc_func, PoolFreeFunc free_func, const size_t &max_cached_bytes):
+    alloc_func_(alloc_func ? alloc_func : CudaAlloc),
+    free_func_(free_func ? free_func : CudaFree),
+    max_cached_bytes_(max_cached_bytes)
+{
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+
+BufferPool::~BufferPool()
+{
+    Trim();
+    for(auto it = in_use_.begin(); it != in_use_.end(); ++it)
+    {
+        free_func_(it->first, it->second.first);
+    }
+    in_use_.clear();
+}
+
+
+/**
+ * @brief BufferPool::Acquire -- Get a buffer, hit if a released buffer with same kind and bucket exists.
+ * @param request_bytes       -- buffer size in bytes, rounded up to its bucket
+ * @param kind                -- MEM_DEVICE or MEM_PINNED
+ * @return                    -- buffer pointer, nullptr if the allocator failed
+ */
+void* BufferPool::Acquire(const size_t &request_bytes, const int &kind)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const size_t bytes = BufferPoolBucket(request_bytes);
+    const PoolKey key(kind, bytes);
+    void *ptr = nullptr;
+    auto it = free_list_.find(key);
+    if(it != free_list_.end())
+    {
+        ptr = it->second;
+        free_list_.erase(it);
+        stats_.hits++;
+        stats_.bytes_cached -= bytes;
+    }
+    else
+    {
+        stats_.misses++;
+        ptr = alloc_func_(bytes, kind);
+        if(nullptr == ptr)
+        {
+            return nullptr;
+        }
+        stats_.allocations++;
+    }
+    in_use_[ptr] = key;
+    stats_.bytes_in_use += bytes;
+    return ptr;
+}
+
+
+void BufferPool::Release(void *ptr)
+{
+    if(nullptr == ptr)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = in_use_.find(ptr);
+    if(it == in_use_.end())
+    {
+        return;
+    }
+    stats_.bytes_in_use -= it->second.second;
+    stats_.bytes_cached += it->second.second;
+    free_list_.insert(std::make_pair(it->second, ptr));
+    in_use_.erase(it);
+    Evict();
+}
+
+
+void BufferPool::Evict()
+{
+    while(stats_.bytes_cached > (int64_t)max_cached_bytes_ && !free_list_.empty())
+    {
+        auto largest = free_list_.begin();
+        for(auto it = free_list_.begin(); it != free_list_.end(); ++it)
+        {
+            if(it->first.second > largest->first.second)
+            {
+                largest = it;
+            }
+        }
+        free_func_(largest->second, largest->first.first);
+        stats_.frees++;
+        stats_.bytes_cached -= largest->first.second;
+        free_list_.erase(largest);
+    }
+}
+
+
+void BufferPool::Trim()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for(auto it = free_list_.begin(); it != free_list_.end(); ++it)
+    {
+        free_func_(it->second, it->first.first);
+        stats_.frees++;
+    }
+    free_list_.clear();
+    stats_.bytes_cached = 0;
+}
+
+
+PoolStats BufferPool::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+}
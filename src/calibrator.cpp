@@ -0,0 +1,230 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     calibrator.cpp
+*   Brief:    INT8 calibration batch stream and calibration cache src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/calibrator.h"
+#include "inc/engine_cache.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+
+namespace siran
+{
+
+const char* CalibrationAlgorithmName(const int &algorithm)
+{
+    return CALIB_MINMAX == algorithm ? "MinMaxCalibration" : "EntropyCalibration2";
+}
+
+
+CalibrationBatchStream::CalibrationBatchStream(IFrameSource *source, const CalibrationConfig &config):
+    source_(source),
+    config_(config),
+    letterbox_(config.input_w, config.input_h, config.thread_num),
+    ready_(config.prefetch > 0 ? config.prefetch : 1, false),
+    started_(false),
+    stop_(false),
+    batches_(0),
+    images_(0),
+    dropped_(0)
+{
+    if(config_.batch_size <= 0)
+    {
+        config_.batch_size = 1;
+    }
+}
+
+
+CalibrationBatchStream::~CalibrationBatchStream()
+{
+    Stop();
+}
+
+
+void CalibrationBatchStream::Start()
+{
+    if(started_.exchange(true))
+    {
+        return;
+    }
+    loader_ = std::thread(&CalibrationBatchStream::LoaderLoop, this);
+}
+
+
+void CalibrationBatchStream::LoaderLoop()
+{
+    const size_t image_floats = (size_t)3 * config_.input_h * config_.input_w;
+    std::vector<float> batch;
+    int filled = 0;
+    cv::Mat frame;
+    while(!stop_.load())
+    {
+        if(config_.max_batches > 0 && batches_.load() >= config_.max_batches)
+        {
+            break;
+        }
+        if(source_->Read(frame) != 0)
+        {
+            break;
+        }
+        if(frame.empty() || frame.type() != CV_8UC3)
+        {
+            continue;
+        }
+        if(batch.empty())
+        {
+            std::lock_guard<std::mutex> lock(free_mutex_);
+            if(!free_.empty())
+            {
+                batch.swap(free_.back());
+                free_.pop_back();
+            }
+            batch.resize(BatchFloats());
+        }
+        if(letterbox_.Run(frame.data, frame.step, frame.cols, frame.rows, batch.data() + filled * image_floats) != 0)
+        {
+            continue;
+        }
+        images_++;
+        if(++filled < config_.batch_size)
+        {
+            continue;
+        }
+        /// @brief Waits while prefetch batches are queued, this is what bounds memory.
+        if(ready_.Push(std::move(batch)) != 0)
+        {
+            break;
+        }
+        batch.clear();
+        batches_++;
+        filled = 0;
+    }
+    dropped_ += filled;
+    ready_.Close();
+}
+
+
+bool CalibrationBatchStream::Next(std::vector<float> &batch)
+{
+    Start();
+    if(!batch.empty())
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        free_.push_back(std::vector<float>());
+        free_.back().swap(batch);
+    }
+    return ready_.Pop(batch) == 0;
+}
+
+
+void CalibrationBatchStream::Stop()
+{
+    stop_ = true;
+    ready_.Close();
+    if(loader_.joinable())
+    {
+        loader_.join();
+    }
+}
+
+
+int CalibrationBatchStream::BatchSize() const
+{
+    return config_.batch_size;
+}
+
+
+size_t CalibrationBatchStream::BatchFloats() const
+{
+    return (size_t)config_.batch_size * 3 * config_.input_h * config_.input_w;
+}
+
+
+int64_t CalibrationBatchStream::Batches() const
+{
+    return batches_.load();
+}
+
+
+int64_t CalibrationBatchStream::Images() const
+{
+    return images_.load();
+}
+
+
+int64_t CalibrationBatchStream::Dropped() const
+{
+    return dropped_.load();
+}
+
+
+int ReadCalibrationCache(const std::string &path, const int &algorithm, std::string &data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open())
+    {
+        return -1;
+    }
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    const std::string content = stream.str();
+    /// @brief First line is "TRT-<version>-<algorithm>", a cache of another algorithm would
+    ///        silently calibrate the engine with the wrong scales.
+    const size_t eol = content.find('\n');
+    const std::string header = content.substr(0, eol);
+    const std::string tag = std::string("-") + CalibrationAlgorithmName(algorithm);
+    if(header.compare(0, 4, "TRT-") != 0 || header.size() < tag.size()
+       || header.compare(header.size() - tag.size(), tag.size(), tag) != 0)
+    {
+        printf("calibration cache %s is not a %s cache, recalibrate\n", path.c_str(), CalibrationAlgorithmName(algorithm));
+        return -2;
+    }
+    data = content;
+    return 0;
+}
+
+
+int WriteCalibrationCache(const std::string &path, const std::string &data)
+{
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        if(!file.good())
+        {
+            file.close();
+            unlink(tmp.c_str());
+            return -1;
+        }
+    }
+    if(rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+
+std::string CalibrationId(const std::vector<std::string> &images, const int &algorithm, const CalibrationConfig &config)
+{
+    std::ostringstream text;
+    text << CalibrationAlgorithmName(algorithm) << " " << config.input_w << "x" << config.input_h << " batch "
+         << config.batch_size << " max " << config.max_batches << "\n";
+    for(size_t i=0;i<images.size();++i)
+    {
+        text << images[i] << "\n";
+    }
+    const std::string id = text.str();
+    char hex[24];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)Fnv1a64(id.data(), id.size()));
+    return std::string(CALIB_MINMAX == algorithm ? "minmax_" : "entropy_") + hex;
+}
+
+}
@@ -0,0 +1,149 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     det_eval.cpp
+*   Brief:    detection evaluation src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/det_eval.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace siran
+{
+
+std::string YoloLabelPath(const std::string &image_file)
+{
+    std::string path = image_file;
+    const size_t images_dir = path.rfind("/images/");
+    if(images_dir != std::string::npos)
+    {
+        path.replace(images_dir, 8, "/labels/");
+    }
+    const size_t slash = path.find_last_of('/');
+    const size_t dot = path.find_last_of('.');
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        path.erase(dot);
+    }
+    return path + ".txt";
+}
+
+
+int LoadYoloLabels(const std::string &label_file, const int &img_w, const int &img_h, std::vector<Detection> &truths)
+{
+    truths.clear();
+    std::ifstream file(label_file);
+    if(!file.is_open())
+    {
+        return -1;
+    }
+    std::string line;
+    while(std::getline(file, line))
+    {
+        if(line.find_first_not_of(" \t\r") == std::string::npos)
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        int class_id = 0;
+        float cx = 0.f, cy = 0.f, w = 0.f, h = 0.f;
+        if(!(fields >> class_id >> cx >> cy >> w >> h))
+        {
+            printf("bad label line in %s: %s\n", label_file.c_str(), line.c_str());
+            return -2;
+        }
+        Detection det;
+        det.left = (cx - w * 0.5f) * img_w;
+        det.top = (cy - h * 0.5f) * img_h;
+        det.right = (cx + w * 0.5f) * img_w;
+        det.bottom = (cy + h * 0.5f) * img_h;
+        det.class_id = class_id;
+        det.prob = 1.f;
+        truths.push_back(det);
+    }
+    return 0;
+}
+
+
+float BoxIou(const Detection &a, const Detection &b)
+{
+    const float w = std::min(a.right, b.right) - std::max(a.left, b.left);
+    const float h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+    if(w <= 0.f || h <= 0.f)
+    {
+        return 0.f;
+    }
+    const float inter = w * h;
+    const float area = (a.right - a.left) * (a.bottom - a.top) + (b.right - b.left) * (b.bottom - b.top);
+    return inter / (area - inter);
+}
+
+
+void MatchDetections(const Detection *preds, const int &pred_num, const Detection *truths, const int &truth_num,
+                     const float &iou_thresh, MatchStats &stats)
+{
+    std::vector<int> order(pred_num);
+    for(int i=0;i<pred_num;++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [preds](const int &a, const int &b) {
+        return preds[a].prob > preds[b].prob;
+    });
+    std::vector<char> used(truth_num, 0);
+    int matched = 0;
+    for(int k=0;k<pred_num;++k)
+    {
+        const Detection &pred = preds[order[k]];
+        int best = -1;
+        float best_iou = iou_thresh;
+        for(int t=0;t<truth_num;++t)
+        {
+            if(used[t] || truths[t].class_id != pred.class_id)
+            {
+                continue;
+            }
+            const float iou = BoxIou(pred, truths[t]);
+            if(iou >= best_iou)
+            {
+                best = t;
+                best_iou = iou;
+            }
+        }
+        if(best < 0)
+        {
+            stats.fp++;
+            continue;
+        }
+        used[best] = 1;
+        matched++;
+        stats.tp++;
+        stats.iou_sum += best_iou;
+    }
+    stats.fn += truth_num - matched;
+}
+
+
+double Precision(const MatchStats &stats)
+{
+    return stats.tp + stats.fp > 0 ? (double)stats.tp / (stats.tp + stats.fp) : 0.;
+}
+
+
+double Recall(const MatchStats &stats)
+{
+    return stats.tp + stats.fn > 0 ? (double)stats.tp / (stats.tp + stats.fn) : 0.;
+}
+
+
+double MeanIou(const MatchStats &stats)
+{
+    return stats.tp > 0 ? stats.iou_sum / stats.tp : 0.;
+}
+
+}
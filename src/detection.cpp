@@ -0,0 +1,143 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     detection.cpp
+*   Brief:    detection arena and ObjResult adapter src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/detection.h"
+
+#include <algorithm>
+#include <export/export.h>
+
+namespace siran
+{
+
+DetectionArena::DetectionArena(const int &capacity):
+    storage_(std::max(0, capacity)),
+    count_(0),
+    truncated_(false)
+{
+}
+
+
+void DetectionArena::Reset()
+{
+    count_ = 0;
+    truncated_ = false;
+}
+
+
+bool DetectionArena::Push(const Detection &det)
+{
+    if(count_ >= (int)storage_.size())
+    {
+        truncated_ = true;
+        return false;
+    }
+    storage_[count_++] = det;
+    return true;
+}
+
+
+void DetectionArena::SetTruncated()
+{
+    truncated_ = true;
+}
+
+
+int DetectionArena::Count() const
+{
+    return count_;
+}
+
+
+int DetectionArena::Capacity() const
+{
+    return storage_.size();
+}
+
+
+bool DetectionArena::Truncated() const
+{
+    return truncated_;
+}
+
+
+DetectionSpan DetectionArena::View() const
+{
+    return DetectionSpan(storage_.data(), count_, truncated_);
+}
+
+
+static void ToObjInfo(const Detection &det, ObjInfo &info)
+{
+    info.obj_box.x = (int)det.left;
+    info.obj_box.y = (int)det.top;
+    info.obj_box.width = (int)det.right - (int)det.left;
+    info.obj_box.height = (int)det.bottom - (int)det.top;
+    info.obj_class = det.class_id;
+    info.obj_prob = det.prob;
+}
+
+
+int ToObjResult(const DetectionSpan &detections, ObjResult *pobj_result, int *source)
+{
+    if(nullptr == pobj_result)
+    {
+        return -1;
+    }
+    pobj_result->obj_num = 0;
+    const int count = detections.Count();
+    if(0 == count)
+    {
+        return -999;
+    }
+    if(count <= YOLOV7_MAX_OBJ_NUM)
+    {
+        for(int i=0;i<count;++i)
+        {
+            ToObjInfo(detections[i], pobj_result->obj_info[i]);
+            if(source != nullptr)
+            {
+                source[i] = i;
+            }
+        }
+        pobj_result->obj_num = count;
+        return 0;
+    }
+    /// @brief Top YOLOV7_MAX_OBJ_NUM by score(ties by index) in a bounded min-heap on the stack, any
+    ///        span length, no allocation, then back to detection order.
+    auto better = [&detections](int a, int b) {
+        return detections[a].prob > detections[b].prob || (detections[a].prob == detections[b].prob && a < b);
+    };
+    int idx[YOLOV7_MAX_OBJ_NUM];
+    for(int i=0;i<YOLOV7_MAX_OBJ_NUM;++i)
+    {
+        idx[i] = i;
+    }
+    std::make_heap(idx, idx + YOLOV7_MAX_OBJ_NUM, better);
+    for(int i=YOLOV7_MAX_OBJ_NUM;i<count;++i)
+    {
+        if(better(i, idx[0]))
+        {
+            std::pop_heap(idx, idx + YOLOV7_MAX_OBJ_NUM, better);
+            idx[YOLOV7_MAX_OBJ_NUM - 1] = i;
+            std::push_heap(idx, idx + YOLOV7_MAX_OBJ_NUM, better);
+        }
+    }
+    std::sort(idx, idx + YOLOV7_MAX_OBJ_NUM);
+    for(int i=0;i<YOLOV7_MAX_OBJ_NUM;++i)
+    {
+        ToObjInfo(detections[idx[i]], pobj_result->obj_info[i]);
+        if(source != nullptr)
+        {
+            source[i] = idx[i];
+        }
+    }
+    pobj_result->obj_num = YOLOV7_MAX_OBJ_NUM;
+    return 0;
+}
+
+}
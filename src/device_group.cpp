@@ -0,0 +1,349 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     device_group.cpp
+*   Brief:    multi-GPU device group src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/device_group.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cuda_runtime_api.h>
+
+namespace siran
+{
+
+/// @brief NUMA node of a PCI device from sysfs, -1 when unknown.
+static int PciNumaNode(const std::string &pci_bus_id)
+{
+    std::string id = pci_bus_id;
+    for(size_t i=0;i<id.size();++i)
+    {
+        id[i] = tolower(id[i]);
+    }
+    const std::string path = "/sys/bus/pci/devices/" + id + "/numa_node";
+    FILE *fp = fopen(path.c_str(), "r");
+    if(nullptr == fp)
+    {
+        return -1;
+    }
+    int node = -1;
+    if(fscanf(fp, "%d", &node) != 1)
+    {
+        node = -1;
+    }
+    fclose(fp);
+    return node;
+}
+
+
+static std::vector<CudaDeviceInfo> QueryCudaDevices()
+{
+    std::vector<CudaDeviceInfo> devices;
+    int count = 0;
+    if(cudaGetDeviceCount(&count) != cudaSuccess)
+    {
+        return devices;
+    }
+    for(int i=0;i<count;++i)
+    {
+        CudaDeviceInfo info;
+        info.id = i;
+        info.numa_node = -1;
+        info.sm_major = 0;
+        info.sm_minor = 0;
+        info.total_mem = 0;
+        cudaDeviceProp prop;
+        if(cudaGetDeviceProperties(&prop, i) == cudaSuccess)
+        {
+            info.name = prop.name;
+            info.sm_major = prop.major;
+            info.sm_minor = prop.minor;
+            info.total_mem = prop.totalGlobalMem;
+        }
+        char bus_id[32] = {0};
+        if(cudaDeviceGetPCIBusId(bus_id, sizeof(bus_id), i) == cudaSuccess)
+        {
+            info.pci_bus_id = bus_id;
+            info.numa_node = PciNumaNode(info.pci_bus_id);
+        }
+        devices.push_back(info);
+    }
+    return devices;
+}
+
+
+const std::vector<CudaDeviceInfo>& CudaDevices()
+{
+    static const std::vector<CudaDeviceInfo> devices = QueryCudaDevices();
+    return devices;
+}
+
+
+int CudaDeviceCount()
+{
+    return (int)CudaDevices().size();
+}
+
+
+int PinThreadToNumaNode(const int &numa_node)
+{
+    if(numa_node < 0)
+    {
+        return -1;
+    }
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+    FILE *fp = fopen(path, "r");
+    if(nullptr == fp)
+    {
+        return -1;
+    }
+    char line[1024] = {0};
+    const bool read_ok = fgets(line, sizeof(line), fp) != nullptr;
+    fclose(fp);
+    if(!read_ok)
+    {
+        return -1;
+    }
+    /// @brief cpulist is comma separated cpus and ranges, e.g. "0-15,32-47".
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    int cpu_num = 0;
+    for(char *p=line;*p;)
+    {
+        char *end = nullptr;
+        const long first = strtol(p, &end, 10);
+        if(end == p)
+        {
+            break;
+        }
+        long last = first;
+        p = end;
+        if('-' == *p)
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for(long c=first;c<=last && c<CPU_SETSIZE;++c)
+        {
+            CPU_SET(c, &cpus);
+            cpu_num++;
+        }
+        if(',' == *p)
+        {
+            p++;
+        }
+        else
+        {
+            break;
+        }
+    }
+    if(0 == cpu_num)
+    {
+        return -1;
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0 ? 0 : -1;
+}
+
+
+DeviceGroup::DeviceGroup(const int &policy, const int &queue_capacity):
+    policy_(policy),
+    queue_capacity_(queue_capacity),
+    running_(false),
+    next_(0)
+{
+}
+
+
+DeviceGroup::~DeviceGroup()
+{
+    Stop();
+}
+
+
+int DeviceGroup::AddDevice(const int &device_id, IInferBackend *backend, const int &numa_node)
+{
+    if(running_ || nullptr == backend)
+    {
+        return -1;
+    }
+    std::unique_ptr<Device> device(new Device);
+    device->device_id = device_id;
+    device->numa_node = numa_node;
+    device->backend = backend;
+    device->server.reset(new InferServer(backend, queue_capacity_));
+    device->pending.store(0);
+    if(numa_node >= 0)
+    {
+        device->server->SetThreadInit([numa_node](const int &instance) {
+            (void)instance;
+            if(PinThreadToNumaNode(numa_node) != 0)
+            {
+                printf("warning: pin to numa node %d failed\n", numa_node);
+            }
+        });
+    }
+    devices_.push_back(std::move(device));
+    return 0;
+}
+
+
+int DeviceGroup::Start()
+{
+    if(devices_.empty())
+    {
+        return -1;
+    }
+    for(size_t i=0;i<devices_.size();++i)
+    {
+        if(devices_[i]->server->Start() != 0)
+        {
+            Stop();
+            return -1;
+        }
+    }
+    running_ = true;
+    return 0;
+}
+
+
+void DeviceGroup::Stop()
+{
+    for(size_t i=0;i<devices_.size();++i)
+    {
+        devices_[i]->server->Stop();
+    }
+    running_ = false;
+}
+
+
+int64_t DeviceGroup::Outstanding(const int &device) const
+{
+    const Device &d = *devices_[device];
+    const ServerStats stats = d.server->GetStats();
+    return d.pending.load() + stats.submitted - stats.completed;
+}
+
+
+void DeviceGroup::Order(std::vector<int> &order) const
+{
+    const int num = devices_.size();
+    /// @brief Rotating start, ties go to a different device each time.
+    const int first = next_.load(std::memory_order_relaxed) % num;
+    order.resize(num);
+    for(int i=0;i<num;++i)
+    {
+        order[i] = (first + i) % num;
+    }
+    if(DISPATCH_ROUND_ROBIN == policy_)
+    {
+        return;
+    }
+    /// @brief Load per context, a device with more contexts takes proportionally more work.
+    std::vector<double> load(num);
+    for(int i=0;i<num;++i)
+    {
+        load[i] = (double)Outstanding(i) / std::max(devices_[i]->backend->NumInstances(), 1);
+    }
+    std::stable_sort(order.begin(), order.end(), [&load](const int &a, const int &b) {
+        return load[a] < load[b];
+    });
+}
+
+
+int DeviceGroup::Submit(InferTask *task)
+{
+    if(!running_ || nullptr == task)
+    {
+        return -1;
+    }
+    next_++;
+    std::vector<int> order;
+    Order(order);
+    for(size_t i=0;i<order.size();++i)
+    {
+        Device &device = *devices_[order[i]];
+        device.pending++;
+        const int iret = device.server->Submit(task);
+        device.pending--;
+        if(iret != -2)
+        {
+            return iret;
+        }
+    }
+    return -2;
+}
+
+
+int DeviceGroup::Run(InferTask *task)
+{
+    if(nullptr == task)
+    {
+        return -1;
+    }
+    /// @brief Same completion handshake as InferServer::Run.
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool finished = false;
+    std::function<void(InferTask*)> user_done = task->done;
+    task->done = [&](InferTask *t) {
+        if(user_done)
+        {
+            user_done(t);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        cond.notify_one();
+    };
+    int iret = -2;
+    while(-2 == (iret = Submit(task)))
+    {
+        /// @brief Every queue is full, back off while the devices drain.
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    if(iret == 0)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&finished] { return finished; });
+        iret = task->status;
+    }
+    task->done = user_done;
+    return iret;
+}
+
+
+int DeviceGroup::NumDevices() const
+{
+    return (int)devices_.size();
+}
+
+
+std::vector<DeviceLoad> DeviceGroup::GetLoads() const
+{
+    std::vector<DeviceLoad> loads(devices_.size());
+    for(size_t i=0;i<devices_.size();++i)
+    {
+        const Device &device = *devices_[i];
+        const ServerStats stats = device.server->GetStats();
+        loads[i].device_id = device.device_id;
+        loads[i].numa_node = device.numa_node;
+        loads[i].instances = device.backend->NumInstances();
+        loads[i].submitted = stats.submitted;
+        loads[i].completed = stats.completed;
+        loads[i].outstanding = stats.submitted - stats.completed;
+    }
+    return loads;
+}
+
+}
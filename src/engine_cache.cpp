@@ -0,0 +1,448 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     engine_cache.cpp
+*   Brief:    TRT engine build and cache manager src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/engine_cache.h"
+#include "inc/model_desc.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+namespace siran
+{
+
+static const char *kEngineExt = ".trt";
+static const char *kKeyExt = ".key";
+
+const char* EnginePrecisionName(const int &precision)
+{
+    switch(precision)
+    {
+        case PRECISION_FP32: return "fp32";
+        case PRECISION_FP16: return "fp16";
+        case PRECISION_INT8: return "int8";
+    }
+    return "unknown";
+}
+
+
+EngineProfile BatchProfile(const std::string &input_name, const int &c, const int &h, const int &w,
+                           const int &opt_batch, const int &max_batch)
+{
+    EngineProfile profile;
+    profile.input_name = input_name;
+    profile.min_dims = {1, c, h, w};
+    profile.opt_dims = {std::max(1, std::min(opt_batch, max_batch)), c, h, w};
+    profile.max_dims = {std::max(1, max_batch), c, h, w};
+    return profile;
+}
+
+
+uint64_t Fnv1a64(const void *data, const size_t &size, const uint64_t &seed)
+{
+    const unsigned char *p = (const unsigned char*)data;
+    uint64_t hash = seed;
+    for(size_t i=0;i<size;++i)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+uint64_t HashFile(const std::string &path)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if(nullptr == fp)
+    {
+        return 0;
+    }
+    std::vector<char> buf(1 << 20);
+    uint64_t hash = 14695981039346656037ULL;
+    size_t len = 0;
+    while((len = fread(buf.data(), 1, buf.size(), fp)) > 0)
+    {
+        hash = Fnv1a64(buf.data(), len, hash);
+    }
+    const bool ok = ferror(fp) == 0;
+    fclose(fp);
+    return ok ? hash : 0;
+}
+
+
+static std::string Hex64(const uint64_t &value)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%016llx", (unsigned long long)value);
+    return text;
+}
+
+
+static std::string DimsText(const std::vector<int> &dims)
+{
+    std::string text;
+    for(size_t i=0;i<dims.size();++i)
+    {
+        text += (i ? "x" : "") + std::to_string(dims[i]);
+    }
+    return text;
+}
+
+
+/// @brief File name without directory and extension.
+static std::string FileStem(const std::string &path)
+{
+    const size_t slash = path.find_last_of('/');
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+
+static bool ReadWholeFile(const std::string &path, std::string &content)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    std::ostringstream stream;
+    stream << file.rdbuf();
+    content = stream.str();
+    return true;
+}
+
+
+/// @brief Write to a temporary name and rename, readers never see a partial file.
+static bool WriteFileAtomic(const std::string &path, const std::string &content)
+{
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        if(!file.is_open())
+        {
+            return false;
+        }
+        file.write(content.data(), content.size());
+        if(!file.good())
+        {
+            file.close();
+            unlink(tmp.c_str());
+            return false;
+        }
+    }
+    if(rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+
+static bool MakeDirs(const std::string &dir)
+{
+    for(size_t pos=1;pos<=dir.size();++pos)
+    {
+        if(pos == dir.size() || '/' == dir[pos])
+        {
+            const std::string sub = dir.substr(0, pos);
+            if(mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST)
+            {
+                return false;
+            }
+        }
+    }
+    struct stat buf;
+    return stat(dir.c_str(), &buf) == 0 && S_ISDIR(buf.st_mode);
+}
+
+
+static int64_t MtimeNs(const struct stat &buf)
+{
+    return (int64_t)buf.st_mtim.tv_sec * 1000000000LL + buf.st_mtim.tv_nsec;
+}
+
+
+EngineCache::EngineCache(IEngineBuilder *builder, const EngineCacheConfig &config):
+    builder_(builder),
+    config_(config)
+{
+    platform_ = builder_->Platform();
+    memset(&stats_, 0, sizeof(stats_));
+}
+
+
+uint64_t EngineCache::ModelHash(const std::string &onnx_file)
+{
+    struct stat buf;
+    if(stat(onnx_file.c_str(), &buf) != 0)
+    {
+        return 0;
+    }
+    std::map<std::string, HashMemo>::iterator it = hash_memo_.find(onnx_file);
+    if(it != hash_memo_.end() && it->second.size == (int64_t)buf.st_size && it->second.mtime == MtimeNs(buf))
+    {
+        return it->second.hash;
+    }
+    HashMemo memo;
+    memo.size = buf.st_size;
+    memo.mtime = MtimeNs(buf);
+    memo.hash = HashFile(onnx_file);
+    if(memo.hash != 0)
+    {
+        hash_memo_[onnx_file] = memo;
+    }
+    return memo.hash;
+}
+
+
+std::string EngineCache::KeyLocked(const EngineBuildConfig &build)
+{
+    std::ostringstream key;
+    key << "model=" << Hex64(ModelHash(build.onnx_file)) << "\n"
+        << "gpu=" << platform_.gpu_name << "\n"
+        << "sm=" << platform_.sm_major << "." << platform_.sm_minor << "\n"
+        << "trt=" << platform_.trt_version << "\n"
+        << "precision=" << EnginePrecisionName(build.precision) << "\n"
+        << "max_batch=" << build.max_batch << "\n"
+        << "workspace_mb=" << build.workspace_mb << "\n";
+    for(size_t i=0;i<build.profiles.size();++i)
+    {
+        const EngineProfile &profile = build.profiles[i];
+        key << "profile=" << profile.input_name << ":" << DimsText(profile.min_dims) << "/"
+            << DimsText(profile.opt_dims) << "/" << DimsText(profile.max_dims) << "\n";
+    }
+    if(PRECISION_INT8 == build.precision)
+    {
+        key << "calibration=" << build.calibration_id << "\n";
+    }
+    return key.str();
+}
+
+
+std::string EngineCache::PathOf(const EngineBuildConfig &build, const std::string &key) const
+{
+    char tag[64];
+    snprintf(tag, sizeof(tag), "_sm%d%d_trt%d_%s_", platform_.sm_major, platform_.sm_minor,
+             platform_.trt_version, EnginePrecisionName(build.precision));
+    return config_.cache_dir + "/" + FileStem(build.onnx_file) + tag + Hex64(Fnv1a64(key.data(), key.size())) + kEngineExt;
+}
+
+
+std::string EngineCache::Key(const EngineBuildConfig &build)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return KeyLocked(build);
+}
+
+
+std::string EngineCache::EnginePath(const EngineBuildConfig &build)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return PathOf(build, KeyLocked(build));
+}
+
+
+std::string EngineCache::TimingCachePath() const
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/timing_sm%d%d_trt%d.cache", platform_.sm_major, platform_.sm_minor, platform_.trt_version);
+    return config_.cache_dir + name;
+}
+
+
+/// @brief .key file of an engine path.
+static std::string KeyFile(const std::string &engine_file)
+{
+    return engine_file.substr(0, engine_file.size() - strlen(kEngineExt)) + kKeyExt;
+}
+
+
+int EngineCache::GetEngine(const EngineBuildConfig &build, std::string &engine_file)
+{
+    /// @brief One build at a time, callers asking for the same engine wait for it and hit.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(access(build.onnx_file.c_str(), R_OK) != 0 || ModelHash(build.onnx_file) == 0)
+    {
+        printf("onnx file not readable: %s\n", build.onnx_file.c_str());
+        return -1;
+    }
+    const std::string key = KeyLocked(build);
+    const std::string path = PathOf(build, key);
+    const std::string key_file = KeyFile(path);
+
+    std::string cached_key;
+    if(ReadWholeFile(key_file, cached_key) && cached_key == key && access(path.c_str(), R_OK) == 0)
+    {
+        stats_.hits++;
+        /// @brief The .key mtime is the last use, shared by every process using the cache.
+        utimensat(AT_FDCWD, key_file.c_str(), nullptr, 0);
+        engine_file = path;
+        return 0;
+    }
+    stats_.misses++;
+    if(!MakeDirs(config_.cache_dir))
+    {
+        printf("engine cache dir not writable: %s\n", config_.cache_dir.c_str());
+        return -2;
+    }
+
+    std::string timing_cache;
+    if(config_.timing_cache)
+    {
+        ReadWholeFile(TimingCachePath(), timing_cache);
+    }
+    printf("building %s engine for %s(sm%d%d), cached as %s\n", EnginePrecisionName(build.precision),
+           platform_.gpu_name.c_str(), platform_.sm_major, platform_.sm_minor, path.c_str());
+    const auto time_start = std::chrono::steady_clock::now();
+    const std::string tmp = path + ".tmp" + std::to_string(getpid());
+    const size_t timing_size = timing_cache.size();
+    const int iret = builder_->Build(build, timing_cache, tmp);
+    if(iret != 0 || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        printf("engine build failed, code %d\n", iret);
+        unlink(tmp.c_str());
+        stats_.build_failures++;
+        return -3;
+    }
+    stats_.builds++;
+    stats_.last_build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+    printf("engine built in %.1fs, timing cache %zu -> %zu bytes\n", stats_.last_build_ms * 1e-3, timing_size, timing_cache.size());
+
+    if(config_.timing_cache && !timing_cache.empty())
+    {
+        WriteFileAtomic(TimingCachePath(), timing_cache);
+    }
+    /// @brief Yolov7Trt reads the model descriptor next to the engine.
+    std::string desc;
+    if(ReadWholeFile(ModelDescPath(build.onnx_file), desc))
+    {
+        WriteFileAtomic(ModelDescPath(path), desc);
+    }
+    /// @brief The key goes last, it marks the entry complete.
+    if(!WriteFileAtomic(key_file, key))
+    {
+        printf("warning: engine cache key not written: %s\n", key_file.c_str());
+    }
+    engine_file = path;
+    TrimLocked(path);
+    return 0;
+}
+
+
+std::vector<EngineCacheEntry> EngineCache::EntriesLocked() const
+{
+    std::vector<EngineCacheEntry> entries;
+    DIR *dir = opendir(config_.cache_dir.c_str());
+    if(nullptr == dir)
+    {
+        return entries;
+    }
+    const size_t ext_len = strlen(kKeyExt);
+    struct dirent *entry = nullptr;
+    while((entry = readdir(dir)) != nullptr)
+    {
+        const std::string name = entry->d_name;
+        if(name.size() <= ext_len || name.compare(name.size() - ext_len, ext_len, kKeyExt) != 0)
+        {
+            continue;
+        }
+        const std::string key_file = config_.cache_dir + "/" + name;
+        const std::string engine_file = key_file.substr(0, key_file.size() - ext_len) + kEngineExt;
+        struct stat key_stat, engine_stat;
+        if(stat(key_file.c_str(), &key_stat) != 0 || stat(engine_file.c_str(), &engine_stat) != 0)
+        {
+            continue;
+        }
+        EngineCacheEntry item;
+        item.engine_file = engine_file;
+        item.size = engine_stat.st_size;
+        item.last_used = MtimeNs(key_stat);
+        entries.push_back(item);
+    }
+    closedir(dir);
+    std::sort(entries.begin(), entries.end(), [](const EngineCacheEntry &a, const EngineCacheEntry &b) {
+        return a.last_used != b.last_used ? a.last_used < b.last_used : a.engine_file < b.engine_file;
+    });
+    return entries;
+}
+
+
+std::vector<EngineCacheEntry> EngineCache::Entries() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return EntriesLocked();
+}
+
+
+void EngineCache::RemoveEntry(const std::string &engine_file)
+{
+    /// @brief Key first, a half removed entry is a miss and never a stale hit.
+    unlink(KeyFile(engine_file).c_str());
+    unlink(engine_file.c_str());
+    unlink(ModelDescPath(engine_file).c_str());
+}
+
+
+int EngineCache::TrimLocked(const std::string &keep_file)
+{
+    std::vector<EngineCacheEntry> entries = EntriesLocked();
+    int64_t total = 0;
+    for(size_t i=0;i<entries.size();++i)
+    {
+        total += entries[i].size;
+    }
+    int count = entries.size();
+    int removed = 0;
+    for(size_t i=0;i<entries.size();++i)
+    {
+        const bool over_count = config_.max_entries > 0 && count > config_.max_entries;
+        const bool over_bytes = config_.max_bytes > 0 && total > config_.max_bytes;
+        if(!over_count && !over_bytes)
+        {
+            break;
+        }
+        if(entries[i].engine_file == keep_file)
+        {
+            continue;
+        }
+        printf("evict engine %s\n", entries[i].engine_file.c_str());
+        RemoveEntry(entries[i].engine_file);
+        total -= entries[i].size;
+        count--;
+        removed++;
+    }
+    stats_.evictions += removed;
+    return removed;
+}
+
+
+int EngineCache::Trim(const std::string &keep_file)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return TrimLocked(keep_file);
+}
+
+
+EngineCacheStats EngineCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+}
@@ -0,0 +1,196 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     engine_loader.cpp
+*   Brief:    TRT engine file loading src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/engine_loader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace siran
+{
+
+/// @brief Known serialized plan tags, first four bytes of the engine file.
+static const char *kEngineMagic[] = {"ftrt", "ptrt"};
+
+static double ElapsedMs(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+MmapFileSource::MmapFileSource():
+    fd_(-1),
+    data_(nullptr),
+    size_(0)
+{
+}
+
+
+MmapFileSource::~MmapFileSource()
+{
+    Close();
+}
+
+
+int MmapFileSource::Open(const std::string &path)
+{
+    Close();
+    fd_ = open(path.c_str(), O_RDONLY);
+    if(fd_ < 0)
+    {
+        return -1;
+    }
+    struct stat buf;
+    if(fstat(fd_, &buf) != 0 || buf.st_size <= 0)
+    {
+        Close();
+        return -1;
+    }
+    size_ = buf.st_size;
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if(data_ == MAP_FAILED)
+    {
+        data_ = nullptr;
+        Close();
+        return -1;
+    }
+    /// @brief Deserialize walks the plan front to back, let the kernel read ahead.
+    madvise(data_, size_, MADV_SEQUENTIAL);
+    madvise(data_, size_, MADV_WILLNEED);
+    return 0;
+}
+
+
+const void* MmapFileSource::Data() const
+{
+    return data_;
+}
+
+
+size_t MmapFileSource::Size() const
+{
+    return size_;
+}
+
+
+void MmapFileSource::Close()
+{
+    if(data_ != nullptr)
+    {
+        munmap(data_, size_);
+        data_ = nullptr;
+    }
+    if(fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+}
+
+
+MemoryFileSource::MemoryFileSource(const std::string &content):
+    content_(content),
+    opened_(false)
+{
+}
+
+
+int MemoryFileSource::Open(const std::string &path)
+{
+    /// @brief The content is the file, the path only names it.
+    (void)path;
+    opened_ = true;
+    return 0;
+}
+
+
+const void* MemoryFileSource::Data() const
+{
+    return opened_ ? content_.data() : nullptr;
+}
+
+
+size_t MemoryFileSource::Size() const
+{
+    return opened_ ? content_.size() : 0;
+}
+
+
+void MemoryFileSource::Close()
+{
+    opened_ = false;
+}
+
+
+int CheckEngineHeader(const void *data, const size_t &size, const bool &strict)
+{
+    if(nullptr == data || size < kMinEngineSize)
+    {
+        printf("engine file too small: %zu bytes\n", size);
+        return -1;
+    }
+    for(size_t i=0;i<sizeof(kEngineMagic)/sizeof(kEngineMagic[0]);++i)
+    {
+        if(memcmp(data, kEngineMagic[i], 4) == 0)
+        {
+            return 0;
+        }
+    }
+    if(strict)
+    {
+        printf("engine file has unknown header\n");
+        return -2;
+    }
+    printf("warning: engine file has unknown header, try to deserialize anyway\n");
+    return 0;
+}
+
+
+int LoadEngineFile(IEngineFileSource &source, const std::string &path,
+                   const std::function<bool(const void*, size_t)> &deserialize,
+                   EngineLoadReport *report)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+    EngineLoadReport tmp_report;
+    memset(&tmp_report, 0, sizeof(tmp_report));
+
+    if(source.Open(path) != 0)
+    {
+        printf("read file error: %s\n", path.c_str());
+        return -1;
+    }
+    tmp_report.file_size = source.Size();
+    tmp_report.open_ms = ElapsedMs(time_start);
+
+    int iret = CheckEngineHeader(source.Data(), source.Size());
+    if(iret != 0)
+    {
+        source.Close();
+        return -2;
+    }
+
+    const auto time_deserialize = std::chrono::steady_clock::now();
+    const bool ok = deserialize(source.Data(), source.Size());
+    tmp_report.deserialize_ms = ElapsedMs(time_deserialize);
+    source.Close();
+    tmp_report.total_ms = ElapsedMs(time_start);
+    if(report != nullptr)
+    {
+        *report = tmp_report;
+    }
+    return ok ? 0 : -3;
+}
+
+}
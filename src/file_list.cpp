@@ -0,0 +1,138 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     file_list.cpp
+*   Brief:    parallel directory listing src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/file_list.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace siran
+{
+
+static bool HasExtension(const char *name, const std::vector<std::string> &extensions)
+{
+    if(extensions.empty())
+    {
+        return true;
+    }
+    const char *dot = strrchr(name, '.');
+    if(nullptr == dot)
+    {
+        return false;
+    }
+    std::string ext(dot + 1);
+    for(size_t i=0;i<ext.size();++i)
+    {
+        ext[i] = tolower(ext[i]);
+    }
+    return std::find(extensions.begin(), extensions.end(), ext) != extensions.end();
+}
+
+
+int ListFiles(const std::string &root, const std::vector<std::string> &extensions, const int &thread_num,
+              std::vector<std::string> &files)
+{
+    files.clear();
+    std::string base = root;
+    while(base.size() > 1 && '/' == base[base.size() - 1])
+    {
+        base.erase(base.size() - 1);
+    }
+    struct stat buf;
+    if(stat(base.c_str(), &buf) != 0 || !S_ISDIR(buf.st_mode))
+    {
+        return -1;
+    }
+
+    /// @brief Work list of directories, a worker lists one and queues its subdirectories.
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::string> dirs(1, base);
+    int busy = 0;
+    auto worker = [&]() {
+        std::vector<std::string> found;
+        std::unique_lock<std::mutex> lock(mutex);
+        for(;;)
+        {
+            cond.wait(lock, [&]() { return !dirs.empty() || 0 == busy; });
+            if(dirs.empty())
+            {
+                break;
+            }
+            const std::string dir_path = dirs.front();
+            dirs.pop_front();
+            busy++;
+            lock.unlock();
+
+            std::vector<std::string> subdirs;
+            DIR *dir = opendir(dir_path.c_str());
+            if(dir != nullptr)
+            {
+                struct dirent *entry = nullptr;
+                while((entry = readdir(dir)) != nullptr)
+                {
+                    if(0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, ".."))
+                    {
+                        continue;
+                    }
+                    const std::string path = dir_path + "/" + entry->d_name;
+                    unsigned char type = entry->d_type;
+                    if(DT_UNKNOWN == type || DT_LNK == type)
+                    {
+                        /// @brief No type from this filesystem, or a link: stat the target, links
+                        ///        to directories are not followed so cycles cannot happen.
+                        struct stat entry_stat;
+                        if(stat(path.c_str(), &entry_stat) != 0)
+                        {
+                            continue;
+                        }
+                        type = S_ISREG(entry_stat.st_mode) ? DT_REG :
+                               (S_ISDIR(entry_stat.st_mode) && DT_UNKNOWN == type ? DT_DIR : DT_UNKNOWN);
+                    }
+                    if(DT_DIR == type)
+                    {
+                        subdirs.push_back(path);
+                    }
+                    else if(DT_REG == type && HasExtension(entry->d_name, extensions))
+                    {
+                        found.push_back(path);
+                    }
+                }
+                closedir(dir);
+            }
+
+            lock.lock();
+            busy--;
+            dirs.insert(dirs.end(), subdirs.begin(), subdirs.end());
+            cond.notify_all();
+        }
+        files.insert(files.end(), found.begin(), found.end());
+    };
+    const int num = thread_num > 0 ? thread_num : std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for(int i=1;i<num;++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(size_t i=0;i<threads.size();++i)
+    {
+        threads[i].join();
+    }
+    std::sort(files.begin(), files.end());
+    return 0;
+}
+
+}
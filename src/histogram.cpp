@@ -0,0 +1,173 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     histogram.cpp
+*   Brief:    fixed bucket histogram src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/histogram.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+namespace siran
+{
+
+Histogram::Histogram():
+    counts_(1, 0),
+    count_(0),
+    sum_(0.),
+    max_(0.)
+{
+}
+
+
+Histogram::Histogram(const std::vector<double> &bounds):
+    bounds_(bounds),
+    counts_(bounds.size() + 1, 0),
+    count_(0),
+    sum_(0.),
+    max_(0.)
+{
+}
+
+
+std::vector<double> Histogram::ExponentialBounds(const double &first, const double &factor, const double &last)
+{
+    std::vector<double> bounds;
+    for(double b=first;b<last && factor > 1.;b*=factor)
+    {
+        bounds.push_back(b);
+    }
+    bounds.push_back(last);
+    return bounds;
+}
+
+
+std::vector<double> Histogram::LinearBounds(const double &first, const double &step, const int &num)
+{
+    std::vector<double> bounds(num);
+    for(int i=0;i<num;++i)
+    {
+        bounds[i] = first + step * i;
+    }
+    return bounds;
+}
+
+
+void Histogram::Add(const double &value)
+{
+    const size_t bucket = std::lower_bound(bounds_.begin(), bounds_.end(), value) - bounds_.begin();
+    counts_[bucket]++;
+    max_ = (count_ == 0) ? value : std::max(max_, value);
+    count_++;
+    sum_ += value;
+}
+
+
+int Histogram::Merge(const std::vector<int64_t> &counts, const double &sum, const double &max)
+{
+    if(counts.size() != counts_.size())
+    {
+        return -1;
+    }
+    int64_t count = 0;
+    for(size_t i=0;i<counts.size();++i)
+    {
+        counts_[i] += counts[i];
+        count += counts[i];
+    }
+    if(count > 0)
+    {
+        max_ = (count_ == 0) ? max : std::max(max_, max);
+        count_ += count;
+        sum_ += sum;
+    }
+    return 0;
+}
+
+
+void Histogram::Reset()
+{
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = 0;
+    sum_ = 0.;
+    max_ = 0.;
+}
+
+
+int64_t Histogram::Count() const
+{
+    return count_;
+}
+
+
+double Histogram::Mean() const
+{
+    return count_ > 0 ? sum_ / count_ : 0.;
+}
+
+
+double Histogram::Max() const
+{
+    return max_;
+}
+
+
+double Histogram::Percentile(const double &q) const
+{
+    if(count_ == 0)
+    {
+        return 0.;
+    }
+    const double rank = q * count_;
+    int64_t seen = 0;
+    for(size_t i=0;i<counts_.size();++i)
+    {
+        seen += counts_[i];
+        if(seen >= rank && counts_[i] > 0)
+        {
+            return i < bounds_.size() ? std::min(bounds_[i], max_) : max_;
+        }
+    }
+    return max_;
+}
+
+
+const std::vector<double>& Histogram::Bounds() const
+{
+    return bounds_;
+}
+
+
+const std::vector<int64_t>& Histogram::Counts() const
+{
+    return counts_;
+}
+
+
+std::string Histogram::ToString() const
+{
+    std::string text;
+    char line[96];
+    for(size_t i=0;i<counts_.size();++i)
+    {
+        if(counts_[i] == 0)
+        {
+            continue;
+        }
+        if(i < bounds_.size())
+        {
+            snprintf(line, sizeof(line), "  <= %10.3f: %lld\n", bounds_[i], (long long)counts_[i]);
+        }
+        else
+        {
+            snprintf(line, sizeof(line), "   > %10.3f: %lld\n", bounds_.empty() ? 0. : bounds_.back(), (long long)counts_[i]);
+        }
+        text += line;
+    }
+    return text;
+}
+
+}
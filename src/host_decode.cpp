@@ -0,0 +1,246 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     host_decode.cpp
+*   Brief:    host decode src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/host_decode.h"
+#include "inc/yolov7_simd.hpp"
+
+namespace siran
+{
+
+std::vector<DecodeBlock> BuildDecodeBlocks(const ModelDesc &desc)
+{
+    std::vector<DecodeBlock> blocks;
+    int row = 0;
+    for (size_t i = 0; i < desc.strides.size(); ++i)
+    {
+        const int feat_h = desc.input_h / desc.strides[i];
+        const int feat_w = desc.input_w / desc.strides[i];
+        for (int ac_i = 0; ac_i < desc.num_anchors; ++ac_i)
+        {
+            DecodeBlock block;
+            block.row_begin = row;
+            block.row_end = row + feat_h * feat_w;
+            block.feat_w = feat_w;
+            block.feat_wf = feat_w;
+            block.feat_hf = feat_h;
+            block.anchor_w = desc.anchors[(i * desc.num_anchors + ac_i) * 2];
+            block.anchor_h = desc.anchors[(i * desc.num_anchors + ac_i) * 2 + 1];
+            blocks.push_back(block);
+            row = block.row_end;
+        }
+    }
+    return blocks;
+}
+
+
+/// @brief Per isa filter/argmax, static members so the row loop below inlines them.
+struct ScalarKernel
+{
+    static inline int Filter(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+    {
+        return FilterObjScalar(fea_out, rows, row_len, thresh, idx);
+    }
+    static inline float Argmax(const float *cls, const int &class_num, int &max_index)
+    {
+        return ArgmaxScalar(cls, class_num, max_index);
+    }
+};
+
+#if defined(YOLOV7_SIMD_X86)
+struct Avx2Kernel
+{
+    __attribute__((target("avx2")))
+    static inline int Filter(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+    {
+        return FilterObjAvx2(fea_out, rows, row_len, thresh, idx);
+    }
+    __attribute__((target("avx2")))
+    static inline float Argmax(const float *cls, const int &class_num, int &max_index)
+    {
+        return ArgmaxAvx2(cls, class_num, max_index);
+    }
+};
+
+struct Sse4Kernel
+{
+    __attribute__((target("sse4.1")))
+    static inline int Filter(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+    {
+        return FilterObjSse4(fea_out, rows, row_len, thresh, idx);
+    }
+    __attribute__((target("sse4.1")))
+    static inline float Argmax(const float *cls, const int &class_num, int &max_index)
+    {
+        return ArgmaxSse4(cls, class_num, max_index);
+    }
+};
+#elif defined(YOLOV7_SIMD_NEON)
+struct NeonKernel
+{
+    static inline int Filter(const float *fea_out, const int &rows, const int &row_len, const float &thresh, int *idx)
+    {
+        return FilterObjNeon(fea_out, rows, row_len, thresh, idx);
+    }
+    static inline float Argmax(const float *cls, const int &class_num, int &max_index)
+    {
+        return ArgmaxNeon(cls, class_num, max_index);
+    }
+};
+#endif
+
+typedef struct DecodeArgs_
+{
+    const float *fea_out;
+    float thresh;
+    int class_num;
+    int input_w;
+    int input_h;
+    int rows;
+    const DecodeBlock *blocks;
+    int *cand_idx;
+    DecodeBox *boxes;
+    int max_num;
+    bool truncated;
+}DecodeArgs;
+
+/**
+ * @brief DecodeRows -- Objectness filter over all rows, then argmax, conf test and box of the
+ *        survivors. Survivors are ascending, so the block and grid cell follow from a running
+ *        block cursor instead of a per row table. Inlined into the per isa entry points below.
+ */
+template <typename Kernel>
+__attribute__((always_inline))
+inline int DecodeRows(DecodeArgs &args)
+{
+    const int class_num = args.class_num;
+    const int row_len = class_num + 5;
+    const int cand_num = Kernel::Filter(args.fea_out, args.rows, row_len, args.thresh, args.cand_idx);
+    const DecodeBlock *block = args.blocks;
+    int n = 0;
+    for (int k = 0; k < cand_num; ++k)
+    {
+        const int row = args.cand_idx[k];
+        const float *feat = args.fea_out + (size_t)row * row_len;
+        const float obj_conf = feat[4];
+        int max_index = 0;
+        const float max_conf = Kernel::Argmax(feat + 5, class_num, max_index);
+        const float conf = max_conf * obj_conf;
+        if (!(conf > args.thresh))
+        {
+            continue;
+        }
+        if (n >= args.max_num)
+        {
+            args.truncated = true;
+            break;
+        }
+        while (row >= block->row_end)
+        {
+            ++block;
+        }
+        const int cell = row - block->row_begin;
+        const int gy = cell / block->feat_w;
+        const int gx = cell - gy * block->feat_w;
+        DecodeBox &box = args.boxes[n++];
+        DecodeGeometry(feat, (float)gx, (float)gy, block->feat_wf, block->feat_hf, block->anchor_w, block->anchor_h,
+                       args.input_w, args.input_h, box);
+        box.prob = conf;
+        box.id = max_index;
+        box.row = row;
+    }
+    return n;
+}
+
+static int DecodeScalar(DecodeArgs &args)
+{
+    return DecodeRows<ScalarKernel>(args);
+}
+
+#if defined(YOLOV7_SIMD_X86)
+__attribute__((target("avx2")))
+static int DecodeAvx2(DecodeArgs &args)
+{
+    return DecodeRows<Avx2Kernel>(args);
+}
+
+__attribute__((target("sse4.1")))
+static int DecodeSse4(DecodeArgs &args)
+{
+    return DecodeRows<Sse4Kernel>(args);
+}
+#elif defined(YOLOV7_SIMD_NEON)
+static int DecodeNeon(DecodeArgs &args)
+{
+    return DecodeRows<NeonKernel>(args);
+}
+#endif
+
+
+HostDecoder::HostDecoder(const ModelDesc &desc):
+    class_num_(desc.num_classes),
+    input_w_(desc.input_w),
+    input_h_(desc.input_h),
+    rows_(0),
+    isa_(DetectDecodeIsa()),
+    blocks_(BuildDecodeBlocks(desc))
+{
+    if (!blocks_.empty())
+    {
+        rows_ = blocks_.back().row_end;
+    }
+    cand_idx_.resize(rows_);
+}
+
+
+void HostDecoder::SetIsa(const int &isa)
+{
+    isa_ = isa;
+}
+
+
+int HostDecoder::Decode(const float *fea_out, const float &thresh, DecodeBox *boxes, const int &max_num, bool &truncated)
+{
+    truncated = false;
+    if (nullptr == fea_out || nullptr == boxes || rows_ <= 0)
+    {
+        return 0;
+    }
+    DecodeArgs args;
+    args.fea_out = fea_out;
+    args.thresh = thresh;
+    args.class_num = class_num_;
+    args.input_w = input_w_;
+    args.input_h = input_h_;
+    args.rows = rows_;
+    args.blocks = blocks_.data();
+    args.cand_idx = cand_idx_.data();
+    args.boxes = boxes;
+    args.max_num = max_num;
+    args.truncated = false;
+    int n = 0;
+    switch (isa_)
+    {
+#if defined(YOLOV7_SIMD_X86)
+    case DECODE_AVX2: n = DecodeAvx2(args); break;
+    case DECODE_SSE4: n = DecodeSse4(args); break;
+#elif defined(YOLOV7_SIMD_NEON)
+    case DECODE_NEON: n = DecodeNeon(args); break;
+#endif
+    default: n = DecodeScalar(args); break;
+    }
+    truncated = args.truncated;
+    return n;
+}
+
+
+IHostDecoder* CreateHostDecoder(const ModelDesc &desc)
+{
+    return new HostDecoder(desc);
+}
+
+}
@@ -0,0 +1,316 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     infer_server.cpp
+*   Brief:    multi-instance inference server src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/infer_server.h"
+
+#include <chrono>
+
+namespace siran
+{
+
+/// @brief Empty polls before a worker parks.
+static const int kWorkerSpin = 64;
+
+
+InferServer::InferServer(IInferBackend *backend, const int &queue_capacity):
+    backend_(backend),
+    queue_(queue_capacity > 0 ? queue_capacity : 1),
+    running_(false),
+    sleepers_(0),
+    submitted_(0),
+    completed_(0),
+    rejected_(0),
+    max_queue_depth_(0)
+{
+}
+
+
+InferServer::~InferServer()
+{
+    Stop();
+}
+
+
+void InferServer::SetThreadInit(const std::function<void(const int &instance)> &init)
+{
+    if(!running_.load())
+    {
+        thread_init_ = init;
+    }
+}
+
+
+int InferServer::Start()
+{
+    if(nullptr == backend_ || backend_->NumInstances() <= 0)
+    {
+        return -1;
+    }
+    if(running_.exchange(true))
+    {
+        return 0;
+    }
+    for(int i=0;i<backend_->NumInstances();++i)
+    {
+        workers_.emplace_back(&InferServer::WorkerLoop, this, i);
+    }
+    return 0;
+}
+
+
+void InferServer::Stop()
+{
+    if(!running_.exchange(false))
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cond_.notify_all();
+    }
+    for(size_t i=0;i<workers_.size();++i)
+    {
+        workers_[i].join();
+    }
+    workers_.clear();
+}
+
+
+void InferServer::WakeWorker()
+{
+    if(sleepers_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_cond_.notify_one();
+    }
+}
+
+
+bool InferServer::Enqueue(InferTask *task)
+{
+    if(!queue_.TryPush(task))
+    {
+        return false;
+    }
+    submitted_++;
+    const int depth = (int)queue_.Size();
+    int max_depth = max_queue_depth_.load(std::memory_order_relaxed);
+    while(depth > max_depth && !max_queue_depth_.compare_exchange_weak(max_depth, depth))
+    {
+    }
+    WakeWorker();
+    return true;
+}
+
+
+int InferServer::Submit(InferTask *task)
+{
+    if(nullptr == task || !running_.load())
+    {
+        return -1;
+    }
+    if(!Enqueue(task))
+    {
+        rejected_++;
+        return -2;
+    }
+    return 0;
+}
+
+
+int InferServer::SubmitWait(InferTask *task, const int &timeout_ms)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    int spin = 0;
+    for(;;)
+    {
+        if(nullptr == task || !running_.load())
+        {
+            return -1;
+        }
+        if(Enqueue(task))
+        {
+            return 0;
+        }
+        if(timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline)
+        {
+            rejected_++;
+            return -2;
+        }
+        /// @brief Queue full, back off while the workers drain it.
+        if(++spin < kWorkerSpin)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+
+int InferServer::Run(InferTask *task)
+{
+    if(nullptr == task)
+    {
+        return -1;
+    }
+    /// @brief Notify under the lock, the waiter can only return once the worker let go of it.
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool finished = false;
+    std::function<void(InferTask*)> user_done = task->done;
+    task->done = [&](InferTask *t) {
+        if(user_done)
+        {
+            user_done(t);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        cond.notify_one();
+    };
+    int iret = SubmitWait(task);
+    if(iret == 0)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&finished] { return finished; });
+        iret = task->status;
+    }
+    task->done = user_done;
+    return iret;
+}
+
+
+void InferServer::WorkerLoop(const int &instance)
+{
+    if(thread_init_)
+    {
+        thread_init_(instance);
+    }
+    int spin = 0;
+    for(;;)
+    {
+        InferTask *task = nullptr;
+        if(queue_.TryPop(task))
+        {
+            spin = 0;
+            task->status = backend_->Run(instance, task);
+            completed_++;
+            /// @brief Call a copy, the owner may reset task->done as soon as it is signalled.
+            const std::function<void(InferTask*)> done = task->done;
+            if(done)
+            {
+                done(task);
+            }
+            continue;
+        }
+        if(!running_.load())
+        {
+            break;
+        }
+        if(++spin < kWorkerSpin)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        /// @brief Park, recheck under the lock so a push racing with sleepers_++ is not missed,
+        ///        the timeout bounds the wait if it still is.
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        sleepers_++;
+        if(queue_.Size() == 0 && running_.load())
+        {
+            idle_cond_.wait_for(lock, std::chrono::milliseconds(1));
+        }
+        sleepers_--;
+        spin = 0;
+    }
+}
+
+
+int InferServer::QueueDepth() const
+{
+    return (int)queue_.Size();
+}
+
+
+ServerStats InferServer::GetStats() const
+{
+    ServerStats stats;
+    stats.submitted = submitted_.load();
+    stats.completed = completed_.load();
+    stats.rejected = rejected_.load();
+    stats.queue_depth = QueueDepth();
+    stats.max_queue_depth = max_queue_depth_.load();
+    return stats;
+}
+
+
+MockInferBackend::MockInferBackend(const int &instance_num, const int &cost_us):
+    cost_us_(cost_us),
+    runs_(instance_num),
+    busy_(instance_num),
+    overlaps_(0),
+    running_(0),
+    max_concurrent_(0)
+{
+}
+
+
+int MockInferBackend::NumInstances() const
+{
+    return (int)runs_.size();
+}
+
+
+int MockInferBackend::Run(const int &instance, InferTask *task)
+{
+    if(instance < 0 || instance >= (int)runs_.size() || nullptr == task)
+    {
+        return -1;
+    }
+    if(busy_[instance].exchange(1) != 0)
+    {
+        overlaps_++;
+    }
+    const int running = ++running_;
+    int max_running = max_concurrent_.load();
+    while(running > max_running && !max_concurrent_.compare_exchange_weak(max_running, running))
+    {
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(cost_us_));
+    runs_[instance]++;
+    running_--;
+    busy_[instance].store(0);
+    return 0;
+}
+
+
+std::vector<int64_t> MockInferBackend::InstanceRuns() const
+{
+    std::vector<int64_t> runs(runs_.size());
+    for(size_t i=0;i<runs_.size();++i)
+    {
+        runs[i] = runs_[i].load();
+    }
+    return runs;
+}
+
+
+int64_t MockInferBackend::Overlaps() const
+{
+    return overlaps_.load();
+}
+
+
+int MockInferBackend::MaxConcurrent() const
+{
+    return max_concurrent_.load();
+}
+
+}
@@ -0,0 +1,390 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     ingest.cpp
+*   Brief:    batch image ingest src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/ingest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace siran
+{
+
+int ReadJpegSize(const std::string &path, int &width, int &height)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if(nullptr == fp)
+    {
+        return -1;
+    }
+    int iret = -1;
+    unsigned char head[2];
+    if(fread(head, 1, 2, fp) == 2 && 0xFF == head[0] && 0xD8 == head[1])
+    {
+        /// @brief Walk the segments to the first SOFn, the frame header holds the size.
+        for(;;)
+        {
+            int c = fgetc(fp);
+            while(c != EOF && c != 0xFF)
+            {
+                c = fgetc(fp);
+            }
+            while(0xFF == c)
+            {
+                c = fgetc(fp);
+            }
+            if(EOF == c || 0xD9 == c || 0xDA == c)
+            {
+                break;
+            }
+            const int marker = c;
+            if(0x01 == marker || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                continue;
+            }
+            unsigned char len_bytes[2];
+            if(fread(len_bytes, 1, 2, fp) != 2)
+            {
+                break;
+            }
+            const int len = (len_bytes[0] << 8) | len_bytes[1];
+            if(len < 2)
+            {
+                break;
+            }
+            const bool sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+            if(sof)
+            {
+                unsigned char frame[5];
+                if(len >= 7 && fread(frame, 1, 5, fp) == 5)
+                {
+                    height = (frame[1] << 8) | frame[2];
+                    width = (frame[3] << 8) | frame[4];
+                    iret = width > 0 && height > 0 ? 0 : -1;
+                }
+                break;
+            }
+            if(fseek(fp, len - 2, SEEK_CUR) != 0)
+            {
+                break;
+            }
+        }
+    }
+    fclose(fp);
+    return iret;
+}
+
+
+int ReducedScale(const int &width, const int &height, const int &target_w, const int &target_h)
+{
+    if(target_w <= 0 || target_h <= 0 || width <= 0 || height <= 0)
+    {
+        return 1;
+    }
+    /// @brief Letterbox scales by min(target_w / w, target_h / h), a reduction up to its inverse
+    ///        drops only pixels the letterbox would drop anyway.
+    const double limit = std::max((double)width / target_w, (double)height / target_h);
+    int reduce = 1;
+    while(reduce < 8 && reduce * 2 <= limit)
+    {
+        reduce *= 2;
+    }
+    return reduce;
+}
+
+
+ImageIngest::ImageIngest(const std::vector<std::string> &files, const IngestConfig &config):
+    files_(files),
+    config_(config),
+    next_decode_(0),
+    next_deliver_(0),
+    decoding_(0),
+    started_(false),
+    stop_(false)
+{
+    memset(&stats_, 0, sizeof(stats_));
+    stats_.files = files_.size();
+    if(config_.prefetch <= 0)
+    {
+        config_.prefetch = 1;
+    }
+    if(config_.decode_threads <= 0)
+    {
+        config_.decode_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+}
+
+
+ImageIngest::~ImageIngest()
+{
+    Stop();
+}
+
+
+void ImageIngest::Start()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(started_)
+    {
+        return;
+    }
+    started_ = true;
+    for(int i=0;i<config_.decode_threads;++i)
+    {
+        decoders_.emplace_back(&ImageIngest::DecodeLoop, this);
+    }
+}
+
+
+void ImageIngest::Decode(IngestItem &item)
+{
+    item.status = -1;
+    item.src_w = 0;
+    item.src_h = 0;
+    item.reduce = 1;
+    int width = 0, height = 0;
+    if(ReadJpegSize(item.path, width, height) == 0)
+    {
+        item.reduce = ReducedScale(width, height, config_.target_w, config_.target_h);
+    }
+    static const int kReducedFlags[] = {cv::IMREAD_COLOR, cv::IMREAD_REDUCED_COLOR_2, cv::IMREAD_REDUCED_COLOR_4, cv::IMREAD_REDUCED_COLOR_8};
+    const int flag = kReducedFlags[item.reduce == 8 ? 3 : item.reduce / 2];
+    item.image = cv::imread(item.path, flag);
+    if(item.image.empty())
+    {
+        return;
+    }
+    item.status = 0;
+    item.src_w = item.image.cols;
+    item.src_h = item.image.rows;
+    if(item.reduce > 1)
+    {
+        /// @brief The header size is before EXIF orientation, imread rotates.
+        const bool rotated = abs(item.image.cols - width / item.reduce) > abs(item.image.cols - height / item.reduce);
+        item.src_w = rotated ? height : width;
+        item.src_h = rotated ? width : height;
+    }
+}
+
+
+void ImageIngest::DecodeLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;)
+    {
+        /// @brief Files are started in order, so the one the consumer waits for is always either
+        ///        decoding or next, the window cannot block it.
+        decode_cond_.wait(lock, [this]() {
+            return stop_ || next_decode_ >= (int64_t)files_.size() || (int)ready_.size() + decoding_ < config_.prefetch;
+        });
+        if(stop_ || next_decode_ >= (int64_t)files_.size())
+        {
+            break;
+        }
+        IngestItem item;
+        item.index = next_decode_++;
+        item.path = files_[item.index];
+        decoding_++;
+        lock.unlock();
+
+        const auto time_start = std::chrono::steady_clock::now();
+        Decode(item);
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+
+        lock.lock();
+        decoding_--;
+        stats_.decode_ms += ms;
+        stats_.decoded += 0 == item.status ? 1 : 0;
+        stats_.failed += 0 == item.status ? 0 : 1;
+        stats_.reduced += 0 == item.status && item.reduce > 1 ? 1 : 0;
+        ready_[item.index] = std::move(item);
+        ready_cond_.notify_all();
+    }
+}
+
+
+bool ImageIngest::Next(IngestItem &item)
+{
+    Start();
+    const auto time_start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_cond_.wait(lock, [this]() {
+        if(stop_ || next_deliver_ >= (int64_t)files_.size())
+        {
+            return true;
+        }
+        return config_.keep_order ? ready_.count(next_deliver_) > 0 : !ready_.empty();
+    });
+    stats_.wait_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+    if(stop_ || next_deliver_ >= (int64_t)files_.size())
+    {
+        return false;
+    }
+    std::map<int64_t, IngestItem>::iterator it = config_.keep_order ? ready_.find(next_deliver_) : ready_.begin();
+    item = std::move(it->second);
+    ready_.erase(it);
+    next_deliver_++;
+    decode_cond_.notify_all();
+    return true;
+}
+
+
+void ImageIngest::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        decode_cond_.notify_all();
+        ready_cond_.notify_all();
+    }
+    for(size_t i=0;i<decoders_.size();++i)
+    {
+        decoders_[i].join();
+    }
+    decoders_.clear();
+}
+
+
+IngestStats ImageIngest::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+
+TextResultSink::TextResultSink(const std::string &path):
+    fp_(stdout),
+    owned_(false)
+{
+    if(!path.empty())
+    {
+        fp_ = fopen(path.c_str(), "w");
+        owned_ = true;
+    }
+}
+
+
+TextResultSink::~TextResultSink()
+{
+    if(owned_ && fp_ != nullptr)
+    {
+        fclose(fp_);
+    }
+}
+
+
+bool TextResultSink::IsOpened() const
+{
+    return fp_ != nullptr;
+}
+
+
+int TextResultSink::Write(const IngestItem &item, const int &status, const DetectionSpan &detections)
+{
+    if(nullptr == fp_)
+    {
+        return -1;
+    }
+    if(0 != status || detections.Empty())
+    {
+        fprintf(fp_, "%s %s\n", item.path.c_str(), 0 == status || -999 == status ? "-" : "error");
+        return 0;
+    }
+    for(int i=0;i<detections.Count();++i)
+    {
+        const Detection &det = detections[i];
+        fprintf(fp_, "%s %d %.4f %.1f %.1f %.1f %.1f\n", item.path.c_str(), det.class_id, det.prob,
+                det.left, det.top, det.right, det.bottom);
+    }
+    return 0;
+}
+
+
+int TextResultSink::Flush()
+{
+    return nullptr == fp_ || fflush(fp_) != 0 ? -1 : 0;
+}
+
+
+int RunIngest(ImageIngest &ingest, const std::vector<IStreamDetector*> &detectors, IResultSink *sink,
+              int64_t *detect_failed)
+{
+    if(detect_failed != nullptr)
+    {
+        *detect_failed = 0;
+    }
+    if(detectors.empty())
+    {
+        return -1;
+    }
+    std::mutex sink_mutex;
+    int sink_status = 0;
+    std::atomic<int64_t> failed(0);
+    auto worker = [&](IStreamDetector *detector) {
+        IngestItem item;
+        std::vector<Detection> scaled;
+        while(ingest.Next(item))
+        {
+            DetectionSpan detections;
+            int status = item.status;
+            if(0 == status)
+            {
+                status = detector->Detect(item.image, &detections);
+                failed += 0 == status || -999 == status ? 0 : 1;
+            }
+            /// @brief Reduced decodes are detected at the reduced size, back to file pixels.
+            if(0 == status && item.reduce > 1)
+            {
+                const float sx = (float)item.src_w / item.image.cols;
+                const float sy = (float)item.src_h / item.image.rows;
+                scaled.assign(detections.begin(), detections.end());
+                for(size_t i=0;i<scaled.size();++i)
+                {
+                    scaled[i].left *= sx;
+                    scaled[i].right *= sx;
+                    scaled[i].top *= sy;
+                    scaled[i].bottom *= sy;
+                }
+                detections = DetectionSpan(scaled.data(), scaled.size(), detections.Truncated());
+            }
+            item.image.release();
+            if(sink != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(sink_mutex);
+                const int iret = sink->Write(item, status, detections);
+                if(iret != 0 && 0 == sink_status)
+                {
+                    sink_status = iret;
+                }
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for(size_t i=1;i<detectors.size();++i)
+    {
+        threads.emplace_back(worker, detectors[i]);
+    }
+    worker(detectors[0]);
+    for(size_t i=0;i<threads.size();++i)
+    {
+        threads[i].join();
+    }
+    if(sink != nullptr && sink->Flush() != 0 && 0 == sink_status)
+    {
+        sink_status = -2;
+    }
+    if(detect_failed != nullptr)
+    {
+        *detect_failed = failed.load();
+    }
+    return sink_status;
+}
+
+}
@@ -0,0 +1,118 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     int8_calibrator.cpp
+*   Brief:    TRT entropy/minmax INT8 calibrators over a CalibrationBatchStream src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/calibrator.h"
+
+#include <stdio.h>
+#include <NvInfer.h>
+#include <cuda_runtime_api.h>
+
+namespace siran
+{
+
+/// @brief Calibrator of one TRT algorithm, Base is IInt8EntropyCalibrator2 or IInt8MinMaxCalibrator.
+template <typename Base>
+class StreamCalibrator : public Base
+{
+public:
+    StreamCalibrator(CalibrationBatchStream *stream, const std::string &cache_file, const int &algorithm):
+        stream_(stream),
+        cache_file_(cache_file),
+        algorithm_(algorithm),
+        device_input_(nullptr),
+        batch_num_(0)
+    {
+    }
+
+    ~StreamCalibrator()
+    {
+        if(device_input_ != nullptr)
+        {
+            cudaFree(device_input_);
+        }
+    }
+
+    int32_t getBatchSize() const noexcept override
+    {
+        return stream_->BatchSize();
+    }
+
+    bool getBatch(void *bindings[], const char *names[], int32_t nbBindings) noexcept override
+    {
+        if(nullptr == device_input_ && cudaMalloc(&device_input_, stream_->BatchFloats() * sizeof(float)) != cudaSuccess)
+        {
+            device_input_ = nullptr;
+            return false;
+        }
+        if(!stream_->Next(batch_))
+        {
+            printf("calibration done, %d batches, %lld images\n", batch_num_, (long long)stream_->Images());
+            return false;
+        }
+        if(cudaMemcpy(device_input_, batch_.data(), batch_.size() * sizeof(float), cudaMemcpyHostToDevice) != cudaSuccess)
+        {
+            return false;
+        }
+        /// @brief yolov7 has a single input.
+        for(int32_t i=0;i<nbBindings;++i)
+        {
+            bindings[i] = device_input_;
+        }
+        if(++batch_num_ % 10 == 0)
+        {
+            printf("calibration batch %d\n", batch_num_);
+        }
+        return true;
+    }
+
+    const void* readCalibrationCache(size_t &length) noexcept override
+    {
+        length = 0;
+        if(cache_file_.empty() || ReadCalibrationCache(cache_file_, algorithm_, cache_) != 0)
+        {
+            return nullptr;
+        }
+        printf("use calibration cache %s\n", cache_file_.c_str());
+        length = cache_.size();
+        return cache_.data();
+    }
+
+    void writeCalibrationCache(const void *cache, size_t length) noexcept override
+    {
+        if(!cache_file_.empty() && WriteCalibrationCache(cache_file_, std::string((const char*)cache, length)) != 0)
+        {
+            printf("warning: write calibration cache %s failed\n", cache_file_.c_str());
+        }
+    }
+
+private:
+    CalibrationBatchStream *stream_;
+    std::string cache_file_;
+    int algorithm_;
+    void *device_input_;
+    std::vector<float> batch_;
+    std::string cache_;
+    int batch_num_;
+};
+
+
+nvinfer1::IInt8Calibrator* CreateInt8Calibrator(CalibrationBatchStream *stream, const std::string &cache_file,
+                                                const int &algorithm)
+{
+    if(nullptr == stream)
+    {
+        return nullptr;
+    }
+    if(CALIB_MINMAX == algorithm)
+    {
+        return new StreamCalibrator<nvinfer1::IInt8MinMaxCalibrator>(stream, cache_file, algorithm);
+    }
+    return new StreamCalibrator<nvinfer1::IInt8EntropyCalibrator2>(stream, cache_file, algorithm);
+}
+
+}
@@ -0,0 +1,134 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     model_desc.cpp
+*   Brief:    runtime model descriptor src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/model_desc.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+
+namespace siran
+{
+
+static std::string Trim(const std::string &s)
+{
+    const char *ws = " \t\r\n";
+    std::string::size_type begin = s.find_first_not_of(ws);
+    if(begin == std::string::npos)
+    {
+        return "";
+    }
+    std::string::size_type end = s.find_last_not_of(ws);
+    return s.substr(begin, end - begin + 1);
+}
+
+
+std::string ModelDescPath(const std::string &engine_file)
+{
+    std::string::size_type dot = engine_file.find_last_of('.');
+    std::string::size_type slash = engine_file.find_last_of('/');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return engine_file + ".cfg";
+    }
+    return engine_file.substr(0, dot) + ".cfg";
+}
+
+
+int CheckModelDesc(const ModelDesc &desc)
+{
+    if(desc.input_c != 3 || desc.input_h <= 0 || desc.input_w <= 0 || desc.num_classes <= 0
+            || desc.num_anchors <= 0 || desc.strides.empty())
+    {
+        return -1;
+    }
+    if(desc.anchors.size() != desc.strides.size() * desc.num_anchors * 2)
+    {
+        return -1;
+    }
+    for(size_t i=0;i<desc.strides.size();++i)
+    {
+        if(desc.strides[i] <= 0 || desc.input_h % desc.strides[i] != 0 || desc.input_w % desc.strides[i] != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+int LoadModelDesc(const std::string &path, ModelDesc &desc)
+{
+    std::ifstream file(path);
+    if(!file.is_open())
+    {
+        return -1;
+    }
+    desc = DefaultModelDesc();
+    std::string line;
+    int line_no = 0;
+    while(std::getline(file, line))
+    {
+        line_no++;
+        line = Trim(line.substr(0, line.find('#')));
+        if(line.empty())
+        {
+            continue;
+        }
+        std::string::size_type colon = line.find(':');
+        if(colon == std::string::npos)
+        {
+            printf("%s:%d missing ':'\n", path.c_str(), line_no);
+            return -2;
+        }
+        const std::string key = Trim(line.substr(0, colon));
+        const std::string value = Trim(line.substr(colon + 1));
+        std::istringstream stream(value);
+        if(key == "input_c")          { stream >> desc.input_c; }
+        else if(key == "input_h")     { stream >> desc.input_h; }
+        else if(key == "input_w")     { stream >> desc.input_w; }
+        else if(key == "num_classes") { stream >> desc.num_classes; }
+        else if(key == "num_anchors") { stream >> desc.num_anchors; }
+        else if(key == "input_blob")  { desc.input_blob = value; }
+        else if(key == "output_blob") { desc.output_blob = value; }
+        else if(key == "conf_thresh") { stream >> desc.conf_thresh; }
+        else if(key == "nms_thresh")  { stream >> desc.nms_thresh; }
+        else if(key == "strides")
+        {
+            desc.strides.clear();
+            int v = 0;
+            while(stream >> v)
+            {
+                desc.strides.push_back(v);
+            }
+        }
+        else if(key == "anchors")
+        {
+            desc.anchors.clear();
+            float v = 0.f;
+            while(stream >> v)
+            {
+                desc.anchors.push_back(v);
+            }
+        }
+        else
+        {
+            printf("%s:%d unknown key %s\n", path.c_str(), line_no, key.c_str());
+            return -2;
+        }
+    }
+    if(CheckModelDesc(desc) != 0)
+    {
+        printf("%s invalid model descriptor\n", path.c_str());
+        return -2;
+    }
+    return 0;
+}
+
+}
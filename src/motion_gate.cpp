@@ -0,0 +1,275 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     motion_gate.cpp
+*   Brief:    motion gate of video streams src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/motion_gate.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+namespace siran
+{
+
+MotionGate::MotionGate(const MotionGateConfig &config):
+    config_(config),
+    frame_w_(0),
+    frame_h_(0),
+    small_w_(0),
+    small_h_(0),
+    cells_x_(0),
+    cells_y_(0),
+    valid_(false),
+    since_key_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+    config_.scale_width = std::max(config_.scale_width, 8);
+    config_.cell_size = std::max(config_.cell_size, 1);
+    config_.max_rois = std::max(config_.max_rois, 1);
+}
+
+
+/**
+ * @brief MotionGate::Downscale -- BGR copy of small_w_ x small_h_, each pixel the mean of four
+ *        samples at the quarter points of its block, so a 1080p frame reads 57600 pixels.
+ */
+void MotionGate::Downscale(const cv::Mat &frame, std::vector<uint8_t> &small)
+{
+    small.resize((size_t)small_w_ * small_h_ * 3);
+    for(int y=0;y<small_h_;++y)
+    {
+        const int y0 = (int)((int64_t)(4 * y + 1) * frame.rows / (4 * small_h_));
+        const int y1 = (int)((int64_t)(4 * y + 3) * frame.rows / (4 * small_h_));
+        const uint8_t *row0 = frame.data + (size_t)y0 * frame.step;
+        const uint8_t *row1 = frame.data + (size_t)y1 * frame.step;
+        uint8_t *out = &small[(size_t)y * small_w_ * 3];
+        for(int x=0;x<small_w_;++x)
+        {
+            const int x0 = (int)((int64_t)(4 * x + 1) * frame.cols / (4 * small_w_)) * 3;
+            const int x1 = (int)((int64_t)(4 * x + 3) * frame.cols / (4 * small_w_)) * 3;
+            for(int c=0;c<3;++c)
+            {
+                out[3 * x + c] = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+
+int MotionGate::MarkCells()
+{
+    const int cell = config_.cell_size;
+    cells_.assign((size_t)cells_x_ * cells_y_, 0);
+    std::vector<int> counts(cells_x_, 0);
+    int moving = 0;
+    for(int cy=0;cy<cells_y_;++cy)
+    {
+        std::fill(counts.begin(), counts.end(), 0);
+        const int y_end = std::min(small_h_, (cy + 1) * cell);
+        for(int y=cy*cell;y<y_end;++y)
+        {
+            const uint8_t *cur = &current_[(size_t)y * small_w_ * 3];
+            const uint8_t *ref = &reference_[(size_t)y * small_w_ * 3];
+            for(int x=0;x<small_w_;++x)
+            {
+                /// @brief Any channel, an object as bright as the background still changes colour.
+                const int diff = std::max(abs((int)cur[3 * x] - (int)ref[3 * x]),
+                                          std::max(abs((int)cur[3 * x + 1] - (int)ref[3 * x + 1]),
+                                                   abs((int)cur[3 * x + 2] - (int)ref[3 * x + 2])));
+                counts[x / cell] += diff > config_.pixel_thresh ? 1 : 0;
+            }
+        }
+        for(int cx=0;cx<cells_x_;++cx)
+        {
+            const int area = (std::min(small_w_, (cx + 1) * cell) - cx * cell) * (y_end - cy * cell);
+            if(counts[cx] > 0 && counts[cx] >= config_.cell_ratio * area)
+            {
+                cells_[(size_t)cy * cells_x_ + cx] = 1;
+                moving++;
+            }
+        }
+    }
+    return moving;
+}
+
+
+/// @private function, grow r to at least min_w x min_h around its center, kept inside the frame.
+static cv::Rect GrowRect(const cv::Rect &r, const int &min_w, const int &min_h, const int &frame_w, const int &frame_h)
+{
+    const int w = std::min(frame_w, std::max(r.width, min_w));
+    const int h = std::min(frame_h, std::max(r.height, min_h));
+    const int x = std::min(std::max(r.x + r.width / 2 - w / 2, 0), frame_w - w);
+    const int y = std::min(std::max(r.y + r.height / 2 - h / 2, 0), frame_h - h);
+    return cv::Rect(x, y, w, h);
+}
+
+
+static inline bool Overlaps(const cv::Rect &a, const cv::Rect &b)
+{
+    return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+
+void MotionGate::CellRegions(std::vector<cv::Rect> &rois)
+{
+    rois.clear();
+    const int cell = config_.cell_size;
+    for(int start=0;start<cells_x_*cells_y_;++start)
+    {
+        if(cells_[start] != 1)
+        {
+            continue;
+        }
+        /// @brief 8-connected moving cells, visited cells become 2.
+        int x_min = cells_x_, y_min = cells_y_, x_max = -1, y_max = -1;
+        stack_.assign(1, start);
+        cells_[start] = 2;
+        while(!stack_.empty())
+        {
+            const int index = stack_.back();
+            stack_.pop_back();
+            const int cx = index % cells_x_;
+            const int cy = index / cells_x_;
+            x_min = std::min(x_min, cx);
+            x_max = std::max(x_max, cx);
+            y_min = std::min(y_min, cy);
+            y_max = std::max(y_max, cy);
+            for(int ny=std::max(cy-1, 0);ny<=std::min(cy+1, cells_y_-1);++ny)
+            {
+                for(int nx=std::max(cx-1, 0);nx<=std::min(cx+1, cells_x_-1);++nx)
+                {
+                    const int next = ny * cells_x_ + nx;
+                    if(1 == cells_[next])
+                    {
+                        cells_[next] = 2;
+                        stack_.push_back(next);
+                    }
+                }
+            }
+        }
+        /// @brief Cells to frame pixels with the margin.
+        const int left = (int)((int64_t)x_min * cell * frame_w_ / small_w_) - config_.roi_margin;
+        const int top = (int)((int64_t)y_min * cell * frame_h_ / small_h_) - config_.roi_margin;
+        const int right = (int)((int64_t)std::min((x_max + 1) * cell, small_w_) * frame_w_ / small_w_) + config_.roi_margin;
+        const int bottom = (int)((int64_t)std::min((y_max + 1) * cell, small_h_) * frame_h_ / small_h_) + config_.roi_margin;
+        const cv::Rect region(std::max(left, 0), std::max(top, 0), std::min(right, frame_w_) - std::max(left, 0),
+                              std::min(bottom, frame_h_) - std::max(top, 0));
+        rois.push_back(GrowRect(region, config_.roi_min_w, config_.roi_min_h, frame_w_, frame_h_));
+    }
+
+    /// @brief Grown regions that overlap become their union, until none overlap.
+    bool merged = true;
+    while(merged)
+    {
+        merged = false;
+        for(size_t i=0;i<rois.size() && !merged;++i)
+        {
+            for(size_t j=i+1;j<rois.size() && !merged;++j)
+            {
+                if(!Overlaps(rois[i], rois[j]))
+                {
+                    continue;
+                }
+                const int x = std::min(rois[i].x, rois[j].x);
+                const int y = std::min(rois[i].y, rois[j].y);
+                const int r = std::max(rois[i].x + rois[i].width, rois[j].x + rois[j].width);
+                const int b = std::max(rois[i].y + rois[i].height, rois[j].y + rois[j].height);
+                rois[i] = cv::Rect(x, y, r - x, b - y);
+                rois.erase(rois.begin() + j);
+                merged = true;
+            }
+        }
+    }
+}
+
+
+int MotionGate::Update(const cv::Mat &frame, GateDecision &decision)
+{
+    decision.action = GATE_FULL;
+    decision.keyframe = false;
+    decision.moving_ratio = 0.f;
+    decision.rois.clear();
+    if(frame.empty() || frame.type() != CV_8UC3)
+    {
+        return -1;
+    }
+    stats_.frames++;
+    if(frame.cols != frame_w_ || frame.rows != frame_h_)
+    {
+        frame_w_ = frame.cols;
+        frame_h_ = frame.rows;
+        small_w_ = std::min(config_.scale_width, frame_w_);
+        small_h_ = std::max(1, (int)((int64_t)frame_h_ * small_w_ / frame_w_));
+        cells_x_ = (small_w_ + config_.cell_size - 1) / config_.cell_size;
+        cells_y_ = (small_h_ + config_.cell_size - 1) / config_.cell_size;
+        valid_ = false;
+    }
+    Downscale(frame, current_);
+
+    bool full = !valid_;
+    int moving = 0;
+    if(valid_)
+    {
+        moving = MarkCells();
+        decision.moving_ratio = (float)moving / (cells_x_ * cells_y_);
+    }
+    if(!full && config_.keyframe_interval > 0 && since_key_ + 1 >= config_.keyframe_interval)
+    {
+        full = true;
+        decision.keyframe = true;
+    }
+    if(!full && 0 == moving)
+    {
+        decision.action = GATE_SKIP;
+        since_key_++;
+        stats_.skipped++;
+        return 0;
+    }
+    if(!full && config_.crop_roi)
+    {
+        CellRegions(decision.rois);
+        int64_t area = 0;
+        for(size_t i=0;i<decision.rois.size();++i)
+        {
+            area += (int64_t)decision.rois[i].width * decision.rois[i].height;
+        }
+        full = (int)decision.rois.size() > config_.max_rois || area > config_.max_roi_ratio * frame_w_ * frame_h_;
+        decision.action = full ? GATE_FULL : GATE_ROI;
+    }
+    if(full)
+    {
+        decision.action = GATE_FULL;
+        decision.rois.clear();
+        since_key_ = 0;
+        stats_.full++;
+        stats_.keyframes += decision.keyframe ? 1 : 0;
+    }
+    else
+    {
+        since_key_++;
+        stats_.roi += GATE_ROI == decision.action ? 1 : 0;
+        stats_.full += GATE_FULL == decision.action ? 1 : 0;
+    }
+    /// @brief The inferred frame is the new reference, skipped frames keep the old one.
+    reference_.swap(current_);
+    valid_ = true;
+    return 0;
+}
+
+
+void MotionGate::Invalidate()
+{
+    valid_ = false;
+}
+
+
+GateStats MotionGate::GetStats() const
+{
+    return stats_;
+}
+
+}
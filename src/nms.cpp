@@ -0,0 +1,323 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     nms.cpp
+*   Brief:    per-class NMS engine src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/nms.h"
+#include "inc/yolov7_simd.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+namespace siran
+{
+
+static void IouMaskScalar(const float *x1, const float *y1, const float *x2, const float *y2, const float *area,
+                          const int &begin, const int &n, const float box[4], const float &box_area,
+                          const float &thresh, uint8_t *mask)
+{
+    for (int j = begin; j < n; ++j)
+    {
+        const float w = std::max(0.f, std::min(box[2], x2[j]) - std::max(box[0], x1[j]));
+        const float h = std::max(0.f, std::min(box[3], y2[j]) - std::max(box[1], y1[j]));
+        const float inter = w * h;
+        mask[j] = inter / (box_area + area[j] - inter) > thresh;
+    }
+}
+
+#if defined(YOLOV7_SIMD_X86)
+
+__attribute__((target("avx2")))
+static void IouMaskAvx2(const float *x1, const float *y1, const float *x2, const float *y2, const float *area,
+                        const int &n, const float box[4], const float &box_area, const float &thresh, uint8_t *mask)
+{
+    const __m256 bx1 = _mm256_set1_ps(box[0]);
+    const __m256 by1 = _mm256_set1_ps(box[1]);
+    const __m256 bx2 = _mm256_set1_ps(box[2]);
+    const __m256 by2 = _mm256_set1_ps(box[3]);
+    const __m256 barea = _mm256_set1_ps(box_area);
+    const __m256 vthresh = _mm256_set1_ps(thresh);
+    const __m256 zero = _mm256_setzero_ps();
+    int j = 0;
+    for (; j + 8 <= n; j += 8)
+    {
+        const __m256 w = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_min_ps(bx2, _mm256_loadu_ps(x2 + j)),
+                                                           _mm256_max_ps(bx1, _mm256_loadu_ps(x1 + j))));
+        const __m256 h = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_min_ps(by2, _mm256_loadu_ps(y2 + j)),
+                                                           _mm256_max_ps(by1, _mm256_loadu_ps(y1 + j))));
+        const __m256 inter = _mm256_mul_ps(w, h);
+        const __m256 uni = _mm256_sub_ps(_mm256_add_ps(barea, _mm256_loadu_ps(area + j)), inter);
+        const int bits = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_div_ps(inter, uni), vthresh, _CMP_GT_OQ));
+        for (int k = 0; k < 8; ++k)
+        {
+            mask[j + k] = (bits >> k) & 1;
+        }
+    }
+    IouMaskScalar(x1, y1, x2, y2, area, j, n, box, box_area, thresh, mask);
+}
+
+__attribute__((target("sse4.1")))
+static void IouMaskSse4(const float *x1, const float *y1, const float *x2, const float *y2, const float *area,
+                        const int &n, const float box[4], const float &box_area, const float &thresh, uint8_t *mask)
+{
+    const __m128 bx1 = _mm_set1_ps(box[0]);
+    const __m128 by1 = _mm_set1_ps(box[1]);
+    const __m128 bx2 = _mm_set1_ps(box[2]);
+    const __m128 by2 = _mm_set1_ps(box[3]);
+    const __m128 barea = _mm_set1_ps(box_area);
+    const __m128 vthresh = _mm_set1_ps(thresh);
+    const __m128 zero = _mm_setzero_ps();
+    int j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        const __m128 w = _mm_max_ps(zero, _mm_sub_ps(_mm_min_ps(bx2, _mm_loadu_ps(x2 + j)),
+                                                     _mm_max_ps(bx1, _mm_loadu_ps(x1 + j))));
+        const __m128 h = _mm_max_ps(zero, _mm_sub_ps(_mm_min_ps(by2, _mm_loadu_ps(y2 + j)),
+                                                     _mm_max_ps(by1, _mm_loadu_ps(y1 + j))));
+        const __m128 inter = _mm_mul_ps(w, h);
+        const __m128 uni = _mm_sub_ps(_mm_add_ps(barea, _mm_loadu_ps(area + j)), inter);
+        const int bits = _mm_movemask_ps(_mm_cmpgt_ps(_mm_div_ps(inter, uni), vthresh));
+        for (int k = 0; k < 4; ++k)
+        {
+            mask[j + k] = (bits >> k) & 1;
+        }
+    }
+    IouMaskScalar(x1, y1, x2, y2, area, j, n, box, box_area, thresh, mask);
+}
+
+#endif // YOLOV7_SIMD_X86
+
+#if defined(YOLOV7_SIMD_NEON)
+
+static void IouMaskNeon(const float *x1, const float *y1, const float *x2, const float *y2, const float *area,
+                        const int &n, const float box[4], const float &box_area, const float &thresh, uint8_t *mask)
+{
+    const float32x4_t bx1 = vdupq_n_f32(box[0]);
+    const float32x4_t by1 = vdupq_n_f32(box[1]);
+    const float32x4_t bx2 = vdupq_n_f32(box[2]);
+    const float32x4_t by2 = vdupq_n_f32(box[3]);
+    const float32x4_t barea = vdupq_n_f32(box_area);
+    const float32x4_t vthresh = vdupq_n_f32(thresh);
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    int j = 0;
+    for (; j + 4 <= n; j += 4)
+    {
+        const float32x4_t w = vmaxq_f32(zero, vsubq_f32(vminq_f32(bx2, vld1q_f32(x2 + j)), vmaxq_f32(bx1, vld1q_f32(x1 + j))));
+        const float32x4_t h = vmaxq_f32(zero, vsubq_f32(vminq_f32(by2, vld1q_f32(y2 + j)), vmaxq_f32(by1, vld1q_f32(y1 + j))));
+        const float32x4_t inter = vmulq_f32(w, h);
+        const float32x4_t uni = vsubq_f32(vaddq_f32(barea, vld1q_f32(area + j)), inter);
+        const uint32x4_t gt = vcgtq_f32(vdivq_f32(inter, uni), vthresh);
+        mask[j]     = vgetq_lane_u32(gt, 0) & 1;
+        mask[j + 1] = vgetq_lane_u32(gt, 1) & 1;
+        mask[j + 2] = vgetq_lane_u32(gt, 2) & 1;
+        mask[j + 3] = vgetq_lane_u32(gt, 3) & 1;
+    }
+    IouMaskScalar(x1, y1, x2, y2, area, j, n, box, box_area, thresh, mask);
+}
+
+#endif // YOLOV7_SIMD_NEON
+
+
+void IouMask(const int &isa, const float *x1, const float *y1, const float *x2, const float *y2, const float *area,
+             const int &n, const float box[4], const float &box_area, const float &thresh, uint8_t *mask)
+{
+    switch (isa)
+    {
+#if defined(YOLOV7_SIMD_X86)
+    case DECODE_AVX2:
+        IouMaskAvx2(x1, y1, x2, y2, area, n, box, box_area, thresh, mask);
+        return;
+    case DECODE_SSE4:
+        IouMaskSse4(x1, y1, x2, y2, area, n, box, box_area, thresh, mask);
+        return;
+#endif
+#if defined(YOLOV7_SIMD_NEON)
+    case DECODE_NEON:
+        IouMaskNeon(x1, y1, x2, y2, area, n, box, box_area, thresh, mask);
+        return;
+#endif
+    default:
+        IouMaskScalar(x1, y1, x2, y2, area, 0, n, box, box_area, thresh, mask);
+        return;
+    }
+}
+
+
+NmsEngine::NmsEngine():
+    isa_(DetectDecodeIsa())
+{
+}
+
+
+void NmsEngine::SetIsa(const int &isa)
+{
+    isa_ = isa;
+}
+
+
+void NmsEngine::Reserve(const int &num)
+{
+    if ((int)in_x1_.size() >= num)
+    {
+        return;
+    }
+    in_x1_.resize(num);
+    in_y1_.resize(num);
+    in_x2_.resize(num);
+    in_y2_.resize(num);
+    in_score_.resize(num);
+    in_cls_.resize(num);
+    by_class_.resize(num);
+    score_rank_.resize(num);
+    x1_.resize(num);
+    y1_.resize(num);
+    x2_.resize(num);
+    y2_.resize(num);
+    area_.resize(num);
+    orig_.resize(num);
+    rank_.resize(num);
+    pos_of_rank_.resize(num);
+    order_.resize(num);
+    alive_.resize(num);
+    mask_.resize(num);
+}
+
+
+int NmsEngine::Run(const float *boxes, const float *scores, const int *classes, const int &num, const float &iou_thresh, int *valid)
+{
+    Reserve(num);
+    for (int i = 0; i < num; ++i)
+    {
+        in_x1_[i] = boxes[i * 4];
+        in_y1_[i] = boxes[i * 4 + 1];
+        in_x2_[i] = boxes[i * 4 + 2];
+        in_y2_[i] = boxes[i * 4 + 3];
+        in_score_[i] = scores[i];
+        in_cls_[i] = classes[i];
+    }
+    return Suppress(num, iou_thresh, valid);
+}
+
+
+/**
+ * @brief NmsEngine::Suppress -- Counting sort of the valid objects by class, then NMS per class,
+ *        boxes of different classes never suppress each other.
+ */
+int NmsEngine::Suppress(const int &num, const float &iou_thresh, int *valid)
+{
+    if (num <= 0 || nullptr == valid)
+    {
+        return 0;
+    }
+    int max_cls = 0;
+    for (int i = 0; i < num; ++i)
+    {
+        max_cls = std::max(max_cls, in_cls_[i]);
+    }
+    class_begin_.assign(max_cls + 2, 0);
+    for (int i = 0; i < num; ++i)
+    {
+        if (valid[i] && in_cls_[i] >= 0)
+        {
+            class_begin_[in_cls_[i] + 1]++;
+        }
+    }
+    for (int c = 0; c <= max_cls; ++c)
+    {
+        class_begin_[c + 1] += class_begin_[c];
+    }
+    class_fill_.assign(class_begin_.begin(), class_begin_.end() - 1);
+    for (int i = 0; i < num; ++i)
+    {
+        if (valid[i] && in_cls_[i] >= 0)
+        {
+            by_class_[class_fill_[in_cls_[i]]++] = i;
+        }
+    }
+
+    int kept = 0;
+    for (int c = 0; c <= max_cls; ++c)
+    {
+        const int n = class_begin_[c + 1] - class_begin_[c];
+        if (n > 0)
+        {
+            kept += SuppressClass(&by_class_[class_begin_[c]], n, iou_thresh, valid);
+        }
+    }
+    return kept;
+}
+
+
+int NmsEngine::SuppressClass(const int *idx, const int &n, const float &iou_thresh, int *valid)
+{
+    /// @brief Score order, ties by index so results do not depend on the partition.
+    int *by_score = order_.data();
+    std::copy(idx, idx + n, by_score);
+    const float *score = in_score_.data();
+    std::sort(by_score, by_score + n, [score](int a, int b) {
+        return score[a] > score[b] || (score[a] == score[b] && a < b);
+    });
+    for (int r = 0; r < n; ++r)
+    {
+        score_rank_[by_score[r]] = r;
+    }
+
+    /// @brief SoA in x1 order, the sweep window of a box is a contiguous range.
+    std::copy(idx, idx + n, orig_.begin());
+    const float *in_x1 = in_x1_.data();
+    std::sort(orig_.begin(), orig_.begin() + n, [in_x1](int a, int b) {
+        return in_x1[a] < in_x1[b] || (in_x1[a] == in_x1[b] && a < b);
+    });
+    float max_w = 0.f;
+    for (int p = 0; p < n; ++p)
+    {
+        const int i = orig_[p];
+        x1_[p] = in_x1_[i];
+        y1_[p] = in_y1_[i];
+        x2_[p] = in_x2_[i];
+        y2_[p] = in_y2_[i];
+        area_[p] = (in_x2_[i] - in_x1_[i]) * (in_y2_[i] - in_y1_[i]);
+        max_w = std::max(max_w, in_x2_[i] - in_x1_[i]);
+        rank_[p] = score_rank_[i];
+        pos_of_rank_[rank_[p]] = p;
+        alive_[p] = 1;
+    }
+
+    int kept = 0;
+    const float *x1_begin = x1_.data();
+    const float *x1_end = x1_begin + n;
+    for (int r = 0; r < n; ++r)
+    {
+        const int p = pos_of_rank_[r];
+        if (!alive_[p])
+        {
+            continue;
+        }
+        ++kept;
+        /// @brief A box starting before x1 - max_w ends before x1, one starting at x2 or later
+        ///        starts after this box ends, neither overlaps. The margin absorbs rounding.
+        const float margin = 1e-5f * (fabsf(x1_[p]) + max_w + 1.f);
+        const int lo = std::lower_bound(x1_begin, x1_end, x1_[p] - max_w - margin) - x1_begin;
+        const int hi = std::lower_bound(x1_begin, x1_end, x2_[p]) - x1_begin;
+        if (hi - lo <= 1)
+        {
+            continue;
+        }
+        const float box[4] = {x1_[p], y1_[p], x2_[p], y2_[p]};
+        IouMask(isa_, &x1_[lo], &y1_[lo], &x2_[lo], &y2_[lo], &area_[lo], hi - lo, box, area_[p], iou_thresh, &mask_[lo]);
+        for (int q = lo; q < hi; ++q)
+        {
+            if (mask_[q] && alive_[q] && rank_[q] > r)
+            {
+                alive_[q] = 0;
+                valid[orig_[q]] = 0;
+            }
+        }
+    }
+    return kept;
+}
+
+}
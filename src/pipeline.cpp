@@ -0,0 +1,123 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     pipeline.cpp
+*   Brief:    stage pipeline scheduler src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/pipeline.h"
+
+#include <algorithm>
+
+namespace siran
+{
+
+PipelineScheduler::PipelineScheduler(IStageExecutor *executor, const int &num_stages):
+    executor_(executor),
+    num_stages_(num_stages)
+{
+}
+
+
+int PipelineScheduler::Slot(const int64_t &frame_id) const
+{
+    return (int)(frame_id % num_stages_);
+}
+
+
+/**
+ * @brief PipelineScheduler::Push -- Enter frame_id at stage 0 and run one tick.
+ * @return                        -- 0--success, else first failing Launch code
+ */
+int PipelineScheduler::Push(const int64_t &frame_id)
+{
+    in_flight_.push_back(std::make_pair(frame_id, 0));
+    return Tick();
+}
+
+
+int PipelineScheduler::Flush()
+{
+    int iret = 0;
+    while(!in_flight_.empty())
+    {
+        int ret = Tick();
+        iret = (iret != 0) ? iret : ret;
+    }
+    return iret;
+}
+
+
+int PipelineScheduler::InFlight() const
+{
+    return (int)in_flight_.size();
+}
+
+
+/**
+ * @brief PipelineScheduler::Tick -- Launch the next stage of every in-flight frame, newest
+ *        frame first so async device stages are queued before the host stage blocks.
+ */
+int PipelineScheduler::Tick()
+{
+    int iret = 0;
+    for(auto it = in_flight_.rbegin(); it != in_flight_.rend(); ++it)
+    {
+        int ret = executor_->Launch(it->second, Slot(it->first), it->first);
+        iret = (iret != 0) ? iret : ret;
+        it->second++;
+    }
+    while(!in_flight_.empty() && in_flight_.front().second >= num_stages_)
+    {
+        in_flight_.pop_front();
+    }
+    return iret;
+}
+
+
+SimStageExecutor::SimStageExecutor(const std::vector<double> &stage_cost):
+    stage_cost_(stage_cost),
+    stage_free_(stage_cost.size(), 0.0),
+    slot_ready_(stage_cost.size(), 0.0)
+{
+}
+
+
+int SimStageExecutor::Launch(const int &stage, const int &slot, const int64_t &frame_id)
+{
+    if(stage < 0 || stage >= (int)stage_cost_.size())
+    {
+        return -1;
+    }
+    /// @brief Stage 0 of a slot starts fresh, the frame that used it before has left the pipeline.
+    const double ready = (stage == 0) ? 0.0 : slot_ready_[slot];
+    StageSpan span;
+    span.frame_id = frame_id;
+    span.stage = stage;
+    span.start = std::max(ready, stage_free_[stage]);
+    span.end = span.start + stage_cost_[stage];
+    stage_free_[stage] = span.end;
+    slot_ready_[slot] = span.end;
+    timeline_.push_back(span);
+    return 0;
+}
+
+
+const std::vector<StageSpan>& SimStageExecutor::Timeline() const
+{
+    return timeline_;
+}
+
+
+double SimStageExecutor::Makespan() const
+{
+    double end = 0.0;
+    for(size_t i=0;i<timeline_.size();++i)
+    {
+        end = std::max(end, timeline_[i].end);
+    }
+    return end;
+}
+
+}
@@ -0,0 +1,290 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     preprocess.cpp
+*   Brief:    letterbox coefficient tables and cpu reference.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/preprocess.h"
+
+#include <math.h>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+namespace siran
+{
+
+static const int kResizeCoefScale = 1 << 11;
+
+static short CoefCast(const float &v)
+{
+    int iv = (int)lrintf(v * kResizeCoefScale);
+    return (short)std::max(-32768, std::min(32767, iv));
+}
+
+
+/**
+ * @brief BuildLetterboxTable -- Same scale and unpad size as the yolov7 letterbox, same source
+ *        coordinates and clamping as cv::resize INTER_LINEAR.
+ */
+void BuildLetterboxTable(const int &src_w, const int &src_h, const int &dst_w, const int &dst_h, LetterboxTable &table)
+{
+    float r = std::min(dst_w / (src_w*1.0), dst_h / (src_h*1.0));
+    table.src_w = src_w;
+    table.src_h = src_h;
+    table.unpad_w = r * src_w;
+    table.unpad_h = r * src_h;
+
+    const double scale_x = 1. / ((double)table.unpad_w / src_w);
+    const double scale_y = 1. / ((double)table.unpad_h / src_h);
+
+    table.x0.resize(table.unpad_w);
+    table.x1.resize(table.unpad_w);
+    table.alpha.resize(table.unpad_w * 2);
+    for(int dx=0;dx<table.unpad_w;++dx)
+    {
+        float fx = (float)((dx + 0.5) * scale_x - 0.5);
+        int sx = (int)floorf(fx);
+        fx -= sx;
+        if(sx < 0)
+        {
+            fx = 0.f;
+            sx = 0;
+        }
+        if(sx >= src_w - 1)
+        {
+            fx = 0.f;
+            sx = src_w - 1;
+        }
+        table.x0[dx] = sx * 3;
+        table.x1[dx] = std::min(sx + 1, src_w - 1) * 3;
+        table.alpha[dx*2] = CoefCast(1.f - fx);
+        table.alpha[dx*2 + 1] = CoefCast(fx);
+    }
+
+    table.y0.resize(table.unpad_h);
+    table.y1.resize(table.unpad_h);
+    table.beta.resize(table.unpad_h * 2);
+    for(int dy=0;dy<table.unpad_h;++dy)
+    {
+        float fy = (float)((dy + 0.5) * scale_y - 0.5);
+        int sy = (int)floorf(fy);
+        fy -= sy;
+        table.y0[dy] = std::max(0, std::min(sy, src_h - 1));
+        table.y1[dy] = std::max(0, std::min(sy + 1, src_h - 1));
+        table.beta[dy*2] = CoefCast(1.f - fy);
+        table.beta[dy*2 + 1] = CoefCast(fy);
+    }
+}
+
+
+int LetterboxRef(const uint8_t *src, const size_t &src_step, const LetterboxTable &table,
+                 float *dst, const int &dst_w, const int &dst_h)
+{
+    if(nullptr == src || nullptr == dst)
+    {
+        return -1;
+    }
+    const int plane = dst_w * dst_h;
+    const float norm = 1.0f / 255.0f;
+    for(int dy=0;dy<dst_h;++dy)
+    {
+        for(int dx=0;dx<dst_w;++dx)
+        {
+            uint8_t bgr[3] = {kLetterboxPad, kLetterboxPad, kLetterboxPad};
+            if(dx < table.unpad_w && dy < table.unpad_h)
+            {
+                LetterboxPixel(src, src_step, table.x0[dx], table.x1[dx], &table.alpha[dx*2],
+                               table.y0[dy], table.y1[dy], &table.beta[dy*2], bgr);
+            }
+            const int o = dy * dst_w + dx;
+            dst[o] = bgr[2] * norm;
+            dst[plane + o] = bgr[1] * norm;
+            dst[plane * 2 + o] = bgr[0] * norm;
+        }
+    }
+    return 0;
+}
+
+
+int StaticResize(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h,
+                 float *dst, const int &dst_w, const int &dst_h)
+{
+    if(nullptr == src || nullptr == dst || src_w <= 0 || src_h <= 0)
+    {
+        return -1;
+    }
+    float r = std::min(dst_w / (src_w*1.0), dst_h / (src_h*1.0));
+    int unpad_w = r * src_w;
+    int unpad_h = r * src_h;
+    cv::Mat frame(src_h, src_w, CV_8UC3, (void*)src, src_step);
+    cv::Mat re(unpad_h, unpad_w, CV_8UC3);
+    cv::resize(frame, re, re.size());
+    cv::Mat out(dst_h, dst_w, CV_8UC3, cv::Scalar(kLetterboxPad, kLetterboxPad, kLetterboxPad));
+    re.copyTo(out(cv::Rect(0, 0, re.cols, re.rows)));
+
+    const int plane = dst_w * dst_h;
+    const float norm = 1.0f / 255.0f;
+    for(int dy=0;dy<dst_h;++dy)
+    {
+        const uint8_t *row = out.ptr<uint8_t>(dy);
+        for(int dx=0;dx<dst_w;++dx)
+        {
+            const int o = dy * dst_w + dx;
+            dst[o] = row[dx*3 + 2] * norm;
+            dst[plane + o] = row[dx*3 + 1] * norm;
+            dst[plane * 2 + o] = row[dx*3] * norm;
+        }
+    }
+    return 0;
+}
+
+
+CpuLetterbox::CpuLetterbox(const int &dst_w, const int &dst_h, const int &thread_num):
+    dst_w_(dst_w),
+    dst_h_(dst_h),
+    pool_(thread_num)
+{
+}
+
+
+const LetterboxTable& CpuLetterbox::GetTable(const int &src_w, const int &src_h)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::pair<int, int> key(src_w, src_h);
+    auto it = tables_.find(key);
+    if(it == tables_.end())
+    {
+        it = tables_.insert(std::make_pair(key, LetterboxTable())).first;
+        BuildLetterboxTable(src_w, src_h, dst_w_, dst_h_, it->second);
+    }
+    return it->second;
+}
+
+
+int CpuLetterbox::Run(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h, float *dst)
+{
+    if(nullptr == src || nullptr == dst || src_w <= 0 || src_h <= 0)
+    {
+        return -1;
+    }
+    const LetterboxTable &table = GetTable(src_w, src_h);
+    pool_.ParallelFor(0, dst_h_, [&](int row_begin, int row_end) {
+        RunBand(src, src_step, table, dst, row_begin, row_end);
+    });
+    return 0;
+}
+
+
+/**
+ * @brief CpuLetterbox::RunViews -- The output rows of every view are one ParallelFor, a band
+ *        crossing a view boundary is split there, so a stereo pair costs one dispatch.
+ */
+int CpuLetterbox::RunViews(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h,
+                           const int &view_num, float *dst)
+{
+    if(nullptr == src || nullptr == dst || view_num <= 0 || src_w < view_num || src_h <= 0)
+    {
+        return -1;
+    }
+    /// @brief Column bands of SplitViews, the last view takes the odd columns.
+    const int view_w = src_w / view_num;
+    std::vector<const LetterboxTable*> tables(view_num);
+    for(int v=0;v<view_num;++v)
+    {
+        tables[v] = &GetTable(v == view_num - 1 ? src_w - view_w * v : view_w, src_h);
+    }
+    const size_t slot = (size_t)3 * dst_w_ * dst_h_;
+    pool_.ParallelFor(0, view_num * dst_h_, [&](int row_begin, int row_end) {
+        for(int row=row_begin;row<row_end;)
+        {
+            const int v = row / dst_h_;
+            const int end = std::min(row_end, (v + 1) * dst_h_);
+            RunBand(src + (size_t)view_w * v * 3, src_step, *tables[v], dst + slot * v, row - v * dst_h_, end - v * dst_h_);
+            row = end;
+        }
+    });
+    return 0;
+}
+
+
+/**
+ * @brief CpuLetterbox::RunBand -- Output rows [row_begin, row_end), horizontal rows are cached
+ *        by source row so a row shared by two output rows is only resized once.
+ */
+void CpuLetterbox::RunBand(const uint8_t *src, const size_t &src_step, const LetterboxTable &table,
+                           float *dst, const int &row_begin, const int &row_end)
+{
+    const int plane = dst_w_ * dst_h_;
+    const int unpad_w = table.unpad_w;
+    const float norm = 1.0f / 255.0f;
+    const float pad = kLetterboxPad * norm;
+
+    /// @brief Two cached horizontal rows, planar B|G|R of unpad_w ints each.
+    std::vector<int> hbuf(unpad_w * 3 * 2);
+    int *hrow[2] = {hbuf.data(), hbuf.data() + unpad_w * 3};
+    int hrow_y[2] = {-1, -1};
+
+    for(int dy=row_begin;dy<row_end;++dy)
+    {
+        float *out_r = dst + dy * dst_w_;
+        float *out_g = out_r + plane;
+        float *out_b = out_g + plane;
+        if(dy >= table.unpad_h)
+        {
+            std::fill(out_r, out_r + dst_w_, pad);
+            std::fill(out_g, out_g + dst_w_, pad);
+            std::fill(out_b, out_b + dst_w_, pad);
+            continue;
+        }
+
+        const int ys[2] = {table.y0[dy], table.y1[dy]};
+        int *h[2];
+        for(int k=0;k<2;++k)
+        {
+            int slot = (hrow_y[0] == ys[k]) ? 0 : ((hrow_y[1] == ys[k]) ? 1 : -1);
+            if(slot < 0)
+            {
+                /// @brief Replace the cached row not used by this output row.
+                slot = (hrow_y[0] == ys[1 - k]) ? 1 : 0;
+                const uint8_t *row = src + (size_t)ys[k] * src_step;
+                int *hb = hrow[slot];
+                int *hg = hb + unpad_w;
+                int *hr = hg + unpad_w;
+                const short *alpha = table.alpha.data();
+                for(int dx=0;dx<unpad_w;++dx)
+                {
+                    const uint8_t *p0 = row + table.x0[dx];
+                    const uint8_t *p1 = row + table.x1[dx];
+                    const int a0 = alpha[dx*2];
+                    const int a1 = alpha[dx*2 + 1];
+                    hb[dx] = p0[0] * a0 + p1[0] * a1;
+                    hg[dx] = p0[1] * a0 + p1[1] * a1;
+                    hr[dx] = p0[2] * a0 + p1[2] * a1;
+                }
+                hrow_y[slot] = ys[k];
+            }
+            h[k] = hrow[slot];
+        }
+
+        const int b0 = table.beta[dy*2];
+        const int b1 = table.beta[dy*2 + 1];
+        float *outs[3] = {out_b, out_g, out_r};
+        for(int c=0;c<3;++c)
+        {
+            const int *s0 = h[0] + c * unpad_w;
+            const int *s1 = h[1] + c * unpad_w;
+            float *out = outs[c];
+            for(int dx=0;dx<unpad_w;++dx)
+            {
+                int v = (((b0 * (s0[dx] >> 4)) >> 16) + ((b1 * (s1[dx] >> 4)) >> 16) + 2) >> 2;
+                v = v < 0 ? 0 : (v > 255 ? 255 : v);
+                out[dx] = v * norm;
+            }
+            std::fill(out + unpad_w, out + dst_w_, pad);
+        }
+    }
+}
+
+}
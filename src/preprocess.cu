@@ -0,0 +1,110 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     preprocess.cu
+*   Brief:    fused letterbox preprocessing cuda kernel.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/preprocess.h"
+
+namespace siran
+{
+
+__global__ void LetterboxKernel(const uint8_t *src, size_t src_step,
+                                const int *x, const short *alpha, const int *y, const short *beta,
+                                int unpad_w, int unpad_h, float *dst, int dst_w, int dst_h)
+{
+    const int dx = blockIdx.x * blockDim.x + threadIdx.x;
+    const int dy = blockIdx.y * blockDim.y + threadIdx.y;
+    if(dx >= dst_w || dy >= dst_h)
+    {
+        return;
+    }
+    uint8_t bgr[3] = {kLetterboxPad, kLetterboxPad, kLetterboxPad};
+    if(dx < unpad_w && dy < unpad_h)
+    {
+        LetterboxPixel(src, src_step, x[dx], x[unpad_w + dx], alpha + dx*2,
+                       y[dy], y[unpad_h + dy], beta + dy*2, bgr);
+    }
+    const int plane = dst_w * dst_h;
+    const int o = dy * dst_w + dx;
+    const float norm = 1.0f / 255.0f;
+    dst[o] = __fmul_rn(bgr[2], norm);
+    dst[plane + o] = __fmul_rn(bgr[1], norm);
+    dst[plane * 2 + o] = __fmul_rn(bgr[0], norm);
+}
+
+
+FusedLetterbox::FusedLetterbox(const int &dst_w, const int &dst_h):
+    dst_w_(dst_w),
+    dst_h_(dst_h)
+{
+}
+
+
+FusedLetterbox::~FusedLetterbox()
+{
+    for(auto it = tables_.begin(); it != tables_.end(); ++it)
+    {
+        cudaFree(it->second.x);
+        cudaFree(it->second.alpha);
+        cudaFree(it->second.y);
+        cudaFree(it->second.beta);
+    }
+    tables_.clear();
+}
+
+
+const FusedLetterbox::DeviceTable* FusedLetterbox::GetTable(const int &src_w, const int &src_h, cudaStream_t stream)
+{
+    const std::pair<int, int> key(src_w, src_h);
+    auto it = tables_.find(key);
+    if(it != tables_.end())
+    {
+        return &it->second;
+    }
+    LetterboxTable table;
+    BuildLetterboxTable(src_w, src_h, dst_w_, dst_h_, table);
+    std::vector<int> x(table.x0);
+    x.insert(x.end(), table.x1.begin(), table.x1.end());
+    std::vector<int> y(table.y0);
+    y.insert(y.end(), table.y1.begin(), table.y1.end());
+
+    DeviceTable dt;
+    dt.unpad_w = table.unpad_w;
+    dt.unpad_h = table.unpad_h;
+    cudaMalloc(&dt.x, x.size() * sizeof(int));
+    cudaMalloc(&dt.alpha, table.alpha.size() * sizeof(short));
+    cudaMalloc(&dt.y, y.size() * sizeof(int));
+    cudaMalloc(&dt.beta, table.beta.size() * sizeof(short));
+    cudaMemcpyAsync(dt.x, x.data(), x.size() * sizeof(int), cudaMemcpyHostToDevice, stream);
+    cudaMemcpyAsync(dt.alpha, table.alpha.data(), table.alpha.size() * sizeof(short), cudaMemcpyHostToDevice, stream);
+    cudaMemcpyAsync(dt.y, y.data(), y.size() * sizeof(int), cudaMemcpyHostToDevice, stream);
+    cudaMemcpyAsync(dt.beta, table.beta.data(), table.beta.size() * sizeof(short), cudaMemcpyHostToDevice, stream);
+    /// @brief Host tables go out of scope, only happens once per source size.
+    cudaStreamSynchronize(stream);
+    return &(tables_[key] = dt);
+}
+
+
+/**
+ * @brief FusedLetterbox::Run -- Letterbox, BGR->RGB, 1/255 and HWC->CHW in one launch.
+ * @return                    -- 0--success, -1--input or launch error
+ */
+int FusedLetterbox::Run(const uint8_t *src, const size_t &src_step, const int &src_w, const int &src_h,
+                        float *dst, cudaStream_t stream)
+{
+    if(nullptr == src || nullptr == dst || src_w <= 0 || src_h <= 0)
+    {
+        return -1;
+    }
+    const DeviceTable *dt = GetTable(src_w, src_h, stream);
+    dim3 block(32, 8);
+    dim3 grid((dst_w_ + block.x - 1) / block.x, (dst_h_ + block.y - 1) / block.y);
+    LetterboxKernel<<<grid, block, 0, stream>>>(src, src_step, dt->x, dt->alpha, dt->y, dt->beta,
+                                                dt->unpad_w, dt->unpad_h, dst, dst_w_, dst_h_);
+    return cudaGetLastError() == cudaSuccess ? 0 : -1;
+}
+
+}
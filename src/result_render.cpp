@@ -0,0 +1,162 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     result_render.cpp
+*   Brief:    asynchronous result rendering src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/result_render.h"
+#include "inc/common.hpp"
+#include "inc/utils.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+namespace siran
+{
+
+void DrawDetections(cv::Mat &image, const Detection *detections, const int &count)
+{
+    for(int i=0;i<count;++i)
+    {
+        const Detection &det = detections[i];
+        const int obj_x = (int)det.left;
+        const int obj_y = (int)det.top;
+        const int obj_width = (int)(det.right - det.left);
+        const int obj_height = (int)(det.bottom - det.top);
+        /// @brief Custom class counts reuse the 80 COCO colors and names.
+        const int obj_class = det.class_id % 80;
+
+        cv::Scalar color = cv::Scalar(color_list[obj_class][0], color_list[obj_class][1], color_list[obj_class][2]);
+        float c_mean = cv::mean(color)[0];
+        cv::Scalar txt_color;
+        if (c_mean > 0.5)
+        {
+            txt_color = cv::Scalar(0, 0, 0);
+        }
+        else
+        {
+            txt_color = cv::Scalar(255, 255, 255);
+        }
+        cv::rectangle(image, cv::Rect(obj_x, obj_y, obj_width, obj_height), color * 255, 2);
+
+        char text[256];
+        memset(text, 0, 256*sizeof(char));
+        sprintf(text, "%s %.1f%%", class_names[obj_class], det.prob * 100);
+
+        int baseLine = 0;
+        cv::Size label_size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, 0.4, 1, &baseLine);
+        cv::Scalar txt_bk_color = color * 0.7 * 255;
+        int x = obj_x;
+        int y = obj_y + 1;
+        y = y>image.rows?image.rows:y;
+        cv::rectangle(image, cv::Rect(cv::Point(x, y), cv::Size(label_size.width, label_size.height + baseLine)), txt_bk_color, -1);
+        cv::putText(image, text, cv::Point(x, y + label_size.height), cv::FONT_HERSHEY_SIMPLEX, 0.4, txt_color, 1);
+    }
+}
+
+
+AsyncRenderer::AsyncRenderer(const RenderConfig &config):
+    config_(config),
+    frame_count_(0),
+    pending_(0),
+    dir_ready_(false),
+    pool_(config.thread_num > 0 ? config.thread_num : 1)
+{
+    memset(&stats_, 0, sizeof(stats_));
+    config_.max_pending = config_.max_pending > 0 ? config_.max_pending : 1;
+    config_.every_n = config_.every_n > 0 ? config_.every_n : 1;
+}
+
+
+AsyncRenderer::~AsyncRenderer()
+{
+    Wait();
+}
+
+
+int AsyncRenderer::Submit(const cv::Mat &frame, const std::string &name, const DetectionSpan &detections)
+{
+    if(frame.empty())
+    {
+        return -1;
+    }
+    std::string file_name = name;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const int64_t index = frame_count_++;
+        stats_.submitted++;
+        if(index % config_.every_n != 0)
+        {
+            stats_.skipped++;
+            return 1;
+        }
+        if(pending_ >= config_.max_pending)
+        {
+            stats_.dropped++;
+            return -2;
+        }
+        pending_++;
+        if(file_name.empty())
+        {
+            char text[32];
+            snprintf(text, sizeof(text), "frame_%lld", (long long)index);
+            file_name = text;
+        }
+    }
+    std::vector<Detection> boxes(detections.begin(), detections.end());
+    pool_.Submit([this, frame, file_name, boxes]() {
+        Render(frame, file_name, boxes);
+    });
+    return 0;
+}
+
+
+void AsyncRenderer::Render(const cv::Mat &frame, const std::string &name, const std::vector<Detection> &detections)
+{
+    const auto time_start = std::chrono::steady_clock::now();
+    bool ok = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(!dir_ready_)
+        {
+            dir_ready_ = CheckFolderExist(config_.save_dir) == 0;
+        }
+        ok = dir_ready_;
+    }
+    if(ok)
+    {
+        /// @brief The frame was handed over in Submit, draw on it without another copy.
+        cv::Mat image = frame;
+        DrawDetections(image, detections.data(), (int)detections.size());
+        const std::string path = config_.save_dir + "/" + name + ".jpg";
+        const std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, config_.jpeg_quality};
+        ok = cv::imwrite(path, image, params);
+    }
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.rendered += ok ? 1 : 0;
+    stats_.failed += ok ? 0 : 1;
+    stats_.render_ms += ms;
+    pending_--;
+    idle_cond_.notify_all();
+}
+
+
+void AsyncRenderer::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cond_.wait(lock, [this]() { return 0 == pending_; });
+}
+
+
+RenderStats AsyncRenderer::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+}
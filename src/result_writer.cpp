@@ -0,0 +1,592 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     result_writer.cpp
+*   Brief:    bulk detection output src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/result_writer.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+namespace siran
+{
+
+/// @brief Size of the fixed payload part before the name, see the layout in result_writer.h.
+static const size_t kRecordFixedBytes = 8 + 8 + 4 + 4 + 4 + 4 + 2;
+static const size_t kDetectionBytes = 6 * 4;
+static_assert(sizeof(Detection) == kDetectionBytes, "records hold Detection as is");
+
+template<typename T>
+static inline void AppendPod(std::string &buf, const T &value)
+{
+    buf.append((const char*)&value, sizeof(T));
+}
+
+template<typename T>
+static inline T ReadPod(const char *data)
+{
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+static void EncodeBinary(const ResultMeta &meta, const DetectionSpan &detections, std::string &buf)
+{
+    const size_t name_len = nullptr == meta.name ? 0 : std::min(strlen(meta.name), (size_t)0xFFFF);
+    const uint32_t payload = (uint32_t)(kRecordFixedBytes + name_len + detections.Count() * kDetectionBytes);
+    AppendPod(buf, payload);
+    AppendPod(buf, (int64_t)meta.frame_id);
+    AppendPod(buf, (uint64_t)meta.timestamp_ns);
+    AppendPod(buf, (int32_t)meta.width);
+    AppendPod(buf, (int32_t)meta.height);
+    AppendPod(buf, (int32_t)meta.status);
+    AppendPod(buf, (uint32_t)detections.Count());
+    AppendPod(buf, (uint16_t)name_len);
+    buf.append(nullptr == meta.name ? "" : meta.name, name_len);
+    for(int i=0;i<detections.Count();++i)
+    {
+        const Detection &det = detections[i];
+        AppendPod(buf, det.left);
+        AppendPod(buf, det.top);
+        AppendPod(buf, det.right);
+        AppendPod(buf, det.bottom);
+        AppendPod(buf, (int32_t)det.class_id);
+        AppendPod(buf, det.prob);
+    }
+}
+
+static void AppendJsonString(std::string &buf, const char *str)
+{
+    buf.push_back('"');
+    for(const char *c = nullptr == str ? "" : str;*c != '\0';++c)
+    {
+        if('"' == *c || '\\' == *c)
+        {
+            buf.push_back('\\');
+            buf.push_back(*c);
+        }
+        else if((unsigned char)*c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)*c);
+            buf.append(escaped);
+        }
+        else
+        {
+            buf.push_back(*c);
+        }
+    }
+    buf.push_back('"');
+}
+
+static void EncodeJson(const ResultMeta &meta, const DetectionSpan &detections, std::string &buf)
+{
+    char text[160];
+    snprintf(text, sizeof(text), "{\"frame\":%lld,\"ts\":%llu,\"name\":", (long long)meta.frame_id,
+             (unsigned long long)meta.timestamp_ns);
+    buf.append(text);
+    AppendJsonString(buf, meta.name);
+    snprintf(text, sizeof(text), ",\"w\":%d,\"h\":%d,\"status\":%d,\"dets\":[", meta.width, meta.height, meta.status);
+    buf.append(text);
+    for(int i=0;i<detections.Count();++i)
+    {
+        const Detection &det = detections[i];
+        snprintf(text, sizeof(text), "%s[%.1f,%.1f,%.1f,%.1f,%d,%.4f]", i > 0 ? "," : "", det.left, det.top,
+                 det.right, det.bottom, det.class_id, det.prob);
+        buf.append(text);
+    }
+    buf.append("]}\n");
+}
+
+/// @brief Binary records of a buffer as JSON lines, run on the writer thread so JSON costs the
+///        caller no more than a binary record.
+static void TranscodeJson(const std::string &records, std::string &json, std::string &name,
+                          std::vector<Detection> &detections)
+{
+    json.clear();
+    const char *data = records.data();
+    const char *end = data + records.size();
+    while(data + 4 + kRecordFixedBytes <= end)
+    {
+        const uint32_t payload = ReadPod<uint32_t>(data);
+        const char *fields = data + 4;
+        ResultMeta meta;
+        meta.frame_id = ReadPod<int64_t>(fields);
+        meta.timestamp_ns = ReadPod<uint64_t>(fields + 8);
+        meta.width = ReadPod<int32_t>(fields + 16);
+        meta.height = ReadPod<int32_t>(fields + 20);
+        meta.status = ReadPod<int32_t>(fields + 24);
+        const uint32_t det_num = ReadPod<uint32_t>(fields + 28);
+        const uint16_t name_len = ReadPod<uint16_t>(fields + 32);
+        name.assign(fields + kRecordFixedBytes, name_len);
+        meta.name = name.c_str();
+        detections.resize(det_num);
+        if(det_num > 0)
+        {
+            memcpy(detections.data(), fields + kRecordFixedBytes + name_len, det_num * kDetectionBytes);
+        }
+        EncodeJson(meta, DetectionSpan(detections.data(), det_num, false), json);
+        data += 4 + payload;
+    }
+}
+
+/// @brief mkdir -p.
+static int MakeDirs(const std::string &dir)
+{
+    if(dir.empty())
+    {
+        return 0;
+    }
+    struct stat buf;
+    if(stat(dir.c_str(), &buf) == 0)
+    {
+        return S_ISDIR(buf.st_mode) ? 0 : -1;
+    }
+    const size_t slash = dir.find_last_of('/');
+    if(slash != std::string::npos && slash > 0 && MakeDirs(dir.substr(0, slash)) != 0)
+    {
+        return -1;
+    }
+    return mkdir(dir.c_str(), 0755) == 0 || EEXIST == errno ? 0 : -1;
+}
+
+
+ResultWriter::ResultWriter(const ResultWriterConfig &config):
+    config_(config),
+    fd_(-1),
+    file_index_(-1),
+    file_bytes_(0),
+    opened_(false),
+    stop_(false),
+    failed_(false),
+    appended_(0),
+    front_records_(0),
+    written_(0),
+    flush_target_(0)
+{
+    memset(&stats_, 0, sizeof(stats_));
+    if(0 == config_.buffer_bytes)
+    {
+        config_.buffer_bytes = 1 << 16;
+    }
+    config_.max_pending_bytes = std::max(config_.max_pending_bytes, config_.buffer_bytes);
+    config_.flush_ms = std::max(1, config_.flush_ms);
+}
+
+
+ResultWriter::~ResultWriter()
+{
+    Close();
+}
+
+
+std::string ResultWriter::FilePath(const int &index) const
+{
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%06d.%s", index, RESULT_JSONL == config_.format ? "jsonl" : "bin");
+    return config_.path_prefix + suffix;
+}
+
+
+int ResultWriter::Open()
+{
+    if(opened_)
+    {
+        return -1;
+    }
+    const size_t slash = config_.path_prefix.find_last_of('/');
+    const std::string dir = slash == std::string::npos ? "." : config_.path_prefix.substr(0, std::max<size_t>(slash, 1));
+    const std::string base = slash == std::string::npos ? config_.path_prefix : config_.path_prefix.substr(slash + 1);
+    if(MakeDirs(dir) != 0)
+    {
+        return -2;
+    }
+
+    /// @brief Files of earlier runs, new files continue after the highest index.
+    file_indices_.clear();
+    const std::string ext = RESULT_JSONL == config_.format ? ".jsonl" : ".bin";
+    DIR *dir_handle = opendir(dir.c_str());
+    if(dir_handle != nullptr)
+    {
+        struct dirent *entry = nullptr;
+        while((entry = readdir(dir_handle)) != nullptr)
+        {
+            const std::string name = entry->d_name;
+            if(name.size() <= base.size() + 1 + ext.size() || name.compare(0, base.size() + 1, base + "_") != 0 ||
+               name.compare(name.size() - ext.size(), ext.size(), ext) != 0)
+            {
+                continue;
+            }
+            const std::string digits = name.substr(base.size() + 1, name.size() - base.size() - 1 - ext.size());
+            if(digits.find_first_not_of("0123456789") == std::string::npos)
+            {
+                file_indices_.push_back(atoi(digits.c_str()));
+            }
+        }
+        closedir(dir_handle);
+    }
+    std::sort(file_indices_.begin(), file_indices_.end());
+    file_index_ = file_indices_.empty() ? -1 : file_indices_.back();
+
+    stop_ = false;
+    failed_ = false;
+    if(OpenNextFile() != 0)
+    {
+        return -2;
+    }
+    front_.reserve(config_.buffer_bytes + (config_.buffer_bytes >> 2));
+    back_.reserve(front_.capacity());
+    opened_ = true;
+    writer_ = std::thread(&ResultWriter::WriterLoop, this);
+    return 0;
+}
+
+
+int ResultWriter::OpenNextFile()
+{
+    if(fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+    const int index = file_index_ + 1;
+    const std::string path = FilePath(index);
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd_ < 0)
+    {
+        printf("cannot open result file %s: %s\n", path.c_str(), strerror(errno));
+        return -1;
+    }
+    file_index_ = index;
+    file_indices_.push_back(index);
+    file_bytes_ = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        current_file_ = path;
+        stats_.files++;
+    }
+    ApplyRetention();
+    if(RESULT_BINARY == config_.format)
+    {
+        std::string header;
+        AppendPod(header, (uint32_t)RESULT_FILE_MAGIC);
+        AppendPod(header, (uint16_t)RESULT_FILE_VERSION);
+        AppendPod(header, (uint16_t)0);
+        return WriteAll(header.data(), header.size());
+    }
+    return 0;
+}
+
+
+void ResultWriter::ApplyRetention()
+{
+    while(config_.max_files > 0 && (int)file_indices_.size() > config_.max_files)
+    {
+        unlink(FilePath(file_indices_.front()).c_str());
+        file_indices_.erase(file_indices_.begin());
+    }
+}
+
+
+int ResultWriter::WriteAll(const char *data, const size_t &size)
+{
+    size_t done = 0;
+    while(done < size)
+    {
+        const ssize_t n = write(fd_, data + done, size - done);
+        if(n < 0)
+        {
+            if(EINTR == errno)
+            {
+                continue;
+            }
+            printf("result file write failed: %s\n", strerror(errno));
+            return -1;
+        }
+        done += n;
+    }
+    file_bytes_ += size;
+    return 0;
+}
+
+
+void ResultWriter::WriterLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;)
+    {
+        writer_cond_.wait_for(lock, std::chrono::milliseconds(config_.flush_ms), [this]() {
+            return stop_ || front_.size() >= config_.buffer_bytes || flush_target_ > written_;
+        });
+        if(front_.empty())
+        {
+            if(stop_)
+            {
+                break;
+            }
+            continue;
+        }
+        front_.swap(back_);
+        const int64_t records = front_records_;
+        front_records_ = 0;
+        space_cond_.notify_all();
+        lock.unlock();
+
+        const std::string *out = &back_;
+        if(RESULT_JSONL == config_.format)
+        {
+            TranscodeJson(back_, json_, json_name_, json_detections_);
+            out = &json_;
+        }
+        /// @brief Rotate between buffers, files always end on a whole record.
+        const uint64_t header_bytes = RESULT_BINARY == config_.format ? RESULT_FILE_HEADER_SIZE : 0;
+        int iret = 0;
+        if(config_.max_file_bytes > 0 && file_bytes_ > header_bytes && file_bytes_ + out->size() > config_.max_file_bytes)
+        {
+            iret = OpenNextFile();
+        }
+        if(0 == iret)
+        {
+            iret = WriteAll(out->data(), out->size());
+        }
+        const size_t bytes = out->size();
+        back_.clear();
+
+        lock.lock();
+        failed_ = failed_ || iret != 0;
+        written_ += records;
+        stats_.bytes += 0 == iret ? bytes : 0;
+        stats_.write_calls++;
+        written_cond_.notify_all();
+        space_cond_.notify_all();
+    }
+}
+
+
+int ResultWriter::Write(const ResultMeta &meta, const DetectionSpan &detections)
+{
+    /// @brief Encode outside the lock, callers on different threads only serialize on the append.
+    ///        Always binary, the writer thread turns it into JSON lines.
+    static thread_local std::string record;
+    record.clear();
+    ResultMeta stamped = meta;
+    if(0 == stamped.timestamp_ns)
+    {
+        stamped.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+    EncodeBinary(stamped, detections, record);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(!opened_ || stop_ || failed_)
+    {
+        return -1;
+    }
+    if(front_.size() >= config_.max_pending_bytes)
+    {
+        if(config_.drop_when_full)
+        {
+            stats_.dropped++;
+            return -2;
+        }
+        const auto time_start = std::chrono::steady_clock::now();
+        space_cond_.wait(lock, [this]() { return front_.size() < config_.max_pending_bytes || stop_ || failed_; });
+        stats_.blocked_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time_start).count();
+        if(stop_ || failed_)
+        {
+            return -1;
+        }
+    }
+    front_.append(record);
+    front_records_++;
+    appended_++;
+    stats_.records++;
+    stats_.max_pending = std::max(stats_.max_pending, front_.size());
+    if(front_.size() >= config_.buffer_bytes)
+    {
+        writer_cond_.notify_one();
+    }
+    return 0;
+}
+
+
+int ResultWriter::Flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(!opened_)
+    {
+        return -1;
+    }
+    flush_target_ = std::max(flush_target_, appended_);
+    const int64_t target = appended_;
+    writer_cond_.notify_one();
+    written_cond_.wait(lock, [this, target]() { return written_ >= target || failed_; });
+    return failed_ ? -1 : 0;
+}
+
+
+int ResultWriter::Close()
+{
+    if(!opened_)
+    {
+        return 0;
+    }
+    const int iret = Flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        writer_cond_.notify_all();
+        space_cond_.notify_all();
+    }
+    writer_.join();
+    if(fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+    opened_ = false;
+    return iret;
+}
+
+
+std::string ResultWriter::CurrentFile() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_file_;
+}
+
+
+ResultWriterStats ResultWriter::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+
+ResultReader::ResultReader():
+    fp_(nullptr)
+{
+}
+
+
+ResultReader::~ResultReader()
+{
+    Close();
+}
+
+
+int ResultReader::Open(const std::string &path)
+{
+    Close();
+    fp_ = fopen(path.c_str(), "rb");
+    if(nullptr == fp_)
+    {
+        return -1;
+    }
+    char header[RESULT_FILE_HEADER_SIZE];
+    if(fread(header, 1, sizeof(header), fp_) != sizeof(header) || ReadPod<uint32_t>(header) != RESULT_FILE_MAGIC ||
+       ReadPod<uint16_t>(header + 4) != RESULT_FILE_VERSION)
+    {
+        Close();
+        return -2;
+    }
+    return 0;
+}
+
+
+int ResultReader::Next(ResultRecord &record)
+{
+    if(nullptr == fp_)
+    {
+        return -1;
+    }
+    char size_bytes[4];
+    const size_t got = fread(size_bytes, 1, sizeof(size_bytes), fp_);
+    if(0 == got)
+    {
+        return 1;
+    }
+    const uint32_t payload = ReadPod<uint32_t>(size_bytes);
+    if(got != sizeof(size_bytes) || payload < kRecordFixedBytes)
+    {
+        return -1;
+    }
+    payload_.resize(payload);
+    if(fread(payload_.data(), 1, payload, fp_) != payload)
+    {
+        return -1;
+    }
+    const char *data = payload_.data();
+    record.frame_id = ReadPod<int64_t>(data);
+    record.timestamp_ns = ReadPod<uint64_t>(data + 8);
+    record.width = ReadPod<int32_t>(data + 16);
+    record.height = ReadPod<int32_t>(data + 20);
+    record.status = ReadPod<int32_t>(data + 24);
+    const uint32_t det_num = ReadPod<uint32_t>(data + 28);
+    const uint16_t name_len = ReadPod<uint16_t>(data + 32);
+    if(kRecordFixedBytes + name_len + (uint64_t)det_num * kDetectionBytes != payload)
+    {
+        return -1;
+    }
+    record.name.assign(data + kRecordFixedBytes, name_len);
+    record.detections.resize(det_num);
+    const char *det_data = data + kRecordFixedBytes + name_len;
+    for(uint32_t i=0;i<det_num;++i, det_data += kDetectionBytes)
+    {
+        Detection &det = record.detections[i];
+        det.left = ReadPod<float>(det_data);
+        det.top = ReadPod<float>(det_data + 4);
+        det.right = ReadPod<float>(det_data + 8);
+        det.bottom = ReadPod<float>(det_data + 12);
+        det.class_id = ReadPod<int32_t>(det_data + 16);
+        det.prob = ReadPod<float>(det_data + 20);
+    }
+    return 0;
+}
+
+
+void ResultReader::Close()
+{
+    if(fp_ != nullptr)
+    {
+        fclose(fp_);
+        fp_ = nullptr;
+    }
+}
+
+
+ResultWriterSink::ResultWriterSink(ResultWriter *writer):
+    writer_(writer)
+{
+}
+
+
+int ResultWriterSink::Write(const IngestItem &item, const int &status, const DetectionSpan &detections)
+{
+    ResultMeta meta;
+    meta.frame_id = item.index;
+    meta.timestamp_ns = 0;
+    meta.width = item.src_w;
+    meta.height = item.src_h;
+    meta.status = status;
+    meta.name = item.path.c_str();
+    return writer_->Write(meta, detections);
+}
+
+
+int ResultWriterSink::Flush()
+{
+    return writer_->Flush();
+}
+
+}
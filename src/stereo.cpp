@@ -0,0 +1,75 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     stereo.cpp
+*   Brief:    stereo left/right association src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/stereo.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace siran
+{
+
+StereoAssociator::StereoAssociator()
+{
+}
+
+
+int StereoAssociator::Run(const DetectionSpan &left, const DetectionSpan &right, const StereoConfig &config,
+                          std::vector<StereoPair> &pairs)
+{
+    pairs.clear();
+    candidates_.clear();
+    for(int l=0;l<left.Count();++l)
+    {
+        const Detection &a = left[l];
+        const float a_h = a.bottom - a.top;
+        for(int r=0;r<right.Count();++r)
+        {
+            const Detection &b = right[r];
+            if(a.class_id != b.class_id)
+            {
+                continue;
+            }
+            /// @brief Rectified views share rows, an object is at the same height on both.
+            const float row_diff = std::max(fabsf(a.top - b.top), fabsf(a.bottom - b.bottom));
+            const float b_h = b.bottom - b.top;
+            if(row_diff > config.max_row_diff || a_h <= 0.f || b_h <= 0.f ||
+               std::max(a_h, b_h) > config.max_height_ratio * std::min(a_h, b_h))
+            {
+                continue;
+            }
+            const float disparity = 0.5f * (a.left + a.right) - 0.5f * (b.left + b.right);
+            if(disparity < config.min_disparity || disparity > config.max_disparity)
+            {
+                continue;
+            }
+            const float cost = row_diff + fabsf(a_h - b_h) + config.disparity_weight * disparity;
+            StereoPair pair = {l, r, disparity, cost};
+            candidates_.push_back(pair);
+        }
+    }
+    std::stable_sort(candidates_.begin(), candidates_.end(), [](const StereoPair &a, const StereoPair &b) {
+        return a.cost < b.cost;
+    });
+    left_used_.assign(left.Count(), 0);
+    right_used_.assign(right.Count(), 0);
+    for(size_t i=0;i<candidates_.size();++i)
+    {
+        const StereoPair &pair = candidates_[i];
+        if(left_used_[pair.left] || right_used_[pair.right])
+        {
+            continue;
+        }
+        left_used_[pair.left] = 1;
+        right_used_[pair.right] = 1;
+        pairs.push_back(pair);
+    }
+    return (int)pairs.size();
+}
+
+}
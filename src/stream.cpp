@@ -0,0 +1,493 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     stream.cpp
+*   Brief:    streaming video pipeline src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/stream.h"
+#include "inc/trace.h"
+
+namespace siran
+{
+
+FramePacer::FramePacer(const double &fps):
+    period_ns_(fps > 0. ? 1e9 / fps : 0.),
+    next_ns_(0)
+{
+}
+
+
+void FramePacer::Wait()
+{
+    if(period_ns_ <= 0.)
+    {
+        return;
+    }
+    const uint64_t now = NowNs();
+    if(0 == next_ns_ || now > next_ns_ + (uint64_t)(period_ns_ * 4))
+    {
+        /// @brief First frame, or far behind(e.g. a slow disk), restart the schedule from now.
+        next_ns_ = now;
+    }
+    else if(next_ns_ > now)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(next_ns_ - now));
+    }
+    next_ns_ += (uint64_t)period_ns_;
+}
+
+
+CameraSource::CameraSource(const int &camera_index, const int &width, const int &height):
+    cap_(camera_index)
+{
+    if(width > 0)
+    {
+        cap_.set(cv::CAP_PROP_FRAME_WIDTH, width);
+    }
+    if(height > 0)
+    {
+        cap_.set(cv::CAP_PROP_FRAME_HEIGHT, height);
+    }
+}
+
+
+bool CameraSource::IsOpened() const
+{
+    return cap_.isOpened();
+}
+
+
+int CameraSource::Read(cv::Mat &frame)
+{
+    /// @brief A fresh Mat per frame, queued frames must not share the capture buffer.
+    cv::Mat image;
+    if(!cap_.isOpened() || !cap_.read(image) || image.empty())
+    {
+        return -1;
+    }
+    frame = image;
+    return 0;
+}
+
+
+VideoFileSource::VideoFileSource(const std::string &path, const double &fps, const bool &loop):
+    path_(path),
+    loop_(loop),
+    cap_(path),
+    pacer_(fps != 0. ? fps : 25.)
+{
+    if(0. == fps && cap_.isOpened() && cap_.get(cv::CAP_PROP_FPS) > 0.)
+    {
+        pacer_ = FramePacer(cap_.get(cv::CAP_PROP_FPS));
+    }
+}
+
+
+bool VideoFileSource::IsOpened() const
+{
+    return cap_.isOpened();
+}
+
+
+int VideoFileSource::Read(cv::Mat &frame)
+{
+    cv::Mat image;
+    if(!cap_.isOpened())
+    {
+        return -1;
+    }
+    if(!cap_.read(image) || image.empty())
+    {
+        if(!loop_ || !cap_.open(path_) || !cap_.read(image) || image.empty())
+        {
+            return -1;
+        }
+    }
+    pacer_.Wait();
+    frame = image;
+    return 0;
+}
+
+
+ImageListSource::ImageListSource(const std::vector<std::string> &paths, const double &fps, const bool &loop):
+    paths_(paths),
+    loop_(loop),
+    next_(0),
+    pacer_(fps)
+{
+}
+
+
+int ImageListSource::Read(cv::Mat &frame)
+{
+    /// @brief One pass over the list at most per call, so a list of unreadable files ends.
+    for(size_t tried=0;tried<paths_.size();++tried)
+    {
+        if(next_ >= paths_.size())
+        {
+            if(!loop_)
+            {
+                return -1;
+            }
+            next_ = 0;
+        }
+        cv::Mat image = cv::imread(paths_[next_++], cv::IMREAD_COLOR);
+        if(image.empty())
+        {
+            continue;
+        }
+        pacer_.Wait();
+        frame = image;
+        return 0;
+    }
+    return -1;
+}
+
+
+SyntheticSource::SyntheticSource(const int &width, const int &height, const double &fps, const int64_t &frame_num):
+    width_(width),
+    height_(height),
+    frame_num_(frame_num),
+    index_(0),
+    pacer_(fps)
+{
+}
+
+
+int SyntheticSource::Read(cv::Mat &frame)
+{
+    if(width_ <= 0 || height_ <= 0 || (frame_num_ >= 0 && index_ >= frame_num_))
+    {
+        return -1;
+    }
+    cv::Mat image(height_, width_, CV_8UC3, cv::Scalar(114, 114, 114));
+    const int box_w = std::max(width_ / 8, 1);
+    const int box_h = std::max(height_ / 6, 1);
+    for(int k=0;k<4;++k)
+    {
+        const int x = (int)((index_ * (3 + 2 * k) + k * width_ / 4) % std::max(width_ - box_w, 1));
+        const int y = (k * height_ / 5 + box_h / 2) % std::max(height_ - box_h, 1);
+        const cv::Scalar color(60 * k, 255 - 50 * k, 40 + 70 * k);
+        cv::rectangle(image, cv::Rect(x, y, box_w, box_h), color, -1);
+    }
+    index_++;
+    pacer_.Wait();
+    frame = image;
+    return 0;
+}
+
+
+void SplitViews(const cv::Mat &frame, const int &view_num, std::vector<cv::Mat> &views)
+{
+    views.clear();
+    const int num = view_num > 0 ? view_num : 1;
+    for(int i=0;i<num;++i)
+    {
+        const int begin = frame.cols / num * i;
+        const int end = (i == num - 1) ? frame.cols : frame.cols / num * (i + 1);
+        views.push_back(frame.colRange(begin, end));
+    }
+}
+
+
+StreamPipeline::StreamPipeline(IStreamDetector *detector, IFrameSource *source, const StreamConfig &config):
+    detector_(detector),
+    source_(source),
+    config_(config),
+    frames_(config.ring_capacity, true),
+    results_(config.result_capacity, false),
+    running_(false),
+    captured_(0),
+    dropped_(0),
+    inferred_(0),
+    delivered_(0),
+    failed_(0),
+    gate_skipped_(0),
+    gate_roi_(0),
+    gate_keyframes_(0),
+    latency_ns_(Histogram::ExponentialBounds(1e5, 1.1, 1e11))
+{
+}
+
+
+StreamPipeline::~StreamPipeline()
+{
+    Stop();
+}
+
+
+int StreamPipeline::Start(const StreamCallback &callback)
+{
+    if(running_ || capture_thread_.joinable() || !callback || nullptr == detector_ || nullptr == source_)
+    {
+        return -1;
+    }
+    callback_ = callback;
+    frames_.Reset();
+    results_.Reset();
+    running_ = true;
+    deliver_thread_ = std::thread(&StreamPipeline::DeliverLoop, this);
+    infer_thread_ = std::thread(&StreamPipeline::InferLoop, this);
+    capture_thread_ = std::thread(&StreamPipeline::CaptureLoop, this);
+    return 0;
+}
+
+
+void StreamPipeline::Wait()
+{
+    if(capture_thread_.joinable())
+    {
+        capture_thread_.join();
+    }
+    if(infer_thread_.joinable())
+    {
+        infer_thread_.join();
+    }
+    if(deliver_thread_.joinable())
+    {
+        deliver_thread_.join();
+    }
+    running_ = false;
+}
+
+
+void StreamPipeline::Stop()
+{
+    running_ = false;
+    Wait();
+}
+
+
+bool StreamPipeline::Running() const
+{
+    return running_;
+}
+
+
+StreamStats StreamPipeline::GetStats() const
+{
+    StreamStats stats;
+    stats.captured = captured_;
+    stats.dropped = dropped_;
+    stats.inferred = inferred_;
+    stats.delivered = delivered_;
+    stats.failed = failed_;
+    stats.gate_skipped = gate_skipped_;
+    stats.gate_roi = gate_roi_;
+    stats.gate_keyframes = gate_keyframes_;
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    stats.latency_mean_ns = latency_ns_.Mean();
+    stats.latency_p50_ns = latency_ns_.Percentile(0.5);
+    stats.latency_p99_ns = latency_ns_.Percentile(0.99);
+    stats.latency_max_ns = latency_ns_.Max();
+    return stats;
+}
+
+
+void StreamPipeline::CaptureLoop()
+{
+    int64_t seq = 0;
+    while(running_)
+    {
+        StreamFrame frame;
+        if(source_->Read(frame.image) != 0)
+        {
+            break;
+        }
+        frame.seq = seq++;
+        frame.timestamp_ns = NowNs();
+        captured_++;
+        if(1 == frames_.Push(std::move(frame)))
+        {
+            dropped_++;
+        }
+    }
+    frames_.Close();
+}
+
+
+/// @private function, the box overlaps one of rois.
+static bool IntersectsAny(const Detection &d, const std::vector<cv::Rect> &rois)
+{
+    for(size_t i=0;i<rois.size();++i)
+    {
+        if(d.left < rois[i].x + rois[i].width && d.right > rois[i].x && d.top < rois[i].y + rois[i].height && d.bottom > rois[i].y)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool StreamPipeline::GatedDetect(const cv::Mat &view, GateState &state, StreamResult &result)
+{
+    GateDecision &decision = state.decision;
+    if(state.gate.Update(view, decision) != 0)
+    {
+        decision.action = GATE_FULL;
+        decision.rois.clear();
+    }
+    result.gate = decision.action;
+    if(GATE_SKIP == decision.action)
+    {
+        result.status = state.status;
+        result.truncated = state.truncated;
+        result.detections = state.last;
+        gate_skipped_++;
+        return false;
+    }
+
+    DetectionSpan span;
+    result.truncated = false;
+    result.detections.clear();
+    if(GATE_FULL == decision.action)
+    {
+        result.status = detector_->Detect(view, &span);
+        result.truncated = span.Truncated();
+        result.detections.assign(span.begin(), span.end());
+        gate_keyframes_ += decision.keyframe ? 1 : 0;
+    }
+    else
+    {
+        /// @brief Boxes clear of every region are still and kept, a box touching a region may have
+        ///        moved and comes from the region detection instead, in frame pixels.
+        for(size_t i=0;i<state.last.size();++i)
+        {
+            if(!IntersectsAny(state.last[i], decision.rois))
+            {
+                result.detections.push_back(state.last[i]);
+            }
+        }
+        result.status = 0;
+        for(size_t r=0;r<decision.rois.size() && 0 == result.status;++r)
+        {
+            const cv::Rect &roi = decision.rois[r];
+            const int iret = detector_->Detect(view(roi), &span);
+            result.status = iret != 0 && iret != -999 ? iret : 0;
+            result.truncated = result.truncated || span.Truncated();
+            for(int i=0;i<span.Count();++i)
+            {
+                Detection d = span[i];
+                d.left += roi.x;
+                d.right += roi.x;
+                d.top += roi.y;
+                d.bottom += roi.y;
+                result.detections.push_back(d);
+            }
+        }
+        gate_roi_++;
+    }
+    if(0 == result.status && result.detections.empty())
+    {
+        result.status = -999;
+    }
+    if(result.status != 0 && result.status != -999)
+    {
+        /// @brief Nothing to reuse after a failure, the next frame of the view runs whole.
+        state.gate.Invalidate();
+        result.detections.clear();
+    }
+    state.status = result.status;
+    state.truncated = result.truncated;
+    state.last = result.detections;
+    return true;
+}
+
+
+void StreamPipeline::InferLoop()
+{
+    StreamFrame frame;
+    std::vector<cv::Mat> views;
+    std::vector<DetectionSpan> detections;
+    std::vector<int> status;
+    std::vector<GateState> gates;
+    std::vector<StereoPair> pairs;
+    while(0 == frames_.Pop(frame))
+    {
+        SplitViews(frame.image, config_.view_num, views);
+        const size_t view_num = views.size();
+        detections.assign(view_num, DetectionSpan());
+        status.assign(view_num, 0);
+        if(config_.gate.enable && gates.size() != view_num)
+        {
+            gates.resize(view_num);
+            for(size_t v=0;v<view_num;++v)
+            {
+                gates[v].gate = MotionGate(config_.gate);
+                gates[v].status = -999;
+                gates[v].truncated = false;
+            }
+        }
+        bool together = view_num > 1 && !config_.gate.enable;
+        for(size_t v=0;v<view_num && together;++v)
+        {
+            together = 0 != (config_.view_mask & (1u << v));
+        }
+        pairs.clear();
+        /// @brief Frames where the detector ran on some view, gated reuses alone do not count.
+        bool detected = false;
+        together = together && 0 == detector_->DetectViews(frame.image, views, detections.data(), status.data(), pairs);
+        for(size_t v=0;v<view_num;++v)
+        {
+            if(0 == (config_.view_mask & (1u << v)))
+            {
+                continue;
+            }
+            StreamResult result;
+            result.seq = frame.seq;
+            result.timestamp_ns = frame.timestamp_ns;
+            result.view = v;
+            result.gate = GATE_FULL;
+            if(config_.gate.enable)
+            {
+                detected = GatedDetect(views[v], gates[v], result) || detected;
+            }
+            else
+            {
+                if(!together)
+                {
+                    status[v] = detector_->Detect(views[v], &detections[v]);
+                }
+                detected = true;
+                result.status = status[v];
+                result.truncated = detections[v].Truncated();
+                result.detections.assign(detections[v].begin(), detections[v].end());
+                if(together && v + 1 == view_num)
+                {
+                    result.pairs = pairs;
+                }
+            }
+            result.infer_done_ns = NowNs();
+            if(result.status != 0 && result.status != -999)
+            {
+                failed_++;
+            }
+            results_.Push(std::move(result));
+        }
+        inferred_ += detected ? 1 : 0;
+        /// @brief Drop the frame reference now, the capture side allocates the next one.
+        frame.image.release();
+    }
+    results_.Close();
+}
+
+
+void StreamPipeline::DeliverLoop()
+{
+    StreamResult result;
+    while(0 == results_.Pop(result))
+    {
+        callback_(result);
+        const uint64_t latency = NowNs() - result.timestamp_ns;
+        {
+            std::lock_guard<std::mutex> lock(latency_mutex_);
+            latency_ns_.Add((double)latency);
+        }
+        delivered_++;
+    }
+}
+
+}
@@ -0,0 +1,194 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     tensor_dump.cpp
+*   Brief:    raw network output dump src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/tensor_dump.h"
+
+#include <string.h>
+
+namespace siran
+{
+
+static const char kTensorDumpMagic[4] = {'Y', '7', 'T', 'D'};
+
+
+TensorDumpWriter::TensorDumpWriter():
+    fp_(nullptr),
+    rows_(0),
+    row_len_(0),
+    frames_(0)
+{
+}
+
+
+TensorDumpWriter::~TensorDumpWriter()
+{
+    Close();
+}
+
+
+int TensorDumpWriter::Open(const std::string &path, const int &rows, const int &row_len)
+{
+    if(rows <= 0 || row_len <= 0)
+    {
+        return -2;
+    }
+    Close();
+    std::lock_guard<std::mutex> lock(mutex_);
+    fp_ = fopen(path.c_str(), "wb");
+    if(nullptr == fp_)
+    {
+        return -1;
+    }
+    TensorDumpHeader header;
+    memcpy(header.magic, kTensorDumpMagic, sizeof(header.magic));
+    header.version = kTensorDumpVersion;
+    header.rows = rows;
+    header.row_len = row_len;
+    if(fwrite(&header, sizeof(header), 1, fp_) != 1)
+    {
+        fclose(fp_);
+        fp_ = nullptr;
+        return -1;
+    }
+    rows_ = rows;
+    row_len_ = row_len;
+    frames_ = 0;
+    return 0;
+}
+
+
+int TensorDumpWriter::Write(const float *output, const int &src_w, const int &src_h)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(nullptr == fp_ || nullptr == output)
+    {
+        return -1;
+    }
+    TensorDumpFrame frame;
+    frame.src_w = src_w;
+    frame.src_h = src_h;
+    const size_t num = (size_t)rows_ * row_len_;
+    if(fwrite(&frame, sizeof(frame), 1, fp_) != 1 || fwrite(output, sizeof(float), num, fp_) != num)
+    {
+        return -1;
+    }
+    frames_++;
+    return 0;
+}
+
+
+void TensorDumpWriter::Close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(fp_)
+    {
+        fclose(fp_);
+        fp_ = nullptr;
+    }
+}
+
+
+bool TensorDumpWriter::IsOpen() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return fp_ != nullptr;
+}
+
+
+int64_t TensorDumpWriter::Frames() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return frames_;
+}
+
+
+TensorDumpReader::TensorDumpReader():
+    rows_(0),
+    row_len_(0),
+    frames_(0),
+    frame_bytes_(0)
+{
+}
+
+
+int TensorDumpReader::Open(const std::string &path)
+{
+    Close();
+    if(source_.Open(path) != 0)
+    {
+        return -1;
+    }
+    TensorDumpHeader header;
+    if(source_.Size() < sizeof(header))
+    {
+        Close();
+        return -2;
+    }
+    memcpy(&header, source_.Data(), sizeof(header));
+    if(memcmp(header.magic, kTensorDumpMagic, sizeof(header.magic)) != 0 || header.version != kTensorDumpVersion
+            || header.rows <= 0 || header.row_len <= 0)
+    {
+        Close();
+        return -2;
+    }
+    rows_ = header.rows;
+    row_len_ = header.row_len;
+    frame_bytes_ = sizeof(TensorDumpFrame) + (size_t)rows_ * row_len_ * sizeof(float);
+    frames_ = (source_.Size() - sizeof(header)) / frame_bytes_;
+    return 0;
+}
+
+
+void TensorDumpReader::Close()
+{
+    source_.Close();
+    rows_ = 0;
+    row_len_ = 0;
+    frames_ = 0;
+}
+
+
+int TensorDumpReader::Rows() const
+{
+    return rows_;
+}
+
+
+int TensorDumpReader::RowLen() const
+{
+    return row_len_;
+}
+
+
+int64_t TensorDumpReader::Frames() const
+{
+    return frames_;
+}
+
+
+const float* TensorDumpReader::Frame(const int64_t &i, int *src_w, int *src_h) const
+{
+    if(i < 0 || i >= frames_)
+    {
+        return nullptr;
+    }
+    const char *p = (const char*)source_.Data() + sizeof(TensorDumpHeader) + i * frame_bytes_;
+    TensorDumpFrame frame;
+    memcpy(&frame, p, sizeof(frame));
+    if(src_w)
+    {
+        *src_w = frame.src_w;
+    }
+    if(src_h)
+    {
+        *src_h = frame.src_h;
+    }
+    return (const float*)(p + sizeof(frame));
+}
+
+}
@@ -0,0 +1,115 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     thread_pool.cpp
+*   Brief:    fixed size worker pool src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/thread_pool.h"
+
+#include <algorithm>
+
+namespace siran
+{
+
+ThreadPool::ThreadPool(const int &thread_num):
+    stop_(false)
+{
+    int num = thread_num > 0 ? thread_num : (int)std::thread::hardware_concurrency();
+    num = std::max(1, num);
+    for(int i=0;i<num;++i)
+    {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for(size_t i=0;i<workers_.size();++i)
+    {
+        workers_[i].join();
+    }
+}
+
+
+int ThreadPool::Size() const
+{
+    return (int)workers_.size();
+}
+
+
+void ThreadPool::Submit(const std::function<void()> &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(task);
+    }
+    cond_.notify_one();
+}
+
+
+void ThreadPool::ParallelFor(const int &begin, const int &end, const std::function<void(int, int)> &func)
+{
+    const int total = end - begin;
+    if(total <= 0)
+    {
+        return;
+    }
+    const int bands = std::min(total, Size());
+    const int band_len = (total + bands - 1) / bands;
+
+    std::mutex done_mutex;
+    std::condition_variable done_cond;
+    int pending = 0;
+    int b = begin;
+    for(; b + band_len < end; b += band_len)
+    {
+        const int band_begin = b;
+        const int band_end = b + band_len;
+        {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            pending++;
+        }
+        Submit([&, band_begin, band_end]() {
+            func(band_begin, band_end);
+            std::lock_guard<std::mutex> lock(done_mutex);
+            if(--pending == 0)
+            {
+                done_cond.notify_one();
+            }
+        });
+    }
+    func(b, end);
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done_cond.wait(lock, [&pending]() { return pending == 0; });
+}
+
+
+void ThreadPool::WorkerLoop()
+{
+    while(true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if(stop_ && tasks_.empty())
+            {
+                return;
+            }
+            task = tasks_.front();
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+}
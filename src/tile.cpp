@@ -0,0 +1,226 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     tile.cpp
+*   Brief:    tiled inference planning and merge src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/tile.h"
+
+#include <algorithm>
+
+namespace siran
+{
+
+/// @private function, tile origins on one axis, first at 0 and last at length - tile.
+static void PlanAxis(const int &length, const int &tile, const int &min_overlap, std::vector<int> &starts, int &size)
+{
+    starts.clear();
+    if(length <= tile)
+    {
+        starts.push_back(0);
+        size = length;
+        return;
+    }
+    size = tile;
+    const int overlap = std::min(std::max(min_overlap, 0), tile - 1);
+    const int stride = tile - overlap;
+    const int num = (length - overlap + stride - 1) / stride;
+    /// @brief num tiles of stride cover length, spread the slack so every overlap is >= min_overlap.
+    for(int i=0;i<num;++i)
+    {
+        starts.push_back((int)((int64_t)i * (length - tile) / (num - 1)));
+    }
+}
+
+
+int PlanTiles(const int &frame_w, const int &frame_h, const TileConfig &config, std::vector<TileRect> &tiles)
+{
+    tiles.clear();
+    if(frame_w <= 0 || frame_h <= 0 || config.tile_w <= 0 || config.tile_h <= 0)
+    {
+        return 0;
+    }
+    std::vector<int> xs, ys;
+    int tile_w = 0, tile_h = 0;
+    PlanAxis(frame_w, config.tile_w, config.min_overlap, xs, tile_w);
+    PlanAxis(frame_h, config.tile_h, config.min_overlap, ys, tile_h);
+    for(size_t j=0;j<ys.size();++j)
+    {
+        for(size_t i=0;i<xs.size();++i)
+        {
+            TileRect tile = {xs[i], ys[j], tile_w, tile_h};
+            tiles.push_back(tile);
+        }
+    }
+    if(config.full_frame && tiles.size() > 1)
+    {
+        TileRect frame = {0, 0, frame_w, frame_h};
+        tiles.push_back(frame);
+    }
+    return (int)tiles.size();
+}
+
+
+static inline bool Intersects(const Detection &det, const TileRect &tile)
+{
+    return det.left < tile.x + tile.width && det.right > tile.x && det.top < tile.y + tile.height && det.bottom > tile.y;
+}
+
+
+/// @brief A box ending this close to an inner tile border is taken as cut by it.
+static const float kCutMargin = 4.f;
+
+
+/// @private function, box touches a border of its tile that is not a frame border.
+static inline bool CutByTile(const Detection &det, const TileRect &tile, const int &frame_w, const int &frame_h)
+{
+    return (tile.x > 0 && det.left <= tile.x + kCutMargin) ||
+           (tile.y > 0 && det.top <= tile.y + kCutMargin) ||
+           (tile.x + tile.width < frame_w && det.right >= tile.x + tile.width - kCutMargin) ||
+           (tile.y + tile.height < frame_h && det.bottom >= tile.y + tile.height - kCutMargin);
+}
+
+
+static inline float Iou(const Detection &a, const Detection &b)
+{
+    const float w = std::min(a.right, b.right) - std::max(a.left, b.left);
+    const float h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+    if(w <= 0.f || h <= 0.f)
+    {
+        return 0.f;
+    }
+    const float inter = w * h;
+    return inter / ((a.right - a.left) * (a.bottom - a.top) + (b.right - b.left) * (b.bottom - b.top) - inter);
+}
+
+
+/// @private function, intersection over the smaller box, a half box inside the whole one is 1.
+static inline float IntersectionOverSmaller(const Detection &a, const Detection &b)
+{
+    const float w = std::min(a.right, b.right) - std::max(a.left, b.left);
+    const float h = std::min(a.bottom, b.bottom) - std::max(a.top, b.top);
+    if(w <= 0.f || h <= 0.f)
+    {
+        return 0.f;
+    }
+    const float smaller = std::min((a.right - a.left) * (a.bottom - a.top), (b.right - b.left) * (b.bottom - b.top));
+    return smaller > 0.f ? w * h / smaller : 0.f;
+}
+
+
+TileMerger::TileMerger()
+{
+}
+
+
+int TileMerger::Run(const std::vector<TileRect> &tiles, const DetectionSpan *tile_dets, const float &match_thresh,
+                    std::vector<Detection> &merged)
+{
+    merged.clear();
+    boxes_.clear();
+    tile_of_.clear();
+    cut_.clear();
+    int frame_w = 0, frame_h = 0;
+    for(size_t t=0;t<tiles.size();++t)
+    {
+        frame_w = std::max(frame_w, tiles[t].x + tiles[t].width);
+        frame_h = std::max(frame_h, tiles[t].y + tiles[t].height);
+    }
+    for(size_t t=0;t<tiles.size();++t)
+    {
+        const TileRect &tile = tiles[t];
+        for(int k=0;k<tile_dets[t].Count();++k)
+        {
+            Detection det = tile_dets[t][k];
+            det.left += tile.x;
+            det.right += tile.x;
+            det.top += tile.y;
+            det.bottom += tile.y;
+            boxes_.push_back(det);
+            tile_of_.push_back((int)t);
+            cut_.push_back(CutByTile(det, tile, frame_w, frame_h) ? 1 : 0);
+        }
+    }
+
+    /// @brief Boxes inside their own tile only cannot have a duplicate, straight to the output.
+    seam_.clear();
+    for(size_t i=0;i<boxes_.size();++i)
+    {
+        bool seam = false;
+        for(size_t t=0;t<tiles.size() && !seam;++t)
+        {
+            seam = (int)t != tile_of_[i] && Intersects(boxes_[i], tiles[t]);
+        }
+        if(seam)
+        {
+            seam_.push_back((int)i);
+        }
+        else
+        {
+            merged.push_back(boxes_[i]);
+        }
+    }
+
+    std::stable_sort(seam_.begin(), seam_.end(), [this](const int &a, const int &b) {
+        return boxes_[a].prob > boxes_[b].prob;
+    });
+    alive_.assign(seam_.size(), 1);
+    for(size_t a=0;a<seam_.size();++a)
+    {
+        if(!alive_[a])
+        {
+            continue;
+        }
+        Detection &keep = boxes_[seam_[a]];
+        const int keep_tile = tile_of_[seam_[a]];
+        bool keep_cut = cut_[seam_[a]] != 0;
+        /// @brief keep grows as it absorbs cut halves, repeat until nothing more joins it.
+        bool grown = true;
+        while(grown)
+        {
+            grown = false;
+            for(size_t b=a+1;b<seam_.size();++b)
+            {
+                const Detection &other = boxes_[seam_[b]];
+                if(!alive_[b] || tile_of_[seam_[b]] == keep_tile || other.class_id != keep.class_id)
+                {
+                    continue;
+                }
+                /// @brief The same object seen twice is dropped. A part cut by a tile border joins
+                ///        the larger box it lies in, but a whole box is never joined, so a small
+                ///        object in front of a larger one of its class stays.
+                const float keep_area = (keep.right - keep.left) * (keep.bottom - keep.top);
+                const float other_area = (other.right - other.left) * (other.bottom - other.top);
+                const bool other_cut = cut_[seam_[b]] != 0;
+                const bool part = keep_area < other_area ? keep_cut : other_cut;
+                const bool same = Iou(keep, other) > match_thresh;
+                if(!same && !(part && IntersectionOverSmaller(keep, other) > match_thresh))
+                {
+                    continue;
+                }
+                alive_[b] = 0;
+                if(same && !part)
+                {
+                    continue;
+                }
+                const bool inside = other.left >= keep.left && other.top >= keep.top && other.right <= keep.right &&
+                                    other.bottom <= keep.bottom;
+                keep.left = std::min(keep.left, other.left);
+                keep.top = std::min(keep.top, other.top);
+                keep.right = std::max(keep.right, other.right);
+                keep.bottom = std::max(keep.bottom, other.bottom);
+                keep_cut = keep_cut && other_cut;
+                grown = grown || !inside;
+            }
+        }
+        merged.push_back(keep);
+    }
+    std::stable_sort(merged.begin(), merged.end(), [](const Detection &a, const Detection &b) {
+        return a.prob > b.prob;
+    });
+    return (int)merged.size();
+}
+
+}
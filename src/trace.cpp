@@ -0,0 +1,412 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     trace.cpp
+*   Brief:    stage level tracing src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace siran
+{
+
+static const char *kStageNames[TRACE_STAGE_NUM] = {"upload", "letterbox", "infer", "d2h", "decode", "nms", "draw"};
+
+/// @brief Spans kept per thread buffer for the chrome export, the oldest are overwritten.
+static const uint64_t kEventCapacity = 1 << 16;
+
+typedef struct TraceEvent_
+{
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    int stage;
+    int device;
+}TraceEvent;
+
+/// @brief Histograms and event ring of one thread. Only the owning thread writes, the relaxed
+///        atomics let TraceLatencies/TraceExportChrome read them without a lock.
+typedef struct ThreadTrace_
+{
+    int lane;
+    std::unique_ptr<std::atomic<int64_t>[]> counts;    // TRACE_STAGE_NUM x (bounds + 1)
+    std::atomic<uint64_t> sum_ns[TRACE_STAGE_NUM];
+    std::atomic<uint64_t> max_ns[TRACE_STAGE_NUM];
+    std::atomic<TraceEvent*> events;
+    std::atomic<uint64_t> head;
+}ThreadTrace;
+
+/// @brief 100ns ~ 100s, 5% wide buckets, p999 within one bucket.
+static const std::vector<double>& LatencyBounds()
+{
+    static const std::vector<double> bounds = Histogram::ExponentialBounds(100., 1.05, 1e11);
+    return bounds;
+}
+
+static std::atomic<int> g_trace_on(0);
+static std::atomic<int> g_trace_events(0);
+
+/// @brief Every buffer ever created, buffers of exited threads go to the free list and are
+///        reused by the next new thread, so short lived worker threads do not grow it.
+static std::mutex g_registry_mutex;
+static std::vector<ThreadTrace*> g_registry;
+static std::vector<ThreadTrace*> g_free_list;
+
+static ThreadTrace* AcquireThreadTrace()
+{
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    if(!g_free_list.empty())
+    {
+        ThreadTrace *trace = g_free_list.back();
+        g_free_list.pop_back();
+        return trace;
+    }
+    const size_t bucket_num = LatencyBounds().size() + 1;
+    ThreadTrace *trace = new ThreadTrace;
+    trace->lane = g_registry.size() + 1;
+    trace->counts.reset(new std::atomic<int64_t>[TRACE_STAGE_NUM * bucket_num]);
+    for(size_t i=0;i<TRACE_STAGE_NUM * bucket_num;++i)
+    {
+        trace->counts[i].store(0, std::memory_order_relaxed);
+    }
+    for(int s=0;s<TRACE_STAGE_NUM;++s)
+    {
+        trace->sum_ns[s].store(0, std::memory_order_relaxed);
+        trace->max_ns[s].store(0, std::memory_order_relaxed);
+    }
+    trace->events.store(nullptr, std::memory_order_relaxed);
+    trace->head.store(0, std::memory_order_relaxed);
+    g_registry.push_back(trace);
+    return trace;
+}
+
+/// @brief Gives the buffer back when its thread exits, counts stay in the merged results.
+class ThreadTraceHolder
+{
+public:
+    ThreadTraceHolder(): trace(AcquireThreadTrace())
+    {
+    }
+    ~ThreadTraceHolder()
+    {
+        std::lock_guard<std::mutex> lock(g_registry_mutex);
+        g_free_list.push_back(trace);
+    }
+    ThreadTrace *trace;
+};
+
+static ThreadTrace* LocalThreadTrace()
+{
+    static thread_local ThreadTraceHolder holder;
+    return holder.trace;
+}
+
+/// @brief Single writer, a plain load and store instead of a locked read-modify-write.
+template<typename T>
+static inline void RelaxedAdd(std::atomic<T> &value, const T &add)
+{
+    value.store(value.load(std::memory_order_relaxed) + add, std::memory_order_relaxed);
+}
+
+
+const char* TraceStageName(const int &stage)
+{
+    if(stage < 0 || stage >= TRACE_STAGE_NUM)
+    {
+        return "none";
+    }
+    return kStageNames[stage];
+}
+
+
+void TraceEnable(const bool &enable, const bool &events)
+{
+    g_trace_events.store(enable && events ? 1 : 0, std::memory_order_relaxed);
+    g_trace_on.store(enable ? 1 : 0, std::memory_order_release);
+}
+
+
+bool TraceEnabled()
+{
+    return g_trace_on.load(std::memory_order_relaxed) != 0;
+}
+
+
+void TraceRecord(const int &stage, const uint64_t &start_ns, const uint64_t &end_ns, const bool &device)
+{
+    if(!TraceEnabled() || stage < 0 || stage >= TRACE_STAGE_NUM)
+    {
+        return;
+    }
+    ThreadTrace *trace = LocalThreadTrace();
+    const uint64_t dur_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+    const std::vector<double> &bounds = LatencyBounds();
+    const size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), (double)dur_ns) - bounds.begin();
+    RelaxedAdd<int64_t>(trace->counts[stage * (bounds.size() + 1) + bucket], 1);
+    RelaxedAdd<uint64_t>(trace->sum_ns[stage], dur_ns);
+    if(dur_ns > trace->max_ns[stage].load(std::memory_order_relaxed))
+    {
+        trace->max_ns[stage].store(dur_ns, std::memory_order_relaxed);
+    }
+
+    if(0 == g_trace_events.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    TraceEvent *events = trace->events.load(std::memory_order_acquire);
+    if(nullptr == events)
+    {
+        events = new TraceEvent[kEventCapacity];
+        trace->events.store(events, std::memory_order_release);
+    }
+    const uint64_t head = trace->head.load(std::memory_order_relaxed);
+    TraceEvent &event = events[head & (kEventCapacity - 1)];
+    event.start_ns = start_ns;
+    event.dur_ns = dur_ns;
+    event.stage = stage;
+    event.device = device ? 1 : 0;
+    trace->head.store(head + 1, std::memory_order_release);
+}
+
+
+Histogram TraceHistogram(const int &stage)
+{
+    const std::vector<double> &bounds = LatencyBounds();
+    Histogram histogram(bounds);
+    if(stage < 0 || stage >= TRACE_STAGE_NUM)
+    {
+        return histogram;
+    }
+    const size_t bucket_num = bounds.size() + 1;
+    std::vector<int64_t> counts(bucket_num);
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    for(size_t t=0;t<g_registry.size();++t)
+    {
+        const ThreadTrace *trace = g_registry[t];
+        for(size_t i=0;i<bucket_num;++i)
+        {
+            counts[i] = trace->counts[stage * bucket_num + i].load(std::memory_order_relaxed);
+        }
+        histogram.Merge(counts, trace->sum_ns[stage].load(std::memory_order_relaxed),
+                        trace->max_ns[stage].load(std::memory_order_relaxed));
+    }
+    return histogram;
+}
+
+
+std::vector<StageLatency> TraceLatencies()
+{
+    std::vector<StageLatency> latencies;
+    for(int s=0;s<TRACE_STAGE_NUM;++s)
+    {
+        const Histogram histogram = TraceHistogram(s);
+        if(histogram.Count() == 0)
+        {
+            continue;
+        }
+        StageLatency latency;
+        latency.stage = s;
+        latency.count = histogram.Count();
+        latency.mean_ns = histogram.Mean();
+        latency.p50_ns = histogram.Percentile(0.5);
+        latency.p99_ns = histogram.Percentile(0.99);
+        latency.p999_ns = histogram.Percentile(0.999);
+        latency.max_ns = histogram.Max();
+        latencies.push_back(latency);
+    }
+    return latencies;
+}
+
+
+void TraceReset()
+{
+    const size_t bucket_num = LatencyBounds().size() + 1;
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    for(size_t t=0;t<g_registry.size();++t)
+    {
+        ThreadTrace *trace = g_registry[t];
+        for(size_t i=0;i<TRACE_STAGE_NUM * bucket_num;++i)
+        {
+            trace->counts[i].store(0, std::memory_order_relaxed);
+        }
+        for(int s=0;s<TRACE_STAGE_NUM;++s)
+        {
+            trace->sum_ns[s].store(0, std::memory_order_relaxed);
+            trace->max_ns[s].store(0, std::memory_order_relaxed);
+        }
+        trace->head.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+int TraceExportChrome(const std::string &path)
+{
+    FILE *fp = fopen(path.c_str(), "w");
+    if(nullptr == fp)
+    {
+        return -1;
+    }
+    fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"host\"}},\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"device\"}}");
+    std::lock_guard<std::mutex> lock(g_registry_mutex);
+    for(size_t t=0;t<g_registry.size();++t)
+    {
+        const ThreadTrace *trace = g_registry[t];
+        const TraceEvent *events = trace->events.load(std::memory_order_acquire);
+        if(nullptr == events)
+        {
+            continue;
+        }
+        /// @brief Spans written while exporting may replace the oldest ones being read.
+        const uint64_t head = trace->head.load(std::memory_order_acquire);
+        const uint64_t begin = head > kEventCapacity ? head - kEventCapacity : 0;
+        for(uint64_t i=begin;i<head;++i)
+        {
+            const TraceEvent &event = events[i & (kEventCapacity - 1)];
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    TraceStageName(event.stage), event.device ? 2 : 1, trace->lane,
+                    event.start_ns / 1000., event.dur_ns / 1000.);
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return 0;
+}
+
+
+TraceSpan::TraceSpan(const int &stage, uint64_t *elapsed_ns):
+    stage_(stage),
+    elapsed_ns_(elapsed_ns),
+    start_ns_(0)
+{
+    if(elapsed_ns_ || TraceEnabled())
+    {
+        start_ns_ = NowNs();
+    }
+}
+
+
+TraceSpan::~TraceSpan()
+{
+    if(0 == start_ns_)
+    {
+        return;
+    }
+    const uint64_t end_ns = NowNs();
+    if(elapsed_ns_)
+    {
+        *elapsed_ns_ = end_ns - start_ns_;
+    }
+    TraceRecord(stage_, start_ns_, end_ns);
+}
+
+
+DeviceTracer::DeviceTracer():
+    active_(false),
+    marks_(0)
+{
+    for(int i=0;i<kMaxMarks;++i)
+    {
+        events_[i] = nullptr;
+        stages_[i] = TRACE_NONE;
+    }
+    memset(stage_ns_, 0, sizeof(stage_ns_));
+}
+
+
+DeviceTracer::~DeviceTracer()
+{
+    for(int i=0;i<kMaxMarks;++i)
+    {
+        if(events_[i])
+        {
+            cudaEventDestroy(events_[i]);
+        }
+    }
+}
+
+
+void DeviceTracer::Begin(cudaStream_t stream, const bool &force)
+{
+    marks_ = 0;
+    active_ = force || TraceEnabled();
+    if(active_)
+    {
+        Mark(TRACE_NONE, stream);
+    }
+}
+
+
+void DeviceTracer::Mark(const int &stage, cudaStream_t stream)
+{
+    if(!active_ || marks_ >= kMaxMarks)
+    {
+        return;
+    }
+    /// @brief Timing events are created on first use, instances that never trace have none.
+    if(nullptr == events_[marks_] && cudaEventCreate(&events_[marks_]) != cudaSuccess)
+    {
+        events_[marks_] = nullptr;
+        return;
+    }
+    cudaEventRecord(events_[marks_], stream);
+    stages_[marks_] = stage;
+    marks_++;
+}
+
+
+int DeviceTracer::End()
+{
+    memset(stage_ns_, 0, sizeof(stage_ns_));
+    if(!active_ || marks_ < 2)
+    {
+        active_ = false;
+        return -1;
+    }
+    active_ = false;
+    const cudaEvent_t last = events_[marks_ - 1];
+    cudaEventSynchronize(last);
+    /// @brief The last mark has just completed, device spans are dated back from host now.
+    const uint64_t end_ns = NowNs();
+    for(int i=1;i<marks_;++i)
+    {
+        if(stages_[i] < 0)
+        {
+            continue;
+        }
+        float span_ms = 0.f, to_last_ms = 0.f;
+        cudaEventElapsedTime(&span_ms, events_[i - 1], events_[i]);
+        cudaEventElapsedTime(&to_last_ms, events_[i - 1], last);
+        const uint64_t span_ns = span_ms * 1e6;
+        const uint64_t start_ns = end_ns - (uint64_t)(to_last_ms * 1e6);
+        stage_ns_[stages_[i]] += span_ns;
+        TraceRecord(stages_[i], start_ns, start_ns + span_ns, true);
+    }
+    return 0;
+}
+
+
+bool DeviceTracer::Active() const
+{
+    return active_;
+}
+
+
+uint64_t DeviceTracer::StageNs(const int &stage) const
+{
+    if(stage < 0 || stage >= TRACE_STAGE_NUM)
+    {
+        return 0;
+    }
+    return stage_ns_[stage];
+}
+
+}
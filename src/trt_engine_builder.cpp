@@ -0,0 +1,221 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     trt_engine_builder.cpp
+*   Brief:    TensorRT engine builder src code, ONNX to a serialized engine with precision,
+*             optimization profiles and a reusable timing cache.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/engine_cache.h"
+#include "inc/common.hpp"
+
+#include <stdio.h>
+#include <NvInfer.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+namespace siran
+{
+
+static nvinfer1::Dims ToDims(const std::vector<int> &values)
+{
+    nvinfer1::Dims dims;
+    dims.nbDims = std::min((int)values.size(), (int)nvinfer1::Dims::MAX_DIMS);
+    for(int i=0;i<dims.nbDims;++i)
+    {
+        dims.d[i] = values[i];
+    }
+    return dims;
+}
+
+
+/**
+ * @brief AutoProfiles -- Profiles of the network inputs when none are given, a dynamic batch
+ *        becomes 1/max_batch/max_batch, any other dynamic dim needs an explicit profile.
+ * @return             -- 0--success, -2--input with dynamic dims other than batch
+ */
+static int AutoProfiles(nvinfer1::INetworkDefinition *network, const int &max_batch, std::vector<EngineProfile> &profiles)
+{
+    for(int i=0;i<network->getNbInputs();++i)
+    {
+        nvinfer1::ITensor *input = network->getInput(i);
+        const nvinfer1::Dims dims = input->getDimensions();
+        bool dynamic_batch = false;
+        for(int d=0;d<dims.nbDims;++d)
+        {
+            if(dims.d[d] >= 0)
+            {
+                continue;
+            }
+            if(d != 0)
+            {
+                printf("input %s has dynamic dim %d, give an optimization profile\n", input->getName(), d);
+                return -2;
+            }
+            dynamic_batch = true;
+        }
+        if(!dynamic_batch)
+        {
+            continue;
+        }
+        EngineProfile profile;
+        profile.input_name = input->getName();
+        for(int d=0;d<dims.nbDims;++d)
+        {
+            profile.min_dims.push_back(d ? dims.d[d] : 1);
+            profile.opt_dims.push_back(d ? dims.d[d] : std::max(max_batch, 1));
+        }
+        profile.max_dims = profile.opt_dims;
+        profiles.push_back(profile);
+    }
+    return 0;
+}
+
+
+TrtEngineBuilder::TrtEngineBuilder(const int &device_id):
+    device_id_(device_id)
+{
+}
+
+
+EnginePlatform TrtEngineBuilder::Platform() const
+{
+    EnginePlatform platform;
+    platform.gpu_name = "unknown";
+    platform.sm_major = 0;
+    platform.sm_minor = 0;
+    platform.trt_version = getInferLibVersion();
+    const std::vector<CudaDeviceInfo> &devices = CudaDevices();
+    if(device_id_ >= 0 && device_id_ < (int)devices.size())
+    {
+        platform.gpu_name = devices[device_id_].name;
+        platform.sm_major = devices[device_id_].sm_major;
+        platform.sm_minor = devices[device_id_].sm_minor;
+    }
+    return platform;
+}
+
+
+int TrtEngineBuilder::Build(const EngineBuildConfig &config, std::string &timing_cache, const std::string &engine_file)
+{
+    if(SetCudaDevice(device_id_) != 0)
+    {
+        return -2;
+    }
+    /// @brief TRT 8 objects are released with delete.
+    std::unique_ptr<nvinfer1::IBuilder> builder(nvinfer1::createInferBuilder(gLogger.getTRTLogger()));
+    const auto explicit_batch = 1U << static_cast<uint32_t>(nvinfer1::NetworkDefinitionCreationFlag::kEXPLICIT_BATCH);
+    std::unique_ptr<nvinfer1::INetworkDefinition> network(builder->createNetworkV2(explicit_batch));
+    std::unique_ptr<nvinfer1::IBuilderConfig> build_config(builder->createBuilderConfig());
+    std::unique_ptr<nvonnxparser::IParser> parser(nvonnxparser::createParser(*network, gLogger.getTRTLogger()));
+    if(!parser->parseFromFile(config.onnx_file.c_str(), static_cast<int>(nvinfer1::ILogger::Severity::kWARNING)))
+    {
+        for(int i=0;i<parser->getNbErrors();++i)
+        {
+            printf("onnx parse error: %s\n", parser->getError(i)->desc());
+        }
+        return -1;
+    }
+
+    build_config->setMemoryPoolLimit(nvinfer1::MemoryPoolType::kWORKSPACE, (size_t)config.workspace_mb << 20);
+    if(PRECISION_FP16 == config.precision || PRECISION_INT8 == config.precision)
+    {
+        if(!builder->platformHasFastFp16())
+        {
+            printf("warning: no fast fp16 on this gpu\n");
+        }
+        build_config->setFlag(nvinfer1::BuilderFlag::kFP16);
+    }
+    if(PRECISION_INT8 == config.precision)
+    {
+        if(!builder->platformHasFastInt8() || nullptr == config.calibrator)
+        {
+            printf("int8 needs a gpu with fast int8 and a calibrator\n");
+            return -2;
+        }
+        build_config->setFlag(nvinfer1::BuilderFlag::kINT8);
+        build_config->setInt8Calibrator(config.calibrator);
+    }
+
+    std::vector<EngineProfile> profiles = config.profiles;
+    if(profiles.empty() && AutoProfiles(network.get(), config.max_batch, profiles) != 0)
+    {
+        return -2;
+    }
+    if(!profiles.empty())
+    {
+        /// @brief One profile for all inputs, owned by the builder.
+        nvinfer1::IOptimizationProfile *profile = builder->createOptimizationProfile();
+        for(size_t i=0;i<profiles.size();++i)
+        {
+            const char *name = profiles[i].input_name.c_str();
+            if(!profile->setDimensions(name, nvinfer1::OptProfileSelector::kMIN, ToDims(profiles[i].min_dims))
+               || !profile->setDimensions(name, nvinfer1::OptProfileSelector::kOPT, ToDims(profiles[i].opt_dims))
+               || !profile->setDimensions(name, nvinfer1::OptProfileSelector::kMAX, ToDims(profiles[i].max_dims)))
+            {
+                printf("invalid optimization profile for input %s\n", name);
+                return -2;
+            }
+        }
+        if(!profile->isValid() || build_config->addOptimizationProfile(profile) < 0)
+        {
+            printf("invalid optimization profile\n");
+            return -2;
+        }
+        if(PRECISION_INT8 == config.precision)
+        {
+            build_config->setCalibrationProfile(profile);
+        }
+    }
+
+    /// @brief A timing cache from an earlier build skips the tactic timing it already did.
+    std::unique_ptr<nvinfer1::ITimingCache> cache(build_config->createTimingCache(timing_cache.data(), timing_cache.size()));
+    if(cache == nullptr || !build_config->setTimingCache(*cache, false))
+    {
+        printf("warning: timing cache rejected, build without it\n");
+    }
+
+    std::unique_ptr<nvinfer1::IHostMemory> plan(builder->buildSerializedNetwork(*network, *build_config));
+    if(plan == nullptr)
+    {
+        return -3;
+    }
+    std::ofstream file(engine_file, std::ios::binary | std::ios::out | std::ios::trunc);
+    file.write((const char*)plan->data(), plan->size());
+    file.close();
+    if(!file.good())
+    {
+        printf("write engine file error: %s\n", engine_file.c_str());
+        return -3;
+    }
+    if(cache != nullptr)
+    {
+        std::unique_ptr<nvinfer1::IHostMemory> data(cache->serialize());
+        if(data != nullptr)
+        {
+            timing_cache.assign((const char*)data->data(), data->size());
+        }
+    }
+    return 0;
+}
+
+
+int GetCachedEngine(const std::string &onnx_file, const int &device_id, std::string &engine_file,
+                    const int &precision, const int &max_batch)
+{
+    TrtEngineBuilder builder(device_id);
+    EngineCacheConfig cache_config = DefaultEngineCacheConfig();
+    const size_t slash = onnx_file.find_last_of('/');
+    cache_config.cache_dir = (slash == std::string::npos ? std::string(".") : onnx_file.substr(0, slash)) + "/engine_cache";
+    EngineCache cache(&builder, cache_config);
+
+    EngineBuildConfig build = DefaultEngineBuildConfig();
+    build.onnx_file = onnx_file;
+    build.precision = precision;
+    build.max_batch = max_batch;
+    return cache.GetEngine(build, engine_file);
+}
+
+}
@@ -0,0 +1,276 @@
+/* * * * * * * * * * * * * * * * * * * * *
+*   File:     yolov7_backend.cpp
+*   Brief:    InferServer backend over Yolov7Trt instances src code.
+*   Author:   hewen
+*   Company:  SIRAN
+*   E-mail:   senlin0901@gmail.com
+*   Time:     2022/07/13
+* * * * * * * * * * * * * * * * * * * * * */
+#include "inc/yolov7_backend.h"
+
+#include <iostream>
+
+namespace siran
+{
+
+Yolov7Backend::Yolov7Backend(const std::string &engine_file, const int &instance_num, const int &iDeviceID)
+{
+    /// @brief First instance deserializes the engine, the others only add a context.
+    Yolov7Trt *owner = new Yolov7Trt(engine_file, iDeviceID);
+    instances_.push_back(owner);
+    stereo_.resize(1);
+    if(owner->InitStatus() != 0)
+    {
+        /// @brief One instance that is not ready, every request fails with -1.
+        std::cout << engine_file << " on gpu " << iDeviceID << " not ready, code " << owner->InitStatus() << std::endl;
+        return;
+    }
+    for(int i=1;i<instance_num;++i)
+    {
+        Yolov7Trt *instance = owner->CreateInstance();
+        if(nullptr == instance || instance->InitStatus() != 0)
+        {
+            std::cout << engine_file << " on gpu " << iDeviceID << " instance " << i << " not ready" << std::endl;
+            delete instance;
+            break;
+        }
+        instances_.push_back(instance);
+    }
+    stereo_.resize(instances_.size());
+}
+
+
+Yolov7Backend::~Yolov7Backend()
+{
+    /// @brief Owner last, the other instances run on its engine.
+    for(size_t i=instances_.size();i>0;--i)
+    {
+        delete instances_[i-1];
+    }
+    instances_.clear();
+}
+
+
+int Yolov7Backend::NumInstances() const
+{
+    return (int)instances_.size();
+}
+
+
+int Yolov7Backend::InitStatus() const
+{
+    return instances_[0]->InitStatus();
+}
+
+
+int Yolov7Backend::Run(const int &instance, InferTask *task)
+{
+    if(instance < 0 || instance >= (int)instances_.size() || nullptr == task || nullptr == task->payload)
+    {
+        return -1;
+    }
+    Yolov7Request *request = (Yolov7Request*)task->payload;
+    if(request->srcs.empty())
+    {
+        return -1;
+    }
+    Yolov7Trt *trt = instances_[instance];
+    if(REQUEST_TILED == request->mode)
+    {
+        request->results.resize(1);
+        request->results[0].obj_num = 0;
+        DetectionSpan detections;
+        const int iret = trt->Yolov7DetectTiled(request->srcs[0], &detections, DefaultTileConfig(), request->verbos);
+        return iret != 0 ? iret : ToObjResult(detections, &request->results[0]);
+    }
+    if(REQUEST_STEREO == request->mode)
+    {
+        return RunStereo(trt, stereo_[instance], request);
+    }
+    if(request->srcs.size() == 1)
+    {
+        request->results.resize(1);
+        const std::string *name = request->name.empty() ? nullptr : &request->name;
+        return trt->Yolov7Infer(request->srcs[0], &request->results[0], name, request->verbos);
+    }
+    return trt->Yolov7InferBatch(request->srcs, request->results, request->verbos);
+}
+
+
+/**
+ * @brief Yolov7Backend::RunStereo -- Both views through Yolov7DetectStereo. The pairs come from the
+ *        float boxes in view pixels, then their indices move to the exported obj_info entries. A
+ *        pair with a box beyond YOLOV7_MAX_OBJ_NUM is not exported.
+ */
+int Yolov7Backend::RunStereo(Yolov7Trt *trt, StereoState &state, Yolov7Request *request)
+{
+    request->results.resize(2);
+    request->results[0].obj_num = 0;
+    request->results[1].obj_num = 0;
+    request->pairs.clear();
+    DetectionSpan views[2];
+    const int iret = trt->Yolov7DetectStereo(request->srcs[0], &views[0], &views[1], request->verbos);
+    if(iret != 0)
+    {
+        return iret;
+    }
+    int source[YOLOV7_MAX_OBJ_NUM];
+    for(int v=0;v<2;++v)
+    {
+        ToObjResult(views[v], &request->results[v], source);
+        state.slots[v].assign(views[v].Count(), -1);
+        for(int k=0;k<request->results[v].obj_num;++k)
+        {
+            state.slots[v][source[k]] = k;
+        }
+    }
+    if(!request->associate)
+    {
+        return 0;
+    }
+    state.associator.Run(views[0], views[1], request->stereo, state.pairs);
+    for(size_t i=0;i<state.pairs.size();++i)
+    {
+        StereoPair pair = state.pairs[i];
+        pair.left = state.slots[0][pair.left];
+        pair.right = state.slots[1][pair.right];
+        if(pair.left >= 0 && pair.right >= 0)
+        {
+            request->pairs.push_back(pair);
+        }
+    }
+    return 0;
+}
+
+
+Yolov7BatchBackend::Yolov7BatchBackend(Yolov7Trt *trt):
+    trt_(trt)
+{
+}
+
+
+std::vector<int> Yolov7BatchBackend::BatchSizes() const
+{
+    return trt_->GetBatchSizes();
+}
+
+
+int Yolov7BatchBackend::RunBatch(const std::vector<void*> &payloads, const int &profile_batch, std::vector<int> &status)
+{
+    /// @brief The input shape follows payloads.size(), no padding up to the profile batch.
+    (void)profile_batch;
+    status.assign(payloads.size(), -1);
+    std::vector<cv::Mat> srcs(payloads.size());
+    for(size_t i=0;i<payloads.size();++i)
+    {
+        Yolov7Request *request = (Yolov7Request*)payloads[i];
+        if(nullptr == request || request->srcs.size() != 1)
+        {
+            return -1;
+        }
+        srcs[i] = request->srcs[0];
+    }
+    std::vector<ObjResult> results;
+    int iret = trt_->Yolov7InferBatch(srcs, results, false);
+    if(iret != 0)
+    {
+        return iret;
+    }
+    for(size_t i=0;i<payloads.size();++i)
+    {
+        Yolov7Request *request = (Yolov7Request*)payloads[i];
+        request->results.assign(1, results[i]);
+        /// @brief Same convention as Yolov7Infer, a frame without objects is -999.
+        status[i] = results[i].obj_num > 0 ? 0 : -999;
+    }
+    return 0;
+}
+
+
+Yolov7DeviceGroup::Yolov7DeviceGroup(const std::string &engine_file, const std::vector<int> &device_ids,
+                                     const int &instance_num, const int &queue_capacity):
+    group_(DISPATCH_LEAST_OUTSTANDING, queue_capacity)
+{
+    const std::vector<CudaDeviceInfo> &devices = CudaDevices();
+    std::vector<int> ids = device_ids;
+    if(ids.empty())
+    {
+        for(size_t i=0;i<devices.size();++i)
+        {
+            ids.push_back(devices[i].id);
+        }
+    }
+    for(size_t i=0;i<ids.size();++i)
+    {
+        if(ids[i] < 0 || ids[i] >= (int)devices.size())
+        {
+            std::cout << "gpu " << ids[i] << " not found, " << devices.size() << " device(s)" << std::endl;
+            continue;
+        }
+        /// @brief The engine file is mmapped, replicas share its page cache instead of a copy per process.
+        Yolov7Backend *backend = new Yolov7Backend(engine_file, instance_num, ids[i]);
+        if(backend->InitStatus() != 0)
+        {
+            delete backend;
+            continue;
+        }
+        backends_.push_back(backend);
+        group_.AddDevice(ids[i], backend, devices[ids[i]].numa_node);
+    }
+}
+
+
+Yolov7DeviceGroup::~Yolov7DeviceGroup()
+{
+    group_.Stop();
+    for(size_t i=0;i<backends_.size();++i)
+    {
+        delete backends_[i];
+    }
+    backends_.clear();
+}
+
+
+int Yolov7DeviceGroup::Start()
+{
+    return group_.Start();
+}
+
+
+void Yolov7DeviceGroup::Stop()
+{
+    group_.Stop();
+}
+
+
+int Yolov7DeviceGroup::Run(Yolov7Request &request)
+{
+    InferTask task;
+    task.payload = &request;
+    task.status = 0;
+    return group_.Run(&task);
+}
+
+
+DeviceGroup& Yolov7DeviceGroup::Group()
+{
+    return group_;
+}
+
+
+Yolov7StreamDetector::Yolov7StreamDetector(Yolov7Trt *trt):
+    trt_(trt)
+{
+}
+
+
+int Yolov7StreamDetector::Detect(const cv::Mat &view, DetectionSpan *detections)
+{
+    if(nullptr == trt_)
+    {
+        return -1;
+    }
+    return trt_->Yolov7Detect(view, detections);
+}
+
+}
@@ -8,36 +8,68 @@
 * * * * * * * * * * * * * * * * * * * * * */
 #include "inc/yolov7_trt.h"
 #include "inc/common.hpp"
+#include "inc/engine_cache.h"
+#include "inc/result_render.h"
+#include "inc/stream.h"
 
 #include <assert.h>
 #include <time.h>
+#include <algorithm>
 #include <chrono>
+#include <thread>
+#include <opencv2/core/cuda_stream_accessor.hpp>
 
 #define YOLOV7_TAG 1.0
-#define ENGINE_ENHANCE_FILE_PATH "../models/yolov7_sim_2070ti_fp16.trt"
-
-static const int kInputChannel = 3;
-static const int kInputHeight  = 640;
-static const int kInputWidth   = 640;
-static const int NUM_CLASSES   = 80;
-static const char *kInputBlobName  = "images";
-static const char *kOutputBlobName = "output";
-
-#define NMS_THRESH 0.45
-#define BBOX_CONF_THRESH 0.5
 
 namespace siran
 {
 
 /// @private function
-static cv::Mat StaticResize(const cv::Mat& src);
-static cv::cuda::GpuMat StaticResize(const cv::cuda::GpuMat& src);
-static int ObjInfo2ObjResult(const cv::cuda::GpuMat &src, std::vector<object_t> &obj_result, ObjResult *pobj_result);
+static float LetterboxScale(const cv::Size &src_size, const cv::Size &input_size);
 
 
-/// @brief Tools function, only for debuging.
-///
-static void DrawObjects(const cv::Mat& bgr, ObjResult *pobj_result, std::string &path, const bool &verbos = true);
+/**
+ * @brief DebugRenderer -- verbos result images of every instance, <name>.jpg under ./result,
+ *        drawn and encoded on a worker thread, frames beyond its queue are not rendered.
+ */
+static RenderConfig DebugRenderConfig()
+{
+    RenderConfig config = DefaultRenderConfig();
+    config.thread_num = 2;
+    return config;
+}
+
+static AsyncRenderer& DebugRenderer()
+{
+    static AsyncRenderer renderer(DebugRenderConfig());
+    return renderer;
+}
+
+
+/**
+ * @brief LoadEngineDesc -- Model descriptor of an engine from its .cfg sidecar, the built-in
+ *        640x640 COCO descriptor when there is none.
+ * @param status       -- set to -3 when the .cfg exists but is invalid, kept otherwise
+ */
+static ModelDesc LoadEngineDesc(const std::string &engine_file, int &status)
+{
+    const std::string desc_file = ModelDescPath(engine_file);
+    ModelDesc desc;
+    int iret = LoadModelDesc(desc_file, desc);
+    if(iret == -1)
+    {
+        std::cout << desc_file << " not found, use default model descriptor" << std::endl;
+        return DefaultModelDesc();
+    }
+    if(iret != 0)
+    {
+        /// @brief A wrong descriptor would decode the output with the wrong layout, do not run.
+        std::cout << desc_file << " invalid model descriptor, code " << iret << std::endl;
+        status = -3;
+        return DefaultModelDesc();
+    }
+    return desc;
+}
 
 
 /**
@@ -45,61 +77,207 @@ static void DrawObjects(const cv::Mat& bgr, ObjResult *pobj_result, std::string
  * @param iDeviceID    -- Supported device id is 0 or 1.
  */
 Yolov7Trt::Yolov7Trt(const int &iDeviceID):
-    engine_file_(ENGINE_ENHANCE_FILE_PATH),
+    Yolov7Trt(ENGINE_ENHANCE_FILE_PATH, iDeviceID)
+{
+}
+
+
+/**
+ * @brief Yolov7Trt::Yolov7Trt -- Load an engine and the model descriptor next to it.
+ * @param engine_file  -- TRT engine path, descriptor is the same path with .cfg extension
+ * @param iDeviceID    -- Supported device id is 0 or 1.
+ */
+Yolov7Trt::Yolov7Trt(const std::string &engine_file, const int &iDeviceID):
+    init_status_(0),
+    engine_file_(engine_file),
+    desc_(LoadEngineDesc(engine_file, init_status_)),
+    trt_runtime_(nullptr),
     trt_engine_(nullptr),
     trt_context_(nullptr),
+    trt_cpu_out_buffers_(nullptr),
+    cuda_stream_(nullptr),
     pyolov7_(nullptr),
+    batch_pool_(nullptr),
+    device_decoder_(nullptr),
+    scheduler_(nullptr),
+    next_frame_id_(0),
+    cpu_letterbox_(nullptr),
+    cpu_input_(nullptr),
     nb_bindings_(0),
     input_size_(0),
     output_size_(0),
+    max_batch_size_(1),
     device_id_(iDeviceID),
-    input_shape_{kInputHeight, kInputWidth}
+    input_shape_{desc_.input_h, desc_.input_w},
+    letterbox_(desc_.input_w, desc_.input_h)
+{
+    if(SetCudaDevice(device_id_) != 0 && 0 == init_status_)
+    {
+        init_status_ = -1;
+    }
+    if(0 == init_status_ && LoadEngine() != 0)
+    {
+        init_status_ = -2;
+    }
+    if(0 == init_status_)
+    {
+        Init();
+    }
+}
+
+
+/**
+ * @brief Yolov7Trt::Yolov7Trt -- Instance over an already loaded engine, own context, stream and buffers.
+ */
+Yolov7Trt::Yolov7Trt(nvinfer1::ICudaEngine *engine, const std::string &engine_file, const ModelDesc &desc, const int &iDeviceID):
+    init_status_(0),
+    engine_file_(engine_file),
+    desc_(desc),
+    trt_runtime_(nullptr),
+    trt_engine_(engine),
+    trt_context_(nullptr),
+    trt_cpu_out_buffers_(nullptr),
+    cuda_stream_(nullptr),
+    pyolov7_(nullptr),
+    batch_pool_(nullptr),
+    device_decoder_(nullptr),
+    scheduler_(nullptr),
+    next_frame_id_(0),
+    cpu_letterbox_(nullptr),
+    cpu_input_(nullptr),
+    nb_bindings_(0),
+    input_size_(0),
+    output_size_(0),
+    max_batch_size_(1),
+    device_id_(iDeviceID),
+    input_shape_{desc_.input_h, desc_.input_w},
+    letterbox_(desc_.input_w, desc_.input_h)
+{
+    if(SetCudaDevice(device_id_) != 0)
+    {
+        init_status_ = -1;
+        return;
+    }
+    Init();
+}
+
+
+Yolov7Trt* Yolov7Trt::CreateInstance() const
+{
+    if(nullptr == trt_engine_ || init_status_ != 0)
+    {
+        return nullptr;
+    }
+    return new Yolov7Trt(trt_engine_, engine_file_, desc_, device_id_);
+}
+
+
+int Yolov7Trt::InitStatus() const
+{
+    return init_status_;
+}
+
+
+/**
+ * @brief Yolov7Trt::Init -- Per instance state over trt_engine_, execution context, stream,
+ *        binding sizes and postprocess.
+ */
+void Yolov7Trt::Init()
 {
-    SetCudaDevice(device_id_);
-    LoadEngine();
     assert(trt_engine_ != nullptr);
     trt_context_ = trt_engine_->createExecutionContext();
     assert(trt_context_ != nullptr);
     nb_bindings_ = trt_engine_->getNbBindings();
     assert(trt_engine_->getNbBindings() == nb_bindings_);
-    input_size_ = 1*kInputChannel*kInputHeight*kInputWidth;
+    input_size_ = 1*desc_.input_c*desc_.input_h*desc_.input_w;
+
+    /// @brief Dynamic batch engine reports -1, take the max of optimization profile 0.
+    auto in_dims = trt_engine_->getBindingDimensions(0);
+    if(in_dims.nbDims == 4 && in_dims.d[2] > 0 && in_dims.d[3] > 0
+            && (in_dims.d[2] != desc_.input_h || in_dims.d[3] != desc_.input_w))
+    {
+        std::cout << "warning: engine input " << in_dims.d[3] << "x" << in_dims.d[2] << " does not match model descriptor "
+                  << desc_.input_w << "x" << desc_.input_h << std::endl;
+    }
+    if(in_dims.d[0] == -1)
+    {
+        max_batch_size_ = trt_engine_->getProfileDimensions(0, 0, nvinfer1::OptProfileSelector::kMAX).d[0];
+    }
+    else
+    {
+        max_batch_size_ = in_dims.d[0];
+    }
 
     buffer_size_.resize(nb_bindings_);
     for(int i=0;i<nb_bindings_;++i)
     {
         auto out_dims = trt_engine_->getBindingDimensions(i);
         auto output_size = 1;
-        for(int j=0;j<out_dims.nbDims;j++)
+        for(int j=1;j<out_dims.nbDims;j++)
         {
             output_size *= out_dims.d[j];
         }
         buffer_size_[i] = (int)output_size;
     }
-    std::cout<<"input_size "<<input_size_<<" output_size  "<<buffer_size_[1]<<std::endl;
-    trt_cpu_out_buffers_ = (float*)malloc(buffer_size_[1]*sizeof(float));
+    std::cout<<"input_size "<<input_size_<<" output_size  "<<buffer_size_[1]<<" max_batch "<<max_batch_size_<<std::endl;
+    trt_cpu_out_buffers_ = (float*)buffer_pool_.Acquire(max_batch_size_*buffer_size_[1]*sizeof(float), MEM_PINNED);
+    for(int i=0;i<nb_bindings_;++i)
+    {
+        trt_out_buffers_[i] = nullptr;
+    }
 
-    const int inputIndex = trt_engine_->getBindingIndex(kInputBlobName);
+    const int inputIndex = trt_engine_->getBindingIndex(desc_.input_blob.c_str());
     assert(trt_engine_->getBindingDataType(inputIndex) == nvinfer1::DataType::kFLOAT);
-    const int outputIndex = trt_engine_->getBindingIndex(kOutputBlobName);
+    const int outputIndex = trt_engine_->getBindingIndex(desc_.output_blob.c_str());
     assert(trt_engine_->getBindingDataType(outputIndex) == nvinfer1::DataType::kFLOAT);
 
     cudaStreamCreate(&cuda_stream_);
-    pyolov7_ = new Yolov7(NUM_CLASSES);
+    pyolov7_ = new Yolov7(desc_);
 }
 
 
 Yolov7Trt::~Yolov7Trt()
 {
+    StopPipeline();
+    SetCpuPreprocess(false);
+    SetDeviceDecode(false);
     if(pyolov7_)
     {
         delete pyolov7_;
         pyolov7_ = nullptr;
     }
+    for(size_t i=0;i<batch_yolov7_.size();++i)
+    {
+        delete batch_yolov7_[i];
+    }
+    batch_yolov7_.clear();
+    if(batch_pool_)
+    {
+        delete batch_pool_;
+        batch_pool_ = nullptr;
+    }
     if(trt_cpu_out_buffers_)
     {
-        free(trt_cpu_out_buffers_);
+        buffer_pool_.Release(trt_cpu_out_buffers_);
         trt_cpu_out_buffers_ = nullptr;
     }
+    if(cuda_stream_)
+    {
+        cudaStreamSynchronize(cuda_stream_);
+        cudaStreamDestroy(cuda_stream_);
+        cuda_stream_ = nullptr;
+    }
+    /// @brief TRT 8 objects are released with delete, the context before its engine. Instances of
+    ///        CreateInstance only borrow the engine, the owner is deleted last, see Yolov7Backend.
+    delete trt_context_;
+    trt_context_ = nullptr;
+    if(trt_runtime_)
+    {
+        delete trt_engine_;
+        delete trt_runtime_;
+        trt_runtime_ = nullptr;
+    }
+    trt_engine_ = nullptr;
 }
 
 /**
@@ -108,16 +286,23 @@ Yolov7Trt::~Yolov7Trt()
 int Yolov7Trt::LoadEngine()
 {
     int iret = 0;
-    std::fstream existEngine;
-    existEngine.open(engine_file_, std::ios::in);
-    if (existEngine)
+    /// @brief An onnx model is built once per gpu/TRT/precision and cached next to it.
+    const std::string ext = ".onnx";
+    if(engine_file_.size() > ext.size() && engine_file_.compare(engine_file_.size() - ext.size(), ext.size(), ext) == 0)
     {
-        readTrtFile(engine_file_, trt_engine_);
-        assert(trt_engine_ != nullptr);
+        std::string cached_file;
+        iret = GetCachedEngine(engine_file_, device_id_, cached_file);
+        if(iret != 0)
+        {
+            std::cout << engine_file_ << " engine build failed, code " << iret << std::endl;
+            return -1;
+        }
+        engine_file_ = cached_file;
     }
-    else
+    /// @brief mmap the engine and deserialize from the mapping, see readTrtFile.
+    if (!readTrtFile(engine_file_, trt_engine_, trt_runtime_))
     {
-        std::cout << engine_file_ << " not exists!" << std::endl;
+        std::cout << engine_file_ << " load failed!" << std::endl;
         return -1;
     }
     return iret;
@@ -126,303 +311,973 @@ int Yolov7Trt::LoadEngine()
 
 
 /**
- * @brief Yolov7Trt::PreprocessImage -- Read image and transform 3 channels mat to one-dimensional array.
- * @param img                    -- input cv::cuda::GpuMat data
- * @param data                   -- output one-dim array
+ * @brief Yolov7Trt::PreprocessImage -- Letterbox(pad 114), BGR->RGB, 1/255 and HWC->CHW in one kernel.
+ * @param img                    -- input cv::cuda::GpuMat 8UC3 BGR frame
+ * @param data                   -- output one-dim array, 3 x input_h x input_w
+ * @param stream                 -- cuda stream of the kernel
  */
-int Yolov7Trt::PreprocessImage(cv::cuda::GpuMat &img, float* data)
+int Yolov7Trt::PreprocessImage(const cv::cuda::GpuMat &img, float* data, cudaStream_t stream)
 {
-    int iret = 0;
-    if(img.empty())
+    if(img.empty() || img.type() != CV_8UC3)
     {
         return -1;
     }
-    int dst_h = img.rows;
-    int dst_w = img.cols;
-    int rc = img.channels();
-    int img_length = dst_h * dst_w;
-
-    /// @brief One channel image length. HWC 640x640x3 --> CHW 3x640x640.
-    std::vector<cv::cuda::GpuMat> split_img = {
-        cv::cuda::GpuMat(dst_h, dst_w, CV_32FC1, data + img_length * 2), // R
-        cv::cuda::GpuMat(dst_h, dst_w, CV_32FC1, data + img_length * 1), // G
-        cv::cuda::GpuMat(dst_h, dst_w, CV_32FC1, data + img_length * 0)  // B
-    };
-    cv::cuda::split(img, split_img);
-    return iret;
+    return letterbox_.Run(img.data, img.step, img.cols, img.rows, data, stream);
 }
 
 
 /**
  * @brief Yolov7Trt::DoInference
- * @param img
+ * @param batch_size -- filled slots of the input binding, batch_size <= max_batch_size_
  * @param dst_h
  * @param dst_w
- * @param verbos
- * @return
+ * @return           -- device output, batch x buffer_size_[1] floats, ready after cuda_stream_ sync,
+ *                      nullptr if the inference could not be queued
  */
-float* Yolov7Trt::DoInference(cv::cuda::GpuMat &img, const int &dst_h, const int &dst_w, const bool &verbos)
+float* Yolov7Trt::DoInference(const int &batch_size, const int &dst_h, const int &dst_w)
 {
     /// @brief set GpuMat processing platform.
     SetCudaDevice(device_id_);
+    float *output = (float *) trt_out_buffers_[1];
+
+    /// @brief Define input param -- BCHW.
+    nvinfer1::Dims4 input_dims{batch_size, desc_.input_c, dst_h, dst_w};
+    trt_context_->setBindingDimensions(0, input_dims);
 
-    /// @brief Apply cuda memory for tensorrt inculude input and all output.
-    for (int i = 0; i < nb_bindings_; ++i)
+    /// @brief Do inference processing, queued behind the preprocessing kernel on cuda_stream_.
+    const bool queued = trt_context_->enqueueV2(trt_out_buffers_, cuda_stream_, nullptr);
+    tracer_.Mark(TRACE_INFER, cuda_stream_);
+
+    return queued ? output : nullptr;
+}
+
+
+/**
+ * @brief Yolov7Trt::Yolov7Detect -- One frame into arena_, no heap allocation once warmed up.
+ * @param src          -- input BGR image
+ * @param detections   -- output view over arena_, valid until the next call on this instance
+ * @return             -- 0--success, -1--input error or instance not ready(see InitStatus), -999--no object
+ */
+int Yolov7Trt::Yolov7Detect(const cv::Mat &src, DetectionSpan *detections, const bool &verbos)
+{
+    int iret = 0;
+    if(src.empty() || nullptr == detections || init_status_ != 0)
     {
-        if (i == 0)
+        return -1;
+    }
+    *detections = DetectionSpan();
+    arena_.Reset();
+    const int dst_h = desc_.input_h;
+    const int dst_w = desc_.input_w;
+    float *gpu_out = nullptr;
+    const uint64_t time_start = NowNs();
+    uint64_t time_post = 0;
+
+    SetCudaDevice(device_id_);
+
+    /// @brief Get cuda memory for tensorrt inculude input and all output from the pool.
+    AcquireBindings(1);
+    /// @brief Device stage spans, also without tracing for the verbos timings.
+    tracer_.Begin(cuda_stream_, verbos);
+
+    /// @brief Resize input image. BGR --> RGB f32 1/255.0, 3x640x640.
+    iret = PrepareInput(src, (float*)trt_out_buffers_[0], stage_);
+    if(iret != 0)
+    {
+        ReleaseBindings();
+        ReleaseMats(stage_);
+        return iret;
+    }
+
+    gpu_out = this->DoInference(1, dst_h, dst_w);
+    if(nullptr == gpu_out)
+    {
+        cudaStreamSynchronize(cuda_stream_);
+        tracer_.End();
+        ReleaseBindings();
+        ReleaseMats(stage_);
+        return -1;
+    }
+
+    if(device_decoder_)
+    {
+        if(capture_.IsOpen())
         {
-            cudaMalloc(&trt_out_buffers_[i], buffer_size_[i]*sizeof(float));
+            CaptureDeviceOutput(gpu_out, src.size());
         }
-        else
+        const uint64_t post_start = NowNs();
+        iret = DevicePostprocess(gpu_out, src.size(), arena_);
+        tracer_.End();
+        time_post = NowNs() - post_start;
+        ReleaseBindings();
+        ReleaseMats(stage_);
+    }
+    else
+    {
+        cudaMemcpyAsync(trt_cpu_out_buffers_, gpu_out, buffer_size_[1]*sizeof(float), cudaMemcpyDeviceToHost, cuda_stream_);
+        tracer_.Mark(TRACE_D2H, cuda_stream_);
+        cudaStreamSynchronize(cuda_stream_);
+        tracer_.End();
+
+        const uint64_t post_start = NowNs();
+        /// @brief Device buffers are not needed after the copy, give them back before postprocess.
+        ReleaseBindings();
+        ReleaseMats(stage_);
+
+        if(capture_.IsOpen())
         {
-            cudaMalloc(&trt_out_buffers_[i], buffer_size_[i]*sizeof(float));
+            capture_.Write(trt_cpu_out_buffers_, src.cols, src.rows);
         }
+        iret = Yolov7Postprocess(trt_cpu_out_buffers_, src.size(), arena_);
+        time_post = NowNs() - post_start;
     }
-    float* input = (float *) trt_out_buffers_[0];
-    float *output = (float *) trt_out_buffers_[1];
+    *detections = arena_.View();
+    if(iret != 0)
+    {
+        return iret;
+    }
+    if(verbos)
+    {
+        printf("##### YOLOV7 upload %.3fms letterbox %.3fms infer %.3fms d2h %.3fms\n",
+               tracer_.StageNs(TRACE_UPLOAD) * 1e-6, tracer_.StageNs(TRACE_LETTERBOX) * 1e-6,
+               tracer_.StageNs(TRACE_INFER) * 1e-6, tracer_.StageNs(TRACE_D2H) * 1e-6);
+        printf("$$$$$ YOLOV7 Postprocess time: %.3fms\n", time_post * 1e-6);
+        const PoolStats pool = GetPoolStats();
+        printf("##### YOLOV7 buffer pool hits %lld misses %lld, in use %.1fMB cached %.1fMB\n", (long long)pool.hits,
+               (long long)pool.misses, pool.bytes_in_use / 1048576.0, pool.bytes_cached / 1048576.0);
+        printf("************************ YOLOV7 Processing time: %.3fms ************************\n", (NowNs() - time_start) * 1e-6);
+    }
+    return iret;
+}
 
-    /// @brief Permute image.
-    this->PreprocessImage(img, input);
 
-    double time_start = GetCurrentTime();
-    double time_process = 0.f;
+int Yolov7Trt::Yolov7Infer(const cv::Mat &src, ObjResult *pobj_result, const std::string *path, const bool &verbos)
+{
+    if(nullptr == pobj_result)
+    {
+        return -1;
+    }
+    pobj_result->obj_num = 0;
+    DetectionSpan detections;
+    int iret = Yolov7Detect(src, &detections, verbos);
+    if(iret != 0)
+    {
+        return iret;
+    }
+    iret = ToObjResult(detections, pobj_result);
+    if(iret != 0)
+    {
+        return iret;
+    }
     if(verbos)
     {
-        time_process = GetCurrentTime() - time_start;
-        printf("   @@@@@ YOLOV7 DoInference permute time: %.2fms\n", time_process);
+        /// @brief The caller may reuse src, the renderer takes over the only copy and draws on
+        ///        it, draw and encode run on the renderer thread.
+        uint64_t time_draw = 0;
+        {
+            TraceSpan span(TRACE_DRAW, &time_draw);
+            DebugRenderer().Submit(src.clone(), path != nullptr ? *path : std::string(), detections);
+        }
+        printf("%%%%% YOLOV7 DrawResult queue time: %.3fms\n", time_draw * 1e-6);
     }
+    return iret;
+}
 
-    /// @brief Define input param -- BCHW.
-    nvinfer1::Dims4 input_dims{1, kInputChannel, dst_h, dst_w};
-    trt_context_->setBindingDimensions(0, input_dims);
 
-    time_start = GetCurrentTime();
-    /// @brief Do inference processing.
-        trt_context_->executeV2(trt_out_buffers_); // Synchronously execute inference a network.
-//    trt_context_->enqueue(1, trt_out_buffers_, cuda_stream_, nullptr);// Asynchronously execute inference on a batch.
-    if(verbos)
+/**
+ * @brief Yolov7Trt::RunBatch -- Letterbox N frames into one NCHW input, one inference call per
+ *        chunk of max_batch_size_, postprocess of every slot in parallel. on_result gets every
+ *        frame in order on the calling thread, its view is valid until the next chunk.
+ * @param srcs         -- input BGR images, not empty
+ * @param packed       -- frame whose SplitViews are srcs, or nullptr
+ * @return             -- 0--success, -1--instance not ready, slot errors go to on_result
+ */
+int Yolov7Trt::RunBatch(const std::vector<cv::Mat> &srcs, const BatchResultFn &on_result, const bool &verbos,
+                        const cv::Mat *packed)
+{
+    if(init_status_ != 0)
     {
-        time_process = GetCurrentTime() - time_start;
-        printf("   @@@@@ YOLOV7 DoInference forwart time: %.2fms\n", time_process);
+        return -1;
+    }
+    const int dst_h = desc_.input_h;
+    const int dst_w = desc_.input_w;
+    while((int)batch_yolov7_.size() < max_batch_size_)
+    {
+        batch_yolov7_.push_back(new Yolov7(desc_));
+        batch_arenas_.push_back(DetectionArena(kMaxDecodeBoxes));
     }
+    batch_status_.resize(max_batch_size_);
+    if(nullptr == batch_pool_ && max_batch_size_ > 1)
+    {
+        batch_pool_ = new ThreadPool(max_batch_size_);
+    }
+
+    SetCudaDevice(device_id_);
+    for(size_t begin=0;begin<srcs.size();begin+=max_batch_size_)
+    {
+        const int batch_size = std::min((int)(srcs.size()-begin), max_batch_size_);
+        const uint64_t time_start = NowNs();
+
+        std::vector<cv::cuda::GpuMat> stage;
+        AcquireBindings(batch_size);
+        tracer_.Begin(cuda_stream_);
+        /// @brief A slot that could not be prepared keeps its error and is not decoded, its
+        ///        binding slot is still inferred with the others.
+        for(int b=0;b<batch_size;++b)
+        {
+            batch_arenas_[b].Reset();
+        }
+        if(packed != nullptr && batch_size == (int)srcs.size())
+        {
+            const int iret = PrepareViews(*packed, batch_size, (float*)trt_out_buffers_[0], stage);
+            std::fill(batch_status_.begin(), batch_status_.begin() + batch_size, iret);
+        }
+        else
+        {
+            for(int b=0;b<batch_size;++b)
+            {
+                /// @brief Batch slots are contiguous NCHW.
+                batch_status_[b] = PrepareInput(srcs[begin+b], (float*)trt_out_buffers_[0] + b*buffer_size_[0], stage);
+            }
+        }
 
-    return output;
+        float *gpu_out = this->DoInference(batch_size, dst_h, dst_w);
+        if(nullptr == gpu_out)
+        {
+            cudaStreamSynchronize(cuda_stream_);
+            tracer_.End();
+            ReleaseBindings();
+            ReleaseMats(stage);
+            std::fill(batch_status_.begin(), batch_status_.begin() + batch_size, -1);
+        }
+        else if(device_decoder_)
+        {
+            /// @brief One decoder, slots run back to back on cuda_stream_, each copies back only its boxes.
+            for(int b=0;b<batch_size;++b)
+            {
+                if(batch_status_[b] != 0)
+                {
+                    continue;
+                }
+                if(b > 0)
+                {
+                    /// @brief The host box export of the previous slot is not charged to this decode.
+                    tracer_.Mark(TRACE_NONE, cuda_stream_);
+                }
+                if(capture_.IsOpen())
+                {
+                    CaptureDeviceOutput(gpu_out + b*buffer_size_[1], srcs[begin+b].size());
+                }
+                batch_status_[b] = DevicePostprocess(gpu_out + b*buffer_size_[1], srcs[begin+b].size(), batch_arenas_[b]);
+            }
+            tracer_.End();
+            ReleaseBindings();
+            ReleaseMats(stage);
+        }
+        else
+        {
+            cudaMemcpyAsync(trt_cpu_out_buffers_, gpu_out, batch_size*buffer_size_[1]*sizeof(float), cudaMemcpyDeviceToHost, cuda_stream_);
+            tracer_.Mark(TRACE_D2H, cuda_stream_);
+            cudaStreamSynchronize(cuda_stream_);
+            tracer_.End();
+            ReleaseBindings();
+            ReleaseMats(stage);
+            for(int b=0;b<batch_size && capture_.IsOpen();++b)
+            {
+                if(0 == batch_status_[b])
+                {
+                    capture_.Write(trt_cpu_out_buffers_ + b*buffer_size_[1], srcs[begin+b].cols, srcs[begin+b].rows);
+                }
+            }
+
+            /// @brief Split [N,25200,85] output, slots postprocessed in parallel on batch_pool_.
+            const std::function<void(int, int)> postprocess = [this, begin, &srcs](int slot_begin, int slot_end) {
+                for(int b=slot_begin;b<slot_end;++b)
+                {
+                    if(0 == batch_status_[b])
+                    {
+                        batch_status_[b] = Yolov7Postprocess(trt_cpu_out_buffers_ + b*buffer_size_[1], srcs[begin+b].size(),
+                                batch_arenas_[b], batch_yolov7_[b]);
+                    }
+                }
+            };
+            if(batch_pool_ != nullptr)
+            {
+                batch_pool_->ParallelFor(0, batch_size, postprocess);
+            }
+            else
+            {
+                postprocess(0, batch_size);
+            }
+        }
+        for(int b=0;b<batch_size;++b)
+        {
+            on_result((int)begin + b, batch_status_[b], batch_arenas_[b].View());
+        }
+        if(verbos)
+        {
+            printf("************************ YOLOV7 Batch(%d) Processing time: %.3fms ************************\n",
+                   batch_size, (NowNs() - time_start) * 1e-6);
+        }
+    }
+    return 0;
 }
 
 
-int Yolov7Trt::Yolov7Infer(const cv::Mat &src, ObjResult *pobj_result, const std::string *path, const bool &verbos)
+/**
+ * @brief Yolov7Trt::Yolov7InferBatch -- N frames through RunBatch, every slot exported to ObjResult.
+ * @param srcs         -- input BGR images
+ * @param obj_results  -- output results, resized to srcs.size(), slot i of a failed frame keeps obj_num 0
+ * @param verbos
+ * @return             -- 0--success, -1--input error or instance not ready, otherwise the code of the
+ *                        first failed slot: -1 for a frame that is not 8UC3 or a failed inference,
+ *                        or the postprocess code(host or device decode)
+ */
+int Yolov7Trt::Yolov7InferBatch(const std::vector<cv::Mat> &srcs, std::vector<ObjResult> &obj_results, const bool &verbos)
 {
-    int iret = 0;
-    if(src.empty())
+    if(srcs.empty() || init_status_ != 0)
     {
         return -1;
     }
-    const int dst_h = kInputHeight;
-    const int dst_w = kInputWidth;
-    float *gpu_out = nullptr;
+    for(size_t i=0;i<srcs.size();++i)
+    {
+        if(srcs[i].empty())
+        {
+            return -1;
+        }
+    }
+    obj_results.resize(srcs.size());
+    memset(obj_results.data(), 0, obj_results.size()*sizeof(ObjResult));
+    /// @brief A frame without objects is not a batch failure, the first slot error is returned.
+    int failed = 0;
+    int iret = RunBatch(srcs, [&obj_results, &failed](const int &index, const int &status, const DetectionSpan &detections) {
+        if(0 == status)
+        {
+            ToObjResult(detections, &obj_results[index]);
+        }
+        else if(status != -999 && 0 == failed)
+        {
+            failed = status;
+        }
+    }, verbos);
+    return iret != 0 ? iret : failed;
+}
 
-    double time_start = GetCurrentTime();
-    const double time_start1 = time_start;
-    double time_process = 0.f;
 
-    SetCudaDevice(device_id_);
-    cv::cuda::GpuMat gpu_src;
-    gpu_src.upload(src);
-    cv::cuda::GpuMat resized_src;
+/**
+ * @brief Yolov7Trt::Yolov7DetectTiled -- Overlapping network sized ROIs of src(no copy) and the
+ *        letterboxed whole frame run as one batch, tile boxes mapped back to src pixels and
+ *        merged across seams by TileMerger, into arena_.
+ * @param src          -- input BGR image, any size, a frame within one tile runs as Yolov7Detect
+ * @param detections   -- output view over arena_, valid until the next call on this instance
+ * @param config       -- tile size, overlap and merge threshold, see PlanTiles
+ * @return             -- 0--success, -1--input error or instance not ready, -999--no object,
+ *                        others the first failed tile status, nothing is merged then
+ */
+int Yolov7Trt::Yolov7DetectTiled(const cv::Mat &src, DetectionSpan *detections, const TileConfig &config, const bool &verbos)
+{
+    if(src.empty() || nullptr == detections || init_status_ != 0)
+    {
+        return -1;
+    }
+    *detections = DetectionSpan();
+    if(PlanTiles(src.cols, src.rows, config, tiles_) <= 1)
+    {
+        return Yolov7Detect(src, detections, verbos);
+    }
+    const uint64_t time_start = NowNs();
+    tile_srcs_.resize(tiles_.size());
+    tile_dets_.resize(tiles_.size());
+    for(size_t t=0;t<tiles_.size();++t)
+    {
+        /// @brief ROI headers share src pixels, PrepareInput uploads them row by row.
+        tile_srcs_[t] = src(cv::Rect(tiles_[t].x, tiles_[t].y, tiles_[t].width, tiles_[t].height));
+    }
+    bool truncated = false;
+    int failed = 0;
+    const int iret = RunBatch(tile_srcs_, [this, &truncated, &failed](const int &index, const int &status, const DetectionSpan &dets) {
+        /// @brief -999 is an empty tile, any other code fails the frame, a partial merge would
+        ///        silently lose the objects of the failed tile.
+        if(status != 0 && status != -999 && 0 == failed)
+        {
+            failed = status;
+        }
+        tile_dets_[index].assign(dets.begin(), dets.end());
+        truncated = truncated || dets.Truncated();
+    }, verbos);
+    if(iret != 0 || failed != 0)
+    {
+        return iret != 0 ? iret : failed;
+    }
 
-    /// @brief Resize input image. BGR --> RGB f32 1/255.0, 640x640x3.
-    resized_src = StaticResize(gpu_src);
-    if(verbos)
+    tile_spans_.resize(tiles_.size());
+    for(size_t t=0;t<tiles_.size();++t)
     {
-        double time_process = GetCurrentTime() - time_start;
-        printf("##### YOLOV7 Resize time: %.2fms\n", time_process);
+        tile_spans_[t] = DetectionSpan(tile_dets_[t].data(), (int)tile_dets_[t].size(), false);
     }
+    const uint64_t merge_start = NowNs();
+    tile_merger_.Run(tiles_, tile_spans_.data(), config.match_thresh, merged_);
 
-    time_start = GetCurrentTime();
-    gpu_out = this->DoInference(resized_src, dst_h, dst_w);
+    /// @brief merged_ is sorted by score, a full arena drops the lowest and marks itself truncated.
+    arena_.Reset();
+    for(size_t i=0;i<merged_.size() && arena_.Push(merged_[i]);++i)
+    {
+    }
+    if(truncated)
+    {
+        arena_.SetTruncated();
+    }
+    *detections = arena_.View();
     if(verbos)
     {
-        time_process = GetCurrentTime() - time_start;
-        printf("@@@@@ YOLOV7 DoInference time: %.2fms\n", time_process);
+        printf("$$$$$ YOLOV7 %zu tiles merge time: %.3fms\n", tiles_.size(), (NowNs() - merge_start) * 1e-6);
+        printf("************************ YOLOV7 Tiled Processing time: %.3fms ************************\n", (NowNs() - time_start) * 1e-6);
     }
+    return detections->Empty() ? -999 : 0;
+}
 
-    memset(trt_cpu_out_buffers_, 0, buffer_size_[1]*sizeof(float));
-    cudaMemcpyAsync(trt_cpu_out_buffers_, gpu_out, buffer_size_[1]*sizeof(float), cudaMemcpyDeviceToHost, cuda_stream_);
-    cudaStreamSynchronize(cuda_stream_);
 
-    time_start = GetCurrentTime();
-    memset(pobj_result, 0, sizeof(ObjResult));
-    iret = Yolov7Postprocess(trt_cpu_out_buffers_, gpu_src, pobj_result);
-    if(iret != 0)
+/**
+ * @brief Yolov7Trt::Yolov7DetectStereo -- Left and right views of a side by side stereo frame
+ *        through RunBatch as one batch of 2, an engine with max batch 1 runs them back to back.
+ * @param frame        -- input BGR stereo frame, left view in the left half
+ * @param left         -- output view over arena_, left view pixels
+ * @param right        -- output view over right_arena_, right view pixels
+ * @return             -- 0--success, -1--input error or instance not ready, -999--no object in either view
+ */
+int Yolov7Trt::Yolov7DetectStereo(const cv::Mat &frame, DetectionSpan *left, DetectionSpan *right, const bool &verbos)
+{
+    if(frame.empty() || frame.cols < 2 || nullptr == left || nullptr == right || init_status_ != 0)
     {
-        return iret;
+        return -1;
     }
+    *left = DetectionSpan();
+    *right = DetectionSpan();
+    const uint64_t time_start = NowNs();
+    SplitViews(frame, 2, stereo_views_);
+    DetectionArena *arenas[2] = {&arena_, &right_arena_};
+    int status[2] = {-1, -1};
+    RunBatch(stereo_views_, [&arenas, &status](const int &index, const int &iret, const DetectionSpan &dets) {
+        DetectionArena &arena = *arenas[index];
+        arena.Reset();
+        for(int i=0;i<dets.Count() && arena.Push(dets[i]);++i)
+        {
+        }
+        if(dets.Truncated())
+        {
+            arena.SetTruncated();
+        }
+        status[index] = iret;
+    }, verbos, &frame);
+    *left = arena_.View();
+    *right = right_arena_.View();
     if(verbos)
     {
-        time_process = GetCurrentTime() - time_start;
-        printf("$$$$$ YOLOV7 Postprocess time: %.2fms\n", time_process);
-        time_process = GetCurrentTime() - time_start1;
-        printf("************************ YOLOV7 Processing time: %.2fms ************************\n", time_process);
+        printf("************************ YOLOV7 Stereo Processing time: %.3fms ************************\n", (NowNs() - time_start) * 1e-6);
+    }
+    for(int v=0;v<2;++v)
+    {
+        if(status[v] != 0 && status[v] != -999)
+        {
+            return status[v];
+        }
+    }
+    return left->Empty() && right->Empty() ? -999 : 0;
+}
 
-        std::string tmp_path = " ";
-        if(path != nullptr)
+
+PoolStats Yolov7Trt::GetPoolStats() const
+{
+    return buffer_pool_.GetStats();
+}
+
+
+std::vector<int> Yolov7Trt::GetBatchSizes() const
+{
+    std::vector<int> sizes;
+    if(init_status_ != 0)
+    {
+        return sizes;
+    }
+    if(trt_engine_->getBindingDimensions(0).d[0] != -1)
+    {
+        sizes.push_back(max_batch_size_);
+        return sizes;
+    }
+    const nvinfer1::OptProfileSelector selectors[3] = {nvinfer1::OptProfileSelector::kMIN,
+                                                       nvinfer1::OptProfileSelector::kOPT,
+                                                       nvinfer1::OptProfileSelector::kMAX};
+    for(int i=0;i<3;++i)
+    {
+        const int batch = trt_engine_->getProfileDimensions(0, 0, selectors[i]).d[0];
+        if(sizes.empty() || batch > sizes.back())
         {
-            tmp_path = *path;
+            sizes.push_back(batch);
         }
-        time_start = GetCurrentTime();
-        DrawObjects(src, pobj_result, tmp_path, true);
-        time_process = GetCurrentTime() - time_start;
-        printf("%%%%% YOLOV7 DrawResult time: %.2fms\n", time_process);
     }
+    return sizes;
+}
 
-    /// @brief Free cuda memory.
-    for(int i=0;i<nb_bindings_;++i)
+
+/**
+ * @brief Yolov7Trt::SetCpuPreprocess -- Letterbox on host threads and copy the planar tensor,
+ *        keeps the GPU free for inference on busy devices.
+ * @param enable                     -- false goes back to the fused gpu kernel
+ * @param thread_num                 -- cpu preprocess threads, <= 0 for all hardware threads
+ */
+void Yolov7Trt::SetCpuPreprocess(const bool &enable, const int &thread_num)
+{
+    if(cpu_letterbox_)
     {
-        cudaFree(trt_out_buffers_[i]);
-        trt_out_buffers_[i] = nullptr;
+        cudaStreamSynchronize(cuda_stream_);
+        delete cpu_letterbox_;
+        cpu_letterbox_ = nullptr;
+        buffer_pool_.Release(cpu_input_);
+        cpu_input_ = nullptr;
+    }
+    if(enable && 0 == init_status_)
+    {
+        cpu_letterbox_ = new CpuLetterbox(desc_.input_w, desc_.input_h, thread_num);
+        cpu_input_ = (float*)buffer_pool_.Acquire(max_batch_size_*buffer_size_[0]*sizeof(float), MEM_PINNED);
     }
+}
+
+
+/**
+ * @brief Yolov7Trt::SetDeviceDecode -- Replace the full output copy and host decode by the
+ *        device decoder, the row table comes from the host postprocess.
+ * @param enable                     -- false goes back to host postprocess
+ * @param device_nms                 -- false copies the compacted candidates and runs NMS on host
+ */
+void Yolov7Trt::SetDeviceDecode(const bool &enable, const bool &device_nms)
+{
+    if(device_decoder_)
+    {
+        cudaStreamSynchronize(cuda_stream_);
+        delete device_decoder_;
+        device_decoder_ = nullptr;
+    }
+    if(enable && pyolov7_)
+    {
+        SetCudaDevice(device_id_);
+        DecodeParams params;
+        params.rows = pyolov7_->RowInfo().size();
+        params.class_num = desc_.num_classes;
+        params.input_w = desc_.input_w;
+        params.input_h = desc_.input_h;
+        params.conf_thresh = desc_.conf_thresh;
+        params.nms_thresh = desc_.nms_thresh;
+        device_decoder_ = new DeviceBoxDecoder(params, pyolov7_->RowInfo(), device_nms);
+        device_decoder_->SetTracer(&tracer_);
+        decode_boxes_.reserve(kMaxDecodeBoxes);
+    }
+}
+
+
+/**
+ * @brief Yolov7Trt::PrepareInput -- Fill one input binding slot from a host BGR frame, on the gpu
+ *        (upload + fused kernel) or on the host(CpuLetterbox + H2D copy), queued on cuda_stream_.
+ */
+int Yolov7Trt::PrepareInput(const cv::Mat &src, float *input, std::vector<cv::cuda::GpuMat> &stage)
+{
+    if(src.empty() || src.type() != CV_8UC3)
+    {
+        return -1;
+    }
+    if(cpu_letterbox_)
+    {
+        /// @brief Pinned staging slot follows the binding slot so batch copies do not overlap.
+        float *host = cpu_input_ + (input - (float*)trt_out_buffers_[0]);
+        int iret = 0;
+        {
+            TraceSpan span(TRACE_LETTERBOX);
+            iret = cpu_letterbox_->Run(src.data, src.step, src.cols, src.rows, host);
+        }
+        if(iret != 0)
+        {
+            return iret;
+        }
+        /// @brief Host letterbox time is not device upload time.
+        tracer_.Mark(TRACE_NONE, cuda_stream_);
+        cudaMemcpyAsync(input, host, buffer_size_[0]*sizeof(float), cudaMemcpyHostToDevice, cuda_stream_);
+        tracer_.Mark(TRACE_UPLOAD, cuda_stream_);
+        return 0;
+    }
+    cv::cuda::GpuMat gpu_src = AcquireMat(src.rows, src.cols, src.type());
+    stage.push_back(gpu_src);
+    cv::cuda::Stream stream = cv::cuda::StreamAccessor::wrapStream(cuda_stream_);
+    gpu_src.upload(src, stream);
+    tracer_.Mark(TRACE_UPLOAD, cuda_stream_);
+    int iret = PreprocessImage(gpu_src, input, cuda_stream_);
+    tracer_.Mark(TRACE_LETTERBOX, cuda_stream_);
     return iret;
 }
 
 
-int Yolov7Trt::Yolov7Postprocess(float *trt_out, const cv::cuda::GpuMat &src, ObjResult *pobj_result)
+/**
+ * @brief Yolov7Trt::PrepareViews -- The views of a side by side frame into consecutive binding
+ *        slots. The whole frame is uploaded once and every view is letterboxed from its column
+ *        range on the device, or all views are letterboxed in one host pass and copied at once.
+ * @return             -- 0--success, -1--input error
+ */
+int Yolov7Trt::PrepareViews(const cv::Mat &frame, const int &view_num, float *input, std::vector<cv::cuda::GpuMat> &stage)
 {
-    int iret = 0;
-    if(nullptr == trt_out)
+    if(frame.empty() || frame.type() != CV_8UC3 || view_num <= 0 || frame.cols < view_num)
     {
-        return iret;
+        return -1;
     }
-    std::vector<object_t> object_t_vec;
-    iret = pyolov7_->YoloProcess(trt_out, BBOX_CONF_THRESH, &object_t_vec);
-    if(iret != 0)
+    int iret = 0;
+    if(cpu_letterbox_)
     {
-        return iret;
+        float *host = cpu_input_ + (input - (float*)trt_out_buffers_[0]);
+        {
+            TraceSpan span(TRACE_LETTERBOX);
+            iret = cpu_letterbox_->RunViews(frame.data, frame.step, frame.cols, frame.rows, view_num, host);
+        }
+        if(iret != 0)
+        {
+            return iret;
+        }
+        tracer_.Mark(TRACE_NONE, cuda_stream_);
+        cudaMemcpyAsync(input, host, view_num*buffer_size_[0]*sizeof(float), cudaMemcpyHostToDevice, cuda_stream_);
+        tracer_.Mark(TRACE_UPLOAD, cuda_stream_);
+        return 0;
     }
-    iret = ObjInfo2ObjResult(src, object_t_vec, pobj_result);
-    if(iret != 0)
+    cv::cuda::GpuMat gpu_frame = AcquireMat(frame.rows, frame.cols, frame.type());
+    stage.push_back(gpu_frame);
+    cv::cuda::Stream stream = cv::cuda::StreamAccessor::wrapStream(cuda_stream_);
+    gpu_frame.upload(frame, stream);
+    tracer_.Mark(TRACE_UPLOAD, cuda_stream_);
+    /// @brief Column bands of SplitViews, device ROIs share the uploaded frame.
+    const int view_w = frame.cols / view_num;
+    for(int v=0;v<view_num && 0 == iret;++v)
     {
-        return iret;
+        const int end = v == view_num - 1 ? frame.cols : view_w * (v + 1);
+        iret = PreprocessImage(gpu_frame.colRange(view_w * v, end), input + v*buffer_size_[0], cuda_stream_);
     }
+    tracer_.Mark(TRACE_LETTERBOX, cuda_stream_);
     return iret;
 }
 
 
-static cv::Mat StaticResize(const cv::Mat& src)
+cv::cuda::GpuMat Yolov7Trt::AcquireMat(const int &rows, const int &cols, const int &type)
+{
+    const size_t step = cols * CV_ELEM_SIZE(type);
+    void *data = buffer_pool_.Acquire(rows * step, MEM_DEVICE);
+    return cv::cuda::GpuMat(rows, cols, type, data, step);
+}
+
+
+void Yolov7Trt::ReleaseMats(std::vector<cv::cuda::GpuMat> &mats)
 {
-    float r = std::min(kInputWidth / (src.cols*1.0), kInputHeight / (src.rows*1.0));
-    int unpad_w = r * src.cols;
-    int unpad_h = r * src.rows;
-    cv::Mat re(unpad_h, unpad_w, CV_8UC3);
-    cv::resize(src, re, re.size());
-    cv::Mat out(kInputHeight, kInputWidth, CV_8UC3, cv::Scalar(114, 114, 114));
-    re.copyTo(out(cv::Rect(0, 0, re.cols, re.rows)));
-    out.convertTo(out, CV_32FC3, 1.0f / 255.0f);
-    return out;
+    for(size_t i=0;i<mats.size();++i)
+    {
+        buffer_pool_.Release(mats[i].data);
+    }
+    mats.clear();
 }
 
 
-static cv::cuda::GpuMat StaticResize(const cv::cuda::GpuMat& src)
+void Yolov7Trt::AcquireBindings(const int &batch_size)
 {
-    float r = std::min(kInputWidth / (src.cols*1.0), kInputHeight / (src.rows*1.0));
-    int unpad_w = r * src.cols;
-    int unpad_h = r * src.rows;
-    cv::cuda::GpuMat re(unpad_h, unpad_w, CV_8UC3);
-    cv::cuda::resize(src, re, re.size());
-    cv::cuda::GpuMat out(kInputHeight, kInputWidth, CV_8UC3);//, cv::Scalar(114, 114, 114)
-    re.copyTo(out(cv::Rect(0, 0, re.cols, re.rows)));
-    out.convertTo(out, CV_32FC3, 1.0f / 255.0f);
-    return out;
+    for(int i=0;i<nb_bindings_;++i)
+    {
+        trt_out_buffers_[i] = buffer_pool_.Acquire(batch_size*buffer_size_[i]*sizeof(float), MEM_DEVICE);
+    }
 }
 
 
-static int ObjInfo2ObjResult(const cv::cuda::GpuMat &src, std::vector<object_t> &obj_result, ObjResult *pobj_result)
+void Yolov7Trt::ReleaseBindings()
 {
-    int iret = 0;
-    if(0 == obj_result.size() || obj_result.size() > 100)
+    for(int i=0;i<nb_bindings_;++i)
+    {
+        buffer_pool_.Release(trt_out_buffers_[i]);
+        trt_out_buffers_[i] = nullptr;
+    }
+}
+
+
+/**
+ * @brief Yolov7Trt::StartPipeline -- Create stage streams, events and per-slot buffers.
+ * @param callback                 -- completion callback, called once per pushed frame
+ * @return                         -- 0--success, -1--already started or instance not ready
+ */
+int Yolov7Trt::StartPipeline(const InferCallback &callback)
+{
+    if(scheduler_ != nullptr || init_status_ != 0)
     {
         return -1;
     }
-    const int img_h = src.rows;
-    const int img_w = src.cols;
-    const float ratio = float(img_w) / float(kInputWidth) > float(img_h) / float(kInputHeight)  ?
-                float(img_w) / float(kInputWidth) : float(img_h) / float(kInputHeight);
-    memset(pobj_result, 0, sizeof(ObjResult));
-    pobj_result->obj_num = obj_result.size();
-    for(int i=0;i<obj_result.size();++i)
-    {
-        pobj_result->obj_info[i].obj_box.x = (int)obj_result[i].left * ratio;
-        pobj_result->obj_info[i].obj_box.y = (int)obj_result[i].low  * ratio;
-        pobj_result->obj_info[i].obj_box.width = ((int)obj_result[i].right - (int)obj_result[i].left) * ratio;
-        pobj_result->obj_info[i].obj_box.height = ((int)obj_result[i].high - (int)obj_result[i].low) * ratio;
-        pobj_result->obj_info[i].obj_class = obj_result[i].id;
-        pobj_result->obj_info[i].obj_prob = obj_result[i].prob;
+    SetCudaDevice(device_id_);
+    cudaStreamCreate(&upload_stream_);
+    cudaStreamCreate(&d2h_stream_);
+    slots_.resize(STAGE_NUM);
+    for(size_t i=0;i<slots_.size();++i)
+    {
+        PipelineSlot &slot = slots_[i];
+        for(int j=0;j<nb_bindings_;++j)
+        {
+            slot.bindings[j] = buffer_pool_.Acquire(buffer_size_[j]*sizeof(float), MEM_DEVICE);
+        }
+        slot.host_out = (float*)buffer_pool_.Acquire(buffer_size_[1]*sizeof(float), MEM_PINNED);
+        cudaEventCreateWithFlags(&slot.pre_done, cudaEventDisableTiming);
+        cudaEventCreateWithFlags(&slot.infer_done, cudaEventDisableTiming);
+        cudaEventCreateWithFlags(&slot.d2h_done, cudaEventDisableTiming);
+        slot.tracer = new DeviceTracer();
+        slot.status = 0;
     }
-    return iret;
+    callback_ = callback;
+    next_frame_id_ = 0;
+    scheduler_ = new PipelineScheduler(this, STAGE_NUM);
+    return 0;
 }
 
 
-static void DrawObjects(const cv::Mat& bgr, ObjResult *pobj_result, std::string &path, const bool &verbos)
+int64_t Yolov7Trt::PushFrame(const cv::Mat &src)
 {
-    int iret = 0;
-    const std::string save_path = "./result";
-    iret = CheckFolderExist(save_path);
-    if(iret != 0)
+    if(nullptr == scheduler_ || src.empty() || src.type() != CV_8UC3)
+    {
+        return -1;
+    }
+    const int64_t frame_id = next_frame_id_++;
+    PipelineSlot &slot = slots_[scheduler_->Slot(frame_id)];
+    slot.src = src;
+    slot.status = 0;
+    /// @brief A failed stage of this or an earlier frame reaches callback_ with its frame id.
+    scheduler_->Push(frame_id);
+    return frame_id;
+}
+
+
+int Yolov7Trt::FlushPipeline()
+{
+    if(nullptr == scheduler_)
+    {
+        return -1;
+    }
+    return scheduler_->Flush();
+}
+
+
+void Yolov7Trt::StopPipeline()
+{
+    if(nullptr == scheduler_)
     {
         return;
     }
-    cv::Mat image = bgr.clone();
-    for (size_t i = 0; i < pobj_result->obj_num; i++)
+    scheduler_->Flush();
+    delete scheduler_;
+    scheduler_ = nullptr;
+    for(size_t i=0;i<slots_.size();++i)
     {
-        const ObjInfo& obj_info = pobj_result->obj_info[i];
-        const int obj_x = obj_info.obj_box.x;
-        const int obj_y = obj_info.obj_box.y ;
-        const int obj_width = obj_info.obj_box.width;
-        const int obj_height = obj_info.obj_box.height;
-        const int obj_class = obj_info.obj_class;
-        const float obj_prob = obj_info.obj_prob;
+        PipelineSlot &slot = slots_[i];
+        for(int j=0;j<nb_bindings_;++j)
+        {
+            buffer_pool_.Release(slot.bindings[j]);
+        }
+        buffer_pool_.Release(slot.host_out);
+        cudaEventDestroy(slot.pre_done);
+        cudaEventDestroy(slot.infer_done);
+        cudaEventDestroy(slot.d2h_done);
+        delete slot.tracer;
+    }
+    slots_.clear();
+    cudaStreamDestroy(upload_stream_);
+    cudaStreamDestroy(d2h_stream_);
+}
 
-        cv::Scalar color = cv::Scalar(color_list[obj_class][0], color_list[obj_class][1], color_list[obj_class][2]);
-        float c_mean = cv::mean(color)[0];
-        cv::Scalar txt_color;
-        if (c_mean > 0.5)
+
+/**
+ * @brief Yolov7Trt::Launch -- Run one pipeline stage, device stages only queue work and
+ *        order it behind the previous stage by events, the host stage waits for D2H. A frame
+ *        whose preprocess or inference failed skips its later device stages.
+ */
+int Yolov7Trt::Launch(const int &stage, const int &slot_id, const int64_t &frame_id)
+{
+    int iret = 0;
+    PipelineSlot &slot = slots_[slot_id];
+    switch(stage)
+    {
+    case STAGE_PREPROCESS:
+    {
+        cv::cuda::Stream stream = cv::cuda::StreamAccessor::wrapStream(upload_stream_);
+        cv::cuda::GpuMat gpu_src = AcquireMat(slot.src.rows, slot.src.cols, slot.src.type());
+        slot.stage.push_back(gpu_src);
+        slot.tracer->Begin(upload_stream_);
+        gpu_src.upload(slot.src, stream);
+        slot.tracer->Mark(TRACE_UPLOAD, upload_stream_);
+        slot.status = PreprocessImage(gpu_src, (float*)slot.bindings[0], upload_stream_);
+        slot.tracer->Mark(TRACE_LETTERBOX, upload_stream_);
+        cudaEventRecord(slot.pre_done, upload_stream_);
+        break;
+    }
+    case STAGE_INFER:
+    {
+        if(slot.status != 0)
         {
-            txt_color = cv::Scalar(0, 0, 0);
+            break;
         }
-        else
+        cudaStreamWaitEvent(cuda_stream_, slot.pre_done, 0);
+        /// @brief Boundary after the wait, time queued behind other frames is not inference.
+        slot.tracer->Mark(TRACE_NONE, cuda_stream_);
+        trt_context_->setBindingDimensions(0, nvinfer1::Dims4{1, desc_.input_c, desc_.input_h, desc_.input_w});
+        if(!trt_context_->enqueueV2(slot.bindings, cuda_stream_, nullptr))
+        {
+            iret = -1;
+            slot.status = -1;
+        }
+        slot.tracer->Mark(TRACE_INFER, cuda_stream_);
+        cudaEventRecord(slot.infer_done, cuda_stream_);
+        break;
+    }
+    case STAGE_D2H:
+    {
+        if(slot.status != 0)
+        {
+            break;
+        }
+        cudaStreamWaitEvent(d2h_stream_, slot.infer_done, 0);
+        slot.tracer->Mark(TRACE_NONE, d2h_stream_);
+        cudaMemcpyAsync(slot.host_out, slot.bindings[1], buffer_size_[1]*sizeof(float), cudaMemcpyDeviceToHost, d2h_stream_);
+        slot.tracer->Mark(TRACE_D2H, d2h_stream_);
+        cudaEventRecord(slot.d2h_done, d2h_stream_);
+        break;
+    }
+    case STAGE_POSTPROCESS:
+    {
+        /// @brief A failed frame queued no D2H, its upload still holds the staging mats.
+        cudaEventSynchronize(slot.status != 0 ? slot.pre_done : slot.d2h_done);
+        slot.tracer->End();
+        ReleaseMats(slot.stage);
+        ObjResult obj_result;
+        obj_result.obj_num = 0;
+        iret = slot.status;
+        if(0 == iret && capture_.IsOpen())
+        {
+            capture_.Write(slot.host_out, slot.src.cols, slot.src.rows);
+        }
+        if(0 == iret)
+        {
+            iret = Yolov7Postprocess(slot.host_out, slot.src.size(), arena_);
+        }
+        if(0 == iret)
         {
-            txt_color = cv::Scalar(255, 255, 255);
+            iret = ToObjResult(arena_.View(), &obj_result);
         }
-        cv::rectangle(image, cv::Rect(obj_x, obj_y, obj_width, obj_height), color * 255, 2);
+        slot.src.release();
+        if(callback_)
+        {
+            callback_(frame_id, iret, obj_result);
+        }
+        /// @brief A frame without objects is not a pipeline failure.
+        iret = 0;
+        break;
+    }
+    default:
+        iret = -1;
+        break;
+    }
+    return iret;
+}
 
-        char text[256];
-        memset(text, 0, 256*sizeof(char));
-        sprintf(text, "%s %.1f%%", class_names[obj_class], obj_prob * 100);
 
-        int baseLine = 0;
-        cv::Size label_size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, 0.4, 1, &baseLine);
-        cv::Scalar txt_bk_color = color * 0.7 * 255;
-        int x = obj_x;
-        int y = obj_y + 1;
-        y = y>image.rows?image.rows:y;
-        cv::rectangle(image, cv::Rect(cv::Point(x, y), cv::Size(label_size.width, label_size.height + baseLine)), txt_bk_color, -1);
-        cv::putText(image, text, cv::Point(x, y + label_size.height), cv::FONT_HERSHEY_SIMPLEX, 0.4, txt_color, 1);
+/**
+ * @brief Yolov7Trt::Yolov7Postprocess -- Host decode and NMS of one frame into arena, source pixels.
+ * @return                           -- 0--success, -1--input error, -999--no object
+ */
+int Yolov7Trt::Yolov7Postprocess(float *trt_out, const cv::Size &src_size, DetectionArena &arena, Yolov7 *pyolov7)
+{
+    arena.Reset();
+    if(nullptr == trt_out)
+    {
+        return -1;
     }
-    if(verbos == true)
+    if(nullptr == pyolov7)
     {
-        char filepath[256];
-        memset(filepath, 0, sizeof(filepath));
-        sprintf(filepath, "%s/%s.jpg",save_path.c_str(), path.c_str());
-        cv::imwrite(filepath, image);
+        pyolov7 = pyolov7_;
     }
-    else
+    const float scale = LetterboxScale(src_size, cv::Size(desc_.input_w, desc_.input_h));
+    return pyolov7->YoloProcess(trt_out, desc_.conf_thresh, scale, &arena);
+}
+
+
+int Yolov7Trt::DevicePostprocess(const float *gpu_out, const cv::Size &src_size, DetectionArena &arena)
+{
+    arena.Reset();
+    int iret = device_decoder_->Decode(gpu_out, decode_boxes_, cuda_stream_);
+    if(device_decoder_->Truncated())
+    {
+        arena.SetTruncated();
+    }
+    if(iret != 0)
+    {
+        return iret;
+    }
+    const float scale = LetterboxScale(src_size, cv::Size(desc_.input_w, desc_.input_h));
+    for(size_t i=0;i<decode_boxes_.size();++i)
+    {
+        const DecodeBox &box = decode_boxes_[i];
+        Detection det;
+        det.left     = box.left * desc_.input_w * scale;
+        det.top      = box.low * desc_.input_h * scale;
+        det.right    = box.right * desc_.input_w * scale;
+        det.bottom   = box.high * desc_.input_h * scale;
+        det.class_id = box.id;
+        det.prob     = box.prob;
+        arena.Push(det);
+    }
+    return iret;
+}
+
+
+void Yolov7Trt::CaptureDeviceOutput(const float *gpu_out, const cv::Size &src_size)
+{
+    cudaMemcpyAsync(trt_cpu_out_buffers_, gpu_out, buffer_size_[1]*sizeof(float), cudaMemcpyDeviceToHost, cuda_stream_);
+    /// @brief The capture copy is its own D2H span, the host write after the sync is not charged
+    ///        to the decode that follows.
+    tracer_.Mark(TRACE_D2H, cuda_stream_);
+    cudaStreamSynchronize(cuda_stream_);
+    capture_.Write(trt_cpu_out_buffers_, src_size.width, src_size.height);
+    tracer_.Mark(TRACE_NONE, cuda_stream_);
+}
+
+
+/**
+ * @brief Yolov7Trt::StartCapture -- Dump every following frame output to dump_file.
+ * @return                        -- 0--success, -1--open failed or instance not ready
+ */
+int Yolov7Trt::StartCapture(const std::string &dump_file)
+{
+    if(init_status_ != 0)
+    {
+        return -1;
+    }
+    const int row_len = desc_.num_classes + 5;
+    int iret = capture_.Open(dump_file, buffer_size_[1] / row_len, row_len);
+    if(iret != 0)
     {
-        cv::namedWindow("yolov7_window", cv::WINDOW_NORMAL);
-        cv::imshow("yolov7_window", image);
-        cv::waitKey(1);
+        std::cout << dump_file << " capture open failed" << std::endl;
+        return -1;
     }
-    return;
+    return 0;
 }
 
+
+void Yolov7Trt::StopCapture()
+{
+    capture_.Close();
+}
+
+
+/// @brief Source pixels per input pixel of the letterbox, the larger of the two axis ratios.
+static float LetterboxScale(const cv::Size &src_size, const cv::Size &input_size)
+{
+    const float ratio_w = float(src_size.width) / float(input_size.width);
+    const float ratio_h = float(src_size.height) / float(input_size.height);
+    return ratio_w > ratio_h ? ratio_w : ratio_h;
+}
+
+
 /**
  * @brief argsort -- Sort vector by w/h ratio.
  * @param array   -- input w/h ratio vector
@@ -8,6 +8,12 @@
 * * * * * * * * * * * * * * * * * * * * * */
 #include "export/export.h"
 #include "inc/yolov7_trt.h"
+#include "inc/yolov7_backend.h"
+#include "inc/ingest.h"
+#include "inc/result_writer.h"
+#include "inc/stereo.h"
+#include <string.h>
+#include <algorithm>
 #include <vector>
 #include <opencv2/opencv.hpp>
 
@@ -15,23 +21,94 @@
 #define CAMERA_WIDTH  2560
 #define CAMERA_HEIGHT 960
 
-///@private function
-std::vector<cv::Mat> SplitImage(const cv::Mat &image, int num,int type);
+/// @brief Execution contexts over the shared engine, i.e. concurrent C API callers.
+#define SERVER_INSTANCE_NUM 2
+#define SERVER_QUEUE_SIZE   64
+
+/**
+ * @brief GetServer -- All C API entries share one engine, calls from different threads run
+ *        on different execution contexts, extra callers wait in the server queue.
+ */
+static siran::InferServer& GetServer()
+{
+    static siran::Yolov7Backend backend(ENGINE_ENHANCE_FILE_PATH, SERVER_INSTANCE_NUM, 0);
+    static siran::InferServer server(&backend, SERVER_QUEUE_SIZE);
+    static int started = server.Start();
+    (void)started;
+    return server;
+}
+
+
+/// @private function, run request on the shared server, return the Yolov7Trt status.
+static int RunRequest(siran::Yolov7Request &request)
+{
+    siran::InferTask task;
+    task.payload = &request;
+    task.status = 0;
+    return GetServer().Run(&task);
+}
+
+
+/// @private function, exported box back to a detection in source pixels.
+static siran::Detection ToDetection(const ObjInfo &info)
+{
+    siran::Detection det;
+    det.left     = info.obj_box.x;
+    det.top      = info.obj_box.y;
+    det.right    = info.obj_box.x + info.obj_box.width;
+    det.bottom   = info.obj_box.y + info.obj_box.height;
+    det.class_id = info.obj_class;
+    det.prob     = info.obj_prob;
+    return det;
+}
+
+
+/// @private function, association limits of the C API over the library defaults.
+static siran::StereoConfig ToStereoConfig(const StereoParam *param)
+{
+    siran::StereoConfig config = siran::DefaultStereoConfig();
+    if(param != nullptr)
+    {
+        config.max_row_diff = param->max_row_diff;
+        config.max_height_ratio = param->max_height_ratio;
+        config.min_disparity = param->min_disparity;
+        config.max_disparity = param->max_disparity;
+    }
+    return config;
+}
+
+
+/// @private function, pairs of the backend, already indices into the exported obj_info.
+static void ExportMatches(const std::vector<siran::StereoPair> &pairs, StereoResult *presult)
+{
+    presult->match_num = std::min((int)pairs.size(), YOLOV7_MAX_OBJ_NUM);
+    for(int i=0;i<presult->match_num;++i)
+    {
+        presult->matches[i].left = pairs[i].left;
+        presult->matches[i].right = pairs[i].right;
+        presult->matches[i].disparity = pairs[i].disparity;
+    }
+}
 
 
 int Yolov7Infer(const void *src, ObjResult *pobj_result, const bool &verbos)
 {
     int iret = 0;
-    if(nullptr == src)
+    if(nullptr == src || nullptr == pobj_result)
     {
         return -1;
     }
     cv::Mat *img = (cv::Mat*)src;
-    static siran::Yolov7Trt Yolov7_trt= siran::Yolov7Trt(0);
-    iret = Yolov7_trt.Yolov7Infer(*img, pobj_result, nullptr, verbos);
-    if(iret != 0)
+    siran::Yolov7Request request;
+    request.srcs.push_back(*img);
+    request.verbos = verbos;
+    request.mode = siran::REQUEST_FRAMES;
+    /// @brief A failed or empty frame leaves obj_num 0, never the boxes of the previous call.
+    pobj_result->obj_num = 0;
+    iret = RunRequest(request);
+    if(!request.results.empty())
     {
-        return iret;
+        *pobj_result = request.results[0];
     }
     return iret;
 }
@@ -39,10 +116,11 @@ int Yolov7Infer(const void *src, ObjResult *pobj_result, const bool &verbos)
 int Yolov7Infer2(const std::string &path, ObjResult *pobj_result, const bool &verbos)
 {
     int iret = 0;
-    if(" " == path)
+    if(" " == path || nullptr == pobj_result)
     {
         return -1;
     }
+    pobj_result->obj_num = 0;
     cv::Mat src = cv::imread(path, -1);
     if(src.empty())
     {
@@ -52,82 +130,351 @@ int Yolov7Infer2(const std::string &path, ObjResult *pobj_result, const bool &ve
     std::string filename = str_filepath.substr(str_filepath.find_last_of('/')+1);
     std::string fileinname = filename.substr(0, filename.find_last_of("."));
 
-    static siran::Yolov7Trt Yolov7_trt= siran::Yolov7Trt(0);
-    iret = Yolov7_trt.Yolov7Infer(src, pobj_result, &fileinname, verbos);
-    if(iret != 0)
+    siran::Yolov7Request request;
+    request.srcs.push_back(src);
+    request.name = fileinname;
+    request.verbos = verbos;
+    request.mode = siran::REQUEST_FRAMES;
+    iret = RunRequest(request);
+    if(!request.results.empty())
     {
-        return iret;
+        *pobj_result = request.results[0];
     }
     return iret;
 }
 
-int Yolov7Infer3(const int &camera_index, ObjResult *pobj_result, const bool &verbos)
+int Yolov7InferTiled(const void *src, ObjResult *pobj_result, const bool &verbos)
 {
     int iret = 0;
-    if(-1 == camera_index)
+    if(nullptr == src || nullptr == pobj_result)
     {
         return -1;
     }
-    static siran::Yolov7Trt Yolov7_trt= siran::Yolov7Trt(0);
+    cv::Mat *img = (cv::Mat*)src;
+    siran::Yolov7Request request;
+    request.srcs.push_back(*img);
+    request.verbos = verbos;
+    request.mode = siran::REQUEST_TILED;
+    pobj_result->obj_num = 0;
+    iret = RunRequest(request);
+    if(!request.results.empty())
+    {
+        *pobj_result = request.results[0];
+    }
+    return iret;
+}
 
-    cv::VideoCapture cap(camera_index);
-    cap.set(cv::CAP_PROP_FRAME_WIDTH, CAMERA_WIDTH);  // set dual-camera width
-    cap.set(cv::CAP_PROP_FRAME_HEIGHT, CAMERA_HEIGHT);  // set dual-camera height
+int Yolov7InferBatch(const void *src, const int &batch_size, ObjResult *pobj_results, const bool &verbos)
+{
+    int iret = 0;
+    if(nullptr == src || nullptr == pobj_results || batch_size <= 0)
+    {
+        return -1;
+    }
+    for(int i=0;i<batch_size;++i)
+    {
+        pobj_results[i].obj_num = 0;
+    }
+    const cv::Mat *imgs = (const cv::Mat*)src;
+    siran::Yolov7Request request;
+    request.srcs.assign(imgs, imgs + batch_size);
+    request.verbos = verbos;
+    request.mode = siran::REQUEST_FRAMES;
+    iret = RunRequest(request);
+    /// @brief Slots are exported even when one of them failed, a failed slot has obj_num 0.
+    if(request.results.size() == (size_t)batch_size)
+    {
+        memcpy(pobj_results, request.results.data(), batch_size*sizeof(ObjResult));
+    }
+    return iret;
+}
 
-    if(!cap.isOpened())
+int Yolov7InferBatch2(const std::vector<std::string> &paths, ObjResult *pobj_results, const bool &verbos)
+{
+    int iret = 0;
+    if(paths.empty() || nullptr == pobj_results)
     {
         return -1;
     }
-    cv::Mat frame;
-    while(true)
+    for(size_t i=0;i<paths.size();++i)
     {
-        if(!cap.grab())
-        {
-            break;
-        }
-        cap >> frame;
-        std::vector<cv::Mat> two_img = SplitImage(frame, 2, 1);
-        iret = Yolov7_trt.Yolov7Infer(two_img[0], pobj_result, nullptr, verbos);
-        if(iret != 0)
+        pobj_results[i].obj_num = 0;
+    }
+    siran::Yolov7Request request;
+    request.srcs.resize(paths.size());
+    request.verbos = verbos;
+    request.mode = siran::REQUEST_FRAMES;
+    for(size_t i=0;i<paths.size();++i)
+    {
+        request.srcs[i] = cv::imread(paths[i], -1);
+        if(request.srcs[i].empty())
         {
-            printf("Yolov5 infer null\n");
-            continue;
+            return -1;
         }
     }
+    iret = RunRequest(request);
+    if(request.results.size() == paths.size())
+    {
+        memcpy(pobj_results, request.results.data(), paths.size()*sizeof(ObjResult));
+    }
     return iret;
 }
 
-
-std::vector<cv::Mat> SplitImage(const cv::Mat &image, int num,int type)
+/// @private StreamPipeline detector over the shared server, ObjResult back to source pixel detections.
+class ServerStreamDetector : public siran::IStreamDetector
 {
-    int rows = image.rows;
-    int cols = image.cols;
-    std::vector<cv::Mat> v;
-    if (type == 0)
+public:
+    /// @brief stereo nullptr leaves stereo pairs unassociated.
+    ServerStreamDetector(const bool &verbos, const siran::StereoConfig *stereo = nullptr):
+        verbos_(verbos),
+        associate_(stereo != nullptr),
+        stereo_(stereo != nullptr ? *stereo : siran::DefaultStereoConfig()),
+        arenas_{siran::DetectionArena(YOLOV7_MAX_OBJ_NUM), siran::DetectionArena(YOLOV7_MAX_OBJ_NUM)}
+    {
+    }
+
+    int Detect(const cv::Mat &view, siran::DetectionSpan *detections)
+    {
+        request_.srcs.assign(1, view);
+        request_.verbos = verbos_;
+        request_.mode = siran::REQUEST_FRAMES;
+        int iret = RunRequest(request_);
+        *detections = ToArena(iret, 0, arenas_[0]);
+        return iret;
+    }
+
+    /// @brief A stereo pair is one REQUEST_STEREO batch, other view counts go per view. The arenas
+    ///        hold the exported boxes in obj_info order, so the backend pairs index them as is.
+    int DetectViews(const cv::Mat &frame, const std::vector<cv::Mat> &views, siran::DetectionSpan *detections, int *status,
+                    std::vector<siran::StereoPair> &pairs)
+    {
+        if(views.size() != 2)
+        {
+            return 1;
+        }
+        request_.srcs.assign(1, frame);
+        request_.verbos = verbos_;
+        request_.mode = siran::REQUEST_STEREO;
+        request_.associate = associate_;
+        request_.stereo = stereo_;
+        const int iret = RunRequest(request_);
+        for(int v=0;v<2;++v)
+        {
+            detections[v] = ToArena(iret, v, arenas_[v]);
+            status[v] = 0 == iret && detections[v].Empty() ? -999 : iret;
+        }
+        pairs.clear();
+        if(0 == iret)
+        {
+            pairs.swap(request_.pairs);
+        }
+        return 0;
+    }
+
+private:
+    siran::DetectionSpan ToArena(const int &iret, const int &index, siran::DetectionArena &arena)
     {
-        for (size_t i = 0; i < num; i++)
+        arena.Reset();
+        if(0 == iret)
         {
-            int star = rows / num*i;
-            int end = rows / num*(i + 1);
-            if (i == num - 1)
+            const ObjResult &result = request_.results[index];
+            for(int i=0;i<result.obj_num;++i)
             {
-                end = rows;
+                arena.Push(ToDetection(result.obj_info[i]));
             }
-            v.push_back(image.rowRange(star, end));
         }
+        return arena.View();
     }
-    else if (type == 1)
+
+    bool verbos_;
+    bool associate_;
+    siran::StereoConfig stereo_;
+    siran::Yolov7Request request_;
+    siran::DetectionArena arenas_[2];
+};
+
+
+int Yolov7Infer3(const int &camera_index, ObjResult *pobj_result, const bool &verbos, const bool &gate)
+{
+    if(-1 == camera_index || nullptr == pobj_result)
     {
-        for (size_t i = 0; i < num; i++)
+        return -1;
+    }
+    siran::CameraSource camera(camera_index, CAMERA_WIDTH, CAMERA_HEIGHT);  // dual-camera frame
+    if(!camera.IsOpened())
+    {
+        return -1;
+    }
+    /// @brief Left view of the stereo frame, a slow server drops the oldest frames instead of lagging.
+    ///        With gate still frames reuse the last result and moving regions are detected alone.
+    siran::StreamConfig config = siran::DefaultStreamConfig();
+    config.view_num = 2;
+    config.view_mask = 0x1;
+    config.gate.enable = gate;
+    ServerStreamDetector detector(verbos);
+    siran::StreamPipeline stream(&detector, &camera, config);
+    int iret = stream.Start([pobj_result](const siran::StreamResult &result) {
+        if(0 == result.view)
         {
-            int star = cols / num*i;
-            int end = cols / num*(i + 1);
-            if (i == num - 1)
+            if(result.status != 0)
             {
-                end = cols;
+                pobj_result->obj_num = 0;
+                return;
             }
-            v.push_back(image.colRange(star, end).clone());
+            siran::ToObjResult(siran::DetectionSpan(result.detections.data(), result.detections.size(), result.truncated), pobj_result);
         }
+    });
+    if(iret != 0)
+    {
+        return iret;
+    }
+    stream.Wait();
+    return 0;
+}
+
+
+int Yolov7InferStereo(const void *src, StereoResult *presult, const bool &associate, const bool &verbos,
+                      const StereoParam *param)
+{
+    int iret = 0;
+    if(nullptr == src || nullptr == presult)
+    {
+        return -1;
+    }
+    presult->views[0].obj_num = 0;
+    presult->views[1].obj_num = 0;
+    presult->match_num = 0;
+    cv::Mat *img = (cv::Mat*)src;
+    siran::Yolov7Request request;
+    request.srcs.push_back(*img);
+    request.verbos = verbos;
+    request.mode = siran::REQUEST_STEREO;
+    /// @brief Pairs come from the float boxes inside the backend, before the int export.
+    request.associate = associate;
+    request.stereo = ToStereoConfig(param);
+    iret = RunRequest(request);
+    if(iret != 0)
+    {
+        return iret;
+    }
+    presult->views[0] = request.results[0];
+    presult->views[1] = request.results[1];
+    ExportMatches(request.pairs, presult);
+    return iret;
+}
+
+
+int Yolov7Infer3Stereo(const int &camera_index, StereoResult *presult, const bool &verbos, const StereoParam *param)
+{
+    if(-1 == camera_index || nullptr == presult)
+    {
+        return -1;
+    }
+    siran::CameraSource camera(camera_index, CAMERA_WIDTH, CAMERA_HEIGHT);  // dual-camera frame
+    if(!camera.IsOpened())
+    {
+        return -1;
+    }
+    /// @brief Both views of every frame go to the server as one stereo batch.
+    siran::StreamConfig config = siran::DefaultStreamConfig();
+    config.view_num = 2;
+    config.view_mask = 0x3;
+    const siran::StereoConfig stereo = ToStereoConfig(param);
+    ServerStreamDetector detector(verbos, &stereo);
+    siran::StreamPipeline stream(&detector, &camera, config);
+    /// @brief Views of a frame arrive in order, the pair is published when the right one is in,
+    ///        its result carries the pairs of the backend.
+    StereoResult pending;
+    memset(&pending, 0, sizeof(pending));
+    int iret = stream.Start([presult, &pending](const siran::StreamResult &result) {
+        ObjResult &view = pending.views[result.view];
+        view.obj_num = 0;
+        if(0 == result.status)
+        {
+            siran::ToObjResult(siran::DetectionSpan(result.detections.data(), result.detections.size(), result.truncated), &view);
+        }
+        if(1 == result.view)
+        {
+            ExportMatches(result.pairs, &pending);
+            *presult = pending;
+        }
+    });
+    if(iret != 0)
+    {
+        return iret;
+    }
+    stream.Wait();
+    return 0;
+}
+
+
+int Yolov7InferFolder(const std::string &folder, const std::string &result_file, const bool &verbos)
+{
+    siran::IngestConfig config = siran::DefaultIngestConfig();
+    std::vector<std::string> files;
+    if(siran::ListFiles(folder, config.extensions, config.list_threads, files) != 0)
+    {
+        return -1;
+    }
+    /// @brief .bin and .jsonl go through the background ResultWriter, rotated as
+    ///        <stem>_000000.bin ..., other names get text lines.
+    const size_t dot = result_file.find_last_of('.');
+    const std::string ext = dot == std::string::npos ? "" : result_file.substr(dot + 1);
+    siran::ResultWriter *writer = nullptr;
+    siran::IResultSink *sink = nullptr;
+    if(ext == "bin" || ext == "jsonl")
+    {
+        siran::ResultWriterConfig writer_config = siran::DefaultResultWriterConfig();
+        writer_config.path_prefix = result_file.substr(0, dot);
+        writer_config.format = ext == "jsonl" ? siran::RESULT_JSONL : siran::RESULT_BINARY;
+        writer = new siran::ResultWriter(writer_config);
+        if(writer->Open() != 0)
+        {
+            delete writer;
+            return -2;
+        }
+        sink = new siran::ResultWriterSink(writer);
+    }
+    else
+    {
+        siran::TextResultSink *text_sink = new siran::TextResultSink(result_file);
+        if(!text_sink->IsOpened())
+        {
+            delete text_sink;
+            return -2;
+        }
+        sink = text_sink;
+    }
+    /// @brief One caller per execution context, decode runs ahead on the ingest threads.
+    std::vector<ServerStreamDetector*> detectors;
+    std::vector<siran::IStreamDetector*> views;
+    for(int i=0;i<SERVER_INSTANCE_NUM;++i)
+    {
+        detectors.push_back(new ServerStreamDetector(verbos));
+        views.push_back(detectors.back());
+    }
+    siran::ImageIngest ingest(files, config);
+    int64_t detect_failed = 0;
+    const int sink_status = siran::RunIngest(ingest, views, sink, &detect_failed);
+    ingest.Stop();
+    for(size_t i=0;i<detectors.size();++i)
+    {
+        delete detectors[i];
+    }
+    delete sink;
+    int iret = sink_status != 0 ? -2 : 0;
+    if(writer != nullptr)
+    {
+        iret = writer->Close() != 0 ? -2 : iret;
+        delete writer;
+    }
+    if(verbos)
+    {
+        const siran::IngestStats stats = ingest.GetStats();
+        printf("%lld files, %lld decoded(%lld reduced), %lld failed, %lld detect failed, decode wait %.1fms\n",
+               (long long)stats.files, (long long)stats.decoded, (long long)stats.reduced, (long long)stats.failed,
+               (long long)detect_failed, stats.wait_ms);
     }
-    return  v;
+    /// @brief A result file error wins, the lines of the failed images are already in it.
+    return 0 == iret && detect_failed > 0 ? -3 : iret;
 }
@@ -1,6 +1,6 @@
 /* * * * * * * * * * * * * * * * * * * * *
 *   File:     yolo_test.cpp
-*   Brief:    yolov7_trt test code. use: ./Test_app ../data
+*   Brief:    yolov7_trt test code. use: ./Test_app ../data [result.txt]
 *   Author:   hewen
 *   Company:  SIRAN
 *   E-mail:   senlin0901@gmail.com
@@ -14,10 +14,18 @@ int main(int arv, char** arg)
 {
     if(arv<2)
     {
-        printf("use: ./Test_app filepath\n");
+        printf("use: ./Test_app filepath [result file]\n");
         return -1;
     }
     int iret = 0;
+    if(arv > 2)
+    {
+        /// @brief Batch job, whole folder through the ingest pipeline into the result file.
+        double time_start = GetCurrentTime();
+        iret = Yolov7InferFolder(arg[1], arg[2]);
+        printf("YOLOV7 folder processing time: %f, code %d\n", GetCurrentTime() - time_start, iret);
+        return iret;
+    }
     char filepath[150];
     memset(filepath, 0, sizeof(filepath));
     sprintf(filepath, arg[1]);
@@ -7,6 +7,7 @@
 *   Time:     2022/07/13
 * * * * * * * * * * * * * * * * * * * * * */
 #include "inc/utils.h"
+#include "inc/file_list.h"
 
 #include <iostream>
 #include <string>
@@ -16,7 +17,6 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
-#include "dirent.h"
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -24,52 +24,23 @@ using namespace std;
 
 
 /**
- * @brief GetFilePath       -- Get all file paths in a folder.
+ * @brief GetFilePath       -- Get all file paths in a folder, sorted, subfolders listed in parallel.
  * @param path          -- input folder path
- * @param filename_vec  -- output file paths vector
+ * @param filename_vec  -- output file paths vector, paths are appended
  * @return              -- 0--success, -1--inputpath null
  */
 int GetFilePath(const char *path,std::vector<std::string> &filename_vec)
 {
-    DIR *dir = opendir(path);
-    if(dir == NULL)
+    if(path == NULL)
     {
         return -1;
     }
-    struct dirent *p = NULL;
-    struct stat buf;
-    int res = -1;
-    char sub_name[200] = {0};
-    while(1)
+    std::vector<std::string> files;
+    if(siran::ListFiles(path, std::vector<std::string>(), 0, files) != 0)
     {
-        p = readdir(dir);
-        if(p == NULL)
-        {
-            break;
-            if(errno != 0)
-            {
-                return -1;
-            }
-        }
-        sprintf(sub_name,"%s/%s",path,p->d_name);
-        res = stat(sub_name,&buf);
-        if(res == -1)
-        {
-            return -1;
-        }
-        if(S_ISDIR(buf.st_mode))
-        {
-            if(strcmp(p->d_name,".") ==0 || strcmp(p->d_name,"..") == 0)
-            {
-                continue;
-            }
-            GetFilePath(sub_name,filename_vec);
-        }
-        if(S_ISREG(buf.st_mode))
-        {
-            filename_vec.push_back(sub_name);
-        }
+        return -1;
     }
+    filename_vec.insert(filename_vec.end(), files.begin(), files.end());
     return 0;
 }
 